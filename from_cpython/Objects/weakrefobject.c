@@ -28,6 +28,9 @@ init_weakref(PyWeakReference *self, PyObject *ob, PyObject *callback)
     self->wr_object = ob;
     Py_XINCREF(callback);
     self->wr_callback = callback;
+
+    // Pyston change: let the collector know about this weakref
+    PyGC_RegisterWeakReference((PyObject*)self);
 }
 
 static PyWeakReference *
@@ -0,0 +1,24 @@
+# Lookups that fail (and get caught) most of the time, like a cache that's mostly misses:
+class C(object):
+    pass
+
+def f():
+    d = {}
+    l = []
+    c = C()
+    n = 0
+    for i in xrange(2000000):
+        try:
+            x = d[i]
+        except KeyError:
+            n += 1
+        try:
+            x = l[i]
+        except IndexError:
+            n += 1
+        try:
+            x = c.attr
+        except AttributeError:
+            n += 1
+    print n
+f()
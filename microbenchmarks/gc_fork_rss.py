@@ -0,0 +1,41 @@
+# Measures how much of the heap a collection unshares in a forked worker.
+# The parent builds a large heap and then forks workers, the way a prefork server would;
+# each worker runs a full collection and then reports how much of its memory is private
+# (Private_Dirty in /proc/self/smaps), ie how many of the pages it shared with the parent
+# it ended up copying.  Ideally a collection shouldn't write to the live objects at all.
+# It also reports how long each of those collections took, since marking and sweeping
+# are now supposed to only scan the side bitmaps.
+
+import gc
+import os
+import sys
+import time
+
+NWORKERS = 4
+
+def private_dirty_kb():
+    total = 0
+    with open("/proc/self/smaps") as f:
+        for line in f:
+            if line.startswith("Private_Dirty:"):
+                total += int(line.split()[1])
+    return total
+
+heap = [[i, str(i), (i, i), {i: i}] for i in xrange(500000)]
+gc.collect()
+
+for i in xrange(NWORKERS):
+    pid = os.fork()
+    if pid == 0:
+        before = private_dirty_kb()
+        start = time.time()
+        gc.collect()
+        elapsed = time.time() - start
+        after = private_dirty_kb()
+        print "worker %d: %.1fMB private before collecting, %.1fMB after; collection took %.1fms" % (
+                i, before / 1024.0, after / 1024.0, elapsed * 1000)
+        sys.stdout.flush()
+        os._exit(0)
+    os.waitpid(pid, 0)
+
+print "live objects:", len(heap)
@@ -0,0 +1,26 @@
+# Measures gc pause times as a function of the size of the live heap.
+# The workload keeps a large, long-lived heap alive and then churns through short-lived
+# objects, which is the case that minor collections are supposed to help with: the pause
+# times should stay roughly constant as the live heap grows.
+#
+# Run with "-s" to see the gc_collections_{minor,full}_us stats.
+
+import sys
+import time
+
+def build_heap(n):
+    return [[i, str(i), (i, i)] for i in xrange(n)]
+
+def churn(iters):
+    t = 0
+    for i in xrange(iters):
+        l = [i, i + 1, i + 2]
+        t += len(l)
+    return t
+
+for n in [0, 100000, 400000, 1600000]:
+    heap = build_heap(n)
+    start = time.time()
+    churn(3000000)
+    print "%8d live objects: %.2fs" % (n, time.time() - start)
+    del heap
@@ -0,0 +1,34 @@
+# Measures how long a thread that wakes up from a short sleep has to wait to get the GIL back
+# while other threads are running CPU-bound loops.  With a time-based switch interval the tail
+# latency should stay around (number of spinning threads) * switch interval.
+
+from thread import start_new_thread
+import time
+
+nthreads = 4
+stop = []
+done = []
+
+def spin():
+    n = 0
+    while not stop:
+        n += 1
+    done.append(n)
+
+for i in xrange(nthreads):
+    start_new_thread(spin, ())
+
+latencies = []
+for i in xrange(200):
+    t = time.time()
+    time.sleep(0.001)
+    latencies.append(time.time() - t - 0.001)
+
+stop.append(True)
+while len(done) < nthreads:
+    time.sleep(0.01)
+
+latencies.sort()
+print "median: %.2fms" % (latencies[len(latencies) // 2] * 1000)
+print "p99: %.2fms" % (latencies[len(latencies) * 99 // 100] * 1000)
+print "max: %.2fms" % (latencies[-1] * 1000)
@@ -0,0 +1,13 @@
+# Local-variable heavy loop; meant to be run with -I to measure the interpreter.
+def f(n):
+    a = 1
+    b = 2
+    c = 3
+    t = 0
+    i = 0
+    while i < n:
+        t = t + a * b - c
+        a, b, c = b, c, a
+        i = i + 1
+    return t
+print f(3000000)
@@ -0,0 +1,26 @@
+# Lookups that fail (and get caught) now and then, but usually succeed; these should keep using the ICs:
+class C(object):
+    def __init__(self):
+        self.attr = 1
+
+def f():
+    d = {}
+    c = C()
+    n = 0
+    for i in xrange(2000000):
+        if i % 1000 == 0:
+            d.clear()
+            del c.attr
+        else:
+            d[i] = i
+            c.attr = i
+        try:
+            x = d[i]
+        except KeyError:
+            n += 1
+        try:
+            x = c.attr
+        except AttributeError:
+            n += 1
+    print n
+f()
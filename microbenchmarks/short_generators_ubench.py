@@ -0,0 +1,22 @@
+# Lots of different generator functions that each only get used a few times, which is typical of big programs: most
+# generators never get hot enough to be compiled, and don't run for long each time.
+fns = []
+for i in xrange(2000):
+    d = {}
+    exec """
+def gen%d(l):
+    for x in l:
+        if x %% 3:
+            yield x + %d
+""" % (i, i) in d
+    fns.append(d["gen%d" % i])
+
+def f():
+    l = range(10)
+    t = 0
+    for i in xrange(50):
+        for fn in fns:
+            for x in fn(l):
+                t += x
+    print t
+f()
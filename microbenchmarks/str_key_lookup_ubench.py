@@ -0,0 +1,5 @@
+keys = ["some_fairly_long_attribute_name_%d" % i for i in xrange(20)]
+d = dict.fromkeys(keys, 1)
+for i in xrange(200000):
+    for k in keys:
+        d[k]
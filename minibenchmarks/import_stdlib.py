@@ -0,0 +1,49 @@
+# Imports every module in the standard library (minus the tests and the platform-specific and GUI parts), which
+# mostly measures how fast we can get from a source file to running its top level.  Run it more than once: the first
+# run fills the parse caches, and the later ones show the warm-import time.
+
+import os
+import sys
+import time
+
+# Directories that aren't part of the importable library, or that are for other platforms:
+SKIP_DIRS = set(["test", "tests", "idlelib", "lib-tk", "lib2to3", "plat-mac", "site-packages", "msilib", "bsddb",
+                 "curses"])
+# Modules that do something when imported:
+SKIP_MODULES = set(["this", "antigravity", "user", "__phello__.foo"])
+
+def find_modules(dirname, package):
+    modules = []
+    for fn in sorted(os.listdir(dirname)):
+        path = os.path.join(dirname, fn)
+        if os.path.isdir(path):
+            if fn in SKIP_DIRS or fn.startswith("plat-") or "." in fn:
+                continue
+            if os.path.exists(os.path.join(path, "__init__.py")):
+                name = package + fn
+                modules.append(name)
+                modules += find_modules(path, name + ".")
+        elif fn.endswith(".py") and fn not in ("__init__.py", "__main__.py"):
+            name = package + fn[:-3]
+            if name not in SKIP_MODULES:
+                modules.append(name)
+    return modules
+
+stdlib_dir = os.path.dirname(os.__file__)
+modules = find_modules(stdlib_dir, "")
+
+start = time.time()
+imported = 0
+failed = []
+for name in modules:
+    try:
+        __import__(name)
+        imported += 1
+    except Exception:
+        failed.append(name)
+elapsed = time.time() - start
+
+print "Imported %d of %d modules" % (imported, len(modules))
+if failed:
+    print "Failed:", " ".join(failed)
+print >>sys.stderr, "Took %.2fs" % elapsed
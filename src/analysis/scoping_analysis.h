@@ -175,6 +175,8 @@ public:
 
     InternedStringPool& getInternedStrings();
     bool areGlobalsFromModule() { return globals_from_module; }
+    // The module that got analyzed, or NULL if this was an exec or eval string.
+    AST_Module* getModuleAST() { return parent_module; }
 };
 
 bool containsYield(AST* ast);
@@ -14,6 +14,7 @@
 
 #include "analysis/type_analysis.h"
 
+#include <algorithm>
 #include <cstdio>
 #include <deque>
 #include <unordered_set>
@@ -43,6 +44,7 @@ public:
     ConcreteCompilerType* getTypeAtBlockEnd(InternedString name, CFGBlock* block) override;
 
     BoxedClass* speculatedExprClass(AST_expr*) override { return NULL; }
+    const std::vector<PolymorphicClass>* polymorphicExprClasses(AST_expr*) override { return NULL; }
 };
 
 ConcreteCompilerType* NullTypeAnalysis::getTypeAtBlockStart(InternedString name, CFGBlock* block) {
@@ -84,6 +86,7 @@ typedef llvm::DenseMap<InternedString, CompilerType*> TypeMap;
 typedef llvm::DenseMap<CFGBlock*, TypeMap> AllTypeMap;
 typedef llvm::DenseMap<AST_expr*, CompilerType*> ExprTypeMap;
 typedef llvm::DenseMap<AST_expr*, BoxedClass*> TypeSpeculations;
+typedef llvm::DenseMap<AST_expr*, std::vector<PolymorphicClass>> PolymorphicSpeculations;
 class BasicBlockTypePropagator : public ExprVisitor, public StmtVisitor {
 private:
     static const bool EXPAND_UNNEEDED = true;
@@ -92,16 +95,18 @@ private:
     TypeMap& sym_table;
     ExprTypeMap& expr_types;
     TypeSpeculations& type_speculations;
+    PolymorphicSpeculations& polymorphic_speculations;
     TypeAnalysis::SpeculationLevel speculation;
     ScopeInfo* scope_info;
 
     BasicBlockTypePropagator(CFGBlock* block, TypeMap& initial, ExprTypeMap& expr_types,
-                             TypeSpeculations& type_speculations, TypeAnalysis::SpeculationLevel speculation,
-                             ScopeInfo* scope_info)
+                             TypeSpeculations& type_speculations, PolymorphicSpeculations& polymorphic_speculations,
+                             TypeAnalysis::SpeculationLevel speculation, ScopeInfo* scope_info)
         : block(block),
           sym_table(initial),
           expr_types(expr_types),
           type_speculations(type_speculations),
+          polymorphic_speculations(polymorphic_speculations),
           speculation(speculation),
           scope_info(scope_info) {}
 
@@ -132,8 +137,35 @@ private:
         return old_type;
     }
 
+    // For sites that we couldn't speculate a single class for, remember if they've been seeing a small set of classes,
+    // so that irgen can dispatch on them.  This doesn't change the type of the expression.
+    void processPolymorphicSpeculation(AST_expr* node, CompilerType* type) {
+        assert(speculation != TypeAnalysis::NONE);
+
+        if (type != UNKNOWN)
+            return;
+
+        std::vector<PolymorphicClass> classes;
+        if (!predictClassesFor(node, classes))
+            return;
+
+        // Like with monomorphic speculations, we only want classes that we can embed in the generated code:
+        classes.erase(std::remove_if(classes.begin(), classes.end(),
+                                     [](const PolymorphicClass& c) { return !c.cls->is_constant; }),
+                      classes.end());
+        if (!classes.empty()) {
+            if (VERBOSITY() >= 2) {
+                printf("in propagator, speculating that this is one of %ld classes, at:\n", classes.size());
+                print_ast(node);
+                printf("\n");
+            }
+            polymorphic_speculations[node] = std::move(classes);
+        }
+    }
+
     CompilerType* getType(AST_expr* node) {
         type_speculations.erase(node);
+        polymorphic_speculations.erase(node);
 
         void* raw_rtn = node->accept_expr(this);
         CompilerType* rtn = static_cast<CompilerType*>(raw_rtn);
@@ -186,6 +218,7 @@ private:
         if (speculation != TypeAnalysis::NONE) {
             BoxedClass* speculated_class = predictClassFor(node);
             rtn = processSpeculation(speculated_class, node, rtn);
+            processPolymorphicSpeculation(node, rtn);
         }
 
         if (VERBOSITY() >= 2 && rtn == UNDEF) {
@@ -482,7 +515,11 @@ private:
         CompilerType* getitem_type = val->getattrType(&name, true);
         std::vector<CompilerType*> args;
         args.push_back(slice);
-        return getitem_type->callType(ArgPassSpec(1), args, NULL);
+        CompilerType* rtn = getitem_type->callType(ArgPassSpec(1), args, NULL);
+
+        if (speculation != TypeAnalysis::NONE)
+            processPolymorphicSpeculation(node, rtn);
+        return rtn;
     }
 
     void* visit_tuple(AST_Tuple* node) override {
@@ -648,10 +685,11 @@ private:
 
 public:
     static TypeMap propagate(CFGBlock* block, const TypeMap& starting, ExprTypeMap& expr_types,
-                             TypeSpeculations& type_speculations, TypeAnalysis::SpeculationLevel speculation,
-                             ScopeInfo* scope_info) {
+                             TypeSpeculations& type_speculations, PolymorphicSpeculations& polymorphic_speculations,
+                             TypeAnalysis::SpeculationLevel speculation, ScopeInfo* scope_info) {
         TypeMap ending = starting;
-        BasicBlockTypePropagator(block, ending, expr_types, type_speculations, speculation, scope_info).run();
+        BasicBlockTypePropagator(block, ending, expr_types, type_speculations, polymorphic_speculations, speculation,
+                                 scope_info).run();
         return ending;
     }
 };
@@ -661,13 +699,16 @@ private:
     AllTypeMap starting_types;
     ExprTypeMap expr_types;
     TypeSpeculations type_speculations;
+    PolymorphicSpeculations polymorphic_speculations;
     SpeculationLevel speculation;
 
     PropagatingTypeAnalysis(const AllTypeMap& starting_types, const ExprTypeMap& expr_types,
-                            TypeSpeculations& type_speculations, SpeculationLevel speculation)
+                            TypeSpeculations& type_speculations, PolymorphicSpeculations& polymorphic_speculations,
+                            SpeculationLevel speculation)
         : starting_types(starting_types),
           expr_types(expr_types),
           type_speculations(type_speculations),
+          polymorphic_speculations(polymorphic_speculations),
           speculation(speculation) {}
 
 public:
@@ -686,6 +727,12 @@ public:
     }
 
     BoxedClass* speculatedExprClass(AST_expr* call) override { return type_speculations[call]; }
+    const std::vector<PolymorphicClass>* polymorphicExprClasses(AST_expr* node) override {
+        auto it = polymorphic_speculations.find(node);
+        if (it == polymorphic_speculations.end())
+            return NULL;
+        return &it->second;
+    }
 
     static bool merge(CompilerType* lhs, CompilerType*& rhs) {
         assert(lhs);
@@ -734,6 +781,7 @@ public:
         AllTypeMap starting_types;
         ExprTypeMap expr_types;
         TypeSpeculations type_speculations;
+        PolymorphicSpeculations polymorphic_speculations;
 
         llvm::SmallPtrSet<CFGBlock*, 32> in_queue;
         std::priority_queue<CFGBlock*, llvm::SmallVector<CFGBlock*, 32>, CFGBlockMinIndex> queue;
@@ -764,7 +812,8 @@ public:
             }
 
             TypeMap ending = BasicBlockTypePropagator::propagate(block, starting_types[block], expr_types,
-                                                                 type_speculations, speculation, scope_info);
+                                                                 type_speculations, polymorphic_speculations,
+                                                                 speculation, scope_info);
 
             if (VERBOSITY("types") >= 3) {
                 printf("before (after):\n");
@@ -811,7 +860,8 @@ public:
         static StatCounter us_types("us_compiling_analysis_types");
         us_types.log(_t.end());
 
-        return new PropagatingTypeAnalysis(starting_types, expr_types, type_speculations, speculation);
+        return new PropagatingTypeAnalysis(starting_types, expr_types, type_speculations, polymorphic_speculations,
+                                           speculation);
     }
 };
 
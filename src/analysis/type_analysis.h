@@ -18,6 +18,7 @@
 #include <unordered_map>
 #include <vector>
 
+#include "codegen/type_recording.h"
 #include "core/stringpool.h"
 #include "core/types.h"
 
@@ -41,6 +42,9 @@ public:
     virtual ConcreteCompilerType* getTypeAtBlockStart(InternedString name, CFGBlock* block) = 0;
     virtual ConcreteCompilerType* getTypeAtBlockEnd(InternedString name, CFGBlock* block) = 0;
     virtual BoxedClass* speculatedExprClass(AST_expr*) = 0;
+    // The classes that the expression has been seeing (most common first), if it's polymorphic; NULL if there's nothing
+    // to dispatch on.
+    virtual const std::vector<PolymorphicClass>* polymorphicExprClasses(AST_expr*) = 0;
 };
 
 TypeAnalysis* doTypeAnalysis(CFG* cfg, const ParamNames& param_names,
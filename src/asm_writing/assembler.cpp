@@ -14,6 +14,7 @@
 
 #include "asm_writing/assembler.h"
 
+#include <climits>
 #include <cstring>
 
 #include "core/common.h"
@@ -280,6 +281,27 @@ void Assembler::movb(Indirect src, Register dest) {
 void Assembler::movzbl(Indirect src, Register dest) {
     mov_generic(src, dest, MovType::ZBL);
 }
+void Assembler::movzbl(Register src, Register dest) {
+    int src_idx = src.regnum;
+    int dest_idx = dest.regnum;
+
+    int rex = 0;
+    if (dest_idx >= 8) {
+        rex |= REX_R;
+        dest_idx -= 8;
+    }
+    if (src_idx >= 8) {
+        rex |= REX_B;
+        src_idx -= 8;
+    }
+
+    // Like set_cond, have to emit a blank REX to get the low byte of RSP/RBP/RSI/RDI instead of ah/ch/dh/bh.
+    if (rex || src_idx >= 4)
+        emitRex(rex);
+    emitByte(0x0f);
+    emitByte(0xb6);
+    emitModRM(0b11, dest_idx, src_idx);
+}
 void Assembler::movsbl(Indirect src, Register dest) {
     mov_generic(src, dest, MovType::SBL);
 }
@@ -970,5 +992,20 @@ void Assembler::emitAnnotation(int num) {
     cmp(RAX, Immediate(num));
     nop();
 }
+
+ForwardJump::ForwardJump(Assembler& assembler, ConditionCode condition) : assembler(assembler) {
+    // Pass a far-away destination to force the rel32 encoding, then fix up the offset in the destructor.
+    assembler.jmp_cond(JumpDestination::fromStart(assembler.bytesWritten() + 0x100), condition);
+    jmp_end = assembler.curInstPointer();
+}
+
+ForwardJump::~ForwardJump() {
+    if (assembler.hasFailed())
+        return;
+
+    int64_t offset = assembler.curInstPointer() - jmp_end;
+    assert(offset >= INT_MIN && offset <= INT_MAX);
+    *(int32_t*)(jmp_end - 4) = offset;
+}
 }
 }
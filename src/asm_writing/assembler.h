@@ -109,6 +109,7 @@ public:
     void movl(Indirect scr, Register dest);
     void movb(Indirect scr, Register dest);
     void movzbl(Indirect scr, Register dest);
+    void movzbl(Register src, Register dest);
     void movsbl(Indirect scr, Register dest);
     void movzwl(Indirect scr, Register dest);
     void movswl(Indirect scr, Register dest);
@@ -164,6 +165,18 @@ public:
     bool isExactlyFull() { return addr == end_addr; }
 };
 
+// Emits a conditional jump whose destination isn't known yet; when this goes out of scope, the jump gets
+// pointed at wherever the assembler is at that point.  Always uses the 32-bit offset form.
+class ForwardJump {
+private:
+    Assembler& assembler;
+    uint8_t* jmp_end;
+
+public:
+    ForwardJump(Assembler& assembler, ConditionCode condition);
+    ~ForwardJump();
+};
+
 uint8_t* initializePatchpoint2(uint8_t* start_addr, uint8_t* slowpath_start, uint8_t* end_addr, StackInfo stack_info,
                                const std::unordered_set<int>& live_outs);
 }
@@ -14,6 +14,7 @@
 
 #include "asm_writing/icinfo.h"
 
+#include <algorithm>
 #include <cstring>
 #include <memory>
 
@@ -22,6 +23,7 @@
 #include "asm_writing/assembler.h"
 #include "asm_writing/mc_writer.h"
 #include "codegen/patchpoints.h"
+#include "codegen/profiling/perf_jit.h"
 #include "core/common.h"
 #include "core/options.h"
 #include "core/types.h"
@@ -39,17 +41,35 @@ int64_t ICInvalidator::version() {
 }
 
 void ICInvalidator::addDependent(ICSlotInfo* entry_info) {
-    dependents.insert(entry_info);
+    if (dependents.insert(entry_info).second)
+        entry_info->invalidators.push_back(this);
+}
+
+void ICInvalidator::removeDependent(ICSlotInfo* entry_info) {
+    dependents.erase(entry_info);
+}
+
+static void forgetInvalidator(ICSlotInfo* slot, ICInvalidator* invalidator) {
+    auto it = std::find(slot->invalidators.begin(), slot->invalidators.end(), invalidator);
+    assert(it != slot->invalidators.end());
+    slot->invalidators.erase(it);
 }
 
 void ICInvalidator::invalidateAll() {
     cur_version++;
     for (ICSlotInfo* slot : dependents) {
+        forgetInvalidator(slot, this);
         slot->clear();
     }
     dependents.clear();
 }
 
+ICInvalidator::~ICInvalidator() {
+    for (ICSlotInfo* slot : dependents) {
+        forgetInvalidator(slot, this);
+    }
+}
+
 
 
 void ICSlotInfo::clear() {
@@ -122,6 +142,11 @@ void ICSlotRewrite::commit(CommitHook* hook) {
     }
 
     llvm::sys::Memory::InvalidateInstructionCache(slot_start, ic->getSlotSize());
+
+    static StatCounter ic_slots_written("ic_slots_written");
+    ic_slots_written.log();
+
+    registerPerfJitICSlot(debug_name, ic_entry->idx, slot_start, ic->getSlotSize());
 }
 
 void ICSlotRewrite::addDependenceOn(ICInvalidator& invalidator) {
@@ -201,6 +226,13 @@ ICInfo::ICInfo(void* start_addr, void* slowpath_rtn_addr, void* continue_addr, S
     }
 }
 
+ICInfo::~ICInfo() {
+    for (ICSlotInfo& slot : slots) {
+        for (ICInvalidator* invalidator : slot.invalidators)
+            invalidator->removeDependent(&slot);
+    }
+}
+
 static std::unordered_map<void*, ICInfo*> ics_by_return_addr;
 std::unique_ptr<ICInfo> registerCompiledPatchpoint(uint8_t* start_addr, uint8_t* slowpath_start_addr,
                                                    uint8_t* continue_addr, uint8_t* slowpath_rtn_addr,
@@ -40,6 +40,9 @@ public:
     int idx;        // the index inside the ic
     int num_inside; // the number of stack frames that are currently inside this slot
 
+    // The invalidators that this slot is registered with, so that they can forget about it if the ic gets freed.
+    std::vector<ICInvalidator*> invalidators;
+
     void clear();
 };
 
@@ -110,6 +113,7 @@ public:
     ICInfo(void* start_addr, void* slowpath_rtn_addr, void* continue_addr, StackInfo stack_info, int num_slots,
            int slot_size, llvm::CallingConv::ID calling_conv, const std::unordered_set<int>& live_outs,
            assembler::GenericRegister return_register, TypeRecorder* type_recorder);
+    ~ICInfo();
     void* const start_addr, *const slowpath_rtn_addr, *const continue_addr;
 
     int getSlotSize() { return slot_size; }
@@ -14,6 +14,8 @@
 
 #include "codegen/ast_interpreter.h"
 
+#include <algorithm>
+#include <cstring>
 #include <llvm/ADT/DenseMap.h>
 #include <llvm/ADT/StringMap.h>
 #include <unordered_map>
@@ -27,10 +29,11 @@
 #include "codegen/irgen/irgenerator.h"
 #include "codegen/irgen/util.h"
 #include "codegen/osrentry.h"
+#include "codegen/template_jit.h"
+#include "codegen/unwinding.h"
 #include "core/ast.h"
 #include "core/cfg.h"
 #include "core/common.h"
-#include "core/contiguous_map.h"
 #include "core/stats.h"
 #include "core/thread_utils.h"
 #include "core/util.h"
@@ -70,9 +73,8 @@ union Value {
 
 class ASTInterpreter {
 public:
-    typedef ContiguousMap<InternedString, Box*> SymMap;
-
     ASTInterpreter(CompiledFunction* compiled_function);
+    ~ASTInterpreter();
 
     void initArguments(int nargs, BoxedClosure* closure, BoxedGenerator* generator, Box* arg1, Box* arg2, Box* arg3,
                        Box** args);
@@ -87,7 +89,15 @@ private:
     Box* createFunction(AST* node, AST_arguments* args, const std::vector<AST_stmt*>& body);
     Value doBinOp(Box* left, Box* right, int op, BinExpType exp_type);
     void doStore(AST_expr* node, Value value);
+    void doStore(AST_Name* name, Value value);
     void doStore(InternedString name, Value value);
+    void doStore(InternedString name, ScopeInfo::VarScopeType vst, int vreg, Value value);
+    void caughtException(AST_Invoke* node, const ExcInfo& e);
+    void resumeFromYield(AST_stmt* node);
+    void finishYield(AST_stmt* node);
+    bool isStacklessGeneratorFrame() {
+        return generator && generator->interpreter_frame == this && !generator->context;
+    }
 
     Value visit_assert(AST_Assert* node);
     Value visit_assign(AST_Assign* node);
@@ -138,14 +148,23 @@ private:
     ScopeInfo* scope_info;
     PhiAnalysis* phis;
 
-    SymMap sym_table;
+    // The values of the FAST and CLOSURE names, indexed by the slots that CFG::assignVRegs() gave them.
+    // NULL means the name is currently undefined.
+    std::vector<Box*> vregs;
     CFGBlock* next_block, *current_block;
     AST_stmt* current_inst;
+    // The frame address of our execute() call, which is what identifies this frame to the unwinder.
+    void* frame_addr;
     ExcInfo last_exception;
     BoxedClosure* passed_closure, *created_closure;
     BoxedGenerator* generator;
     unsigned edgecount;
     FrameInfo frame_info;
+    // Whether this frame is hot enough that blocks should be run through the template JIT.
+    bool use_template_jit;
+    // Set when a stackless generator frame returns out of execute() because it yielded at current_inst (possibly from
+    // compiled code that it OSR'd into; see astInterpretGeneratorSuspend()).
+    bool suspended;
 
     // This is either a module or a dict
     Box* globals;
@@ -164,7 +183,9 @@ public:
     CompiledFunction* getCF() { return compiled_func; }
     FrameInfo* getFrameInfo() { return &frame_info; }
     BoxedClosure* getPassedClosure() { return passed_closure; }
-    const SymMap& getSymbolTable() { return sym_table; }
+    const std::vector<Box*>& getVRegs() { return vregs; }
+    const std::vector<InternedString>& getVRegNames() { return source_info->cfg->vreg_names; }
+    Box* getSymbol(InternedString name);
     const ScopeInfo* getScopeInfo() { return scope_info; }
 
     void addSymbol(InternedString name, Box* value, bool allow_duplicates);
@@ -176,12 +197,29 @@ public:
     void setGlobals(Box* globals);
 
     void gcVisit(GCVisitor* visitor);
+
+    friend struct pyston::ASTInterpreterJitInterface;
+    friend bool pyston::astInterpretGeneratorResume(BoxedGenerator* generator);
+    friend Box* pyston::astInterpretGeneratorSuspend(BoxedGenerator* generator, Box* value, CompiledFunction* cf,
+                                                     CFGBlock* block, AST_stmt* stmt, FrameInfo* frame_info,
+                                                     BoxedClosure* created_closure, Box** vregs);
+    friend Box* pyston::astInterpretFrom(CompiledFunction* cf, AST_expr* after_expr, AST_stmt* enclosing_stmt,
+                                         Box* expr_val, FrameStackState frame_state);
 };
 
+Box* ASTInterpreter::getSymbol(InternedString name) {
+    auto it = source_info->cfg->sym_vreg_map.find(name);
+    if (it == source_info->cfg->sym_vreg_map.end())
+        return NULL;
+    return vregs[it->second];
+}
+
 void ASTInterpreter::addSymbol(InternedString name, Box* value, bool allow_duplicates) {
+    auto it = source_info->cfg->sym_vreg_map.find(name);
+    RELEASE_ASSERT(it != source_info->cfg->sym_vreg_map.end(), "%s", name.c_str());
     if (!allow_duplicates)
-        assert(sym_table.count(name) == 0);
-    sym_table[name] = value;
+        assert(vregs[it->second] == NULL);
+    vregs[it->second] = value;
 }
 
 void ASTInterpreter::setGenerator(Box* gen) {
@@ -216,7 +254,7 @@ void ASTInterpreter::setGlobals(Box* globals) {
 }
 
 void ASTInterpreter::gcVisit(GCVisitor* visitor) {
-    visitor->visitRange((void* const*)&sym_table.vector()[0], (void* const*)&sym_table.vector()[sym_table.size()]);
+    visitor->visitRange((void* const*)vregs.data(), (void* const*)(vregs.data() + vregs.size()));
     if (passed_closure)
         visitor->visit(passed_closure);
     if (created_closure)
@@ -235,12 +273,16 @@ ASTInterpreter::ASTInterpreter(CompiledFunction* compiled_function)
       phis(NULL),
       current_block(0),
       current_inst(0),
+      frame_addr(0),
       last_exception(NULL, NULL, NULL),
       passed_closure(0),
       created_closure(0),
       generator(0),
       edgecount(0),
-      frame_info(ExcInfo(NULL, NULL, NULL)) {
+      frame_info(ExcInfo(NULL, NULL, NULL)),
+      use_template_jit(ENABLE_TEMPLATE_JIT && !FORCE_INTERPRETER
+                       && compiled_function->times_called >= TEMPLATE_JIT_THRESHOLD_CALLS),
+      suspended(false) {
 
     CLFunction* f = compiled_function->clfunc;
     if (!source_info->cfg)
@@ -249,6 +291,17 @@ ASTInterpreter::ASTInterpreter(CompiledFunction* compiled_function)
     scope_info = source_info->getScopeInfo();
 
     assert(scope_info);
+
+    if (!source_info->cfg->hasVregsAssigned())
+        source_info->cfg->assignVRegs(f->param_names, scope_info, source_info->getInternedStrings());
+    vregs.resize(source_info->cfg->vreg_names.size(), NULL);
+
+    compiled_func->num_interpreter_frames++;
+}
+
+ASTInterpreter::~ASTInterpreter() {
+    assert(compiled_func->num_interpreter_frames > 0);
+    compiled_func->num_interpreter_frames--;
 }
 
 void ASTInterpreter::initArguments(int nargs, BoxedClosure* _closure, BoxedGenerator* _generator, Box* arg1, Box* arg2,
@@ -304,6 +357,7 @@ Value ASTInterpreter::execute(ASTInterpreter& interpreter, CFGBlock* start_block
 
     void* frame_addr = __builtin_frame_address(0);
     RegisterHelper frame_registerer(&interpreter, frame_addr);
+    interpreter.frame_addr = frame_addr;
 
     Value v;
 
@@ -325,24 +379,82 @@ Value ASTInterpreter::execute(ASTInterpreter& interpreter, CFGBlock* start_block
             if (s != start_at)
                 continue;
             started = true;
+
+            if (interpreter.suspended) {
+                // A stackless generator getting resumed at the yield that it stopped at.
+                interpreter.current_inst = s;
+                interpreter.resumeFromYield(s);
+                continue;
+            }
         }
 
         interpreter.current_inst = s;
         v = interpreter.visit_stmt(s);
+        if (unlikely(interpreter.suspended))
+            return v;
     }
 
     while (interpreter.next_block) {
         interpreter.current_block = interpreter.next_block;
         interpreter.next_block = 0;
 
+        if (interpreter.use_template_jit && !interpreter.current_block->template_jit_failed) {
+            if (!interpreter.current_block->code)
+                compileBlockForTemplateJit(interpreter.current_block, interpreter.source_info, interpreter.scope_info);
+
+            if (interpreter.current_block->code) {
+                // This runs until the code reaches a block that hasn't been compiled yet (or returns), and leaves
+                // next_block set the same way that interpreting the blocks would have.
+                auto entry = (TemplateJitEntryFunc)interpreter.current_block->entry_code;
+                v = entry(&interpreter, interpreter.current_block->code, interpreter.vregs.data());
+                if (unlikely(interpreter.suspended))
+                    return v;
+                continue;
+            }
+        }
+
         for (AST_stmt* s : interpreter.current_block->body) {
             interpreter.current_inst = s;
             v = interpreter.visit_stmt(s);
+            if (unlikely(interpreter.suspended))
+                return v;
         }
     }
     return v;
 }
 
+void ASTInterpreter::resumeFromYield(AST_stmt* node) {
+    assert(suspended && isStacklessGeneratorFrame());
+    suspended = false;
+
+    if (node->type == AST_TYPE::Invoke) {
+        // Same as visit_invoke(), for the part of the statement after the yield:
+        AST_Invoke* invoke = ast_cast<AST_Invoke>(node);
+        try {
+            finishYield(invoke->stmt);
+            next_block = invoke->normal_dest;
+        } catch (ExcInfo e) {
+            caughtException(invoke, e);
+        }
+    } else {
+        finishYield(node);
+    }
+}
+
+// Does what yield() does once the generator gets resumed, and then the store of the result.
+void ASTInterpreter::finishYield(AST_stmt* node) {
+    // The CFG turns every yield into an assignment to a temporary:
+    AST_Assign* assign = ast_cast<AST_Assign>(node);
+    assert(assign->targets.size() == 1 && assign->value->type == AST_TYPE::Yield);
+
+    if (generator->exception.type) {
+        ExcInfo e = generator->exception;
+        generator->exception = ExcInfo(NULL, NULL, NULL);
+        raiseRaw(e);
+    }
+    doStore(assign->targets[0], generator->returnValue);
+}
+
 Value ASTInterpreter::doBinOp(Box* left, Box* right, int op, BinExpType exp_type) {
     if (op == AST_TYPE::Div && (source_info->parent_module->future_flags & FF_DIVISION)) {
         op = AST_TYPE::TrueDiv;
@@ -362,6 +474,22 @@ Value ASTInterpreter::doBinOp(Box* left, Box* right, int op, BinExpType exp_type
 
 void ASTInterpreter::doStore(InternedString name, Value value) {
     ScopeInfo::VarScopeType vst = scope_info->getScopeTypeOfName(name);
+    int vreg = -1;
+    if (vst == ScopeInfo::VarScopeType::FAST || vst == ScopeInfo::VarScopeType::CLOSURE) {
+        auto it = source_info->cfg->sym_vreg_map.find(name);
+        RELEASE_ASSERT(it != source_info->cfg->sym_vreg_map.end(), "%s", name.c_str());
+        vreg = it->second;
+    }
+    doStore(name, vst, vreg, value);
+}
+
+void ASTInterpreter::doStore(AST_Name* node, Value value) {
+    if (node->lookup_type == ScopeInfo::VarScopeType::UNKNOWN)
+        node->lookup_type = scope_info->getScopeTypeOfName(node->id);
+    doStore(node->id, node->lookup_type, node->vreg, value);
+}
+
+void ASTInterpreter::doStore(InternedString name, ScopeInfo::VarScopeType vst, int vreg, Value value) {
     if (vst == ScopeInfo::VarScopeType::GLOBAL) {
         setGlobal(globals, name, value.o);
     } else if (vst == ScopeInfo::VarScopeType::NAME) {
@@ -369,7 +497,8 @@ void ASTInterpreter::doStore(InternedString name, Value value) {
         // TODO should probably pre-box the names when it's a scope that usesNameLookup
         setitem(frame_info.boxedLocals, boxString(name.str()), value.o);
     } else {
-        sym_table[name] = value.o;
+        assert(vreg >= 0 && vreg < vregs.size());
+        vregs[vreg] = value.o;
         if (vst == ScopeInfo::VarScopeType::CLOSURE) {
             created_closure->elts[scope_info->getClosureOffset(name)] = value.o;
         }
@@ -378,8 +507,7 @@ void ASTInterpreter::doStore(InternedString name, Value value) {
 
 void ASTInterpreter::doStore(AST_expr* node, Value value) {
     if (node->type == AST_TYPE::Name) {
-        AST_Name* name = (AST_Name*)node;
-        doStore(name->id, value);
+        doStore((AST_Name*)node, value);
     } else if (node->type == AST_TYPE::Attribute) {
         AST_Attribute* attr = (AST_Attribute*)node;
         setattr(visit_expr(attr->value).o, attr->attr.c_str(), value.o);
@@ -449,89 +577,106 @@ Value ASTInterpreter::visit_branch(AST_Branch* node) {
 
 Value ASTInterpreter::visit_jump(AST_Jump* node) {
     bool backedge = node->target->idx < current_block->idx && compiled_func;
-    if (backedge)
+    if (backedge) {
         threading::allowGLReadPreemption();
 
-    if (ENABLE_OSR && backedge && edgecount++ == OSR_THRESHOLD_INTERPRETER) {
+        ++edgecount;
+        if (ENABLE_TEMPLATE_JIT && !FORCE_INTERPRETER && edgecount >= TEMPLATE_JIT_THRESHOLD_BACKEDGES)
+            use_template_jit = true;
+    }
+
+    if (ENABLE_OSR && backedge && edgecount == OSR_THRESHOLD_INTERPRETER + 1) {
         bool can_osr = !FORCE_INTERPRETER && source_info->scoping->areGlobalsFromModule();
         if (can_osr) {
             static StatCounter ast_osrs("num_ast_osrs");
             ast_osrs.log();
 
-            // TODO: we will immediately want the liveness info again in the jit, we should pass
-            // it through.
-            std::unique_ptr<LivenessAnalysis> liveness = computeLivenessInfo(source_info->cfg);
-            std::unique_ptr<PhiAnalysis> phis
-                = computeRequiredPhis(compiled_func->clfunc->param_names, source_info->cfg, liveness.get(), scope_info);
-
-            std::vector<InternedString> dead_symbols;
-            for (auto& it : sym_table) {
-                if (!liveness->isLiveAtEnd(it.first, current_block)) {
-                    dead_symbols.push_back(it.first);
-                } else if (phis->isRequiredAfter(it.first, current_block)) {
-                    assert(scope_info->getScopeTypeOfName(it.first) != ScopeInfo::VarScopeType::GLOBAL);
-                } else {
-                }
-            }
-            for (auto&& dead : dead_symbols)
-                sym_table.erase(dead);
-
             const OSREntryDescriptor* found_entry = nullptr;
             for (auto& p : compiled_func->clfunc->osr_versions) {
                 if (p.first->cf != compiled_func)
                     continue;
                 if (p.first->backedge != node)
                     continue;
+                if (!p.first->from_interpreter)
+                    continue;
 
                 found_entry = p.first;
             }
 
-            std::map<InternedString, Box*> sorted_symbol_table;
-
-            for (auto& name : phis->definedness.getDefinedNamesAtEnd(current_block)) {
-                auto it = sym_table.find(name);
-                if (!liveness->isLiveAtEnd(name, current_block))
-                    continue;
-
-                if (phis->isPotentiallyUndefinedAfter(name, current_block)) {
-                    bool is_defined = it != sym_table.end();
-                    // TODO only mangle once
-                    sorted_symbol_table[getIsDefinedName(name, source_info->getInternedStrings())] = (Box*)is_defined;
-                    if (is_defined)
-                        assert(sym_table.getMapped(it->second) != NULL);
-                    sorted_symbol_table[name] = is_defined ? sym_table.getMapped(it->second) : NULL;
-                } else {
-                    ASSERT(it != sym_table.end(), "%s", name.c_str());
-                    sorted_symbol_table[it->first] = sym_table.getMapped(it->second);
+            std::vector<Box*, StlCompatAllocator<Box*>> arg_array;
+            if (found_entry) {
+                // We've OSR'd from here before, so the entry already knows which names it takes, and we don't have to
+                // redo the analyses.  Stackless generators come through here after every yield from compiled code, so
+                // this is the part that has to be quick.  (The args are sorted the same way as sorted_symbol_table.)
+                for (auto& it : found_entry->args) {
+                    const std::string& name = it.first.str();
+                    if (isIsDefinedName(name)) {
+                        InternedString defined_name
+                            = source_info->getInternedStrings().get(name.substr(strlen("!is_defined_")));
+                        arg_array.push_back((Box*)(getSymbol(defined_name) != NULL));
+                    } else if (name == PASSED_GENERATOR_NAME) {
+                        arg_array.push_back(generator);
+                    } else if (name == PASSED_CLOSURE_NAME) {
+                        arg_array.push_back(passed_closure);
+                    } else if (name == CREATED_CLOSURE_NAME) {
+                        arg_array.push_back(created_closure);
+                    } else if (name == FRAME_INFO_PTR_NAME) {
+                        arg_array.push_back((Box*)&frame_info);
+                    } else {
+                        arg_array.push_back(getSymbol(it.first));
+                    }
+                }
+            } else {
+                // TODO: we will immediately want the liveness info again in the jit, we should pass
+                // it through.
+                std::unique_ptr<LivenessAnalysis> liveness = computeLivenessInfo(source_info->cfg);
+                std::unique_ptr<PhiAnalysis> phis = computeRequiredPhis(compiled_func->clfunc->param_names,
+                                                                        source_info->cfg, liveness.get(), scope_info);
+
+                std::map<InternedString, Box*> sorted_symbol_table;
+
+                for (auto& name : phis->definedness.getDefinedNamesAtEnd(current_block)) {
+                    if (!liveness->isLiveAtEnd(name, current_block))
+                        continue;
+
+                    Box* val = getSymbol(name);
+                    if (phis->isPotentiallyUndefinedAfter(name, current_block)) {
+                        bool is_defined = val != NULL;
+                        // TODO only mangle once
+                        sorted_symbol_table[getIsDefinedName(name, source_info->getInternedStrings())]
+                            = (Box*)is_defined;
+                        sorted_symbol_table[name] = val;
+                    } else {
+                        ASSERT(val != NULL, "%s", name.c_str());
+                        sorted_symbol_table[name] = val;
+                    }
                 }
-            }
-
-            // Manually free these here, since we might not return from this scope for a long time.
-            liveness.reset(nullptr);
-            phis.reset(nullptr);
 
-            // LLVM has a limit on the number of operands a machine instruction can have (~255),
-            // in order to not hit the limit with the patchpoints cancel OSR when we have a high number of symbols.
-            if (sorted_symbol_table.size() > 225) {
-                static StatCounter times_osr_cancel("num_osr_cancel_too_many_syms");
-                times_osr_cancel.log();
-                next_block = node->target;
-                return Value();
-            }
+                // Manually free these here, since we might not return from this scope for a long time.
+                liveness.reset(nullptr);
+                phis.reset(nullptr);
+
+                // LLVM has a limit on the number of operands a machine instruction can have (~255),
+                // in order to not hit the limit with the patchpoints cancel OSR when we have a high number of symbols.
+                if (sorted_symbol_table.size() > 225) {
+                    static StatCounter times_osr_cancel("num_osr_cancel_too_many_syms");
+                    times_osr_cancel.log();
+                    next_block = node->target;
+                    return Value();
+                }
 
-            if (generator)
-                sorted_symbol_table[source_info->getInternedStrings().get(PASSED_GENERATOR_NAME)] = generator;
+                if (generator)
+                    sorted_symbol_table[source_info->getInternedStrings().get(PASSED_GENERATOR_NAME)] = generator;
 
-            if (passed_closure)
-                sorted_symbol_table[source_info->getInternedStrings().get(PASSED_CLOSURE_NAME)] = passed_closure;
+                if (passed_closure)
+                    sorted_symbol_table[source_info->getInternedStrings().get(PASSED_CLOSURE_NAME)] = passed_closure;
 
-            if (created_closure)
-                sorted_symbol_table[source_info->getInternedStrings().get(CREATED_CLOSURE_NAME)] = created_closure;
+                if (created_closure)
+                    sorted_symbol_table[source_info->getInternedStrings().get(CREATED_CLOSURE_NAME)] = created_closure;
 
-            sorted_symbol_table[source_info->getInternedStrings().get(FRAME_INFO_PTR_NAME)] = (Box*)&frame_info;
+                sorted_symbol_table[source_info->getInternedStrings().get(FRAME_INFO_PTR_NAME)] = (Box*)&frame_info;
 
-            if (found_entry == nullptr) {
-                OSREntryDescriptor* entry = OSREntryDescriptor::create(compiled_func, node);
+                OSREntryDescriptor* entry = OSREntryDescriptor::create(compiled_func, node, true);
 
                 for (auto& it : sorted_symbol_table) {
                     if (isIsDefinedName(it.first.str()))
@@ -549,17 +694,31 @@ Value ASTInterpreter::visit_jump(AST_Jump* node) {
                 }
 
                 found_entry = entry;
+
+                for (auto& it : sorted_symbol_table) {
+                    arg_array.push_back(it.second);
+                }
             }
 
-            OSRExit exit(compiled_func, found_entry);
+            STAT_TIMER(t0, "us_timer_astinterpreter_jump_osrexit");
+            // Only take the codegen lock if the entry still has to get compiled:
+            CompiledFunction* partial_func = NULL;
+            auto it = compiled_func->clfunc->osr_versions.find(found_entry);
+            if (it != compiled_func->clfunc->osr_versions.end())
+                partial_func = it->second;
+            if (!partial_func) {
+                OSRExit exit(compiled_func, found_entry);
+                partial_func = compilePartialFuncInternal(&exit);
+            }
 
-            std::vector<Box*, StlCompatAllocator<Box*>> arg_array;
-            for (auto& it : sorted_symbol_table) {
-                arg_array.push_back(it.second);
+            if (!partial_func) {
+                // The compile got queued for the background thread.  Keep interpreting, and check back on it once
+                // we've taken another OSR_THRESHOLD_INTERPRETER backedges, the same way that compiled code does.
+                edgecount = 0;
+                next_block = node->target;
+                return Value();
             }
 
-            STAT_TIMER(t0, "us_timer_astinterpreter_jump_osrexit");
-            CompiledFunction* partial_func = compilePartialFuncInternal(&exit);
             auto arg_tuple = getTupleFromArgsArray(&arg_array[0], arg_array.size());
             Box* r = partial_func->call(std::get<0>(arg_tuple), std::get<1>(arg_tuple), std::get<2>(arg_tuple),
                                         std::get<3>(arg_tuple));
@@ -578,18 +737,54 @@ Value ASTInterpreter::visit_jump(AST_Jump* node) {
 }
 
 Value ASTInterpreter::visit_invoke(AST_Invoke* node) {
+    node->num_executions++;
+
     Value v;
     try {
-        v = visit_stmt(node->stmt);
+        if (node->shouldUseCAPIExceptions()) {
+            // Same as visit_assign(), but without throwing if the lookup fails:
+            AST_Assign* asgn = ast_cast<AST_Assign>(node->stmt);
+            Box* r;
+            if (asgn->value->type == AST_TYPE::Attribute) {
+                AST_Attribute* attr = ast_cast<AST_Attribute>(asgn->value);
+                r = getattrCAPI(visit_expr(attr->value).o, attr->attr.c_str());
+            } else {
+                AST_Subscript* subscript = ast_cast<AST_Subscript>(asgn->value);
+                Value value = visit_expr(subscript->value);
+                Value slice = visit_expr(subscript->slice);
+                r = getitemCAPI(value.o, slice.o);
+            }
+
+            if (!r) {
+                caughtException(node, fetchCAPIException());
+                return v;
+            }
+            doStore(asgn->targets[0], r);
+        } else {
+            v = visit_stmt(node->stmt);
+            // A stackless generator yielded inside of the statement; resumeFromYield() will finish it.
+            if (suspended)
+                return v;
+        }
         next_block = node->normal_dest;
     } catch (ExcInfo e) {
-        next_block = node->exc_dest;
-        last_exception = e;
+        caughtException(node, e);
     }
 
     return v;
 }
 
+void ASTInterpreter::caughtException(AST_Invoke* node, const ExcInfo& e) {
+    // We catch exceptions below our execute() frame, so the unwinder won't have gotten to that frame yet:
+    addTracebackFrameForInterpretedFrame(e.traceback, frame_addr);
+
+    // This is what decides whether the JIT uses the C API exception convention for this statement:
+    node->num_exceptions_caught++;
+
+    next_block = node->exc_dest;
+    last_exception = e;
+}
+
 Value ASTInterpreter::visit_clsAttribute(AST_ClsAttribute* node) {
     return getclsattr(visit_expr(node->value).o, node->attr.c_str());
 }
@@ -691,14 +886,18 @@ Value ASTInterpreter::visit_langPrimitive(AST_LangPrimitive* node) {
 Value ASTInterpreter::visit_yield(AST_Yield* node) {
     Value value = node->value ? visit_expr(node->value) : None;
     assert(generator && generator->cls == generator_cls);
+
+    if (isStacklessGeneratorFrame()) {
+        // Rather than switching stacks, return all the way out of execute() to whoever resumed the generator.
+        generator->returnValue = value.o;
+        suspended = true;
+        return Value();
+    }
+    assert(generator->context && "a stackless generator can only yield out of its heap frame");
     return yield(generator, value.o);
 }
 
 Value ASTInterpreter::visit_stmt(AST_stmt* node) {
-#if ENABLE_SAMPLING_PROFILER
-    threading::allowGLReadPreemption();
-#endif
-
     if (0) {
         printf("%20s % 2d ", source_info->getName().c_str(), current_block->idx);
         print_ast(node);
@@ -880,8 +1079,11 @@ Value ASTInterpreter::visit_assert(AST_Assert* node) {
 }
 
 Value ASTInterpreter::visit_global(AST_Global* node) {
-    for (auto name : node->names)
-        sym_table.erase(name);
+    for (auto name : node->names) {
+        auto it = source_info->cfg->sym_vreg_map.find(name);
+        if (it != source_info->cfg->sym_vreg_map.end())
+            vregs[it->second] = NULL;
+    }
     return Value();
 }
 
@@ -923,13 +1125,14 @@ Value ASTInterpreter::visit_delete(AST_Delete* node) {
                     }
                 } else {
                     assert(vst == ScopeInfo::VarScopeType::FAST);
+                    assert(target->vreg >= 0);
 
-                    if (sym_table.count(target->id) == 0) {
+                    if (vregs[target->vreg] == NULL) {
                         assertNameDefined(0, target->id.c_str(), NameError, true /* local_var_msg */);
                         return Value();
                     }
 
-                    sym_table.erase(target->id);
+                    vregs[target->vreg] = NULL;
                 }
                 break;
             }
@@ -945,6 +1148,8 @@ Value ASTInterpreter::visit_assign(AST_Assign* node) {
     assert(node->targets.size() == 1 && "cfg should have lowered it to a single target");
 
     Value v = visit_expr(node->value);
+    if (unlikely(suspended))
+        return Value(); // the value was a yield in a stackless generator; the store happens once it gets resumed
     for (AST_expr* e : node->targets)
         doStore(e, v);
     return Value();
@@ -1198,9 +1403,10 @@ Value ASTInterpreter::visit_name(AST_Name* node) {
         }
         case ScopeInfo::VarScopeType::FAST:
         case ScopeInfo::VarScopeType::CLOSURE: {
-            SymMap::iterator it = sym_table.find(node->id);
-            if (it != sym_table.end())
-                return sym_table.getMapped(it->second);
+            assert(node->vreg >= 0);
+            Box* val = vregs[node->vreg];
+            if (val)
+                return val;
 
             assertNameDefined(0, node->id.c_str(), UnboundLocalError, true);
             return Value();
@@ -1243,6 +1449,46 @@ Value ASTInterpreter::visit_attribute(AST_Attribute* node) {
 
 const void* interpreter_instr_addr = (void*)&ASTInterpreter::execute;
 
+int ASTInterpreterJitInterface::getCurrentBlockOffset() {
+    return offsetof(ASTInterpreter, current_block);
+}
+
+int ASTInterpreterJitInterface::getCurrentInstOffset() {
+    return offsetof(ASTInterpreter, current_inst);
+}
+
+int ASTInterpreterJitInterface::getGlobalsOffset() {
+    return offsetof(ASTInterpreter, globals);
+}
+
+int ASTInterpreterJitInterface::getNextBlockOffset() {
+    return offsetof(ASTInterpreter, next_block);
+}
+
+int ASTInterpreterJitInterface::getSuspendedOffset() {
+    return offsetof(ASTInterpreter, suspended);
+}
+
+Box* ASTInterpreterJitInterface::doJumpHelper(void* _interpreter, AST_Jump* node) {
+    ASTInterpreter* interpreter = (ASTInterpreter*)_interpreter;
+    return interpreter->visit_jump(node).o;
+}
+
+void ASTInterpreterJitInterface::doStoreHelper(void* _interpreter, AST_Name* node, Box* value) {
+    ASTInterpreter* interpreter = (ASTInterpreter*)_interpreter;
+    interpreter->doStore(node, value);
+}
+
+Box* ASTInterpreterJitInterface::visitExprHelper(void* _interpreter, AST_expr* node) {
+    ASTInterpreter* interpreter = (ASTInterpreter*)_interpreter;
+    return interpreter->visit_expr(node).o;
+}
+
+Box* ASTInterpreterJitInterface::visitStmtHelper(void* _interpreter, AST_stmt* node) {
+    ASTInterpreter* interpreter = (ASTInterpreter*)_interpreter;
+    return interpreter->visit_stmt(node).o;
+}
+
 Box* astInterpretFunction(CompiledFunction* cf, int nargs, Box* closure, Box* generator, Box* globals, Box* arg1,
                           Box* arg2, Box* arg3, Box** args) {
     assert((!globals) == cf->clfunc->source->scoping->areGlobalsFromModule());
@@ -1282,6 +1528,121 @@ Box* astInterpretFunction(CompiledFunction* cf, int nargs, Box* closure, Box* ge
     return v.o ? v.o : None;
 }
 
+bool astInterpretGeneratorResume(BoxedGenerator* generator) {
+    ASTInterpreter* interpreter = (ASTInterpreter*)generator->interpreter_frame;
+    if (!interpreter) {
+        // The generator is just getting started.
+        BoxedFunctionBase* func = generator->function;
+        CLFunction* clfunc = func->f;
+        int nargs = clfunc->numReceivedArgs();
+        Box** args = generator->args ? &generator->args->elts[0] : nullptr;
+
+        CompiledFunction* cf = pickVersion(clfunc, nargs, generator->arg1, generator->arg2, generator->arg3, args);
+        bool can_reopt = ENABLE_REOPT && !FORCE_INTERPRETER && (func->globals == NULL);
+        if (cf->is_interpreted && can_reopt && cf->times_called > REOPT_THRESHOLD_INTERPRETER)
+            cf = reoptCompiledFuncInternal(cf);
+
+        if (!cf->is_interpreted) {
+            static StatCounter num_stackless_generators_compiled("num_stackless_generators_compiled");
+            num_stackless_generators_compiled.log();
+
+            // Compiled code runs right here as well: if it yields, it moves its frame over into an interpreter frame
+            // and returns, and we continue in that from then on.
+            if (func->closure)
+                cf->closure_generator_call(func->closure, generator, generator->arg1, generator->arg2,
+                                           generator->arg3, args);
+            else
+                cf->generator_call(generator, generator->arg1, generator->arg2, generator->arg3, args);
+
+            interpreter = (ASTInterpreter*)generator->interpreter_frame;
+            return interpreter && interpreter->suspended;
+        }
+
+        static StatCounter num_stackless_generators("num_stackless_generators");
+        num_stackless_generators.log();
+
+        ++cf->times_called;
+        interpreter = new ASTInterpreter(cf);
+        // Set this before anything can allocate, so that the GC can find the frame through the generator:
+        generator->interpreter_frame = interpreter;
+
+        SourceInfo* source_info = clfunc->source.get();
+        assert((!func->globals) == source_info->scoping->areGlobalsFromModule());
+        if (func->globals)
+            interpreter->setGlobals(func->globals);
+        else
+            interpreter->setGlobals(source_info->parent_module);
+
+        if (unlikely(source_info->getScopeInfo()->usesNameLookup()))
+            interpreter->setBoxedLocals(new BoxedDict());
+
+        interpreter->initArguments(nargs, func->closure, generator, generator->arg1, generator->arg2,
+                                   generator->arg3, args);
+    }
+
+    if (!interpreter->current_block)
+        ASTInterpreter::execute(*interpreter);
+    else
+        ASTInterpreter::execute(*interpreter, interpreter->current_block, interpreter->current_inst);
+
+    return interpreter->suspended;
+}
+
+Box* astInterpretGeneratorSuspend(BoxedGenerator* generator, Box* value, CompiledFunction* cf, CFGBlock* block,
+                                  AST_stmt* stmt, FrameInfo* frame_info, BoxedClosure* created_closure, Box** vregs) {
+    static StatCounter num_stackless_compiled_yields("num_stackless_compiled_yields");
+    num_stackless_compiled_yields.log();
+
+    assert(!generator->context);
+    ASTInterpreter* interpreter = (ASTInterpreter*)generator->interpreter_frame;
+    if (!interpreter) {
+        // Compiled code only gets used for functions whose globals are their module's.
+        assert(cf->clfunc->source->scoping->areGlobalsFromModule());
+
+        // Like with deopt, the frame keeps the compiled function; as long as it exists, it counts as a user of its code.
+        interpreter = new ASTInterpreter(cf);
+        // Set this before anything can allocate, so that the GC can find the frame through the generator:
+        generator->interpreter_frame = interpreter;
+        interpreter->setGlobals(cf->clfunc->source->parent_module);
+        interpreter->generator = generator;
+        interpreter->passed_closure = generator->function->closure;
+        interpreter->created_closure = created_closure;
+    }
+    // Otherwise, the compiled code got OSR'd into from this frame, which is further up the stack (in visit_jump()),
+    // and is about to return too.
+    assert(interpreter->created_closure == created_closure);
+
+    std::copy(vregs, vregs + interpreter->vregs.size(), interpreter->vregs.begin());
+    if (frame_info != &interpreter->frame_info)
+        interpreter->frame_info = *frame_info;
+
+    interpreter->current_block = block;
+    interpreter->current_inst = stmt;
+    interpreter->next_block = NULL;
+    interpreter->suspended = true;
+    generator->returnValue = value;
+
+    // Get back into compiled code at the first backedge after the generator gets resumed.  That goes through the OSR
+    // entry that's already there, so it doesn't have to redo any analyses.
+    interpreter->edgecount = OSR_THRESHOLD_INTERPRETER;
+    interpreter->use_template_jit = ENABLE_TEMPLATE_JIT && !FORCE_INTERPRETER;
+
+    return None;
+}
+
+void astInterpretGeneratorFreeFrame(BoxedGenerator* generator) {
+    delete (ASTInterpreter*)generator->interpreter_frame;
+    generator->interpreter_frame = NULL;
+}
+
+void visitGeneratorInterpreterFrame(gc::GCVisitor* visitor, BoxedGenerator* generator) {
+    ASTInterpreter* interpreter = (ASTInterpreter*)generator->interpreter_frame;
+    // Interpreter frames normally live on the stack, so some of their fields (such as last_exception and frame_info)
+    // only get scanned conservatively along with it; do the same here.
+    visitor->visitPotentialRange((void* const*)interpreter, (void* const*)(interpreter + 1));
+    interpreter->gcVisit(visitor);
+}
+
 Box* astInterpretFunctionEval(CompiledFunction* cf, Box* globals, Box* boxedLocals) {
     ++cf->times_called;
 
@@ -1301,16 +1662,9 @@ Box* astInterpretFunctionEval(CompiledFunction* cf, Box* globals, Box* boxedLoca
     return v.o ? v.o : None;
 }
 
-Box* astInterpretFrom(CompiledFunction* cf, AST_expr* after_expr, AST_stmt* enclosing_stmt, Box* expr_val,
-                      FrameStackState frame_state) {
-    assert(cf);
-    assert(enclosing_stmt);
-    assert(frame_state.locals);
-    assert(after_expr);
-    assert(expr_val);
-
-    ASTInterpreter interpreter(cf);
-
+// Continues running a deoptimized frame in the interpreter, from right after after_expr.
+static Box* continueAfterDeopt(ASTInterpreter& interpreter, bool new_frame, CompiledFunction* cf, AST_expr* after_expr,
+                               AST_stmt* enclosing_stmt, Box* expr_val, const FrameStackState& frame_state) {
     ScopeInfo* scope_info = cf->clfunc->source->getScopeInfo();
     SourceInfo* source_info = cf->clfunc->source.get();
     assert(cf->clfunc->source->scoping->areGlobalsFromModule());
@@ -1320,11 +1674,14 @@ Box* astInterpretFrom(CompiledFunction* cf, AST_expr* after_expr, AST_stmt* encl
         assert(p.first->cls == str_cls);
         auto name = static_cast<BoxedString*>(p.first)->s();
         if (name == PASSED_GENERATOR_NAME) {
-            interpreter.setGenerator(p.second);
+            if (new_frame)
+                interpreter.setGenerator(p.second);
         } else if (name == PASSED_CLOSURE_NAME) {
-            interpreter.setPassedClosure(p.second);
+            if (new_frame)
+                interpreter.setPassedClosure(p.second);
         } else if (name == CREATED_CLOSURE_NAME) {
-            interpreter.setCreatedClosure(p.second);
+            if (new_frame)
+                interpreter.setCreatedClosure(p.second);
         } else {
             InternedString interned = cf->clfunc->source->getInternedStrings().get(name);
             interpreter.addSymbol(interned, p.second, false);
@@ -1386,6 +1743,42 @@ Box* astInterpretFrom(CompiledFunction* cf, AST_expr* after_expr, AST_stmt* encl
     return v.o ? v.o : None;
 }
 
+Box* astInterpretFrom(CompiledFunction* cf, AST_expr* after_expr, AST_stmt* enclosing_stmt, Box* expr_val,
+                      FrameStackState frame_state) {
+    assert(cf);
+    assert(enclosing_stmt);
+    assert(frame_state.locals);
+    assert(after_expr);
+    assert(expr_val);
+
+    BoxedGenerator* generator = NULL;
+    for (const auto& p : frame_state.locals->d) {
+        if (static_cast<BoxedString*>(p.first)->s() == PASSED_GENERATOR_NAME)
+            generator = static_cast<BoxedGenerator*>(p.second);
+    }
+
+    if (!generator || generator->context) {
+        ASTInterpreter interpreter(cf);
+        return continueAfterDeopt(interpreter, true, cf, after_expr, enclosing_stmt, expr_val, frame_state);
+    }
+
+    // A stackless generator can only yield out of its heap frame, so that's what it has to continue in.
+    ASTInterpreter* interpreter = (ASTInterpreter*)generator->interpreter_frame;
+    if (!interpreter) {
+        interpreter = new ASTInterpreter(cf);
+        generator->interpreter_frame = interpreter;
+        return continueAfterDeopt(*interpreter, true, cf, after_expr, enclosing_stmt, expr_val, frame_state);
+    }
+
+    // The frame already exists if it's the one that OSR'd into the code that we're deoptimizing.  It's further up the
+    // stack, and will return as soon as we do.
+    std::fill(interpreter->vregs.begin(), interpreter->vregs.end(), (Box*)NULL);
+    void* outer_frame_addr = interpreter->frame_addr;
+    Box* r = continueAfterDeopt(*interpreter, false, cf, after_expr, enclosing_stmt, expr_val, frame_state);
+    interpreter->frame_addr = outer_frame_addr;
+    return r;
+}
+
 AST_stmt* getCurrentStatementForInterpretedFrame(void* frame_ptr) {
     ASTInterpreter* interpreter = s_interpreterMap[frame_ptr];
     assert(interpreter);
@@ -1404,6 +1797,13 @@ CompiledFunction* getCFForInterpretedFrame(void* frame_ptr) {
     return interpreter->getCF();
 }
 
+CompiledFunction* findCFForInterpretedFrame(void* frame_ptr) {
+    auto it = s_interpreterMap.find(frame_ptr);
+    if (it == s_interpreterMap.end())
+        return NULL;
+    return it->second->getCF();
+}
+
 FrameInfo* getFrameInfoForInterpretedFrame(void* frame_ptr) {
     ASTInterpreter* interpreter = s_interpreterMap[frame_ptr];
     assert(interpreter);
@@ -1414,11 +1814,15 @@ BoxedDict* localsForInterpretedFrame(void* frame_ptr, bool only_user_visible) {
     ASTInterpreter* interpreter = s_interpreterMap[frame_ptr];
     assert(interpreter);
     BoxedDict* rtn = new BoxedDict();
-    for (auto& l : interpreter->getSymbolTable()) {
-        if (only_user_visible && (l.first.str()[0] == '!' || l.first.str()[0] == '#'))
+    const std::vector<Box*>& vregs = interpreter->getVRegs();
+    const std::vector<InternedString>& names = interpreter->getVRegNames();
+    for (int i = 0; i < vregs.size(); i++) {
+        if (!vregs[i])
+            continue;
+        if (only_user_visible && (names[i].str()[0] == '!' || names[i].str()[0] == '#'))
             continue;
 
-        rtn->d[boxString(l.first.str())] = interpreter->getSymbolTable().getMapped(l.second);
+        rtn->d[boxString(names[i].str())] = vregs[i];
     }
 
     return rtn;
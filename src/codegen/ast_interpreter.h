@@ -24,25 +24,61 @@ class GCVisitor;
 }
 
 class AST_expr;
+class AST_Jump;
+class AST_Name;
 class AST_stmt;
 class Box;
 class BoxedClosure;
 class BoxedDict;
+class BoxedGenerator;
+class CFGBlock;
 struct CompiledFunction;
+struct FrameInfo;
 struct LineInfo;
 
 extern const void* interpreter_instr_addr;
 
+// The parts of the interpreter that code from the template JIT (codegen/template_jit.cpp) needs to get at.
+// The interpreter gets passed around as a void*, since the ASTInterpreter class is private to ast_interpreter.cpp.
+struct ASTInterpreterJitInterface {
+    static int getCurrentBlockOffset();
+    static int getCurrentInstOffset();
+    static int getGlobalsOffset();
+    static int getNextBlockOffset();
+    static int getSuspendedOffset();
+
+    static Box* doJumpHelper(void* interpreter, AST_Jump* node);
+    static void doStoreHelper(void* interpreter, AST_Name* node, Box* value);
+    static Box* visitExprHelper(void* interpreter, AST_expr* node);
+    static Box* visitStmtHelper(void* interpreter, AST_stmt* node);
+};
+
 Box* astInterpretFunction(CompiledFunction* f, int nargs, Box* closure, Box* generator, Box* globals, Box* arg1,
                           Box* arg2, Box* arg3, Box** args);
 Box* astInterpretFunctionEval(CompiledFunction* cf, Box* globals, Box* boxedLocals);
+
+// Stackless generators: the interpreter frame of the generator body lives on the heap (in generator->interpreter_frame)
+// and gets run on the stack of whoever resumes the generator, returning back out of it at each yield.
+// Compiled code from the LLVM tiers runs on that stack as well.  When it yields, it calls Suspend, which copies its
+// variables into the interpreter frame (creating it if the generator started out in compiled code), and then returns.
+// The interpreter resumes the generator at the yield, and gets back into compiled code through an OSR entry at the
+// next backedge; so each resume costs the interpreter (or baseline JIT) time from the yield to the end of the loop
+// iteration, plus an OSR call, instead of a stack switch.
+// Resume returns whether the generator yielded, as opposed to having returned.
+bool astInterpretGeneratorResume(BoxedGenerator* generator);
+Box* astInterpretGeneratorSuspend(BoxedGenerator* generator, Box* value, CompiledFunction* cf, CFGBlock* block,
+                                  AST_stmt* stmt, FrameInfo* frame_info, BoxedClosure* created_closure, Box** vregs);
+void astInterpretGeneratorFreeFrame(BoxedGenerator* generator);
+void visitGeneratorInterpreterFrame(gc::GCVisitor* visitor, BoxedGenerator* generator);
 Box* astInterpretFrom(CompiledFunction* cf, AST_expr* after_expr, AST_stmt* enclosing_stmt, Box* expr_val,
                       FrameStackState frame_state);
 
 AST_stmt* getCurrentStatementForInterpretedFrame(void* frame_ptr);
 Box* getGlobalsForInterpretedFrame(void* frame_ptr);
 CompiledFunction* getCFForInterpretedFrame(void* frame_ptr);
-struct FrameInfo;
+// Like getCFForInterpretedFrame, but returns NULL if the frame isn't registered (anymore): an interpreter frame
+// unregisters itself once an exception starts running its cleanups.
+CompiledFunction* findCFForInterpretedFrame(void* frame_ptr);
 FrameInfo* getFrameInfoForInterpretedFrame(void* frame_ptr);
 BoxedClosure* passedClosureForInterpretedFrame(void* frame_ptr);
 
@@ -62,6 +62,11 @@ void FunctionAddressRegistry::registerFunction(const std::string& name, void* ad
     functions.insert(std::make_pair(addr, FuncInfo(name, length, llvm_func)));
 }
 
+void FunctionAddressRegistry::deregisterFunction(void* addr) {
+    functions.erase(addr);
+    lookup_neg_cache.erase(addr);
+}
+
 void FunctionAddressRegistry::dumpPerfMap() {
     std::string out_path = "perf_map";
     removeDirectoryIfExists(out_path);
@@ -70,15 +75,11 @@ void FunctionAddressRegistry::dumpPerfMap() {
     code = llvm::sys::fs::create_directory(out_path, false);
     assert(!code);
 
+    // (/tmp/perf-PID.map gets written as we go, by codegen/profiling/perf_jit.cpp)
     FILE* index_f = fopen((out_path + "/index.txt").c_str(), "w");
 
-    char buf[80];
-    snprintf(buf, 80, "/tmp/perf-%d.map", getpid());
-    FILE* f = fopen(buf, "w");
     for (const auto& p : functions) {
         const FuncInfo& info = p.second;
-        fprintf(f, "%lx %x %s\n", (uintptr_t)p.first, info.length, info.name.c_str());
-
         if (info.length > 0) {
             fprintf(index_f, "%lx %s\n", (uintptr_t)p.first, info.name.c_str());
 
@@ -89,7 +90,7 @@ void FunctionAddressRegistry::dumpPerfMap() {
             fclose(data_f);
         }
     }
-    fclose(f);
+    fclose(index_f);
 }
 
 llvm::Function* FunctionAddressRegistry::getLLVMFuncAtAddress(void* addr) {
@@ -48,6 +48,7 @@ public:
     std::string getFuncNameAtAddress(void* addr, bool demangle, bool* out_success = NULL);
     llvm::Function* getLLVMFuncAtAddress(void* addr);
     void registerFunction(const std::string& name, void* addr, int length, llvm::Function* llvm_func);
+    void deregisterFunction(void* addr);
     void dumpPerfMap();
 };
 
@@ -87,9 +88,12 @@ extern GlobalState g;
 // in runtime_hooks.cpp:
 void initGlobalFuncs(GlobalState& g);
 
-extern int sigprof_pending;
-
 DS_DECLARE_RWLOCK(codegen_rwlock);
+
+// Whether the LLVM tiers emit their safepoints (function entries and loop backedges) with frame info, so that the stack
+// can be walked from inside of them.  That makes every safepoint a patchpoint, so it stays off until the sampling
+// profiler gets started; see enableSafepointFrameInfo().  Read while holding codegen_rwlock.
+extern bool safepoint_frame_info;
 }
 
 #endif
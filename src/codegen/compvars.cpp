@@ -341,7 +341,11 @@ public:
 
         bool do_patchpoint = ENABLE_ICGETITEMS && !info.isInterpreted();
         llvm::Value* rtn;
-        if (do_patchpoint) {
+        if (info.unw_info.hasCAPIExcDest()) {
+            // No IC here: the ICs report errors by throwing, which is what we're trying to avoid at this site.
+            rtn = emitter.createCall2(info.unw_info, g.funcs.getitemCAPI, var->getValue(), converted_slice->getValue());
+            emitter.checkAndPropagateCAPIException(info.unw_info, rtn);
+        } else if (do_patchpoint) {
             ICSetupInfo* pp = createGetitemIC(info.getTypeRecorder());
 
             std::vector<llvm::Value*> llvm_args;
@@ -496,7 +500,11 @@ CompilerVariable* UnknownType::getattr(IREmitter& emitter, const OpInfo& info, C
     }
 
     bool do_patchpoint = ENABLE_ICGETATTRS && !info.isInterpreted();
-    if (do_patchpoint) {
+    if (!cls_only && info.unw_info.hasCAPIExcDest()) {
+        // Like in getitem(), skip the IC since it would report a failed lookup by throwing.
+        rtn_val = emitter.createCall2(info.unw_info, g.funcs.getattrCAPI, var->getValue(), ptr);
+        emitter.checkAndPropagateCAPIException(info.unw_info, rtn_val);
+    } else if (do_patchpoint) {
         ICSetupInfo* pp = createGetattrIC(info.getTypeRecorder());
 
         std::vector<llvm::Value*> llvm_args;
@@ -629,6 +637,47 @@ static ConcreteCompilerVariable* _call(IREmitter& emitter, const OpInfo& info, l
     return new ConcreteCompilerVariable(rtn_type, rtn, true);
 }
 
+ConcreteCompilerVariable* callCompiledFunctionDirect(IREmitter& emitter, const OpInfo& info, llvm::Value* func,
+                                                     const std::vector<CompilerVariable*>& args,
+                                                     ConcreteCompilerType* rtn_type) {
+    return _call(emitter, info, func, NULL, {}, ArgPassSpec(args.size()), args, NULL, rtn_type);
+}
+
+// Returns the index as an i64 if it's a plain int, or NULL if it might be something else (a slice, a long,
+// an object with __index__).
+static llvm::Value* getUnboxedListIndex(IREmitter& emitter, CompilerVariable* slice) {
+    if (slice->getType() == INT)
+        return static_cast<ConcreteCompilerVariable*>(slice)->getValue();
+    if (slice->getType() == BOXED_INT)
+        return emitter.getBuilder()->CreateCall(g.funcs.unboxInt,
+                                                static_cast<ConcreteCompilerVariable*>(slice)->getValue());
+    return NULL;
+}
+
+bool tryListSetitem(IREmitter& emitter, const OpInfo& info, CompilerVariable* target, CompilerVariable* slice,
+                    CompilerVariable* val) {
+    if (target->getType() != LIST)
+        return false;
+
+    llvm::Value* idx = getUnboxedListIndex(emitter, slice);
+    if (!idx)
+        return false;
+
+    llvm::Value* list = static_cast<ConcreteCompilerVariable*>(target)->getValue();
+    if (val->getType() == INT) {
+        emitter.createCall3(info.unw_info, g.funcs.listSetitemUnboxedInt, list, idx,
+                            static_cast<ConcreteCompilerVariable*>(val)->getValue());
+    } else if (val->getType() == FLOAT) {
+        emitter.createCall3(info.unw_info, g.funcs.listSetitemUnboxedFloat, list, idx,
+                            static_cast<ConcreteCompilerVariable*>(val)->getValue());
+    } else {
+        ConcreteCompilerVariable* converted_val = val->makeConverted(emitter, val->getBoxType());
+        emitter.createCall3(info.unw_info, g.funcs.listSetitemUnboxed, list, idx, converted_val->getValue());
+        converted_val->decvref(emitter);
+    }
+    return true;
+}
+
 CompilerVariable* UnknownType::call(IREmitter& emitter, const OpInfo& info, ConcreteCompilerVariable* var,
                                     ArgPassSpec argspec, const std::vector<CompilerVariable*>& args,
                                     const std::vector<const std::string*>* keyword_names) {
@@ -1584,6 +1633,9 @@ public:
         }
         llvm::FunctionType* ft = llvm::FunctionType::get(cf->spec->rtn_type->llvmType(), arg_types, false);
 
+        // We're about to bake this version's address into the code we're generating:
+        cf->pinned = true;
+
         llvm::Value* linked_function;
         if (cf->func) // for JITed functions we need to make the desination address relocatable.
             linked_function = embedRelocatablePtr(cf->code, ft->getPointerTo());
@@ -1691,6 +1743,14 @@ public:
     }
 
     CompilerVariable* getitem(IREmitter& emitter, const OpInfo& info, VAR* var, CompilerVariable* slice) override {
+        // Indexing a list with an int is common enough to skip __getitem__ (and boxing the index) for:
+        if (cls == list_cls) {
+            if (llvm::Value* idx = getUnboxedListIndex(emitter, slice)) {
+                llvm::Value* rtn = emitter.createCall2(info.unw_info, g.funcs.listGetitemUnboxed, var->getValue(), idx);
+                return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
+            }
+        }
+
         static const std::string attr("__getitem__");
         bool no_attribute = false;
         ConcreteCompilerVariable* called_constant = tryCallattrConstant(
@@ -407,6 +407,17 @@ CompilerType* typeOfClassobj(BoxedClass*);
 CompilerType* makeTupleType(const std::vector<CompilerType*>& elt_types);
 CompilerType* makeFuncType(ConcreteCompilerType* rtn_type, const std::vector<ConcreteCompilerType*>& arg_types);
 
+// Calls a specific compiled version of a function with positional arguments, bypassing runtimeCall; the caller is
+// responsible for making sure that it's the version that runtimeCall would have picked.
+ConcreteCompilerVariable* callCompiledFunctionDirect(IREmitter& emitter, const OpInfo& info, llvm::Value* func,
+                                                     const std::vector<CompilerVariable*>& args,
+                                                     ConcreteCompilerType* rtn_type);
+
+// Stores into an exact list without going through __setitem__ when the index is a plain int, passing int and float
+// values unboxed.  Returns false (without emitting anything) if the types don't allow it.
+bool tryListSetitem(IREmitter& emitter, const OpInfo& info, CompilerVariable* target, CompilerVariable* slice,
+                    CompilerVariable* val);
+
 ConcreteCompilerVariable* boolFromI1(IREmitter&, llvm::Value*);
 llvm::Value* i1FromBool(IREmitter&, ConcreteCompilerVariable*);
 
@@ -15,9 +15,11 @@
 #include "codegen/entry.h"
 
 #include <cstdio>
+#include <elf.h>
 #include <iostream>
-#include <lz4frame.h>
+#include <link.h>
 #include <openssl/evp.h>
+#include <sys/stat.h>
 #include <unordered_map>
 
 #include "llvm/Analysis/Passes.h"
@@ -39,7 +41,10 @@
 #include "llvm/Transforms/Utils/Cloning.h"
 
 #include "codegen/codegen.h"
+#include "codegen/irgen/hooks.h"
 #include "codegen/memmgr.h"
+#include "codegen/parser.h"
+#include "codegen/profiling/perf_jit.h"
 #include "codegen/profiling/profiling.h"
 #include "codegen/stackmaps.h"
 #include "core/options.h"
@@ -55,8 +60,6 @@
 
 namespace pyston {
 
-int sigprof_pending = 0;
-
 GlobalState g;
 
 extern "C" {
@@ -123,87 +126,6 @@ static llvm::Module* loadStdlib() {
     return m;
 }
 
-class CompressedFile {
-public:
-    static bool writeFile(llvm::StringRef file_name, llvm::StringRef data) {
-        std::error_code error_code;
-        llvm::raw_fd_ostream file(file_name, error_code, llvm::sys::fs::F_RW);
-        if (error_code)
-            return false;
-
-        int uncompressed_size = data.size();
-        // Write the uncompressed size to the beginning of the file as a simple checksum.
-        // It looks like each lz4 block has its own data checksum, but we need to also
-        // make sure that we have all the blocks that we expected.
-        // In particular, without this, an empty file seems to be a valid lz4 stream.
-        file.write(reinterpret_cast<const char*>(&uncompressed_size), 4);
-
-        LZ4F_preferences_t preferences;
-        memset(&preferences, 0, sizeof(preferences));
-        preferences.frameInfo.contentChecksumFlag = contentChecksumEnabled;
-        preferences.frameInfo.contentSize = data.size();
-
-        std::vector<char> compressed;
-        size_t max_size = LZ4F_compressFrameBound(data.size(), &preferences);
-        compressed.resize(max_size);
-        size_t compressed_size = LZ4F_compressFrame(&compressed[0], max_size, data.data(), data.size(), &preferences);
-        if (LZ4F_isError(compressed_size))
-            return false;
-        file.write(compressed.data(), compressed_size);
-        return true;
-    }
-
-    static std::unique_ptr<llvm::MemoryBuffer> getFile(llvm::StringRef file_name) {
-        auto compressed_content = llvm::MemoryBuffer::getFile(file_name, -1, false);
-        if (!compressed_content)
-            return std::unique_ptr<llvm::MemoryBuffer>();
-
-        LZ4F_decompressionContext_t context;
-        LZ4F_createDecompressionContext(&context, LZ4F_VERSION);
-
-        LZ4F_frameInfo_t frame_info;
-        memset(&frame_info, 0, sizeof(frame_info));
-
-        const char* start = (*compressed_content)->getBufferStart();
-        size_t pos = 0;
-        size_t compressed_size = (*compressed_content)->getBufferSize();
-        if (compressed_size < 4)
-            return std::unique_ptr<llvm::MemoryBuffer>();
-
-        int orig_uncompressed_size = *reinterpret_cast<const int*>(start);
-        pos += 4;
-
-        size_t remaining = compressed_size - pos;
-        LZ4F_getFrameInfo(context, &frame_info, start + pos, &remaining);
-        pos += remaining;
-
-        std::vector<char> uncompressed;
-        uncompressed.reserve(frame_info.contentSize);
-        while (pos < compressed_size) {
-            unsigned char buff[4096];
-            size_t buff_size = sizeof(buff);
-            remaining = compressed_size - pos;
-            size_t error_code = LZ4F_decompress(context, buff, &buff_size, start + pos, &remaining, NULL);
-            if (LZ4F_isError(error_code)) {
-                LZ4F_freeDecompressionContext(context);
-                return std::unique_ptr<llvm::MemoryBuffer>();
-            }
-            pos += remaining;
-            if (buff_size != 0)
-                uncompressed.insert(uncompressed.end(), buff, buff + buff_size);
-        }
-
-        LZ4F_freeDecompressionContext(context);
-        if (uncompressed.size() != frame_info.contentSize)
-            return std::unique_ptr<llvm::MemoryBuffer>();
-
-        if (uncompressed.size() != orig_uncompressed_size)
-            return std::unique_ptr<llvm::MemoryBuffer>();
-
-        return llvm::MemoryBuffer::getMemBufferCopy(llvm::StringRef(uncompressed.data(), uncompressed.size()));
-    }
-};
-
 class PystonObjectCache : public llvm::ObjectCache {
 private:
     // Stream which calculates the SHA256 hash of the data writen to.
@@ -239,11 +161,21 @@ private:
     };
 
     llvm::SmallString<128> cache_dir;
-    std::string module_identifier;
-    std::string hash_before_codegen;
+
+    // The key for the module that's being compiled, set by irgen before handing it off to the JIT;
+    // see setObjectCacheKey().
+    std::string cur_key;
+    // If irgen found the key in the cache, it won't have optimized the IR, so the object that LLVM would generate
+    // from it if we fail to load the cached one after all shouldn't get stored.
+    bool cur_key_was_cached;
+
+    void getCacheFile(llvm::SmallString<128>& cache_file, llvm::StringRef key) {
+        cache_file = cache_dir;
+        llvm::sys::path::append(cache_file, key);
+    }
 
 public:
-    PystonObjectCache() {
+    PystonObjectCache() : cur_key_was_cached(false) {
         llvm::sys::path::home_directory(cache_dir);
         llvm::sys::path::append(cache_dir, ".cache");
         llvm::sys::path::append(cache_dir, "pyston");
@@ -252,6 +184,23 @@ public:
         cleanupCacheDirectory();
     }
 
+    static std::string hash(llvm::StringRef data) {
+        HashOStream hash_stream;
+        hash_stream << data;
+        return hash_stream.getHash();
+    }
+
+    bool setKey(const std::string& key) {
+        cur_key = key;
+        cur_key_was_cached = false;
+        if (key.empty())
+            return false;
+
+        llvm::SmallString<128> cache_file;
+        getCacheFile(cache_file, key);
+        cur_key_was_cached = llvm::sys::fs::exists(cache_file.str());
+        return cur_key_was_cached;
+    }
 
 #if LLVMREV < 216002
     virtual void notifyObjectCompiled(const llvm::Module* M, const llvm::MemoryBuffer* Obj)
@@ -259,15 +208,32 @@ public:
     virtual void notifyObjectCompiled(const llvm::Module* M, llvm::MemoryBufferRef Obj)
 #endif
     {
-        RELEASE_ASSERT(module_identifier == M->getModuleIdentifier(), "");
-        RELEASE_ASSERT(!hash_before_codegen.empty(), "");
+        if (cur_key.empty() || cur_key_was_cached)
+            return;
 
-        llvm::SmallString<128> cache_file = cache_dir;
-        llvm::sys::path::append(cache_file, hash_before_codegen);
         if (!llvm::sys::fs::exists(cache_dir.str()) && llvm::sys::fs::create_directories(cache_dir.str()))
             return;
 
-        CompressedFile::writeFile(cache_file, Obj.getBuffer());
+        // Write the object to a temporary file and then move it into place, so that other processes never see (and
+        // map) a partially-written entry.
+        int fd;
+        llvm::SmallString<128> tmp_file;
+        if (llvm::sys::fs::createUniqueFile(llvm::Twine(cache_dir.str()) + "/tmp-%%%%%%%%", fd, tmp_file))
+            return;
+
+        bool ok;
+        {
+            llvm::raw_fd_ostream file(fd, /* shouldClose = */ true);
+            file << Obj.getBuffer();
+            file.close();
+            ok = !file.has_error();
+            file.clear_error();
+        }
+
+        llvm::SmallString<128> cache_file;
+        getCacheFile(cache_file, cur_key);
+        if (!ok || llvm::sys::fs::rename(tmp_file.str(), cache_file.str()))
+            llvm::sys::fs::remove(tmp_file.str());
     }
 
 #if LLVMREV < 215566
@@ -279,50 +245,23 @@ public:
         static StatCounter jit_objectcache_hits("num_jit_objectcache_hits");
         static StatCounter jit_objectcache_misses("num_jit_objectcache_misses");
 
-        module_identifier = M->getModuleIdentifier();
-
-        // Generate a hash for the module
-        HashOStream hash_stream;
-        llvm::WriteBitcodeToFile(M, hash_stream);
-        hash_before_codegen = hash_stream.getHash();
-
-        llvm::SmallString<128> cache_file = cache_dir;
-        llvm::sys::path::append(cache_file, hash_before_codegen);
-        if (!llvm::sys::fs::exists(cache_file.str())) {
-#if 0
-            // This code helps with identifying why we got a cache miss for a file.
-            // - clear the cache directory
-            // - run pyston
-            // - run pyston a second time
-            // - Now look for "*_second.ll" files in the cache directory and compare them to the "*_first.ll" IR dump
-            std::string llvm_ir;
-            llvm::raw_string_ostream sstr(llvm_ir);
-            M->print(sstr, 0);
-            sstr.flush();
-
-            llvm::sys::fs::create_directories(cache_dir.str());
-            std::string filename = cache_dir.str().str() + "/" + module_identifier + "_first.ll";
-            if (llvm::sys::fs::exists(filename))
-                filename = cache_dir.str().str() + "/" + module_identifier + "_second.ll";
-            FILE* f = fopen(filename.c_str(), "wt");
-            ASSERT(f, "%s", strerror(errno));
-            fwrite(llvm_ir.c_str(), 1, llvm_ir.size(), f);
-            fclose(f);
-#endif
-
-            // This file isn't in our cache
+        if (!cur_key_was_cached) {
             jit_objectcache_misses.log();
             return NULL;
         }
 
-        std::unique_ptr<llvm::MemoryBuffer> mem_buff = CompressedFile::getFile(cache_file);
+        // Map the entry directly rather than reading it in; the entries are written once and never modified in
+        // place, and the mapping stays valid even if the file gets removed by cleanupCacheDirectory().
+        llvm::SmallString<128> cache_file;
+        getCacheFile(cache_file, cur_key);
+        auto mem_buff = llvm::MemoryBuffer::getFile(cache_file, -1, /* RequiresNullTerminator = */ false);
         if (!mem_buff) {
             jit_objectcache_misses.log();
             return NULL;
         }
 
         jit_objectcache_hits.log();
-        return mem_buff;
+        return std::move(mem_buff.get());
     }
 
     void cleanupCacheDirectory() {
@@ -352,16 +291,66 @@ public:
     }
 };
 
+static PystonObjectCache* object_cache = NULL;
+
+std::string getObjectCacheKey(llvm::StringRef data) {
+    return PystonObjectCache::hash(data);
+}
+
+bool setObjectCacheKey(const std::string& key) {
+    if (!object_cache)
+        return false;
+    return object_cache->setKey(key);
+}
+
+static int findBuildId(struct dl_phdr_info* info, size_t size, void* data) {
+    // The first object is the executable itself:
+    std::string& build_id = *static_cast<std::string*>(data);
+    for (int i = 0; i < info->dlpi_phnum; i++) {
+        const ElfW(Phdr)& phdr = info->dlpi_phdr[i];
+        if (phdr.p_type != PT_NOTE)
+            continue;
+
+        const char* p = reinterpret_cast<const char*>(info->dlpi_addr + phdr.p_vaddr);
+        const char* end = p + phdr.p_memsz;
+        while (p + sizeof(ElfW(Nhdr)) <= end) {
+            const ElfW(Nhdr)* note = reinterpret_cast<const ElfW(Nhdr)*>(p);
+            const char* name = p + sizeof(ElfW(Nhdr));
+            const char* desc = name + ((note->n_namesz + 3) & ~3);
+            if (note->n_type == NT_GNU_BUILD_ID && note->n_namesz == 4 && memcmp(name, "GNU", 4) == 0) {
+                build_id.assign(desc, note->n_descsz);
+                return 1;
+            }
+            p = desc + ((note->n_descsz + 3) & ~3);
+        }
+    }
+    return 1;
+}
+
+const std::string& getObjectCacheBinaryId() {
+    static std::string binary_id;
+    if (!binary_id.empty())
+        return binary_id;
+
+    std::string build_id;
+    dl_iterate_phdr(findBuildId, &build_id);
+    if (build_id.empty()) {
+        // Fall back to something that at least changes whenever the binary gets rebuilt:
+        struct stat st;
+        RELEASE_ASSERT(stat("/proc/self/exe", &st) == 0, "");
+        build_id = std::to_string(st.st_size) + ' ' + std::to_string(st.st_mtime);
+    }
+
+    binary_id = getObjectCacheKey(build_id);
+    return binary_id;
+}
+
 static void handle_sigusr1(int signum) {
     assert(signum == SIGUSR1);
     fprintf(stderr, "SIGUSR1, printing stack trace\n");
     _printStacktrace();
 }
 
-static void handle_sigprof(int signum) {
-    sigprof_pending++;
-}
-
 static void handle_sigint(int signum) {
     assert(signum == SIGINT);
     // TODO: this should set a flag saying a KeyboardInterrupt is pending.
@@ -413,8 +402,10 @@ void initCodegen() {
     g.engine = eb.create(g.tm);
     assert(g.engine && "engine creation failed?");
 
-    if (ENABLE_JIT_OBJECT_CACHE)
-        g.engine->setObjectCache(new PystonObjectCache());
+    if (ENABLE_JIT_OBJECT_CACHE) {
+        object_cache = new PystonObjectCache();
+        g.engine->setObjectCache(object_cache);
+    }
 
     g.i1 = llvm::Type::getInt1Ty(g.context);
     g.i8 = llvm::Type::getInt8Ty(g.context);
@@ -448,6 +439,13 @@ void initCodegen() {
     g.jit_listeners.push_back(tracebacks_listener);
     g.engine->RegisterJITEventListener(tracebacks_listener);
 
+    if (PROFILE) {
+        initPerfJit();
+        llvm::JITEventListener* perf_listener = makePerfJITEventListener();
+        g.jit_listeners.push_back(perf_listener);
+        g.engine->RegisterJITEventListener(perf_listener);
+    }
+
     if (SHOW_DISASM) {
 #if LLVMREV < 216983
         llvm::JITEventListener* listener = new DisassemblerJITEventListener();
@@ -467,14 +465,6 @@ void initCodegen() {
     signal(SIGUSR1, &handle_sigusr1);
     signal(SIGINT, &handle_sigint);
 
-#if ENABLE_SAMPLING_PROFILER
-    struct itimerval prof_timer;
-    prof_timer.it_value.tv_sec = prof_timer.it_interval.tv_sec = 0;
-    prof_timer.it_value.tv_usec = prof_timer.it_interval.tv_usec = 1000;
-    signal(SIGPROF, handle_sigprof);
-    setitimer(ITIMER_PROF, &prof_timer, NULL);
-#endif
-
     // There are some parts of llvm that are only configurable through command line args,
     // so construct a fake argc/argv pair and pass it to the llvm command line machinery:
     std::vector<const char*> llvm_args = { "fake_name" };
@@ -508,6 +498,8 @@ void teardownCodegen() {
     }
     g.jit_listeners.clear();
     delete g.engine;
+
+    teardownPerfJit();
 }
 
 void printAllIR() {
@@ -522,6 +514,9 @@ int joinRuntime() {
     if (PROFILE)
         g.func_addr_registry.dumpPerfMap();
 
+    shutdownCompileThread();
+    writePendingParseCaches();
+
     teardownRuntime();
     teardownCodegen();
 
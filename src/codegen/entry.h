@@ -15,6 +15,10 @@
 #ifndef PYSTON_CODEGEN_ENTRY_H
 #define PYSTON_CODEGEN_ENTRY_H
 
+#include <string>
+
+#include "llvm/ADT/StringRef.h"
+
 namespace pyston {
 
 class AST_Module;
@@ -24,6 +28,16 @@ void initCodegen();
 void teardownCodegen();
 void printAllIR();
 int joinRuntime();
+
+// The JIT object cache is keyed on a fingerprint of everything that determines the code for a function, which irgen
+// computes without having to look at the IR.  getObjectCacheKey() turns that data into a key, and setObjectCacheKey()
+// sets the key for the next module that gets handed to the JIT; it returns whether there's a cached object for it.
+// An empty key means that the module shouldn't be cached.
+std::string getObjectCacheKey(llvm::StringRef data);
+bool setObjectCacheKey(const std::string& key);
+// Cached objects refer to the runtime by name and depend on its data layouts, so they can only be shared between
+// processes that run the same pyston binary; this identifies it (by its build id, if it has one).
+const std::string& getObjectCacheBinaryId();
 }
 
 #endif
@@ -19,6 +19,7 @@
 #include <set>
 #include <sstream>
 #include <stdint.h>
+#include <unordered_map>
 
 #include "llvm/Analysis/Passes.h"
 #include "llvm/IR/DIBuilder.h"
@@ -40,7 +41,9 @@
 #include "analysis/type_analysis.h"
 #include "codegen/codegen.h"
 #include "codegen/compvars.h"
+#include "codegen/entry.h"
 #include "codegen/gcbuilder.h"
+#include "codegen/irgen/hooks.h"
 #include "codegen/irgen/irgenerator.h"
 #include "codegen/irgen/util.h"
 #include "codegen/opt/escape_analysis.h"
@@ -48,11 +51,13 @@
 #include "codegen/opt/passes.h"
 #include "codegen/osrentry.h"
 #include "codegen/patchpoints.h"
+#include "codegen/serialize_ast.h"
 #include "codegen/stackmaps.h"
 #include "core/ast.h"
 #include "core/cfg.h"
 #include "core/options.h"
 #include "core/stats.h"
+#include "core/threading.h"
 #include "core/util.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
@@ -180,6 +185,15 @@ static void optimizeIR(llvm::Function* f, EffortLevel effort) {
         // fpm.add(llvm::createCFGSimplificationPass());
     }
 
+    // The passes only look at the IR (and at constant classes), so the background compile thread doesn't need to hold
+    // the GIL while they run.  It lets go of codegen_rwlock first, and takes it back after the GIL: under the GRWL,
+    // a thread holding the GIL could be waiting for codegen_rwlock, and we have to be able to get the GIL back.
+    std::unique_ptr<threading::GLAllowThreadsReadRegion> allow_threads;
+    if (isCompileThread()) {
+        codegen_rwlock.asWrite()->unlock();
+        allow_threads.reset(new threading::GLAllowThreadsReadRegion());
+    }
+
     fpm.doInitialization();
 
     for (int i = 0; i < MAX_OPT_ITERATIONS; i++) {
@@ -203,6 +217,11 @@ static void optimizeIR(llvm::Function* f, EffortLevel effort) {
         }
     }
 
+    if (allow_threads) {
+        allow_threads.reset();
+        codegen_rwlock.asWrite()->lock();
+    }
+
     long us = _t.end();
     static StatCounter us_optimizing("us_compiling_optimizing");
     us_optimizing.log(us);
@@ -935,9 +954,7 @@ static llvm::MDNode* setupDebugInfo(SourceInfo* source, llvm::Function* f, std::
     return func_info;
 }
 
-static std::string getUniqueFunctionName(std::string nameprefix, EffortLevel effort, const OSREntryDescriptor* entry) {
-    static int num_functions = 0;
-
+static std::string getFunctionName(std::string nameprefix, EffortLevel effort, const OSREntryDescriptor* entry) {
     std::ostringstream os;
     os << nameprefix;
     os << "_e" << (int)effort;
@@ -946,11 +963,86 @@ static std::string getUniqueFunctionName(std::string nameprefix, EffortLevel eff
         if (entry->cf->func)
             os << "_from_" << entry->cf->func->getName().data();
     }
-    os << '_' << num_functions;
+    return os.str();
+}
+
+static std::string getUniqueFunctionName(const std::string& function_name) {
+    static int num_functions = 0;
+
+    std::ostringstream os;
+    os << function_name << '_' << num_functions;
     num_functions++;
     return os.str();
 }
 
+// Objects in the cache refer to their function by name, so the name can't depend on the order in which this process
+// happened to compile things; instead, make it unique by using the object cache key.
+static std::string getCachedFunctionName(const std::string& function_name, std::string& key) {
+    // The same code can get compiled more than once (ex after its previous version got freed), so give each repeat
+    // a key of its own:
+    static std::unordered_map<std::string, int> times_compiled;
+    int n = times_compiled[key]++;
+    if (n)
+        key = getObjectCacheKey(key + '#' + std::to_string(n));
+
+    return function_name + '_' + key.substr(0, 16);
+}
+
+static std::string getModuleSourceKey(AST_Module* module) {
+    // Modules never get freed, so we only have to hash each one once:
+    static std::unordered_map<AST_Module*, std::string> module_keys;
+    auto it = module_keys.find(module);
+    if (it != module_keys.end())
+        return it->second;
+
+    std::string key = getObjectCacheKey(serializeAST(module, "key "));
+    module_keys[module] = key;
+    return key;
+}
+
+// The object cache key for a function is computed from everything that determines the code we generate for it, rather
+// than from the IR itself: the source of its module, which function it is, its signature and effort level, the options
+// that affect codegen, and what irgen recorded in the code fingerprint (embedded constants, speculations).  This means
+// a cache hit doesn't have to serialize the IR to find out that it's a hit, and can skip optimizing it.
+// Nothing that depends on the layout of this particular process goes into the key: pointers to runtime objects are
+// relocatable symbols that get resolved when the object is loaded, so the cache can be shared between processes.
+// Returns an empty key if the function can't be cached, ie if it comes from an exec or eval string.
+static std::string computeObjectCacheKey(SourceInfo* source, const OSREntryDescriptor* entry_descriptor,
+                                         EffortLevel effort, FunctionSpecialization* spec, const std::string& name) {
+    AST_Module* module = source->scoping->getModuleAST();
+    if (!module)
+        return "";
+
+    std::string data;
+    llvm::raw_string_ostream os(data);
+    os << "v4 " << getObjectCacheBinaryId() << '\n';
+    os << getModuleSourceKey(module) << ' ' << source->fn << '\n';
+    os << name << ' ' << source->ast->lineno << ':' << source->ast->col_offset << '\n';
+    os << (int)effort << '\n';
+    if (spec) {
+        for (auto type : spec->arg_types)
+            os << type->debugName() << ',';
+        os << "-> " << spec->rtn_type->debugName() << '\n';
+    } else {
+        os << "osr " << entry_descriptor->backedge->target->idx << ": ";
+        for (const auto& p : entry_descriptor->args)
+            os << p.first.str() << ' ' << p.second->debugName() << ',';
+        os << '\n';
+    }
+
+    // The options that change what code gets generated:
+    os << ENABLE_ICS << ENABLE_ICGENERICS << ENABLE_ICGETITEMS << ENABLE_ICSETITEMS << ENABLE_ICDELITEMS
+       << ENABLE_ICCALLSITES << ENABLE_ICSETATTRS << ENABLE_ICGETATTRS << ENABLE_ICGETGLOBALS << ENABLE_ICBINEXPS
+       << ENABLE_ICNONZEROS << ENABLE_SPECULATION << ENABLE_OSR << ENABLE_REOPT << ENABLE_LLVMOPTS << ENABLE_INLINING
+       << ENABLE_DIRECT_CALLS << ENABLE_PYSTON_PASSES << ENABLE_FRAME_INTROSPECTION << BOOLS_AS_I64
+       << ENABLE_CAPI_EXCEPTIONS << ' ' << OSR_THRESHOLD_BASELINE << ' ' << REOPT_THRESHOLD_BASELINE << ' '
+       << OSR_THRESHOLD_T2 << ' ' << REOPT_THRESHOLD_T2 << '\n';
+
+    os.flush();
+    data += getCodeFingerprint();
+    return getObjectCacheKey(data);
+}
+
 CompiledFunction* doCompile(SourceInfo* source, ParamNames* param_names, const OSREntryDescriptor* entry_descriptor,
                             EffortLevel effort, FunctionSpecialization* spec, std::string nameprefix) {
     Timer _t("in doCompile");
@@ -965,8 +1057,10 @@ CompiledFunction* doCompile(SourceInfo* source, ParamNames* param_names, const O
     assert(g.cur_module == NULL);
 
     clearRelocatableSymsMap();
+    clearCodeFingerprint();
 
-    std::string name = getUniqueFunctionName(nameprefix, effort, entry_descriptor);
+    std::string function_name = getFunctionName(nameprefix, effort, entry_descriptor);
+    std::string name = getUniqueFunctionName(function_name);
     g.cur_module = new llvm::Module(name, g.context);
 #if LLVMREV < 217070 // not sure if this is the right rev
     g.cur_module->setDataLayout(g.tm->getDataLayout()->getStringRepresentation());
@@ -1091,9 +1185,29 @@ CompiledFunction* doCompile(SourceInfo* source, ParamNames* param_names, const O
     static StatCounter us_irgen("us_compiling_irgen");
     us_irgen.log(irgen_us);
 
-    if (ENABLE_LLVMOPTS)
+    // If the object cache already has the code for this function, the IR only matters for the metadata that irgen
+    // produced along the way (patchpoints, relocatable constants), so there's no point in optimizing it.
+    bool in_object_cache = false;
+    if (ENABLE_JIT_OBJECT_CACHE) {
+        std::string key = computeObjectCacheKey(source, entry_descriptor, effort, spec, function_name);
+        if (!key.empty())
+            f->setName(getCachedFunctionName(function_name, key));
+        in_object_cache = setObjectCacheKey(key);
+
+        static StatCounter us_key("us_compiling_objectcache_key");
+        us_key.log(_t2.split());
+    }
+
+    if (ENABLE_LLVMOPTS && !in_object_cache)
         optimizeIR(f, effort);
 
+    if (ENABLE_JIT_OBJECT_CACHE && !in_object_cache && !makeAbsoluteAddressesRelocatable(f)) {
+        // Some address in the code is only valid in this process, so other processes must not load it:
+        static StatCounter num_uncacheable("num_jit_objectcache_uncacheable");
+        num_uncacheable.log();
+        setObjectCacheKey("");
+    }
+
     g.cur_module = NULL;
 
     return cf;
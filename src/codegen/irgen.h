@@ -33,10 +33,15 @@ struct UnwindInfo {
 public:
     AST_stmt* current_stmt;
     llvm::BasicBlock* exc_dest;
+    // If set, operations that have a C API (return-code) version can call that instead, and branch here
+    // when it signals an exception.  See IREmitter::checkAndPropagateCAPIException.
+    llvm::BasicBlock* capi_exc_dest;
 
     bool needsInvoke() { return exc_dest != NULL; }
+    bool hasCAPIExcDest() const { return capi_exc_dest != NULL; }
 
-    UnwindInfo(AST_stmt* current_stmt, llvm::BasicBlock* exc_dest) : current_stmt(current_stmt), exc_dest(exc_dest) {}
+    UnwindInfo(AST_stmt* current_stmt, llvm::BasicBlock* exc_dest, llvm::BasicBlock* capi_exc_dest = NULL)
+        : current_stmt(current_stmt), exc_dest(exc_dest), capi_exc_dest(capi_exc_dest) {}
 
     // Risky!  This means that we can't unwind from this location, and should be used in the
     // rare case that there are language-specific reasons that the statement should not unwind
@@ -88,6 +93,8 @@ public:
                                      llvm::Value* arg3) = 0;
     virtual llvm::Value* createIC(const ICSetupInfo* pp, void* func_addr, const std::vector<llvm::Value*>& args,
                                   UnwindInfo unw_info) = 0;
+    // Branches to unw_info.capi_exc_dest if returned_val (the result of a C API-style call) is NULL.
+    virtual void checkAndPropagateCAPIException(UnwindInfo unw_info, llvm::Value* returned_val) = 0;
 };
 
 extern const std::string CREATED_CLOSURE_NAME;
@@ -14,6 +14,12 @@
 
 #include "codegen/irgen/hooks.h"
 
+#include <algorithm>
+#include <deque>
+#include <pthread.h>
+#include <time.h>
+#include <unordered_set>
+
 #include "llvm/ExecutionEngine/ExecutionEngine.h"
 #include "llvm/Support/raw_ostream.h"
 
@@ -26,16 +32,20 @@
 #include "codegen/irgen.h"
 #include "codegen/irgen/future.h"
 #include "codegen/irgen/util.h"
+#include "codegen/memmgr.h"
 #include "codegen/osrentry.h"
 #include "codegen/parser.h"
 #include "codegen/patchpoints.h"
+#include "codegen/profiling/perf_jit.h"
 #include "codegen/stackmaps.h"
+#include "codegen/template_jit.h"
 #include "codegen/unwinding.h"
 #include "core/ast.h"
 #include "core/cfg.h"
 #include "core/common.h"
 #include "core/options.h"
 #include "core/stats.h"
+#include "core/threading.h"
 #include "core/types.h"
 #include "core/util.h"
 #include "runtime/capi.h"
@@ -131,6 +141,44 @@ EffortLevel initialEffort() {
     return EffortLevel::MINIMAL;
 }
 
+// All compiles go through the LLVM state in `g`, so only one of them can be in progress at a time.  The GIL isn't
+// enough to guarantee that, since the background compile thread (see below) gives up the GIL while it runs the
+// optimization passes.  The lock is recursive so that the compile thread can hold it across compileFunction().
+//
+// Compiles happen with codegen_rwlock held for writing, so the lock order is codegen_rwlock, then the LLVM lock,
+// except that the compile thread lets go of codegen_rwlock (and the GIL) while the passes run.
+static pthread_mutex_t llvm_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+
+static void acquireLLVMLock(bool holding_codegen_rwlock) {
+    if (pthread_mutex_trylock(&llvm_lock) == 0)
+        return;
+
+    // Whoever has the lock might be waiting for the GIL or for codegen_rwlock, so we have to give those up while we
+    // wait:
+    static StatCounter num_llvm_lock_waits("num_llvm_lock_waits");
+    num_llvm_lock_waits.log();
+
+    if (holding_codegen_rwlock)
+        codegen_rwlock.asWrite()->unlock();
+    {
+        threading::GLAllowThreadsReadRegion _allow;
+        pthread_mutex_lock(&llvm_lock);
+    }
+    if (holding_codegen_rwlock)
+        codegen_rwlock.asWrite()->lock();
+}
+
+static void releaseLLVMLock() {
+    pthread_mutex_unlock(&llvm_lock);
+}
+
+// For compiles, which hold codegen_rwlock:
+class LLVMLockRegion {
+public:
+    LLVMLockRegion() { acquireLLVMLock(true); }
+    ~LLVMLockRegion() { releaseLLVMLock(); }
+};
+
 static void compileIR(CompiledFunction* cf, EffortLevel effort) {
     assert(cf);
     assert(cf->func);
@@ -172,14 +220,38 @@ static void compileIR(CompiledFunction* cf, EffortLevel effort) {
     delete stackmap;
 }
 
-// Compiles a new version of the function with the given signature and adds it to the list;
-// should only be called after checking to see if the other versions would work.
-// The codegen_lock needs to be held in W mode before calling this function:
-CompiledFunction* compileFunction(CLFunction* f, FunctionSpecialization* spec, EffortLevel effort,
-                                  const OSREntryDescriptor* entry_descriptor) {
+CompiledFunction::~CompiledFunction() {
+    for (ICInfo* ic : ics) {
+        deregisterCompiledPatchpoint(ic);
+        delete ic;
+    }
+    delete location_map;
+
+    if (func) {
+        deregisterCompiledFunction(this);
+        g.func_addr_registry.deregisterFunction(code);
+        deregisterPerfJitCode(code);
+        freeJitMemory(this);
+
+        llvm::Module* module = func->getParent();
+        if (g.engine->removeModule(module))
+            delete module;
+    }
+}
+
+static void freeDeadCompiledFunctions();
+
+// queued_us is how long the compile spent waiting for the background compile thread; it gets counted towards the
+// per-effort compile times.
+// Has to be called with codegen_rwlock held for writing.
+static CompiledFunction* _compileFunction(CLFunction* f, FunctionSpecialization* spec, EffortLevel effort,
+                                          const OSREntryDescriptor* entry_descriptor, long queued_us) {
     STAT_TIMER(t0, "us_timer_compileFunction");
+    LLVMLockRegion _llvm_lock;
     Timer _t("for compileFunction()", 1000);
 
+    freeDeadCompiledFunctions();
+
     assert((entry_descriptor != NULL) + (spec != NULL) == 1);
 
     SourceInfo* source = f->source.get();
@@ -263,6 +335,7 @@ CompiledFunction* compileFunction(CLFunction* f, FunctionSpecialization* spec, E
     static StatCounter num_compiles("num_compiles");
     num_compiles.log();
 
+    us += queued_us;
     switch (effort) {
         case EffortLevel::INTERPRETED: {
             static StatCounter us_compiling("us_compiling_0_interpreted");
@@ -299,6 +372,485 @@ CompiledFunction* compileFunction(CLFunction* f, FunctionSpecialization* spec, E
     return cf;
 }
 
+// Compiles a new version of the function with the given signature and adds it to the list;
+// should only be called after checking to see if the other versions would work.
+// The codegen_lock needs to be held in W mode before calling this function:
+CompiledFunction* compileFunction(CLFunction* f, FunctionSpecialization* spec, EffortLevel effort,
+                                  const OSREntryDescriptor* entry_descriptor) {
+    return _compileFunction(f, spec, effort, entry_descriptor, 0);
+}
+
+// Background compilation:
+//
+// Compiling at the maximal effort level runs the full set of LLVM optimizations, which can easily take long enough to
+// be a noticeable pause.  So instead of doing those compiles on whichever thread noticed that a function got hot, we
+// hand them to a dedicated thread and keep running the current version in the meantime.  The compile thread holds
+// the GIL while it generates the IR and when it installs the new version, but releases it while the optimization
+// passes run, which is where most of the time goes.
+struct CompileJob {
+    CLFunction* clfunc;
+    // Exactly one of these is set: the version we're reoptimizing, or the OSR entry we're compiling.
+    CompiledFunction* reopt_cf;
+    const OSREntryDescriptor* osr_entry;
+    EffortLevel effort;
+    uint64_t queued_at_us;
+};
+
+static pthread_mutex_t compile_queue_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t compile_queue_cond = PTHREAD_COND_INITIALIZER;
+static std::deque<CompileJob> compile_queue;
+static bool compile_thread_started = false, compile_thread_stopping = false;
+static __thread bool is_compile_thread = false;
+// The reopt_cf / osr_entry of every job that hasn't been installed yet.  Only accessed while holding the GIL.
+static std::unordered_set<const void*> pending_compiles;
+
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
+
+bool isCompileThread() {
+    return is_compile_thread;
+}
+
+static bool shouldCompileInBackground(EffortLevel effort) {
+    // Only the maximal effort level runs the optimization passes, which is both the slow part and the part that can
+    // run without the GIL.  The lower levels are quick enough that queueing them wouldn't be worth it.
+    return ENABLE_BACKGROUND_COMPILE && effort == EffortLevel::MAXIMAL && !is_compile_thread
+           && !compile_thread_stopping;
+}
+
+static void retireCompiledFunction(CompiledFunction* cf);
+
+static void runCompileJob(const CompileJob& job) {
+    static StatCounter us_compiling_queued("us_compiling_queued");
+    long queued_us = monotonicUs() - job.queued_at_us;
+    us_compiling_queued.log(queued_us);
+
+    if (job.reopt_cf) {
+        CompiledFunction* cf = job.reopt_cf;
+        FunctionList& versions = job.clfunc->versions;
+
+        // The version might have gotten killed for failing its speculations while it was waiting:
+        if (std::find(versions.begin(), versions.end(), cf) == versions.end()) {
+            static StatCounter num_dropped("num_background_compiles_dropped");
+            num_dropped.log();
+            return;
+        }
+
+        // This adds the new version to the back of the version list; the old one stays usable until it's done.
+        _compileFunction(job.clfunc, cf->spec, job.effort, NULL, queued_us);
+
+        auto it = std::find(versions.begin(), versions.end(), cf);
+        if (it != versions.end()) {
+            versions.erase(it);
+            cf->dependent_callsites.invalidateAll();
+            retireCompiledFunction(cf);
+        }
+
+        static StatCounter stat_reopt("reopts");
+        stat_reopt.log();
+    } else {
+        if (job.clfunc->osr_versions[job.osr_entry] == NULL) {
+            _compileFunction(job.clfunc, NULL, job.effort, job.osr_entry, queued_us);
+
+            static StatCounter stat_osr_compiles("num_osr_compiles");
+            stat_osr_compiles.log();
+        }
+        assert(job.clfunc->osr_versions[job.osr_entry]);
+    }
+
+    static StatCounter num_background_compiles("num_background_compiles");
+    num_background_compiles.log();
+}
+
+static void* compileThreadMain(void*) {
+    is_compile_thread = true;
+
+    // This isn't a Python-level thread, but it allocates while it generates IR, so the GC needs to know about it:
+    threading::registerRuntimeThread();
+    threading::GLReadRegion _glock;
+
+    // We only hold the GIL while working on a job.
+    while (true) {
+        CompileJob job;
+        {
+            threading::GLAllowThreadsReadRegion _allow;
+
+            pthread_mutex_lock(&compile_queue_lock);
+            while (compile_queue.empty() && !compile_thread_stopping)
+                pthread_cond_wait(&compile_queue_cond, &compile_queue_lock);
+
+            if (compile_thread_stopping) {
+                pthread_mutex_unlock(&compile_queue_lock);
+                break;
+            }
+
+            job = compile_queue.front();
+            compile_queue.pop_front();
+            pthread_mutex_unlock(&compile_queue_lock);
+        }
+
+        LOCK_REGION(codegen_rwlock.asWrite());
+        runCompileJob(job);
+        pending_compiles.erase(job.reopt_cf ? (const void*)job.reopt_cf : (const void*)job.osr_entry);
+    }
+
+    threading::unregisterRuntimeThread();
+    return NULL;
+}
+
+static void forkPrepare() {
+    // Don't fork in the middle of a compile, since the child wouldn't be able to finish it:
+    acquireLLVMLock(false);
+}
+
+static void forkParent() {
+    releaseLLVMLock();
+}
+
+static void forkChild() {
+    // The compile thread doesn't exist in the child; reset everything so that we start a new one if we need it.
+    pthread_mutex_t fresh_llvm_lock = PTHREAD_RECURSIVE_MUTEX_INITIALIZER_NP;
+    llvm_lock = fresh_llvm_lock;
+    pthread_mutex_init(&compile_queue_lock, NULL);
+    pthread_cond_init(&compile_queue_cond, NULL);
+    compile_queue.clear();
+    pending_compiles.clear();
+    compile_thread_started = false;
+}
+
+static void queueCompile(CLFunction* clfunc, CompiledFunction* reopt_cf, const OSREntryDescriptor* osr_entry,
+                         EffortLevel effort) {
+    assert((reopt_cf != NULL) + (osr_entry != NULL) == 1);
+
+    const void* key = reopt_cf ? (const void*)reopt_cf : (const void*)osr_entry;
+    if (pending_compiles.count(key))
+        return;
+
+    if (!compile_thread_started) {
+        compile_thread_started = true;
+        static bool registered_atfork = false;
+        if (!registered_atfork) {
+            pthread_atfork(forkPrepare, forkParent, forkChild);
+            registered_atfork = true;
+        }
+        pthread_t thread_id;
+        int code = pthread_create(&thread_id, NULL, &compileThreadMain, NULL);
+        RELEASE_ASSERT(code == 0, "");
+        pthread_detach(thread_id);
+    }
+
+    static StatCounter num_queued("num_background_compiles_queued");
+    num_queued.log();
+
+    pending_compiles.insert(key);
+
+    pthread_mutex_lock(&compile_queue_lock);
+    compile_queue.push_back(CompileJob({.clfunc = clfunc,
+                                        .reopt_cf = reopt_cf,
+                                        .osr_entry = osr_entry,
+                                        .effort = effort,
+                                        .queued_at_us = monotonicUs() }));
+    pthread_cond_signal(&compile_queue_cond);
+    pthread_mutex_unlock(&compile_queue_lock);
+}
+
+void shutdownCompileThread() {
+    if (!compile_thread_started)
+        return;
+
+    pthread_mutex_lock(&compile_queue_lock);
+    compile_thread_stopping = true;
+    compile_queue.clear();
+    pthread_cond_signal(&compile_queue_cond);
+    pthread_mutex_unlock(&compile_queue_lock);
+
+    // Wait for any compile that's in progress, and keep the lock so that the compile thread can't touch the LLVM
+    // state while it gets torn down:
+    acquireLLVMLock(false);
+}
+
+// Reclaiming old versions:
+//
+// Once a version has been superseded (reoptimized, or killed for failing its speculations), nothing new can start
+// running it.  The ICs that call it depend on its dependent_callsites, which get invalidated when it gets retired
+// (and versions whose address got baked into other code are pinned, and never retired), so what can still be using
+// it are frames that are in the middle of it:
+// - Interpreter frames count themselves in num_interpreter_frames, wherever they live.
+// - Compiled frames have a return address into the code on some thread or generator stack.  During full
+//   collections, the collector passes every word of those stacks (and of the saved registers) to
+//   noteRetiredCodePointer().  That also catches code that is about to call a version it has a pointer to.
+// A retired version that isn't in use, and none of whose osr versions are, is dead.  Dead versions get freed at the
+// beginning of the next compile, since that's when we hold the LLVM lock.
+//
+// Once a CLFunction can't get called any more (an exec or eval string, or a module's top level, that finished
+// running), it gets retired, and freed along with its last version.  That orphans the CLFunctions of the scopes
+// defined in it, since nothing can make new function objects for them any more; the function objects get passed to
+// noteCLFunctionReference() during full collections, and an orphan that none of them refer to gets retired too.
+//
+// These are only accessed while holding the GIL.
+static std::vector<CompiledFunction*> retired_cfs;
+static std::vector<CompiledFunction*> dead_cfs;
+// CLFunctions that can't get called any more; they get freed once all of their versions have been.
+static std::vector<CLFunction*> retired_clfunctions;
+// CLFunctions whose parent scope has been freed, and the ones of those that no function object referred to during
+// the last full collection:
+static std::vector<CLFunction*> orphaned_clfunctions;
+static std::vector<CLFunction*> unreferenced_clfunctions;
+
+static bool canRetire(CompiledFunction* cf) {
+    // A pinned version might still get called from other code, and the always_use_version gets called directly.
+    return !cf->pinned && cf != cf->clfunc->always_use_version;
+}
+
+// The cf should have just been removed from its CLFunction's version list and had its dependents invalidated.
+static void retireCompiledFunction(CompiledFunction* cf) {
+    assert(std::find(cf->clfunc->versions.begin(), cf->clfunc->versions.end(), cf) == cf->clfunc->versions.end());
+
+    if (!canRetire(cf))
+        return;
+
+    static StatCounter num_retired("num_compiled_functions_retired");
+    num_retired.log();
+    retired_cfs.push_back(cf);
+}
+
+// Called once the given CLFunction can't get called again, such as the code for an exec or eval string that has
+// finished running.  Needs codegen_rwlock to be held.
+static void _retireCLFunction(CLFunction* cl) {
+    // Whoever asked for the code object could run it again:
+    if (cl->code_obj)
+        return;
+
+    for (CompiledFunction* cf : cl->versions) {
+        if (!canRetire(cf))
+            return;
+    }
+
+    FunctionList versions;
+    versions.swap(cl->versions);
+    for (CompiledFunction* cf : versions) {
+        cf->dependent_callsites.invalidateAll();
+        retireCompiledFunction(cf);
+    }
+    retired_clfunctions.push_back(cl);
+}
+
+static void retireCLFunction(CLFunction* cl) {
+    LOCK_REGION(codegen_rwlock.asWrite());
+    _retireCLFunction(cl);
+}
+
+bool safepoint_frame_info = false;
+
+void enableSafepointFrameInfo() {
+    LOCK_REGION(codegen_rwlock.asWrite());
+    if (safepoint_frame_info)
+        return;
+    safepoint_frame_info = true;
+
+    static StatCounter num_retired("num_versions_retired_for_safepoint_frame_info");
+    for (CompiledFunction* cf : getRegisteredCompiledFunctions()) {
+        CLFunction* cl = cf->clfunc;
+        if (cf == cl->always_use_version)
+            continue;
+
+        if (cf->entry_descriptor) {
+            auto it = cl->osr_versions.find(cf->entry_descriptor);
+            if (it == cl->osr_versions.end() || it->second != cf)
+                continue;
+            cl->osr_versions.erase(it);
+        } else {
+            auto it = std::find(cl->versions.begin(), cl->versions.end(), cf);
+            if (it == cl->versions.end())
+                continue;
+            cl->versions.erase(it);
+        }
+        cf->dependent_callsites.invalidateAll();
+        retireCompiledFunction(cf);
+        num_retired.log();
+    }
+}
+
+namespace {
+struct RetiredRange {
+    // Inclusive on both ends, since a call at the very end of a function has the end as its return address.
+    uintptr_t start, end;
+    int idx; // into retired_cfs
+};
+}
+static std::vector<RetiredRange> retired_ranges;
+// Set by the mark threads without any synchronization; they only ever store 1, so racing each other is harmless.
+static std::vector<char> retired_seen;
+static uintptr_t retired_min_addr, retired_max_addr;
+// The orphaned_clfunctions, sorted, and whether each one has been seen (same deal as retired_seen):
+static std::vector<CLFunction*> scanned_orphans;
+static std::vector<char> orphan_seen;
+
+static void addRetiredRanges(CompiledFunction* cf, int idx) {
+    retired_ranges.push_back(RetiredRange{ (uintptr_t)cf, (uintptr_t)cf + sizeof(CompiledFunction), idx });
+    if (!cf->is_interpreted)
+        retired_ranges.push_back(RetiredRange{ cf->code_start, cf->code_start + cf->code_size, idx });
+
+    for (auto& p : cf->clfunc->osr_versions) {
+        if (p.first->cf == cf && p.second)
+            addRetiredRanges(p.second, idx);
+    }
+}
+
+bool startRetiredCodeScan() {
+    retired_ranges.clear();
+    scanned_orphans.clear();
+    if (retired_cfs.empty() && orphaned_clfunctions.empty())
+        return false;
+
+    for (int i = 0; i < retired_cfs.size(); i++)
+        addRetiredRanges(retired_cfs[i], i);
+
+    std::sort(retired_ranges.begin(), retired_ranges.end(),
+              [](const RetiredRange& lhs, const RetiredRange& rhs) { return lhs.start < rhs.start; });
+    retired_seen.assign(retired_cfs.size(), 0);
+
+    retired_min_addr = UINTPTR_MAX;
+    retired_max_addr = 0;
+    for (const RetiredRange& r : retired_ranges) {
+        retired_min_addr = std::min(retired_min_addr, r.start);
+        retired_max_addr = std::max(retired_max_addr, r.end);
+    }
+
+    scanned_orphans = orphaned_clfunctions;
+    std::sort(scanned_orphans.begin(), scanned_orphans.end());
+    orphan_seen.assign(scanned_orphans.size(), 0);
+    return true;
+}
+
+void noteRetiredCodePointer(void* p) {
+    uintptr_t addr = (uintptr_t)p;
+    if (addr < retired_min_addr || addr > retired_max_addr)
+        return;
+
+    auto it = std::upper_bound(retired_ranges.begin(), retired_ranges.end(), addr,
+                               [](uintptr_t addr, const RetiredRange& r) { return addr < r.start; });
+    if (it == retired_ranges.begin())
+        return;
+    --it;
+    if (addr <= it->end)
+        retired_seen[it->idx] = 1;
+}
+
+void noteCLFunctionReference(CLFunction* cl) {
+    if (scanned_orphans.empty())
+        return;
+
+    auto it = std::lower_bound(scanned_orphans.begin(), scanned_orphans.end(), cl);
+    if (it != scanned_orphans.end() && *it == cl)
+        orphan_seen[it - scanned_orphans.begin()] = 1;
+}
+
+void finishRetiredCodeScan() {
+    std::vector<CompiledFunction*> still_retired;
+    for (int i = 0; i < retired_cfs.size(); i++) {
+        if (retired_seen[i] || retired_cfs[i]->num_interpreter_frames)
+            still_retired.push_back(retired_cfs[i]);
+        else
+            dead_cfs.push_back(retired_cfs[i]);
+    }
+    retired_cfs.swap(still_retired);
+    retired_ranges.clear();
+
+    // The collection happens with the GIL held, so nothing has been added to orphaned_clfunctions since the start.
+    orphaned_clfunctions.clear();
+    for (int i = 0; i < scanned_orphans.size(); i++) {
+        if (orphan_seen[i])
+            orphaned_clfunctions.push_back(scanned_orphans[i]);
+        else
+            unreferenced_clfunctions.push_back(scanned_orphans[i]);
+    }
+    scanned_orphans.clear();
+}
+
+static bool hasPendingCompile(CompiledFunction* cf) {
+    if (pending_compiles.count(cf))
+        return true;
+    for (auto& p : cf->clfunc->osr_versions) {
+        if (p.first->cf != cf)
+            continue;
+        if (pending_compiles.count(p.first) || (p.second && hasPendingCompile(p.second)))
+            return true;
+    }
+    return false;
+}
+
+static void freeCompiledFunction(CompiledFunction* cf) {
+    CLFunction* cl = cf->clfunc;
+    std::vector<std::pair<const OSREntryDescriptor*, CompiledFunction*>> osr_entries;
+    for (auto& p : cl->osr_versions) {
+        if (p.first->cf == cf)
+            osr_entries.push_back(p);
+    }
+
+    for (auto& p : osr_entries) {
+        cl->osr_versions.erase(p.first);
+        if (p.second)
+            freeCompiledFunction(p.second);
+        delete p.first;
+    }
+
+    static StatCounter num_freed("num_compiled_functions_freed");
+    num_freed.log();
+    delete cf;
+}
+
+// Needs to be called with the LLVM lock held, since freeing a version removes its module from the execution engine,
+// and with codegen_rwlock held.
+static void freeDeadCompiledFunctions() {
+    if (dead_cfs.empty() && unreferenced_clfunctions.empty())
+        return;
+
+    // Nothing can call these any more, so they can go the same way as a finished exec string:
+    for (CLFunction* cl : unreferenced_clfunctions)
+        _retireCLFunction(cl);
+    unreferenced_clfunctions.clear();
+
+    std::vector<CompiledFunction*> still_dead;
+    for (CompiledFunction* cf : dead_cfs) {
+        // The background thread might still be reoptimizing it, or compiling one of its osr entries:
+        if (hasPendingCompile(cf)) {
+            still_dead.push_back(cf);
+            continue;
+        }
+        freeCompiledFunction(cf);
+    }
+    dead_cfs.swap(still_dead);
+
+    for (auto it = retired_clfunctions.begin(); it != retired_clfunctions.end();) {
+        CLFunction* cl = *it;
+        auto belongs_to_cl = [cl](CompiledFunction* cf) { return cf->clfunc == cl; };
+        if (std::any_of(retired_cfs.begin(), retired_cfs.end(), belongs_to_cl)
+            || std::any_of(dead_cfs.begin(), dead_cfs.end(), belongs_to_cl)) {
+            ++it;
+            continue;
+        }
+
+        if (cl->source) {
+            for (auto& p : cl->source->nested_functions)
+                orphaned_clfunctions.push_back(p.second);
+
+            if (cl->source->cfg) {
+                freeTemplateJitCode(cl->source->cfg);
+                freeCFG(cl->source.get());
+            }
+        }
+
+        static StatCounter num_clfunctions_freed("num_clfunctions_freed");
+        num_clfunctions_freed.log();
+        delete cl;
+        it = retired_clfunctions.erase(it);
+    }
+}
+
 void compileAndRunModule(AST_Module* m, BoxedModule* bm) {
     CompiledFunction* cf;
 
@@ -328,13 +880,20 @@ void compileAndRunModule(AST_Module* m, BoxedModule* bm) {
         assert(cf->clfunc->versions.size());
     }
 
-    if (cf->is_interpreted) {
-        STAT_TIMER(t0, "us_timer_interpreted_module_toplevel");
-        astInterpretFunction(cf, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
-    } else {
-        STAT_TIMER(t1, "us_timer_jitted_module_toplevel");
-        ((void (*)())cf->code)();
+    try {
+        if (cf->is_interpreted) {
+            STAT_TIMER(t0, "us_timer_interpreted_module_toplevel");
+            astInterpretFunction(cf, 0, NULL, NULL, NULL, NULL, NULL, NULL, NULL);
+        } else {
+            STAT_TIMER(t1, "us_timer_jitted_module_toplevel");
+            ((void (*)())cf->code)();
+        }
+    } catch (ExcInfo e) {
+        retireCLFunction(cf->clfunc);
+        throw e;
     }
+    // The top level only ever runs once:
+    retireCLFunction(cf->clfunc);
 }
 
 Box* evalOrExec(CLFunction* cl, Box* globals, Box* boxedLocals) {
@@ -354,12 +913,29 @@ Box* evalOrExec(CLFunction* cl, Box* globals, Box* boxedLocals) {
     if (doc_string != None)
         setGlobal(boxedLocals, "__doc__", doc_string);
 
-    CompiledFunction* cf = compileFunction(cl, new FunctionSpecialization(VOID), effort, NULL);
+    CompiledFunction* cf;
+    {
+        LOCK_REGION(codegen_rwlock.asWrite());
+        cf = compileFunction(cl, new FunctionSpecialization(VOID), effort, NULL);
+    }
     assert(cf->clfunc->versions.size());
 
     return astInterpretFunctionEval(cf, globals, boxedLocals);
 }
 
+// Runs the code for an exec or eval string, which nothing else can get a hold of, so we can free it afterwards.
+static Box* evalOrExecString(CLFunction* cl, Box* globals, Box* boxedLocals) {
+    Box* r;
+    try {
+        r = evalOrExec(cl, globals, boxedLocals);
+    } catch (ExcInfo e) {
+        retireCLFunction(cl);
+        throw e;
+    }
+    retireCLFunction(cl);
+    return r;
+}
+
 CLFunction* compileForEvalOrExec(AST* source, std::vector<AST_stmt*> body, std::string fn) {
     LOCK_REGION(codegen_rwlock.asWrite());
 
@@ -560,6 +1136,7 @@ Box* eval(Box* boxedCode, Box* globals, Box* locals) {
     if (boxedCode->cls == str_cls) {
         AST_Expression* parsed = parseEval(static_cast<BoxedString*>(boxedCode)->s());
         cl = compileEval(parsed, "<string>");
+        return evalOrExecString(cl, globals, locals);
     } else if (boxedCode->cls == code_cls) {
         cl = clfunctionFromCode(boxedCode);
     } else {
@@ -627,6 +1204,7 @@ Box* exec(Box* boxedCode, Box* globals, Box* locals) {
     if (boxedCode->cls == str_cls) {
         AST_Suite* parsed = parseExec(static_cast<BoxedString*>(boxedCode)->s());
         cl = compileExec(parsed, "<string>");
+        return evalOrExecString(cl, globals, locals);
     } else if (boxedCode->cls == code_cls) {
         cl = clfunctionFromCode(boxedCode);
     } else {
@@ -677,6 +1255,7 @@ void CompiledFunction::speculationFailed() {
             if (clfunc->versions[i] == this) {
                 clfunc->versions.erase(clfunc->versions.begin() + i);
                 this->dependent_callsites.invalidateAll();
+                retireCompiledFunction(this);
                 found = true;
                 break;
             }
@@ -724,6 +1303,7 @@ static CompiledFunction* _doReopt(CompiledFunction* cf, EffortLevel new_effort)
                                   NULL); // this pushes the new CompiledVersion to the back of the version list
 
             cf->dependent_callsites.invalidateAll();
+            retireCompiledFunction(cf);
 
             return new_cf;
         }
@@ -739,40 +1319,52 @@ static CompiledFunction* _doReopt(CompiledFunction* cf, EffortLevel new_effort)
 
 static StatCounter stat_osrexits("num_osr_exits");
 static StatCounter stat_osr_compiles("num_osr_compiles");
+// Returns NULL if the compile got queued for the background thread; the caller should keep running the current
+// version in that case.
 CompiledFunction* compilePartialFuncInternal(OSRExit* exit) {
     LOCK_REGION(codegen_rwlock.asWrite());
 
     assert(exit);
     assert(exit->parent_cf);
-    assert(exit->parent_cf->effort < EffortLevel::MAXIMAL);
-    stat_osrexits.log();
+    // Compiled code at the MAXIMAL level doesn't OSR, but an interpreter frame can be running a MAXIMAL version of the
+    // function (after a deopt, or in a stackless generator), and that gets compiled at MAXIMAL again.
+    assert(exit->parent_cf->effort < EffortLevel::MAXIMAL || exit->entry->from_interpreter);
 
     // if (VERBOSITY("irgen") >= 1) printf("In compilePartialFunc, handling %p\n", exit);
 
-    assert(exit->parent_cf->clfunc);
-    CompiledFunction*& new_cf = exit->parent_cf->clfunc->osr_versions[exit->entry];
+    CLFunction* clfunc = exit->parent_cf->clfunc;
+    assert(clfunc);
+    CompiledFunction* new_cf = clfunc->osr_versions[exit->entry];
     if (new_cf == NULL) {
         EffortLevel new_effort = exit->parent_cf->effort == EffortLevel::INTERPRETED ? EffortLevel::MINIMAL
                                                                                      : EffortLevel::MAXIMAL;
-        CompiledFunction* compiled = compileFunction(exit->parent_cf->clfunc, NULL, new_effort, exit->entry);
-        assert(compiled == new_cf);
+        if (shouldCompileInBackground(new_effort)) {
+            queueCompile(clfunc, NULL, exit->entry, new_effort);
+            return NULL;
+        }
+
+        new_cf = compileFunction(clfunc, NULL, new_effort, exit->entry);
+        assert(new_cf == clfunc->osr_versions[exit->entry]);
 
         stat_osr_compiles.log();
     }
 
+    stat_osrexits.log();
     return new_cf;
 }
 
 void* compilePartialFunc(OSRExit* exit) {
-    return compilePartialFuncInternal(exit)->code;
+    CompiledFunction* new_cf = compilePartialFuncInternal(exit);
+    return new_cf ? new_cf->code : NULL;
 }
 
 
 static StatCounter stat_reopt("reopts");
+// If the compile gets queued for the background thread, this returns the same version, with its call count reset so
+// that it doesn't immediately come back here.
 extern "C" CompiledFunction* reoptCompiledFuncInternal(CompiledFunction* cf) {
     if (VERBOSITY("irgen") >= 2)
         printf("In reoptCompiledFunc, %p, %ld\n", cf, cf->times_called);
-    stat_reopt.log();
 
     assert(cf->effort < EffortLevel::MAXIMAL);
     assert(cf->clfunc->versions.size());
@@ -787,6 +1379,14 @@ extern "C" CompiledFunction* reoptCompiledFuncInternal(CompiledFunction* cf) {
     else
         RELEASE_ASSERT(0, "unknown effort: %d", cf->effort);
 
+    if (shouldCompileInBackground(new_effort)) {
+        LOCK_REGION(codegen_rwlock.asWrite());
+        queueCompile(cf->clfunc, cf, NULL, new_effort);
+        cf->times_called = 0;
+        return cf;
+    }
+
+    stat_reopt.log();
     CompiledFunction* new_cf = _doReopt(cf, new_effort);
     assert(!new_cf->is_interpreted);
     return new_cf;
@@ -30,6 +30,24 @@ void* compilePartialFunc(OSRExit*);
 extern "C" CompiledFunction* reoptCompiledFuncInternal(CompiledFunction*);
 extern "C" char* reoptCompiledFunc(CompiledFunction*);
 
+// Whether the current thread is the one doing background compiles.
+bool isCompileThread();
+// Waits for any background compile that's in progress, and stops any more from happening.
+void shutdownCompileThread();
+
+// Used by the collector to find out which superseded versions are no longer running anywhere, and which orphaned
+// CLFunctions can't get called any more.  During a full collection, every word of the thread and generator stacks
+// gets passed to noteRetiredCodePointer(), and the CLFunction of every live function object to
+// noteCLFunctionReference().  startRetiredCodeScan() returns false if there's nothing to look for.
+bool startRetiredCodeScan();
+void noteRetiredCodePointer(void* p);
+void noteCLFunctionReference(CLFunction* cl);
+void finishRetiredCodeScan();
+
+// Turns on safepoint_frame_info, and retires the LLVM-tier versions that were compiled without it so that they get
+// recompiled with it when they next get called.  Frames that are already running old code keep doing so.
+void enableSafepointFrameInfo();
+
 class AST_Module;
 class BoxedModule;
 void compileAndRunModule(AST_Module* m, BoxedModule* bm);
@@ -31,6 +31,7 @@
 #include "core/cfg.h"
 #include "core/types.h"
 #include "core/util.h"
+#include "gc/collector.h"
 #include "runtime/generator.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
@@ -395,6 +396,18 @@ public:
         rtn.setCallingConv(pp->getCallingConvention());
         return rtn.getInstruction();
     }
+
+    void checkAndPropagateCAPIException(UnwindInfo unw_info, llvm::Value* returned_val) override {
+        assert(unw_info.hasCAPIExcDest());
+
+        llvm::BasicBlock* normal_dest = createBasicBlock("capi_normal");
+        normal_dest->moveAfter(curblock);
+
+        llvm::Value* is_null = getBuilder()->CreateICmpEQ(returned_val, getNullPtr(returned_val->getType()));
+        getBuilder()->CreateCondBr(is_null, unw_info.capi_exc_dest, normal_dest);
+
+        setCurrentBasicBlock(normal_dest);
+    }
 };
 IREmitter* createIREmitter(IRGenState* irstate, llvm::BasicBlock*& curblock, IRGenerator* irgenerator) {
     return new IREmitterImpl(irstate, curblock, irgenerator);
@@ -531,6 +544,52 @@ private:
         return rtn;
     }
 
+    // Catches the C++ exception that brought us to the current block, and extracts the Python exception from it.
+    void emitLandingpad(llvm::Value*& exc_type, llvm::Value*& exc_value, llvm::Value*& exc_traceback) {
+        // llvm::Function* _personality_func = g.stdlib_module->getFunction("__py_personality_v0");
+        llvm::Function* _personality_func = g.stdlib_module->getFunction("__gxx_personality_v0");
+        assert(_personality_func);
+        llvm::Value* personality_func = g.cur_module->getOrInsertFunction(_personality_func->getName(),
+                                                                          _personality_func->getFunctionType());
+        assert(personality_func);
+        llvm::LandingPadInst* landing_pad = emitter.getBuilder()->CreateLandingPad(
+            llvm::StructType::create(std::vector<llvm::Type*>{ g.i8_ptr, g.i64 }), personality_func, 1);
+        landing_pad->addClause(getNullPtr(g.i8_ptr));
+
+        llvm::Value* cxaexc_pointer = emitter.getBuilder()->CreateExtractValue(landing_pad, { 0 });
+
+        if (irstate->getEffortLevel() != EffortLevel::INTERPRETED) {
+            llvm::Function* std_module_catch = g.stdlib_module->getFunction("__cxa_begin_catch");
+            auto begin_catch_func = g.cur_module->getOrInsertFunction(std_module_catch->getName(),
+                                                                      std_module_catch->getFunctionType());
+            assert(begin_catch_func);
+
+            llvm::Value* excinfo_pointer = emitter.getBuilder()->CreateCall(begin_catch_func, cxaexc_pointer);
+            loadExcInfo(excinfo_pointer, exc_type, exc_value, exc_traceback);
+        } else {
+            // TODO This doesn't get hit, right?
+            abort();
+
+            // The interpreter can't really support the full C++ exception handling model since it's
+            // itself written in C++.  Let's make it easier for the interpreter and use a simpler interface:
+            llvm::Value* exc_obj = emitter.getBuilder()->CreateBitCast(cxaexc_pointer, g.llvm_value_type_ptr);
+        }
+    }
+
+    void loadExcInfo(llvm::Value* excinfo_pointer, llvm::Value*& exc_type, llvm::Value*& exc_value,
+                     llvm::Value*& exc_traceback) {
+        auto* builder = emitter.getBuilder();
+        llvm::Value* excinfo_pointer_casted
+            = builder->CreateBitCast(excinfo_pointer, g.llvm_excinfo_type->getPointerTo());
+
+        exc_type = builder->CreateLoad(builder->CreateConstInBoundsGEP2_32(excinfo_pointer_casted, 0, 0));
+        exc_value = builder->CreateLoad(builder->CreateConstInBoundsGEP2_32(excinfo_pointer_casted, 0, 1));
+        exc_traceback = builder->CreateLoad(builder->CreateConstInBoundsGEP2_32(excinfo_pointer_casted, 0, 2));
+        assert(exc_type->getType() == g.llvm_value_type_ptr);
+        assert(exc_value->getType() == g.llvm_value_type_ptr);
+        assert(exc_traceback->getType() == g.llvm_value_type_ptr);
+    }
+
     CompilerVariable* evalLangPrimitive(AST_LangPrimitive* node, UnwindInfo unw_info) {
         switch (node->opcode) {
             case AST_LangPrimitive::CHECK_EXC_MATCH: {
@@ -550,50 +609,30 @@ private:
                 return boolFromI1(emitter, v);
             }
             case AST_LangPrimitive::LANDINGPAD: {
-                // llvm::Function* _personality_func = g.stdlib_module->getFunction("__py_personality_v0");
-                llvm::Function* _personality_func = g.stdlib_module->getFunction("__gxx_personality_v0");
-                assert(_personality_func);
-                llvm::Value* personality_func = g.cur_module->getOrInsertFunction(_personality_func->getName(),
-                                                                                  _personality_func->getFunctionType());
-                assert(personality_func);
-                llvm::LandingPadInst* landing_pad = emitter.getBuilder()->CreateLandingPad(
-                    llvm::StructType::create(std::vector<llvm::Type*>{ g.i8_ptr, g.i64 }), personality_func, 1);
-                landing_pad->addClause(getNullPtr(g.i8_ptr));
-
-                llvm::Value* cxaexc_pointer = emitter.getBuilder()->CreateExtractValue(landing_pad, { 0 });
-
-                if (irstate->getEffortLevel() != EffortLevel::INTERPRETED) {
-                    llvm::Function* std_module_catch = g.stdlib_module->getFunction("__cxa_begin_catch");
-                    auto begin_catch_func = g.cur_module->getOrInsertFunction(std_module_catch->getName(),
-                                                                              std_module_catch->getFunctionType());
-                    assert(begin_catch_func);
-
-                    llvm::Value* excinfo_pointer = emitter.getBuilder()->CreateCall(begin_catch_func, cxaexc_pointer);
-                    llvm::Value* excinfo_pointer_casted
-                        = emitter.getBuilder()->CreateBitCast(excinfo_pointer, g.llvm_excinfo_type->getPointerTo());
+                llvm::Value* exc_type, *exc_value, *exc_traceback;
 
+                auto incoming = irstate->getIncomingExcState(emitter.currentBasicBlock());
+                if (incoming) {
+                    // We get here by a branch from the blocks that caught the exception, not from the unwinder:
                     auto* builder = emitter.getBuilder();
-                    llvm::Value* exc_type
-                        = builder->CreateLoad(builder->CreateConstInBoundsGEP2_32(excinfo_pointer_casted, 0, 0));
-                    llvm::Value* exc_value
-                        = builder->CreateLoad(builder->CreateConstInBoundsGEP2_32(excinfo_pointer_casted, 0, 1));
-                    llvm::Value* exc_traceback
-                        = builder->CreateLoad(builder->CreateConstInBoundsGEP2_32(excinfo_pointer_casted, 0, 2));
-                    assert(exc_type->getType() == g.llvm_value_type_ptr);
-                    assert(exc_value->getType() == g.llvm_value_type_ptr);
-                    assert(exc_traceback->getType() == g.llvm_value_type_ptr);
-
-                    return makeTuple({ new ConcreteCompilerVariable(UNKNOWN, exc_type, true),
-                                       new ConcreteCompilerVariable(UNKNOWN, exc_value, true),
-                                       new ConcreteCompilerVariable(UNKNOWN, exc_traceback, true) });
+                    llvm::PHINode* type_phi = builder->CreatePHI(g.llvm_value_type_ptr, incoming->size());
+                    llvm::PHINode* value_phi = builder->CreatePHI(g.llvm_value_type_ptr, incoming->size());
+                    llvm::PHINode* traceback_phi = builder->CreatePHI(g.llvm_value_type_ptr, incoming->size());
+                    for (auto&& s : *incoming) {
+                        type_phi->addIncoming(s.exc_type, s.from_block);
+                        value_phi->addIncoming(s.exc_value, s.from_block);
+                        traceback_phi->addIncoming(s.exc_traceback, s.from_block);
+                    }
+                    exc_type = type_phi;
+                    exc_value = value_phi;
+                    exc_traceback = traceback_phi;
                 } else {
-                    // TODO This doesn't get hit, right?
-                    abort();
-
-                    // The interpreter can't really support the full C++ exception handling model since it's
-                    // itself written in C++.  Let's make it easier for the interpreter and use a simpler interface:
-                    llvm::Value* exc_obj = emitter.getBuilder()->CreateBitCast(cxaexc_pointer, g.llvm_value_type_ptr);
+                    emitLandingpad(exc_type, exc_value, exc_traceback);
                 }
+
+                return makeTuple({ new ConcreteCompilerVariable(UNKNOWN, exc_type, true),
+                                   new ConcreteCompilerVariable(UNKNOWN, exc_value, true),
+                                   new ConcreteCompilerVariable(UNKNOWN, exc_traceback, true) });
             }
             case AST_LangPrimitive::LOCALS: {
                 return new ConcreteCompilerVariable(UNKNOWN, irstate->getBoxedLocalsVar(), true);
@@ -747,13 +786,193 @@ private:
         return left->binexp(emitter, getOpInfoForNode(node, unw_info), right, type, exp_type);
     }
 
+    static bool isPolymorphicArithClass(BoxedClass* cls) { return cls == int_cls || cls == float_cls; }
+    static bool isPolymorphicSubscriptClass(BoxedClass* cls) { return cls == list_cls || cls == tuple_cls; }
+
+    // The classes out of the expression's polymorphic profile that we can do better than the generic operation for.
+    std::vector<PolymorphicClass> getPolymorphicClasses(AST_expr* node, CompilerVariable* var,
+                                                        bool (*usable)(BoxedClass*)) {
+        std::vector<PolymorphicClass> rtn;
+        if (var->getType() != UNKNOWN)
+            return rtn;
+
+        const std::vector<PolymorphicClass>* classes = types->polymorphicExprClasses(node);
+        if (!classes)
+            return rtn;
+
+        for (const PolymorphicClass& c : *classes) {
+            if (usable(c.cls))
+                rtn.push_back(c);
+        }
+        return rtn;
+    }
+
+    static const int MAX_POLYMORPHIC_CASES = 4;
+
+    // Dispatches on the classes that the profiled operands have been seeing: each combination gets a class check and
+    // a copy of the operation on the unboxed operands, and anything else goes through the generic version.  The result
+    // is always boxed, since that's what the type analysis thinks these expressions are.
+    // is_useful_case gets each combination of classes (with NULL for the operands that don't get dispatched on), and
+    // says whether the operation on those is any better than the generic one.  Returns NULL if no combination is.
+    template <typename Op, typename Filter>
+    CompilerVariable* emitPolymorphicDispatch(const std::vector<CompilerVariable*>& operands,
+                                              const std::vector<std::vector<PolymorphicClass>>& operand_classes,
+                                              Filter is_useful_case, Op op) {
+        assert(operands.size() == operand_classes.size());
+
+        struct Case {
+            std::vector<BoxedClass*> classes;
+            // How often we expect to see this combination, assuming that the operands' classes are independent.
+            double frequency;
+        };
+        std::vector<Case> cases(1, Case{ {}, 1.0 });
+        for (const auto& classes : operand_classes) {
+            std::vector<Case> new_cases;
+            for (const auto& c : cases) {
+                if (classes.empty()) {
+                    new_cases.push_back(c);
+                    new_cases.back().classes.push_back(NULL);
+                    continue;
+                }
+                for (const PolymorphicClass& pc : classes) {
+                    new_cases.push_back(c);
+                    new_cases.back().classes.push_back(pc.cls);
+                    new_cases.back().frequency *= pc.frequency;
+                }
+            }
+            cases = std::move(new_cases);
+        }
+
+        cases.erase(std::remove_if(cases.begin(), cases.end(),
+                                   [&](const Case& c) { return !is_useful_case(c.classes); }),
+                    cases.end());
+        if (cases.empty())
+            return NULL;
+
+        // Check for the most common combinations first, and drop the rarest ones if there are too many:
+        std::stable_sort(cases.begin(), cases.end(),
+                         [](const Case& lhs, const Case& rhs) { return lhs.frequency > rhs.frequency; });
+        if (cases.size() > MAX_POLYMORPHIC_CASES)
+            cases.resize(MAX_POLYMORPHIC_CASES);
+
+        static StatCounter num_polymorphic_dispatches("num_polymorphic_dispatches");
+        num_polymorphic_dispatches.log();
+
+        std::vector<ConcreteCompilerVariable*> boxed(operands.size(), NULL);
+        for (int i = 0; i < operands.size(); i++) {
+            if (!operand_classes[i].empty())
+                boxed[i] = operands[i]->makeConverted(emitter, UNKNOWN);
+        }
+
+        llvm::BasicBlock* join_bb = emitter.createBasicBlock("polymorphic_join");
+        std::vector<std::pair<llvm::Value*, llvm::BasicBlock*>> incoming;
+        auto emit_case = [&](const std::vector<CompilerVariable*>& args) {
+            CompilerVariable* r = op(args);
+            ConcreteCompilerVariable* converted = r->makeConverted(emitter, UNKNOWN);
+            r->decvref(emitter);
+            incoming.push_back(std::make_pair(converted->getValue(), emitter.currentBasicBlock()));
+            converted->decvref(emitter);
+        };
+
+        for (const Case& dispatch_case : cases) {
+            const std::vector<BoxedClass*>& c = dispatch_case.classes;
+            llvm::Value* check = NULL;
+            for (int i = 0; i < c.size(); i++) {
+                // The classes get embedded relocatably, but which ones they are (and which operands they are for)
+                // changes the code we generate.  Include the terminators, so that names can't run together:
+                const char* tp_name = c[i] ? c[i]->tp_name : "";
+                addToCodeFingerprint(tp_name, strlen(tp_name) + 1);
+
+                if (!c[i])
+                    continue;
+
+                llvm::Value* this_check = boxed[i]->makeClassCheck(emitter, c[i]);
+                check = check ? emitter.getBuilder()->CreateAnd(check, this_check) : this_check;
+            }
+            assert(check);
+
+            llvm::BasicBlock* case_bb = emitter.createBasicBlock("polymorphic_case");
+            llvm::BasicBlock* next_bb = emitter.createBasicBlock("polymorphic_next");
+            emitter.getBuilder()->CreateCondBr(check, case_bb, next_bb);
+
+            emitter.setCurrentBasicBlock(case_bb);
+            std::vector<CompilerVariable*> args;
+            for (int i = 0; i < c.size(); i++)
+                args.push_back(c[i] ? unboxVar(typeFromClass(c[i]), boxed[i]->getValue(), false) : operands[i]);
+            emit_case(args);
+            for (int i = 0; i < c.size(); i++) {
+                if (c[i])
+                    args[i]->decvref(emitter);
+            }
+            emitter.getBuilder()->CreateBr(join_bb);
+
+            emitter.setCurrentBasicBlock(next_bb);
+        }
+
+        emit_case(operands);
+        emitter.getBuilder()->CreateBr(join_bb);
+
+        emitter.setCurrentBasicBlock(join_bb);
+        llvm::PHINode* phi = emitter.getBuilder()->CreatePHI(g.llvm_value_type_ptr, incoming.size(), "polymorphic");
+        for (const auto& p : incoming)
+            phi->addIncoming(p.first, p.second);
+
+        for (ConcreteCompilerVariable* b : boxed) {
+            if (b)
+                b->decvref(emitter);
+        }
+        return new ConcreteCompilerVariable(UNKNOWN, phi, true);
+    }
+
+    // Returns NULL if neither operand has a polymorphic profile worth dispatching on.
+    CompilerVariable* _evalPolymorphicBinExp(AST* node, AST_expr* left_node, CompilerVariable* left,
+                                             AST_expr* right_node, CompilerVariable* right, AST_TYPE::AST_TYPE type,
+                                             BinExpType exp_type, UnwindInfo unw_info) {
+        if (exp_type == Compare) {
+            // These are the comparisons that the unboxed types lower:
+            if (type != AST_TYPE::Eq && type != AST_TYPE::NotEq && type != AST_TYPE::Lt && type != AST_TYPE::LtE
+                && type != AST_TYPE::Gt && type != AST_TYPE::GtE)
+                return NULL;
+        }
+
+        std::vector<PolymorphicClass> left_classes = getPolymorphicClasses(left_node, left, isPolymorphicArithClass);
+        std::vector<PolymorphicClass> right_classes
+            = getPolymorphicClasses(right_node, right, isPolymorphicArithClass);
+
+        if (left_classes.empty() && right_classes.empty())
+            return NULL;
+
+        // The other side needs to be something that the typed versions can handle too:
+        if (left_classes.empty() && left->getType() != INT && left->getType() != FLOAT)
+            return NULL;
+        if (right_classes.empty() && right->getType() != INT && right->getType() != FLOAT)
+            return NULL;
+
+        // Int arithmetic doesn't get lowered (it would need overflow checks), so an int op int case would just box
+        // both sides again.  Comparisons get lowered either way, and arithmetic once either side is a float:
+        auto is_useful_case = [&](const std::vector<BoxedClass*>& classes) {
+            if (exp_type == Compare)
+                return true;
+            return classes[0] == float_cls || classes[1] == float_cls || (!classes[0] && left->getType() == FLOAT)
+                   || (!classes[1] && right->getType() == FLOAT);
+        };
+
+        return emitPolymorphicDispatch({ left, right }, { left_classes, right_classes }, is_useful_case,
+                                       [&](const std::vector<CompilerVariable*>& args) {
+            return this->_evalBinExp(node, args[0], args[1], type, exp_type, unw_info);
+        });
+    }
+
     CompilerVariable* evalBinOp(AST_BinOp* node, UnwindInfo unw_info) {
         CompilerVariable* left = evalExpr(node->left, unw_info);
         CompilerVariable* right = evalExpr(node->right, unw_info);
 
         assert(node->op_type != AST_TYPE::Is && node->op_type != AST_TYPE::IsNot && "not tested yet");
 
-        CompilerVariable* rtn = this->_evalBinExp(node, left, right, node->op_type, BinOp, unw_info);
+        CompilerVariable* rtn
+            = this->_evalPolymorphicBinExp(node, node->left, left, node->right, right, node->op_type, BinOp, unw_info);
+        if (!rtn)
+            rtn = this->_evalBinExp(node, left, right, node->op_type, BinOp, unw_info);
         left->decvref(emitter);
         right->decvref(emitter);
         return rtn;
@@ -765,7 +984,10 @@ private:
 
         assert(node->op_type != AST_TYPE::Is && node->op_type != AST_TYPE::IsNot && "not tested yet");
 
-        CompilerVariable* rtn = this->_evalBinExp(node, left, right, node->op_type, AugBinOp, unw_info);
+        CompilerVariable* rtn = this->_evalPolymorphicBinExp(node, node->left, left, node->right, right, node->op_type,
+                                                             AugBinOp, unw_info);
+        if (!rtn)
+            rtn = this->_evalBinExp(node, left, right, node->op_type, AugBinOp, unw_info);
         left->decvref(emitter);
         right->decvref(emitter);
         return rtn;
@@ -780,12 +1002,154 @@ private:
         assert(left);
         assert(right);
 
-        CompilerVariable* rtn = _evalBinExp(node, left, right, node->ops[0], Compare, unw_info);
+        CompilerVariable* rtn = this->_evalPolymorphicBinExp(node, node->left, left, node->comparators[0], right,
+                                                             node->ops[0], Compare, unw_info);
+        if (!rtn)
+            rtn = _evalBinExp(node, left, right, node->ops[0], Compare, unw_info);
         left->decvref(emitter);
         right->decvref(emitter);
         return rtn;
     }
 
+    // Calls to module-level Python functions normally go through runtimeCall, which has to figure out which version of
+    // the callee to run and how to pass the arguments to it.  If the name is currently bound to a function that has a
+    // fully-optimized version (or that is the function we're compiling), call that version directly, guarded on the
+    // identity of the function object; if the name gets rebound we go back to the generic call.  Since the callee is
+    // a real call, its frame shows up in tracebacks and it can deopt or OSR on its own like it normally would.
+    // Returns NULL if the call isn't a candidate.
+    CompilerVariable* _evalDirectCall(AST_Call* node, CompilerVariable* func, ArgPassSpec argspec,
+                                      const std::vector<CompilerVariable*>& args, UnwindInfo unw_info) {
+        if (!ENABLE_DIRECT_CALLS || irstate->getEffortLevel() < EffortLevel::MODERATE)
+            return NULL;
+        if (argspec.num_keywords || argspec.has_starargs || argspec.has_kwargs)
+            return NULL;
+        if (node->func->type != AST_TYPE::Name || func->getType() != UNKNOWN)
+            return NULL;
+
+        AST_Name* name = ast_cast<AST_Name>(node->func);
+        SourceInfo* source = irstate->getSourceInfo();
+        if (irstate->getScopeInfo()->getScopeTypeOfName(name->id) != ScopeInfo::VarScopeType::GLOBAL)
+            return NULL;
+        if (!source->scoping->areGlobalsFromModule())
+            return NULL;
+
+        Box* callee = source->parent_module->getattr(name->id.str());
+        if (!callee || callee->cls != function_cls)
+            return NULL;
+        BoxedFunction* callee_func = static_cast<BoxedFunction*>(callee);
+
+        CLFunction* cl = callee_func->f;
+        if (!cl->source || cl->isGenerator() || cl->takes_varargs || cl->takes_kwargs || callee_func->closure)
+            return NULL;
+        // We don't fill in defaults; that would mean also guarding on them.
+        if (args.size() != cl->num_args)
+            return NULL;
+
+        // Only fully-optimized versions are safe to call directly: the lower tiers can get retired by a reopt, and
+        // they would try to reopt themselves again the next time we called into them.
+        CompiledFunction* target = NULL;
+        llvm::Value* target_func = NULL;
+        if (cl->source.get() == source) {
+            if (irstate->getEffortLevel() == EffortLevel::MAXIMAL && irstate->getCurFunction()->spec) {
+                target = irstate->getCurFunction();
+                target_func = irstate->getLLVMFunction();
+            }
+        } else {
+            for (CompiledFunction* cf : cl->versions) {
+                if (!cf->is_interpreted && cf->effort == EffortLevel::MAXIMAL) {
+                    target = cf;
+                    break;
+                }
+            }
+        }
+        if (!target)
+            return NULL;
+
+        FunctionSpecialization* spec = target->spec;
+        assert(spec->arg_types.size() == args.size());
+        for (int i = 0; i < args.size(); i++) {
+            // TODO support passing unboxed values as arguments
+            if (spec->arg_types[i]->llvmType() != g.llvm_value_type_ptr || !args[i]->canConvertTo(spec->arg_types[i]))
+                return NULL;
+        }
+
+        if (!target_func) {
+            std::vector<llvm::Type*> arg_types;
+            for (int i = 0; i < args.size(); i++) {
+                if (i == 3) {
+                    arg_types.push_back(g.llvm_value_type_ptr->getPointerTo());
+                    break;
+                }
+                arg_types.push_back(g.llvm_value_type_ptr);
+            }
+            llvm::FunctionType* ft = llvm::FunctionType::get(spec->rtn_type->llvmType(), arg_types, false);
+
+            // We're about to bake this version's address into the code we're generating:
+            target->pinned = true;
+            if (target->func)
+                target_func = embedRelocatablePtr(target->code, ft->getPointerTo());
+            else
+                target_func = embedConstantPtr(target->code, ft->getPointerTo());
+        }
+
+        // Which function we picked, and what it returns, changes the code we generate:
+        addToCodeFingerprint(name->id.c_str(), name->id.str().size() + 1);
+        std::string rtn_type_name = spec->rtn_type->debugName();
+        addToCodeFingerprint(rtn_type_name.c_str(), rtn_type_name.size() + 1);
+
+        // The guard compares against the function's address, but we don't want to keep the function alive just for
+        // that.  Instead, the guard also checks that a weakref to the function still points to it: that gets cleared
+        // in the collection that finds the function dead, which is before anything else can get allocated in its
+        // place.  Only the (shared) weakref gets kept alive.
+        PyObject* callee_ref = PyWeakref_NewRef(callee_func, NULL);
+        if (!callee_ref) {
+            PyErr_Clear();
+            return NULL;
+        }
+        gc::registerPermanentRoot(callee_ref, /* allow_duplicates */ true);
+
+        static StatCounter num_direct_calls("num_direct_calls");
+        num_direct_calls.log();
+
+        llvm::Value* expected_func = embedRelocatablePtr(callee_func, g.llvm_value_type_ptr);
+        llvm::Value* ref_obj = emitter.getBuilder()->CreateLoad(embedRelocatablePtr(
+            &((PyWeakReference*)callee_ref)->wr_object, g.llvm_value_type_ptr->getPointerTo()));
+        ConcreteCompilerVariable* converted_func = func->makeConverted(emitter, UNKNOWN);
+        llvm::Value* is_callee = emitter.getBuilder()->CreateICmpEQ(converted_func->getValue(), expected_func);
+        llvm::Value* is_alive = emitter.getBuilder()->CreateICmpEQ(ref_obj, expected_func);
+        llvm::Value* is_expected = emitter.getBuilder()->CreateAnd(is_callee, is_alive);
+        converted_func->decvref(emitter);
+
+        llvm::BasicBlock* direct_bb = emitter.createBasicBlock("direct_call");
+        llvm::BasicBlock* generic_bb = emitter.createBasicBlock("generic_call");
+        llvm::BasicBlock* join_bb = emitter.createBasicBlock("call_join");
+        emitter.getBuilder()->CreateCondBr(is_expected, direct_bb, generic_bb);
+
+        emitter.setCurrentBasicBlock(direct_bb);
+        ConcreteCompilerVariable* direct_rtn
+            = callCompiledFunctionDirect(emitter, getOpInfoForNode(node, unw_info), target_func, args, spec->rtn_type);
+        ConcreteCompilerVariable* converted_direct_rtn = direct_rtn->makeConverted(emitter, UNKNOWN);
+        direct_rtn->decvref(emitter);
+        llvm::BasicBlock* direct_end_bb = emitter.currentBasicBlock();
+        emitter.getBuilder()->CreateBr(join_bb);
+
+        emitter.setCurrentBasicBlock(generic_bb);
+        CompilerVariable* generic_rtn = func->call(emitter, getOpInfoForNode(node, unw_info), argspec, args, NULL);
+        ConcreteCompilerVariable* converted_generic_rtn = generic_rtn->makeConverted(emitter, UNKNOWN);
+        generic_rtn->decvref(emitter);
+        llvm::BasicBlock* generic_end_bb = emitter.currentBasicBlock();
+        emitter.getBuilder()->CreateBr(join_bb);
+
+        emitter.setCurrentBasicBlock(join_bb);
+        llvm::PHINode* phi = emitter.getBuilder()->CreatePHI(g.llvm_value_type_ptr, 2, "call_rtn");
+        phi->addIncoming(converted_direct_rtn->getValue(), direct_end_bb);
+        phi->addIncoming(converted_generic_rtn->getValue(), generic_end_bb);
+        converted_direct_rtn->decvref(emitter);
+        converted_generic_rtn->decvref(emitter);
+
+        return new ConcreteCompilerVariable(UNKNOWN, phi, true);
+    }
+
     CompilerVariable* evalCall(AST_Call* node, UnwindInfo unw_info) {
         bool is_callattr;
         bool callattr_clsonly = false;
@@ -852,7 +1216,9 @@ private:
             CallattrFlags flags = {.cls_only = callattr_clsonly, .null_on_nonexistent = false };
             rtn = func->callattr(emitter, getOpInfoForNode(node, unw_info), attr, flags, argspec, args, keyword_names);
         } else {
-            rtn = func->call(emitter, getOpInfoForNode(node, unw_info), argspec, args, keyword_names);
+            rtn = _evalDirectCall(node, func, argspec, args, unw_info);
+            if (!rtn)
+                rtn = func->call(emitter, getOpInfoForNode(node, unw_info), argspec, args, keyword_names);
         }
 
         func->decvref(emitter);
@@ -1178,7 +1544,18 @@ private:
         CompilerVariable* value = evalExpr(node->value, unw_info);
         CompilerVariable* slice = evalExpr(node->slice, unw_info);
 
-        CompilerVariable* rtn = value->getitem(emitter, getOpInfoForNode(node, unw_info), slice);
+        CompilerVariable* rtn = NULL;
+        std::vector<PolymorphicClass> value_classes
+            = getPolymorphicClasses(node->value, value, isPolymorphicSubscriptClass);
+        if (!value_classes.empty()) {
+            rtn = emitPolymorphicDispatch({ value, slice }, { value_classes, {} },
+                                          [](const std::vector<BoxedClass*>& classes) { return true; },
+                                          [&](const std::vector<CompilerVariable*>& args) {
+                return args[0]->getitem(emitter, getOpInfoForNode(node, unw_info), args[1]);
+            });
+        }
+        if (!rtn)
+            rtn = value->getitem(emitter, getOpInfoForNode(node, unw_info), slice);
         value->decvref(emitter);
         slice->decvref(emitter);
         return rtn;
@@ -1238,12 +1615,90 @@ private:
 
         llvm::Value* rtn
             = emitter.createCall2(unw_info, g.funcs.yield, convertedGenerator->getValue(), convertedValue->getValue());
+        emitStacklessYieldCheck(rtn, convertedGenerator->getValue(), convertedValue->getValue(), unw_info);
         convertedGenerator->decvref(emitter);
         convertedValue->decvref(emitter);
 
         return new ConcreteCompilerVariable(UNKNOWN, rtn, true);
     }
 
+    // yield() returns NULL instead of yielding if the generator is stackless (see ast_interpreter.h).  In that case,
+    // hand our variables over to the generator's interpreter frame, which will resume from this yield, and return.
+    void emitStacklessYieldCheck(llvm::Value* yield_rtn, llvm::Value* generator, llvm::Value* value,
+                                 UnwindInfo unw_info) {
+        assert(unw_info.current_stmt);
+
+        llvm::BasicBlock* resumed_bb = llvm::BasicBlock::Create(g.context, "yield_resumed", irstate->getLLVMFunction());
+        resumed_bb->moveAfter(curblock);
+        llvm::BasicBlock* stackless_bb
+            = llvm::BasicBlock::Create(g.context, "yield_stackless", irstate->getLLVMFunction());
+
+        llvm::Value* is_stackless
+            = emitter.getBuilder()->CreateICmpEQ(yield_rtn, getNullPtr(g.llvm_value_type_ptr));
+        emitter.getBuilder()->CreateCondBr(is_stackless, stackless_bb, resumed_bb);
+
+        curblock = stackless_bb;
+        emitter.getBuilder()->SetInsertPoint(curblock);
+
+        // The interpreter frame stores the variables in the slots that the CFG assigned them:
+        SourceInfo* source = irstate->getSourceInfo();
+        CFG* cfg = source->cfg;
+        if (!cfg->hasVregsAssigned())
+            cfg->assignVRegs(irstate->getCurFunction()->clfunc->param_names, irstate->getScopeInfo(),
+                             source->getInternedStrings());
+
+        llvm::Value* null_value = getNullPtr(g.llvm_value_type_ptr);
+        std::vector<llvm::Value*> vreg_values(cfg->vreg_names.size(), null_value);
+        // Sort the names here to make the process deterministic:
+        std::map<InternedString, CompilerVariable*> sorted_symbol_table(symbol_table.begin(), symbol_table.end());
+        for (const auto& p : sorted_symbol_table) {
+            auto it = cfg->sym_vreg_map.find(p.first);
+            // Skips the fake names, which the interpreter keeps elsewhere (or doesn't need):
+            if (it == cfg->sym_vreg_map.end())
+                continue;
+            if (p.second->getType() == UNDEF)
+                continue;
+
+            ConcreteCompilerVariable* var = p.second->makeConverted(emitter, UNKNOWN);
+            llvm::Value* val = var->getValue();
+            ConcreteCompilerVariable* is_defined_var
+                = static_cast<ConcreteCompilerVariable*>(_getFake(getIsDefinedName(p.first), true));
+            if (is_defined_var)
+                val = emitter.getBuilder()->CreateSelect(i1FromBool(emitter, is_defined_var), val, null_value);
+            vreg_values[it->second] = val;
+            var->decvref(emitter);
+        }
+
+        llvm::Value* vregs = getNullPtr(g.llvm_value_type_ptr->getPointerTo());
+        if (!vreg_values.empty()) {
+            vregs = new llvm::AllocaInst(g.llvm_value_type_ptr, getConstantInt(vreg_values.size(), g.i64), "",
+                                         irstate->getLLVMFunction()->getEntryBlock().getFirstInsertionPt());
+            for (int i = 0; i < vreg_values.size(); i++)
+                emitter.getBuilder()->CreateStore(vreg_values[i], emitter.getBuilder()->CreateConstGEP1_32(vregs, i));
+        }
+
+        llvm::Value* created_closure = getNullPtr(g.llvm_closure_type_ptr);
+        auto closure_it = symbol_table.find(internString(CREATED_CLOSURE_NAME));
+        if (closure_it != symbol_table.end()) {
+            ConcreteCompilerVariable* closure = closure_it->second->makeConverted(emitter, CLOSURE);
+            created_closure = closure->getValue();
+            closure->decvref(emitter);
+        }
+
+        llvm::Value* rtn = emitter.createCall(
+            UnwindInfo(unw_info.current_stmt, NULL), g.funcs.astInterpretGeneratorSuspend,
+            { generator, value, embedRelocatablePtr(irstate->getCurFunction(), g.i8_ptr),
+              embedRelocatablePtr(myblock, g.i8_ptr), embedRelocatablePtr(unw_info.current_stmt, g.i8_ptr),
+              irstate->getFrameInfoVar(), created_closure, vregs });
+        if (irstate->getReturnType() == VOID)
+            emitter.getBuilder()->CreateRetVoid();
+        else
+            emitter.getBuilder()->CreateRet(rtn);
+
+        curblock = resumed_bb;
+        emitter.getBuilder()->SetInsertPoint(curblock);
+    }
+
     CompilerVariable* evalMakeClass(AST_MakeClass* mkclass, UnwindInfo unw_info) {
         assert(mkclass->type == AST_TYPE::MakeClass && mkclass->class_def->type == AST_TYPE::ClassDef);
         AST_ClassDef* node = mkclass->class_def;
@@ -1491,6 +1946,9 @@ private:
         if (speculated_class != NULL) {
             assert(rtn);
 
+            // The class itself gets embedded relocatably, but which one it is changes the code we generate:
+            addToCodeFingerprint(speculated_class->tp_name, strlen(speculated_class->tp_name) + 1);
+
             ConcreteCompilerType* speculated_type = typeFromClass(speculated_class);
             if (VERBOSITY("irgen") >= 2) {
                 printf("Speculating that %s is actually %s, at ", rtn->getConcreteType()->debugName().c_str(),
@@ -1609,6 +2067,12 @@ private:
         CompilerVariable* tget = evalExpr(target->value, unw_info);
         CompilerVariable* slice = evalExpr(target->slice, unw_info);
 
+        if (tryListSetitem(emitter, getEmptyOpInfo(unw_info), tget, slice, val)) {
+            tget->decvref(emitter);
+            slice->decvref(emitter);
+            return;
+        }
+
         ConcreteCompilerVariable* converted_target = tget->makeConverted(emitter, tget->getBoxType());
         ConcreteCompilerVariable* converted_slice = slice->makeConverted(emitter, slice->getBoxType());
         tget->decvref(emitter);
@@ -1985,8 +2449,11 @@ private:
     }
 
     void doOSRExit(llvm::BasicBlock* normal_target, AST_Jump* osr_key) {
-        llvm::BasicBlock* starting_block = curblock;
         llvm::BasicBlock* onramp = llvm::BasicBlock::Create(g.context, "onramp", irstate->getLLVMFunction());
+        // The OSR compile might get done in the background, in which case we keep running this version until it's
+        // ready.  Both ways of not doing the OSR go through this block, so that it's the only predecessor of the
+        // normal target and the phis there don't need to know about the onramp.
+        llvm::BasicBlock* no_osr = llvm::BasicBlock::Create(g.context, "no_osr", irstate->getLLVMFunction());
 
         // Code to check if we want to do the OSR:
         llvm::GlobalVariable* edgecount_ptr = new llvm::GlobalVariable(
@@ -2009,7 +2476,10 @@ private:
             = { llvm::MDString::get(g.context, "branch_weights"), llvm::ConstantAsMetadata::get(getConstantInt(1)),
                 llvm::ConstantAsMetadata::get(getConstantInt(1000)) };
         llvm::MDNode* branch_weights = llvm::MDNode::get(g.context, llvm::ArrayRef<llvm::Metadata*>(md_vals));
-        emitter.getBuilder()->CreateCondBr(osr_test, onramp, normal_target, branch_weights);
+        emitter.getBuilder()->CreateCondBr(osr_test, onramp, no_osr, branch_weights);
+
+        emitter.getBuilder()->SetInsertPoint(no_osr);
+        emitter.getBuilder()->CreateBr(normal_target);
 
         // Emitting the actual OSR:
         emitter.getBuilder()->SetInsertPoint(onramp);
@@ -2018,6 +2488,21 @@ private:
         llvm::Value* partial_func = emitter.getBuilder()->CreateCall(g.funcs.compilePartialFunc,
                                                                      embedRelocatablePtr(exit, g.i8->getPointerTo()));
 
+        llvm::BasicBlock* osr_ready = llvm::BasicBlock::Create(g.context, "osr_ready", irstate->getLLVMFunction());
+        llvm::BasicBlock* osr_not_ready
+            = llvm::BasicBlock::Create(g.context, "osr_not_ready", irstate->getLLVMFunction());
+        llvm::Value* is_ready = emitter.getBuilder()->CreateICmpNE(
+            partial_func, llvm::ConstantPointerNull::get(llvm::cast<llvm::PointerType>(partial_func->getType())));
+        emitter.getBuilder()->CreateCondBr(is_ready, osr_ready, osr_not_ready);
+
+        // The compile has been queued; start counting again, so that we only check back on it every osr_threshold
+        // iterations instead of calling into the runtime on every backedge until it's done.
+        emitter.getBuilder()->SetInsertPoint(osr_not_ready);
+        emitter.getBuilder()->CreateStore(getConstantInt(0, g.i64), edgecount_ptr);
+        emitter.getBuilder()->CreateBr(no_osr);
+
+        emitter.getBuilder()->SetInsertPoint(osr_ready);
+
         std::vector<llvm::Value*> llvm_args;
         std::vector<llvm::Type*> llvm_arg_types;
         std::vector<ConcreteCompilerVariable*> converted_args;
@@ -2152,7 +2637,8 @@ private:
         else
             emitter.getBuilder()->CreateRet(rtn);
 
-        emitter.getBuilder()->SetInsertPoint(starting_block);
+        emitter.getBuilder()->SetInsertPoint(no_osr);
+        curblock = no_osr;
     }
 
     void doJump(AST_Jump* node, UnwindInfo unw_info) {
@@ -2257,7 +2743,15 @@ private:
             case AST_TYPE::Invoke: {
                 assert(!unw_info.needsInvoke());
                 AST_Invoke* invoke = ast_cast<AST_Invoke>(node);
-                doStmt(invoke->stmt, UnwindInfo(node, entry_blocks[invoke->exc_dest]));
+
+                bool use_capi = invoke->shouldUseCAPIExceptions();
+                addToCodeFingerprint(&use_capi, sizeof(use_capi));
+
+                if (use_capi) {
+                    doCAPIExceptionInvoke(invoke);
+                } else {
+                    doStmt(invoke->stmt, UnwindInfo(node, entry_blocks[invoke->exc_dest]));
+                }
 
                 assert(state == RUNNING || state == DEAD);
                 if (state == RUNNING) {
@@ -2276,6 +2770,35 @@ private:
         }
     }
 
+    // This invoke's exceptions get caught often enough that we use the C API calling convention for it where we can:
+    // the operations that support it return NULL instead of throwing, and we branch to the handler ourselves.  Both
+    // that path and the normal landingpad feed the exception to the handler block's LANDINGPAD through phis.
+    void doCAPIExceptionInvoke(AST_Invoke* invoke) {
+        llvm::BasicBlock* exc_dest = entry_blocks[invoke->exc_dest];
+        llvm::BasicBlock* orig_block = emitter.currentBasicBlock();
+        llvm::Value* exc_type, *exc_value, *exc_traceback;
+
+        llvm::BasicBlock* cxx_exc_dest = emitter.createBasicBlock("cxx_exc");
+        emitter.setCurrentBasicBlock(cxx_exc_dest);
+        emitLandingpad(exc_type, exc_value, exc_traceback);
+        emitter.getBuilder()->CreateBr(exc_dest);
+        irstate->addIncomingExcState(exc_dest, IRGenState::ExceptionState(cxx_exc_dest, exc_type, exc_value,
+                                                                          exc_traceback));
+
+        llvm::BasicBlock* capi_exc_dest = emitter.createBasicBlock("capi_exc");
+        emitter.setCurrentBasicBlock(capi_exc_dest);
+        llvm::Value* excinfo_pointer
+            = emitter.createCall(UnwindInfo(invoke, cxx_exc_dest), g.funcs.catchCAPIException);
+        loadExcInfo(excinfo_pointer, exc_type, exc_value, exc_traceback);
+        emitter.getBuilder()->CreateBr(exc_dest);
+        // createCall can split the block, so take the block that we ended up in:
+        irstate->addIncomingExcState(exc_dest, IRGenState::ExceptionState(emitter.currentBasicBlock(), exc_type,
+                                                                          exc_value, exc_traceback));
+
+        emitter.setCurrentBasicBlock(orig_block);
+        doStmt(invoke->stmt, UnwindInfo(invoke, cxx_exc_dest, capi_exc_dest));
+    }
+
     void loadArgument(InternedString name, ConcreteCompilerType* t, llvm::Value* v, UnwindInfo unw_info) {
         assert(name.str() != FRAME_INFO_PTR_NAME);
         ConcreteCompilerVariable* var = unboxVar(t, v, false);
@@ -2609,12 +3132,6 @@ public:
                 break;
             assert(state != FINISHED);
 
-#if ENABLE_SAMPLING_PROFILER
-            auto stmt = block->body[i];
-            if (!(i == 0 && stmt->type == AST_TYPE::Assign) && stmt->lineno > 0) // could be a landingpad
-                doSafePoint(block->body[i]);
-#endif
-
             doStmt(block->body[i], UnwindInfo(block->body[i], NULL));
         }
         if (VERBOSITY("irgenerator") >= 2) { // print ending symbol table
@@ -2626,13 +3143,13 @@ public:
     }
 
     void doSafePoint(AST_stmt* next_statement) override {
-// If the sampling profiler is turned on (and eventually, destructors), we need frame-introspection
-// support while in allowGLReadPreemption:
-#if ENABLE_SAMPLING_PROFILER
-        emitter.createCall(UnwindInfo(next_statement, NULL), g.funcs.allowGLReadPreemption);
-#else
-        emitter.getBuilder()->CreateCall(g.funcs.allowGLReadPreemption);
-#endif
+        // The sampling profiler walks the stack from inside allowGLReadPreemption, which needs frame info; that makes
+        // the safepoint a patchpoint, so only do it once the profiler has been used.
+        addToCodeFingerprint(&safepoint_frame_info, sizeof(safepoint_frame_info));
+        if (safepoint_frame_info)
+            emitter.createCall(UnwindInfo(next_statement, NULL), g.funcs.allowGLReadPreemption);
+        else
+            emitter.getBuilder()->CreateCall(g.funcs.allowGLReadPreemption);
     }
 };
 
@@ -2644,9 +3161,7 @@ IRGenerator* createIRGenerator(IRGenState* irstate, std::unordered_map<CFGBlock*
 CLFunction* wrapFunction(AST* node, AST_arguments* args, const std::vector<AST_stmt*>& body, SourceInfo* source) {
     // Different compilations of the parent scope of a functiondef should lead
     // to the same CLFunction* being used:
-    static std::unordered_map<AST*, CLFunction*> made;
-
-    CLFunction*& cl = made[node];
+    CLFunction*& cl = source->nested_functions[node];
     if (cl == NULL) {
         std::unique_ptr<SourceInfo> si(new SourceInfo(source->parent_module, source->scoping, node, body, source->fn));
         if (args)
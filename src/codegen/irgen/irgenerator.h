@@ -17,6 +17,8 @@
 
 #include <map>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/iterator_range.h"
 #include "llvm/IR/Instructions.h"
 
@@ -68,6 +70,20 @@ private:
     llvm::Value* frame_info_arg;
     int scratch_size;
 
+public:
+    // An exception (as its type, value, and traceback) arriving at an exception handler from a particular block.
+    struct ExceptionState {
+        llvm::BasicBlock* from_block;
+        llvm::Value* exc_type, *exc_value, *exc_traceback;
+        ExceptionState(llvm::BasicBlock* from_block, llvm::Value* exc_type, llvm::Value* exc_value,
+                       llvm::Value* exc_traceback)
+            : from_block(from_block), exc_type(exc_type), exc_value(exc_value), exc_traceback(exc_traceback) {}
+    };
+
+private:
+    // For exception handlers that are reached by normal branches rather than directly by the unwinder (ie the
+    // invokes that use the C API exception convention): handler block -> the exceptions coming into it.
+    llvm::DenseMap<llvm::BasicBlock*, llvm::SmallVector<ExceptionState, 2>> incoming_exc_state;
 
 public:
     IRGenState(CompiledFunction* cf, SourceInfo* source_info, std::unique_ptr<LivenessAnalysis> liveness,
@@ -101,6 +117,17 @@ public:
     ParamNames* getParamNames() { return param_names; }
 
     void setFrameInfoArgument(llvm::Value* v) { frame_info_arg = v; }
+
+    void addIncomingExcState(llvm::BasicBlock* exc_dest, const ExceptionState& state) {
+        incoming_exc_state[exc_dest].push_back(state);
+    }
+    // Returns NULL if exc_dest gets its exception from a landingpad.
+    llvm::SmallVector<ExceptionState, 2>* getIncomingExcState(llvm::BasicBlock* exc_dest) {
+        auto it = incoming_exc_state.find(exc_dest);
+        if (it == incoming_exc_state.end())
+            return NULL;
+        return &it->second;
+    }
 };
 
 // turns CFGBlocks into LLVM IR
@@ -14,6 +14,7 @@
 
 #include "codegen/irgen/util.h"
 
+#include <dlfcn.h>
 #include <sstream>
 #include <unordered_map>
 
@@ -25,6 +26,8 @@
 
 #include "codegen/codegen.h"
 #include "core/common.h"
+#include "core/options.h"
+#include "core/util.h"
 #include "runtime/types.h"
 
 namespace pyston {
@@ -94,15 +97,37 @@ llvm::Constant* getStringConstantPtr(const char* str) {
 // but doing it this way makes it clearer what's going on.
 
 static llvm::StringMap<const void*> relocatable_syms;
+// LLVM assumes that two different global variables have different addresses, so make sure that each address only
+// gets one relocatable symbol per module:
+static std::unordered_map<const void*, llvm::GlobalVariable*> relocatable_globals;
+
+// Relocatable symbols with this prefix stand for the current value of one of the runtime's global variables (ex True
+// or int_cls).  Unlike the ones that irgen numbers, they can be resolved without redoing irgen, which is what the
+// optimization passes need when they fold such a value into the code.
+static const char runtime_global_prefix[] = "pyston_global.";
+
+static void* getRuntimeGlobalAddr(llvm::StringRef name) {
+    void* handle = dlopen(NULL, RTLD_LAZY);
+    void* addr = dlsym(handle, name.str().c_str());
+    dlclose(handle);
+    return addr;
+}
 
 void clearRelocatableSymsMap() {
     relocatable_syms.clear();
+    relocatable_globals.clear();
 }
 
 const void* getValueOfRelocatableSym(const std::string& str) {
     auto it = relocatable_syms.find(str);
     if (it != relocatable_syms.end())
         return it->second;
+
+    if (startswith(str, runtime_global_prefix)) {
+        void** addr = (void**)getRuntimeGlobalAddr(llvm::StringRef(str).substr(sizeof(runtime_global_prefix) - 1));
+        if (addr)
+            return *addr;
+    }
     return NULL;
 }
 
@@ -112,12 +137,16 @@ llvm::Constant* embedRelocatablePtr(const void* addr, llvm::Type* type, llvm::St
     if (!ENABLE_JIT_OBJECT_CACHE)
         return embedConstantPtr(addr, type);
 
+    auto it = relocatable_globals.find(addr);
+    if (it != relocatable_globals.end())
+        return llvm::ConstantExpr::getPointerCast(it->second, type);
+
     std::string name;
     if (!shared_name.empty()) {
         llvm::GlobalVariable* gv = g.cur_module->getGlobalVariable(shared_name, true);
         if (gv)
-            return gv;
-        assert(!relocatable_syms.count(name));
+            return llvm::ConstantExpr::getPointerCast(gv, type);
+        assert(!relocatable_syms.count(shared_name));
         name = shared_name;
     } else {
         name = (llvm::Twine("c") + llvm::Twine(relocatable_syms.size())).str();
@@ -126,11 +155,127 @@ llvm::Constant* embedRelocatablePtr(const void* addr, llvm::Type* type, llvm::St
     relocatable_syms[name] = addr;
 
     llvm::Type* var_type = type->getPointerElementType();
-    return new llvm::GlobalVariable(*g.cur_module, var_type, true, llvm::GlobalVariable::ExternalLinkage, 0, name);
+    llvm::GlobalVariable* gv
+        = new llvm::GlobalVariable(*g.cur_module, var_type, true, llvm::GlobalVariable::ExternalLinkage, 0, name);
+    relocatable_globals[addr] = gv;
+    return gv;
+}
+
+llvm::Constant* embedRuntimeGlobalValue(llvm::StringRef global_name, llvm::Type* type) {
+    void** addr = (void**)getRuntimeGlobalAddr(global_name);
+    RELEASE_ASSERT(addr, "%s", global_name.str().c_str());
+    return embedRelocatablePtr(*addr, type, (llvm::Twine(runtime_global_prefix) + global_name).str());
+}
+
+// Returns the name under which the dynamic linker will find the given address (for functions of the runtime or of
+// the libraries it links against), or the empty string if there is no such name.
+static const std::string& getExportedSymbolName(const void* addr) {
+    static std::unordered_map<const void*, std::string> names;
+    auto it = names.find(addr);
+    if (it != names.end())
+        return it->second;
+
+    std::string& name = names[addr];
+    Dl_info info;
+    if (dladdr(addr, &info) && info.dli_sname && info.dli_saddr == addr && getRuntimeGlobalAddr(info.dli_sname) == addr)
+        name = info.dli_sname;
+    return name;
+}
+
+static bool canBeAbsoluteAddress(uint64_t val) {
+    // Things like the dummy patchpoint targets are not addresses:
+    return val >= 0x10000 && val != (uint64_t)-1L;
+}
+
+static llvm::Constant* relocateConstant(llvm::Constant* c, llvm::DenseMap<llvm::Constant*, llvm::Constant*>& cache,
+                                        bool& all_relocated) {
+    llvm::ConstantExpr* ce = llvm::dyn_cast<llvm::ConstantExpr>(c);
+    if (!ce)
+        return c;
+
+    auto it = cache.find(c);
+    if (it != cache.end())
+        return it->second;
+
+    llvm::Constant* rtn = c;
+    llvm::PointerType* pt = llvm::dyn_cast<llvm::PointerType>(ce->getType());
+    if (ce->getOpcode() == llvm::Instruction::IntToPtr && pt && llvm::isa<llvm::ConstantInt>(ce->getOperand(0))) {
+        uint64_t val = llvm::cast<llvm::ConstantInt>(ce->getOperand(0))->getZExtValue();
+        std::string name;
+        if (canBeAbsoluteAddress(val))
+            name = getExportedSymbolName((void*)val);
+
+        llvm::Module* module = g.cur_module;
+        llvm::GlobalValue* existing = name.empty() ? NULL : module->getNamedValue(name);
+        if (name.empty() || (existing && !existing->isDeclaration())) {
+            if (canBeAbsoluteAddress(val))
+                all_relocated = false;
+        } else if (existing) {
+            rtn = llvm::ConstantExpr::getPointerCast(existing, pt);
+        } else if (llvm::FunctionType* ft = llvm::dyn_cast<llvm::FunctionType>(pt->getElementType())) {
+            rtn = llvm::ConstantExpr::getPointerCast(module->getOrInsertFunction(name, ft), pt);
+        } else {
+            rtn = new llvm::GlobalVariable(*module, pt->getElementType(), false, llvm::GlobalVariable::ExternalLinkage,
+                                           0, name);
+        }
+    } else {
+        llvm::SmallVector<llvm::Constant*, 4> new_ops;
+        bool changed = false;
+        for (int i = 0, n = ce->getNumOperands(); i < n; i++) {
+            llvm::Constant* op = ce->getOperand(i);
+            llvm::Constant* new_op = relocateConstant(op, cache, all_relocated);
+            changed = changed || (new_op != op);
+            new_ops.push_back(new_op);
+        }
+        if (changed)
+            rtn = ce->getWithOperands(new_ops);
+    }
+
+    cache[c] = rtn;
+    return rtn;
+}
+
+bool makeAbsoluteAddressesRelocatable(llvm::Function* f) {
+    assert(f->getParent() == g.cur_module);
+
+    llvm::DenseMap<llvm::Constant*, llvm::Constant*> cache;
+    bool all_relocated = true;
+    for (llvm::inst_iterator it = inst_begin(f), end = inst_end(f); it != end; ++it) {
+        for (int i = 0, n = it->getNumOperands(); i < n; i++) {
+            llvm::Constant* op = llvm::dyn_cast<llvm::Constant>(it->getOperand(i));
+            if (!op)
+                continue;
+            llvm::Constant* new_op = relocateConstant(op, cache, all_relocated);
+            if (new_op != op)
+                it->setOperand(i, new_op);
+        }
+    }
+    return all_relocated;
+}
+
+static std::string code_fingerprint;
+
+void clearCodeFingerprint() {
+    code_fingerprint.clear();
+}
+
+void addToCodeFingerprint(const void* data, size_t size) {
+    code_fingerprint.append(static_cast<const char*>(data), size);
+}
+
+const std::string& getCodeFingerprint() {
+    return code_fingerprint;
 }
 
 llvm::Constant* embedConstantPtr(const void* addr, llvm::Type* type) {
     assert(type);
+    // Runtime functions don't necessarily end up at the same address in every process, but they will be referred to
+    // by name in the code that gets cached (see makeAbsoluteAddressesRelocatable()).
+    const std::string& name = getExportedSymbolName(addr);
+    if (!name.empty())
+        addToCodeFingerprint(name.c_str(), name.size() + 1);
+    else
+        addToCodeFingerprint(&addr, sizeof(addr));
     llvm::Constant* int_val = llvm::ConstantInt::get(g.i64, reinterpret_cast<uintptr_t>(addr), false);
     llvm::Constant* ptr_val = llvm::ConstantExpr::getIntToPtr(int_val, type);
     return ptr_val;
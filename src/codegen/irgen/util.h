@@ -36,9 +36,26 @@ llvm::Constant* getConstantDouble(double val);
 llvm::Constant* getConstantInt(int64_t val, llvm::Type*);
 llvm::Constant* getNullPtr(llvm::Type* t);
 
+// Embeds the value of the named global variable of the runtime (ex True or int_cls), which has to stay constant.
+// When the object cache is enabled, this is done symbolically, so that it also works for passes that run after irgen.
+llvm::Constant* embedRuntimeGlobalValue(llvm::StringRef global_name, llvm::Type*);
+
 void clearRelocatableSymsMap();
 const void* getValueOfRelocatableSym(const std::string& str);
 
+// Replaces the absolute addresses of runtime functions in the given (fully optimized) function with references to
+// their symbols, which get resolved when the object gets loaded, so that the object can be reused by other processes.
+// Returns false if there are absolute addresses left that couldn't be made relocatable.
+bool makeAbsoluteAddressesRelocatable(llvm::Function* f);
+
+// Things that affect the code for the current function but aren't determined by its source and signature, such as
+// the values of embedded constants or the classes that got speculated on, get recorded here so that the object cache
+// can make them part of its key.  Variable-length data has to be self-delimiting (ex include a string's terminator),
+// so that different sequences of additions can't produce the same fingerprint.
+void clearCodeFingerprint();
+void addToCodeFingerprint(const void* data, size_t size);
+const std::string& getCodeFingerprint();
+
 void dumpPrettyIR(llvm::Function* f);
 }
 
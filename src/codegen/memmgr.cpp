@@ -14,12 +14,15 @@
 
 #include "codegen/memmgr.h"
 
+#include <unordered_map>
+
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ExecutionEngine/RTDyldMemoryManager.h"
 #include "llvm/ExecutionEngine/RuntimeDyld.h"
 #include "llvm/Support/ErrorHandling.h"
 #include "llvm/Support/Memory.h"
 
+#include "codegen/codegen.h"
 #include "codegen/irgen/util.h"
 #include "core/common.h"
 #include "core/stats.h"
@@ -45,6 +48,10 @@ public:
 
     bool finalizeMemory(std::string* ErrMsg = 0) override;
 
+    void registerEHFrames(uint8_t* Addr, uint64_t LoadAddr, size_t Size) override;
+
+    void freeFunctionMemory(CompiledFunction* cf);
+
 private:
     void invalidateInstructionCache();
 
@@ -54,6 +61,21 @@ private:
         sys::MemoryBlock Near;
     };
 
+    struct EHFrame {
+        uint8_t* addr;
+        uint64_t load_addr;
+        size_t size;
+    };
+
+    // pyston: everything that got mapped or registered while compiling a given function (ie while g.cur_cf was
+    // set), so that it can be released again once that function is no longer needed.  Since free blocks never
+    // outlive a finalizeMemory() call, every mapping belongs to exactly one function.
+    struct FunctionMemory {
+        std::vector<std::pair<sys::MemoryBlock, MemoryGroup*>> blocks;
+        std::vector<EHFrame> eh_frames;
+    };
+    std::unordered_map<CompiledFunction*, FunctionMemory> function_memory;
+
     uint8_t* allocateSection(MemoryGroup& MemGroup, uintptr_t Size, unsigned Alignment, StringRef SectionName);
 
     llvm_error_code applyMemoryGroupPermissions(MemoryGroup& MemGroup, unsigned Permissions);
@@ -129,6 +151,8 @@ uint8_t* PystonMemoryManager::allocateSection(MemoryGroup& MemGroup, uintptr_t S
     MemGroup.Near = MB;
 
     MemGroup.AllocatedMem.push_back(MB);
+    if (g.cur_cf)
+        function_memory[g.cur_cf].blocks.push_back(std::make_pair(MB, &MemGroup));
     Addr = (uintptr_t)MB.base();
     uintptr_t EndOfBlock = Addr + MB.size();
 
@@ -176,6 +200,10 @@ bool PystonMemoryManager::finalizeMemory(std::string* ErrMsg) {
 
     // Read-write data memory already has the correct permissions
 
+    // pyston: don't let the next object share these pages either, so that they can get freed along with
+    // the function that they belong to.
+    RWDataMem.FreeMem.clear();
+
     // Some platforms with separate data cache and instruction cache require
     // explicit cache flush, otherwise JIT code manipulations (like resolved
     // relocations) will get to the data cache but not to the instruction cache.
@@ -223,6 +251,41 @@ uint64_t PystonMemoryManager::getSymbolAddress(const std::string& name) {
     return 0;
 }
 
+void PystonMemoryManager::registerEHFrames(uint8_t* Addr, uint64_t LoadAddr, size_t Size) {
+    if (g.cur_cf)
+        function_memory[g.cur_cf].eh_frames.push_back(EHFrame{ Addr, LoadAddr, Size });
+    RTDyldMemoryManager::registerEHFrames(Addr, LoadAddr, Size);
+}
+
+void PystonMemoryManager::freeFunctionMemory(CompiledFunction* cf) {
+    auto it = function_memory.find(cf);
+    if (it == function_memory.end())
+        return;
+
+    for (const EHFrame& frame : it->second.eh_frames)
+        deregisterEHFrames(frame.addr, frame.load_addr, frame.size);
+
+    static StatCounter mem_jit_freed("mem_jit_freed_bytes");
+    for (auto& p : it->second.blocks) {
+        sys::MemoryBlock& MB = p.first;
+        auto& allocated = p.second->AllocatedMem;
+        for (auto alloc_it = allocated.begin(); alloc_it != allocated.end(); ++alloc_it) {
+            if (alloc_it->base() == MB.base()) {
+                allocated.erase(alloc_it);
+                break;
+            }
+        }
+        // Near is only a hint, but it shouldn't point at memory we've given back:
+        if (p.second->Near.base() == MB.base())
+            p.second->Near = sys::MemoryBlock();
+
+        mem_jit_freed.log(MB.size());
+        sys::Memory::releaseMappedMemory(MB);
+    }
+
+    function_memory.erase(it);
+}
+
 PystonMemoryManager::~PystonMemoryManager() {
     for (unsigned i = 0, e = CodeMem.AllocatedMem.size(); i != e; ++i)
         sys::Memory::releaseMappedMemory(CodeMem.AllocatedMem[i]);
@@ -232,8 +295,18 @@ PystonMemoryManager::~PystonMemoryManager() {
         sys::Memory::releaseMappedMemory(RODataMem.AllocatedMem[i]);
 }
 
+// The memory manager that the execution engine is using:
+static PystonMemoryManager* jit_memory_manager = NULL;
+
 std::unique_ptr<llvm::RTDyldMemoryManager> createMemoryManager() {
-    return std::unique_ptr<llvm::RTDyldMemoryManager>(new PystonMemoryManager());
+    assert(!jit_memory_manager);
+    jit_memory_manager = new PystonMemoryManager();
+    return std::unique_ptr<llvm::RTDyldMemoryManager>(jit_memory_manager);
+}
+
+void freeJitMemory(CompiledFunction* cf) {
+    assert(jit_memory_manager);
+    jit_memory_manager->freeFunctionMemory(cf);
 }
 
 // These functions exist as instance methods of the RTDyldMemoryManager class,
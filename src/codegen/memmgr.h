@@ -25,9 +25,15 @@ class RTDyldMemoryManager;
 
 namespace pyston {
 
+class CompiledFunction;
+
 std::unique_ptr<llvm::RTDyldMemoryManager> createMemoryManager();
 void registerEHFrames(uint8_t* addr, uint64_t load_addr, size_t size);
 void deregisterEHFrames(uint8_t* addr, uint64_t load_addr, size_t size);
+
+// Releases the sections (and deregisters the eh_frames) that got allocated while compiling the given function.
+// The caller is responsible for making sure that nothing can reference that code or data any more.
+void freeJitMemory(CompiledFunction* cf);
 }
 
 #endif
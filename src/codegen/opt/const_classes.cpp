@@ -61,10 +61,7 @@ private:
         if (VERBOSITY()) {
             llvm::errs() << "Constant-folding this load: " << *li << '\n';
         }
-        if (gv->getName() == "True")
-            li->replaceAllUsesWith(embedConstantPtr(True, g.llvm_bool_type_ptr));
-        else
-            li->replaceAllUsesWith(embedConstantPtr(False, g.llvm_bool_type_ptr));
+        li->replaceAllUsesWith(embedRuntimeGlobalValue(gv->getName(), g.llvm_bool_type_ptr));
         return true;
     }
 
@@ -143,7 +140,7 @@ private:
         if (VERBOSITY()) {
             llvm::errs() << "Constant-folding this load: " << *li << '\n';
         }
-        li->replaceAllUsesWith(embedConstantPtr(cls, g.llvm_class_type_ptr));
+        li->replaceAllUsesWith(embedRuntimeGlobalValue(gv->getName(), g.llvm_class_type_ptr));
 
         changed = true;
         return changed;
@@ -31,16 +31,21 @@ struct StackMap;
 
 class OSREntryDescriptor {
 private:
-    OSREntryDescriptor(CompiledFunction* from_cf, AST_Jump* backedge) : cf(from_cf), backedge(backedge) {}
+    OSREntryDescriptor(CompiledFunction* from_cf, AST_Jump* backedge, bool from_interpreter)
+        : cf(from_cf), backedge(backedge), from_interpreter(from_interpreter) {}
 
 public:
     CompiledFunction* const cf;
     AST_Jump* const backedge;
+    // The interpreter passes every variable boxed, whereas compiled code passes them as whatever type it had them in.
+    // An interpreter frame can run a compiled version of the function (after a deopt, or in a stackless generator),
+    // so this is what keeps it from using one of the compiled code's entries.
+    const bool from_interpreter;
     typedef std::map<InternedString, ConcreteCompilerType*> ArgMap;
     ArgMap args;
 
-    static OSREntryDescriptor* create(CompiledFunction* from_cf, AST_Jump* backedge) {
-        return new OSREntryDescriptor(from_cf, backedge);
+    static OSREntryDescriptor* create(CompiledFunction* from_cf, AST_Jump* backedge, bool from_interpreter = false) {
+        return new OSREntryDescriptor(from_cf, backedge, from_interpreter);
     }
 };
 
@@ -18,8 +18,12 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <fcntl.h>
 #include <stdint.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
+#include <unistd.h>
+#include <unordered_map>
 
 #include "llvm/Support/FileSystem.h"
 #include "llvm/Support/Path.h"
@@ -27,6 +31,7 @@
 #include "codegen/pypa-parser.h"
 #include "codegen/serialize_ast.h"
 #include "core/ast.h"
+#include "core/cfg.h"
 #include "core/options.h"
 #include "core/stats.h"
 #include "core/types.h"
@@ -1026,69 +1031,65 @@ AST_Module* parse_file(const char* fn) {
 
 const char* getMagic() {
     if (ENABLE_PYPA_PARSER)
-        return "a\ncM";
+        return "a\ncN";
     else
-        return "a\ncm";
+        return "a\ncn";
 }
 
-#define MAGIC_STRING_LENGTH 4
-#define LENGTH_LENGTH sizeof(int)
-#define CHECKSUM_LENGTH 1
-
-enum class ParseResult {
-    SUCCESS,
-    PYC_UNWRITABLE,
-};
-static ParseResult _reparse(const char* fn, const std::string& cache_fn, AST_Module*& module) {
-    FILE* cache_fp = fopen(cache_fn.c_str(), "w");
-    if (!cache_fp)
-        return ParseResult::PYC_UNWRITABLE;
-
-    fwrite(getMagic(), 1, MAGIC_STRING_LENGTH, cache_fp);
-
-    int checksum_start = ftell(cache_fp);
-
-    int bytes_written = -1;
-    static_assert(sizeof(bytes_written) == LENGTH_LENGTH, "");
-    fwrite(&bytes_written, 1, LENGTH_LENGTH, cache_fp);
-    bytes_written = 0;
-
-    uint8_t checksum = -1;
-    static_assert(sizeof(checksum) == CHECKSUM_LENGTH, "");
-    fwrite(&checksum, 1, CHECKSUM_LENGTH, cache_fp);
-    checksum = 0;
-
-    if (ENABLE_PYPA_PARSER) {
-        module = pypa_parse(fn);
-        RELEASE_ASSERT(module, "unknown parse error");
+// Returns whether the cache file exists and is at least as new as the source file.
+static bool isParseCacheFresh(const char* fn, const std::string& cache_fn) {
+    struct stat source_stat, cache_stat;
+    int code = stat(fn, &source_stat);
+    assert(code == 0);
+    code = stat(cache_fn.c_str(), &cache_stat);
+    if (code != 0)
+        return false;
+    return cache_stat.st_mtime > source_stat.st_mtime
+           || (cache_stat.st_mtime == source_stat.st_mtime
+               && cache_stat.st_mtim.tv_nsec >= source_stat.st_mtim.tv_nsec);
+}
+
+// Readers mmap the cache file, so we never modify it in place: the new version gets written to a temporary file
+// which then gets renamed over the old one.
+static bool writeParseCache(const std::string& cache_fn, AST_Module* module,
+                            const std::vector<std::pair<AST*, CFG*>>& cfgs) {
+    std::string data = serializeAST(module, getMagic(), cfgs);
+
+    std::string tmp_fn = cache_fn + ".tmp" + std::to_string(getpid());
+    FILE* fp = fopen(tmp_fn.c_str(), "w");
+    if (!fp)
+        return false;
+
+    bool good = fwrite(data.data(), 1, data.size(), fp) == data.size();
+    good = (fclose(fp) == 0) && good;
+    if (good)
+        good = rename(tmp_fn.c_str(), cache_fn.c_str()) == 0;
+    if (!good)
+        unlink(tmp_fn.c_str());
+    return good;
+}
+
+static AST_Module* readParseCache(const std::string& cache_fn, std::vector<std::pair<AST*, CFG*>>& cfgs) {
+    int fd = open(cache_fn.c_str(), O_RDONLY);
+    if (fd == -1)
+        return NULL;
 
-        auto p = serializeAST(module, cache_fp);
-        checksum = p.second;
-        bytes_written += p.first;
-    } else {
-        FILE* parser = popen(getParserCommandLine(fn).c_str(), "r");
-        char buf[80];
-        while (true) {
-            int nread = fread(buf, 1, 80, parser);
-            if (nread == 0)
-                break;
-            bytes_written += nread;
-            fwrite(buf, 1, nread, cache_fp);
-
-            for (int i = 0; i < nread; i++) {
-                checksum ^= buf[i];
-            }
+    AST_Module* module = NULL;
+    struct stat st;
+    if (fstat(fd, &st) == 0 && st.st_size > 0) {
+        // The whole file gets used, so ask for it to be read in up front rather than a page fault at a time:
+        void* data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
+        if (data != MAP_FAILED) {
+            module = deserializeAST(static_cast<const char*>(data), st.st_size, getMagic(), &cfgs);
+            munmap(data, st.st_size);
         }
-        int code = pclose(parser);
-        assert(code == 0);
     }
+    close(fd);
 
-    fseek(cache_fp, checksum_start, SEEK_SET);
-    fwrite(&bytes_written, 1, LENGTH_LENGTH, cache_fp);
-    fwrite(&checksum, 1, CHECKSUM_LENGTH, cache_fp);
-
-    fclose(cache_fp);
-    return ParseResult::SUCCESS;
+    if (!module && VERBOSITY()) {
+        printf("Warning: corrupt, truncated, or out-of-date .pyc file found; ignoring\n");
+    }
+    return module;
 }
 
 // Parsing the file is somewhat expensive since we have to shell out to cpython;
@@ -1100,132 +1101,52 @@ AST_Module* caching_parse_file(const char* fn) {
     Timer _t("parsing");
     _t.setExitCallback([](uint64_t t) { us_parsing.log(t); });
 
-    int code;
     std::string cache_fn = std::string(fn) + "c";
 
-    struct stat source_stat, cache_stat;
-    code = stat(fn, &source_stat);
-    assert(code == 0);
-    code = stat(cache_fn.c_str(), &cache_stat);
-    if (code != 0 || cache_stat.st_mtime < source_stat.st_mtime
-        || (cache_stat.st_mtime == source_stat.st_mtime && cache_stat.st_mtim.tv_nsec < source_stat.st_mtim.tv_nsec)) {
-        AST_Module* mod = 0;
-        auto result = _reparse(fn, cache_fn, mod);
-        if (mod)
-            return mod;
-
-        if (result == ParseResult::PYC_UNWRITABLE)
-            return parse_file(fn);
-
-        code = stat(cache_fn.c_str(), &cache_stat);
-        if (code != 0)
-            return parse_file(fn);
-    }
-
+    AST_Module* module = NULL;
+    std::vector<std::pair<AST*, CFG*>> cfgs;
+    if (isParseCacheFresh(fn, cache_fn))
+        module = readParseCache(cache_fn, cfgs);
 
-    std::vector<char> file_data;
-    int tries = 0;
-    while (true) {
-        FILE* fp = fopen(cache_fn.c_str(), "r");
-
-        bool good = (bool)fp;
-
-        if (good) {
-            char buf[1024];
-            while (true) {
-                int read = fread(buf, 1, 1024, fp);
-                for (int i = 0; i < read; i++)
-                    file_data.push_back(buf[i]);
-
-                if (read == 0) {
-                    if (ferror(fp))
-                        good = false;
-                    break;
-                }
-            }
-
-            fclose(fp);
-            fp = NULL;
-        }
-
-        if (file_data.size() < MAGIC_STRING_LENGTH + LENGTH_LENGTH + CHECKSUM_LENGTH)
-            good = false;
-
-        if (good) {
-            if (strncmp(&file_data[0], getMagic(), MAGIC_STRING_LENGTH) != 0) {
-                if (VERBOSITY()) {
-                    printf("Warning: corrupt or non-Pyston .pyc file found; ignoring\n");
-                }
-                good = false;
-            }
-        }
-
-        if (good) {
-            int length;
-            static_assert(sizeof(length) == LENGTH_LENGTH, "");
-            length = *reinterpret_cast<int*>(&file_data[MAGIC_STRING_LENGTH]);
-
-            int expected_total_length = MAGIC_STRING_LENGTH + LENGTH_LENGTH + CHECKSUM_LENGTH + length;
-
-            if (expected_total_length != file_data.size()) {
-                if (VERBOSITY()) {
-                    printf("Warning: truncated .pyc file found; ignoring\n");
-                }
-                good = false;
-            } else {
-                RELEASE_ASSERT(length > 0 && length < 10 * 1048576, "invalid file length: %d (file size is %ld)",
-                               length, file_data.size());
-            }
-        }
+    if (!module) {
+        module = parse_file(fn);
+        writeParseCache(cache_fn, module, cfgs);
+    }
 
-        if (good) {
-            uint8_t checksum;
-            static_assert(sizeof(checksum) == CHECKSUM_LENGTH, "");
-            checksum = *reinterpret_cast<uint8_t*>(&file_data[MAGIC_STRING_LENGTH + LENGTH_LENGTH]);
+    trackCFGs(module, cfgs);
+    return module;
+}
 
-            for (int i = MAGIC_STRING_LENGTH + LENGTH_LENGTH + CHECKSUM_LENGTH; i < file_data.size(); i++) {
-                checksum ^= file_data[i];
-            }
+// The modules whose CFGs still have to be written to their parse cache, keyed on the source file.  Only the most recent
+// import of each file gets written.
+static std::unordered_map<std::string, AST_Module*> pending_cache_modules;
 
-            if (checksum != 0) {
-                if (VERBOSITY())
-                    printf("pyc checksum failed!\n");
-                good = false;
-            }
-        }
-
-        if (good) {
-            std::unique_ptr<BufferedReader> reader(
-                new BufferedReader(file_data, MAGIC_STRING_LENGTH + LENGTH_LENGTH + CHECKSUM_LENGTH));
-            AST* rtn = readASTMisc(reader.get());
-            reader->fill();
-
-            if (rtn && reader->bytesBuffered() == 0) {
-                assert(rtn->type == AST_TYPE::Module);
-                return ast_cast<AST_Module>(rtn);
-            }
-            good = false;
-        }
-
-        assert(!good);
-        tries++;
-        RELEASE_ASSERT(tries <= 5, "repeatedly failing to parse file");
-        if (!good) {
-            assert(!fp);
-            file_data.clear();
+void addCFGsToParseCache(const char* fn, AST_Module* module) {
+    AST_Module*& pending = pending_cache_modules[fn];
+    if (pending && pending != module) {
+        std::vector<std::pair<AST*, CFG*>> unused;
+        finishTrackingCFGs(pending, unused);
+    }
+    pending = module;
+}
 
-            AST_Module* mod = 0;
-            auto result = _reparse(fn, cache_fn, mod);
-            if (mod)
-                return mod;
+void writePendingParseCaches() {
+    for (auto&& p : pending_cache_modules) {
+        const char* fn = p.first.c_str();
+        std::vector<std::pair<AST*, CFG*>> cfgs;
+        if (!finishTrackingCFGs(p.second, cfgs))
+            continue;
 
-            if (result == ParseResult::PYC_UNWRITABLE)
-                return parse_file(fn);
+        // Don't clobber the cache if the source changed since we read it (or if there isn't a cache, ex because the
+        // directory isn't writable):
+        std::string cache_fn = std::string(fn) + "c";
+        if (!isParseCacheFresh(fn, cache_fn))
+            continue;
 
-            code = stat(cache_fn.c_str(), &cache_stat);
-            if (code != 0)
-                return parse_file(fn);
-        }
+        static StatCounter num_cfg_cache_writes("num_parse_cache_cfg_writes");
+        num_cfg_cache_writes.log();
+        writeParseCache(cache_fn, p.second, cfgs);
     }
+    pending_cache_modules.clear();
 }
 }
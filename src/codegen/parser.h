@@ -23,6 +23,12 @@ AST_Module* parse_string(const char* code);
 
 AST_Module* parse_file(const char* fn);
 AST_Module* caching_parse_file(const char* fn);
+// Once a module that came from caching_parse_file() has been run, this arranges for the CFGs that get computed for it
+// to be saved into its parse cache, so that the next import can skip building them.  Most of them only get computed
+// once their function first runs, so the cache files get written by writePendingParseCaches(), which should be called
+// at exit.
+void addCFGsToParseCache(const char* fn, AST_Module* module);
+void writePendingParseCaches();
 }
 
 #endif
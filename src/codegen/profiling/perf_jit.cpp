@@ -0,0 +1,324 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codegen/profiling/perf_jit.h"
+
+#include <cstdio>
+#include <elf.h>
+#include <fcntl.h>
+#include <map>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#if LLVMREV < 227586
+#include "llvm/DebugInfo/DIContext.h"
+#else
+#include "llvm/DebugInfo/DWARF/DIContext.h"
+#endif
+#include "llvm/ExecutionEngine/JITEventListener.h"
+#include "llvm/Object/ObjectFile.h"
+
+#include "core/common.h"
+#include "core/thread_utils.h"
+
+namespace pyston {
+
+bool perf_jit_enabled = false;
+
+// IC rewrites happen with the GIL held, but LLVM functions can get emitted by the background compile thread, so
+// everything below is guarded by this:
+static threading::PthreadFastMutex perf_jit_lock;
+
+static FILE* perf_map_file;
+static FILE* jitdump_file;
+static void* jitdump_marker;
+static uint64_t jitdump_code_index;
+
+// The code that we've told perf about (not counting IC slots), so that IC slots can get named after the code that
+// they are in and can get the line number of their statement.
+struct PerfCodeInfo {
+    uint64_t end;
+    std::string name;
+    std::string filename;
+    PerfLineTable lines;
+};
+static std::map<uint64_t, PerfCodeInfo> code_infos;
+
+// The jitdump format is described in tools/perf/Documentation/jitdump-specification.txt in the Linux tree.
+static const uint32_t JITDUMP_MAGIC = 0x4A695444; // "JiTD"
+static const uint32_t JITDUMP_VERSION = 1;
+
+enum JitdumpRecordType {
+    JIT_CODE_LOAD = 0,
+    JIT_CODE_DEBUG_INFO = 2,
+    JIT_CODE_CLOSE = 3,
+};
+
+struct JitdumpHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+};
+
+struct JitdumpRecordPrefix {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;
+};
+
+// Followed by the null-terminated name, and then the code bytes.
+struct JitdumpCodeLoad {
+    JitdumpRecordPrefix prefix;
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+};
+
+// Followed by nr_entry entries, each of which is a JitdumpDebugEntry followed by a null-terminated filename.
+// This has to come before the JIT_CODE_LOAD record of the code that it describes.
+struct JitdumpDebugInfo {
+    JitdumpRecordPrefix prefix;
+    uint64_t code_addr;
+    uint64_t nr_entry;
+};
+
+struct JitdumpDebugEntry {
+    uint64_t addr;
+    int32_t lineno;
+    int32_t discrim;
+};
+
+static_assert(sizeof(JitdumpHeader) == 40, "");
+static_assert(sizeof(JitdumpCodeLoad) == 56, "");
+static_assert(sizeof(JitdumpDebugInfo) == 32, "");
+static_assert(sizeof(JitdumpDebugEntry) == 16, "");
+
+static uint64_t jitdumpTimestamp() {
+    struct timespec ts;
+    int r = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(r == 0);
+    return ts.tv_sec * 1000000000ul + ts.tv_nsec;
+}
+
+static void writeCode(const std::string& name, void* addr, int size, const std::string& filename,
+                      const PerfLineTable& lines) {
+    fprintf(perf_map_file, "%lx %x %s\n", (uintptr_t)addr, size, name.c_str());
+
+    uint64_t timestamp = jitdumpTimestamp();
+
+    if (lines.size() && filename.size()) {
+        JitdumpDebugInfo info;
+        info.prefix.id = JIT_CODE_DEBUG_INFO;
+        info.prefix.total_size = sizeof(info) + lines.size() * (sizeof(JitdumpDebugEntry) + filename.size() + 1);
+        info.prefix.timestamp = timestamp;
+        info.code_addr = (uint64_t)addr;
+        info.nr_entry = lines.size();
+        fwrite(&info, sizeof(info), 1, jitdump_file);
+
+        for (const auto& p : lines) {
+            JitdumpDebugEntry entry;
+            entry.addr = p.first;
+            entry.lineno = p.second;
+            entry.discrim = 0;
+            fwrite(&entry, sizeof(entry), 1, jitdump_file);
+            fwrite(filename.c_str(), filename.size() + 1, 1, jitdump_file);
+        }
+    }
+
+    JitdumpCodeLoad load;
+    load.prefix.id = JIT_CODE_LOAD;
+    load.prefix.total_size = sizeof(load) + name.size() + 1 + size;
+    load.prefix.timestamp = timestamp;
+    load.pid = getpid();
+    load.tid = syscall(SYS_gettid);
+    load.vma = (uint64_t)addr;
+    load.code_addr = (uint64_t)addr;
+    load.code_size = size;
+    load.code_index = jitdump_code_index++;
+    fwrite(&load, sizeof(load), 1, jitdump_file);
+    fwrite(name.c_str(), name.size() + 1, 1, jitdump_file);
+    fwrite(addr, size, 1, jitdump_file);
+}
+
+void initPerfJit() {
+    assert(!perf_jit_enabled);
+
+    char buf[80];
+    snprintf(buf, sizeof(buf), "/tmp/perf-%d.map", getpid());
+    perf_map_file = fopen(buf, "w");
+    RELEASE_ASSERT(perf_map_file, "couldn't open %s", buf);
+
+    snprintf(buf, sizeof(buf), "/tmp/jit-%d.dump", getpid());
+    int fd = open(buf, O_CREAT | O_TRUNC | O_RDWR, 0666);
+    RELEASE_ASSERT(fd != -1, "couldn't open %s", buf);
+    // perf record finds the jitdump file by seeing it get mapped as executable; we never touch the mapping.
+    jitdump_marker = mmap(NULL, sysconf(_SC_PAGESIZE), PROT_READ | PROT_EXEC, MAP_PRIVATE, fd, 0);
+    RELEASE_ASSERT(jitdump_marker != MAP_FAILED, "");
+    jitdump_file = fdopen(fd, "wb");
+    RELEASE_ASSERT(jitdump_file, "");
+
+    JitdumpHeader header;
+    header.magic = JITDUMP_MAGIC;
+    header.version = JITDUMP_VERSION;
+    header.total_size = sizeof(header);
+    header.elf_mach = EM_X86_64;
+    header.pad1 = 0;
+    header.pid = getpid();
+    header.timestamp = jitdumpTimestamp();
+    header.flags = 0;
+    fwrite(&header, sizeof(header), 1, jitdump_file);
+
+    perf_jit_enabled = true;
+}
+
+void teardownPerfJit() {
+    LOCK_REGION(&perf_jit_lock);
+    if (!perf_jit_enabled)
+        return;
+    perf_jit_enabled = false;
+
+    JitdumpRecordPrefix close;
+    close.id = JIT_CODE_CLOSE;
+    close.total_size = sizeof(close);
+    close.timestamp = jitdumpTimestamp();
+    fwrite(&close, sizeof(close), 1, jitdump_file);
+
+    fclose(jitdump_file);
+    munmap(jitdump_marker, sysconf(_SC_PAGESIZE));
+    fclose(perf_map_file);
+    code_infos.clear();
+}
+
+void registerPerfJitCode(const std::string& name, void* addr, int size, const std::string& filename,
+                         const PerfLineTable& lines) {
+    if (!perf_jit_enabled)
+        return;
+
+    LOCK_REGION(&perf_jit_lock);
+    if (!perf_jit_enabled)
+        return;
+
+    writeCode(name, addr, size, filename, lines);
+
+    PerfCodeInfo& info = code_infos[(uint64_t)addr];
+    info.end = (uint64_t)addr + size;
+    info.name = name;
+    info.filename = filename;
+    info.lines = lines;
+}
+
+void deregisterPerfJitCode(void* addr) {
+    if (!perf_jit_enabled)
+        return;
+
+    LOCK_REGION(&perf_jit_lock);
+    code_infos.erase((uint64_t)addr);
+}
+
+void registerPerfJitICSlot(const char* debug_name, int slot_idx, void* slot_start, int slot_size) {
+    if (!perf_jit_enabled)
+        return;
+
+    LOCK_REGION(&perf_jit_lock);
+    if (!perf_jit_enabled)
+        return;
+
+    uint64_t addr = (uint64_t)slot_start;
+    std::string name = std::string(debug_name) + " IC slot " + std::to_string(slot_idx);
+    std::string filename;
+    PerfLineTable lines;
+
+    auto it = code_infos.upper_bound(addr);
+    if (it != code_infos.begin()) {
+        --it;
+        const PerfCodeInfo& parent = it->second;
+        if (addr < parent.end) {
+            name += " in " + parent.name;
+
+            // The line of the last line table entry at or before the IC:
+            int lineno = 0;
+            for (const auto& p : parent.lines) {
+                if (p.first > addr)
+                    break;
+                lineno = p.second;
+            }
+            if (lineno > 0) {
+                filename = parent.filename;
+                lines.push_back(std::make_pair(addr, lineno));
+            }
+        }
+    }
+
+    writeCode(name, slot_start, slot_size, filename, lines);
+}
+
+class PerfJITEventListener : public llvm::JITEventListener {
+public:
+    virtual void NotifyObjectEmitted(const llvm::object::ObjectFile& Obj,
+                                     const llvm::RuntimeDyld::LoadedObjectInfo& L) {
+        std::unique_ptr<llvm::DIContext> Context(llvm::DIContext::getDWARFContext(Obj));
+
+        for (const auto& sym : Obj.symbols()) {
+            llvm::object::SymbolRef::Type SymType;
+            if (sym.getType(SymType) || SymType != llvm::object::SymbolRef::ST_Function)
+                continue;
+
+            llvm::StringRef Name;
+            uint64_t Size;
+            if (sym.getName(Name) || sym.getSize(Size))
+                continue;
+
+            uint64_t func_addr = L.getSymbolLoadAddress(Name);
+            if (!func_addr || !Size)
+                continue;
+
+#if LLVMREV < 208921
+            llvm::DILineInfoTable lines = Context->getLineInfoForAddressRange(
+                func_addr, Size, llvm::DILineInfoSpecifier::FunctionName | llvm::DILineInfoSpecifier::FileLineInfo
+                                     | llvm::DILineInfoSpecifier::AbsoluteFilePath);
+#else
+            llvm::DILineInfoTable lines = Context->getLineInfoForAddressRange(
+                func_addr, Size,
+                llvm::DILineInfoSpecifier(llvm::DILineInfoSpecifier::FileLineInfoKind::AbsoluteFilePath,
+                                          llvm::DILineInfoSpecifier::FunctionNameKind::LinkageName));
+#endif
+
+            // Each of our functions comes from a single Python file:
+            std::string filename;
+            PerfLineTable line_table;
+            for (const auto& p : lines) {
+                if (filename.empty())
+                    filename = p.second.FileName;
+                line_table.push_back(std::make_pair(p.first, (int)p.second.Line));
+            }
+
+            registerPerfJitCode(Name.str(), (void*)func_addr, Size, filename, line_table);
+        }
+    }
+};
+
+llvm::JITEventListener* makePerfJITEventListener() {
+    return new PerfJITEventListener();
+}
+}
@@ -0,0 +1,61 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_PROFILING_PERFJIT_H
+#define PYSTON_CODEGEN_PROFILING_PERFJIT_H
+
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace llvm {
+class JITEventListener;
+}
+
+namespace pyston {
+
+// Tells perf about all of the code that we generate: LLVM functions (including OSR entries), template JIT blocks,
+// runtime IC stubs, and the code that gets written into IC slots.  Enabled with -p, and writes two files:
+//
+// - /tmp/perf-PID.map, the "start size name" text format that perf report uses to name addresses.
+// - /tmp/jit-PID.dump, the jitdump format, which also has the code bytes and a line table for each piece of code.
+//   Record with "perf record -k mono" (the records are timestamped with CLOCK_MONOTONIC), and then run
+//   "perf inject --jit" to turn every record into its own ELF object for perf report and perf annotate.
+//
+// IC slots get overwritten in place, so every rewrite gets a new record, and perf attributes each sample to the
+// version of the slot that was there at the time.
+
+void initPerfJit();
+void teardownPerfJit();
+
+extern bool perf_jit_enabled;
+inline bool isPerfJitEnabled() {
+    return perf_jit_enabled;
+}
+
+// Pairs of (code address, line number), sorted by address; each line applies until the next entry's address.
+typedef std::vector<std::pair<uint64_t, int>> PerfLineTable;
+
+void registerPerfJitCode(const std::string& name, void* addr, int size, const std::string& filename = "",
+                         const PerfLineTable& lines = PerfLineTable());
+void deregisterPerfJitCode(void* addr);
+// Called after an IC slot gets rewritten.  The record is named after the rewrite's debug name and the code that the IC
+// is in, and gets the line of the statement that the IC belongs to.
+void registerPerfJitICSlot(const char* debug_name, int slot_idx, void* slot_start, int slot_size);
+
+llvm::JITEventListener* makePerfJITEventListener();
+}
+
+#endif
@@ -0,0 +1,173 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codegen/profiling/sampling_profiler.h"
+
+#include <algorithm>
+#include <signal.h>
+#include <sys/time.h>
+#include <unordered_map>
+#include <vector>
+
+#include "codegen/irgen/hooks.h"
+#include "codegen/unwinding.h"
+#include "core/ast.h"
+#include "core/common.h"
+#include "core/stats.h"
+#include "core/threading.h"
+#include "core/types.h"
+
+namespace pyston {
+
+std::atomic<int> profiler_samples_pending(0);
+
+// These are only accessed while holding the GIL.
+static bool profiler_running = false;
+static struct sigaction old_sigprof_action;
+// Number of samples for each distinct stack, keyed by the folded representation of the stack.
+static std::unordered_map<std::string, int64_t> folded_stack_counts;
+
+static void handleSigprof(int signum) {
+    profiler_samples_pending.fetch_add(1, std::memory_order_relaxed);
+    threading::requestSafePoint();
+}
+
+static const char* tierName(EffortLevel effort) {
+    switch (effort) {
+        case EffortLevel::INTERPRETED:
+            return "interpreted";
+        case EffortLevel::MINIMAL:
+            return "minimal";
+        case EffortLevel::MODERATE:
+            return "moderate";
+        case EffortLevel::MAXIMAL:
+            return "maximal";
+    }
+    RELEASE_ASSERT(0, "%d", (int)effort);
+}
+
+static void appendFrame(std::string& folded, const ExecutionPoint& point) {
+    SourceInfo* source = point.cf->clfunc->source.get();
+    assert(source);
+
+    // ';' separates frames in the folded format, and the count comes after the last space of the line.
+    std::string name = source->getName();
+    std::replace(name.begin(), name.end(), ';', ':');
+    std::string fn = source->fn;
+    std::replace(fn.begin(), fn.end(), ';', ':');
+
+    folded += name;
+    folded += " (";
+    folded += fn;
+    folded += ':';
+    // Code that got compiled before the profiler was first started doesn't know where its safepoints are:
+    if (point.current_stmt)
+        folded += std::to_string(point.current_stmt->lineno);
+    else
+        folded += '?';
+    folded += ") [";
+    folded += tierName(point.cf->effort);
+    if (point.cf->entry_descriptor)
+        folded += " osr";
+    folded += ']';
+}
+
+void takePendingProfilerSamples() {
+    // If there's more than one, we weren't able to get to a safepoint for a while (such as while in LLVM or the GC),
+    // and we attribute all of that time to where we are now.
+    int n = profiler_samples_pending.exchange(0, std::memory_order_relaxed);
+    if (!n || !profiler_running)
+        return;
+
+    static StatCounter num_profiler_samples("num_profiler_samples");
+    num_profiler_samples.log(n);
+
+    std::vector<ExecutionPoint> points;
+    unwindExecutionPoints([&](const ExecutionPoint& point) {
+        points.push_back(point);
+        return false;
+    });
+
+    // The folded format lists the outermost frame first:
+    std::string folded;
+    for (auto it = points.rbegin(); it != points.rend(); ++it) {
+        if (!folded.empty())
+            folded += ';';
+        appendFrame(folded, *it);
+    }
+    if (folded.empty())
+        folded = "[no Python frames]";
+
+    folded_stack_counts[folded] += n;
+}
+
+void startSamplingProfiler(int interval_us) {
+    assert(interval_us > 0);
+
+    enableSafepointFrameInfo();
+
+    if (!profiler_running) {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_handler = handleSigprof;
+        // Don't make the program see EINTR from its system calls just because we're profiling it:
+        action.sa_flags = SA_RESTART;
+        sigemptyset(&action.sa_mask);
+        int r = sigaction(SIGPROF, &action, &old_sigprof_action);
+        RELEASE_ASSERT(r == 0, "%s", strerror(errno));
+
+        profiler_running = true;
+    }
+
+    // ITIMER_PROF counts the CPU time of the whole process, which is what we want to attribute.
+    struct itimerval prof_timer;
+    prof_timer.it_value.tv_sec = prof_timer.it_interval.tv_sec = interval_us / 1000000;
+    prof_timer.it_value.tv_usec = prof_timer.it_interval.tv_usec = interval_us % 1000000;
+    int r = setitimer(ITIMER_PROF, &prof_timer, NULL);
+    RELEASE_ASSERT(r == 0, "%s", strerror(errno));
+}
+
+bool isSamplingProfilerRunning() {
+    return profiler_running;
+}
+
+std::string stopSamplingProfiler() {
+    if (profiler_running) {
+        struct itimerval prof_timer;
+        memset(&prof_timer, 0, sizeof(prof_timer));
+        int r = setitimer(ITIMER_PROF, &prof_timer, NULL);
+        RELEASE_ASSERT(r == 0, "%s", strerror(errno));
+
+        r = sigaction(SIGPROF, &old_sigprof_action, NULL);
+        RELEASE_ASSERT(r == 0, "%s", strerror(errno));
+
+        profiler_running = false;
+        profiler_samples_pending.store(0, std::memory_order_relaxed);
+    }
+
+    // Sorted, so that the output is deterministic:
+    std::vector<std::pair<std::string, int64_t>> stacks(folded_stack_counts.begin(), folded_stack_counts.end());
+    std::sort(stacks.begin(), stacks.end());
+    folded_stack_counts.clear();
+
+    std::string rtn;
+    for (const auto& p : stacks) {
+        rtn += p.first;
+        rtn += ' ';
+        rtn += std::to_string(p.second);
+        rtn += '\n';
+    }
+    return rtn;
+}
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_PROFILING_SAMPLINGPROFILER_H
+#define PYSTON_CODEGEN_PROFILING_SAMPLINGPROFILER_H
+
+#include <atomic>
+#include <string>
+
+namespace pyston {
+
+// A sampling profiler for Python code that can be turned on and off while the program runs (through
+// __pyston__.startProfiler and __pyston__.stopProfiler), so that it can be pointed at a live process.
+//
+// SIGPROF only marks a sample as pending; the thread that holds the GIL takes it at its next safepoint (a function
+// entry or a loop backedge) by walking its Python stack.  Each frame gets recorded as its function, the line it is at,
+// and the tier that it is running in, and the samples get aggregated into the "folded stacks" format that
+// flamegraph.pl and similar tools read.
+//
+// Since samples only get taken at safepoints, the line of the innermost frame is skewed: it's always the first
+// statement of a function or of a loop body, never the statement that was actually running when the signal arrived.
+// A loop's samples all land on its first line, and straight-line code between safepoints gets charged to the next
+// one.  The outer frames are at calls, so their lines are accurate.  The function-level totals are unaffected.
+//
+// Starting the profiler for the first time turns on safepoint_frame_info and sends the already-compiled code back to
+// be recompiled; frames that are still running the old code show up with "?" for their line.
+
+void startSamplingProfiler(int interval_us);
+bool isSamplingProfilerRunning();
+// Stops the profiler and returns the samples that it took, one "frame;frame;... count" line per distinct stack.
+std::string stopSamplingProfiler();
+
+extern std::atomic<int> profiler_samples_pending;
+inline bool hasPendingProfilerSamples() {
+    return profiler_samples_pending.load(std::memory_order_relaxed) != 0;
+}
+// Called from allowGLReadPreemption(), with the GIL held.
+void takePendingProfilerSamples();
+}
+
+#endif
@@ -29,6 +29,7 @@
 #include "llvm/Support/TargetSelect.h"
 #include "llvm/Transforms/Scalar.h"
 
+#include "codegen/ast_interpreter.h"
 #include "codegen/codegen.h"
 #include "codegen/irgen.h"
 #include "codegen/irgen/hooks.h"
@@ -41,6 +42,7 @@
 #include "runtime/import.h"
 #include "runtime/inline/boxing.h"
 #include "runtime/int.h"
+#include "runtime/list.h"
 #include "runtime/long.h"
 #include "runtime/objmodel.h"
 #include "runtime/set.h"
@@ -195,6 +197,8 @@ void initGlobalFuncs(GlobalState& g) {
     GET(delattr);
     GET(getitem);
     GET(setitem);
+    GET(getattrCAPI);
+    GET(getitemCAPI);
     GET(delitem);
     GET(getGlobal);
     GET(delGlobal);
@@ -213,6 +217,11 @@ void initGlobalFuncs(GlobalState& g) {
     GET(strOrUnicode);
     GET(exceptionMatches);
     GET(yield);
+    llvm::Type* suspend_arg_types[] = { g.llvm_generator_type_ptr, g.llvm_value_type_ptr, g.i8_ptr, g.i8_ptr, g.i8_ptr,
+                                        g.llvm_frame_info_type->getPointerTo(), g.llvm_closure_type_ptr,
+                                        g.llvm_value_type_ptr->getPointerTo() };
+    g.funcs.astInterpretGeneratorSuspend
+        = addFunc((void*)astInterpretGeneratorSuspend, g.llvm_value_type_ptr, suspend_arg_types);
     GET(getiterHelper);
     GET(hasnext);
 
@@ -229,6 +238,11 @@ void initGlobalFuncs(GlobalState& g) {
     GET(listAppendInternal);
     GET(getSysStdout);
 
+    GET(listGetitemUnboxed);
+    GET(listSetitemUnboxed);
+    GET(listSetitemUnboxedInt);
+    GET(listSetitemUnboxedFloat);
+
     GET(exec);
     GET(boxedLocalsSet);
     GET(boxedLocalsGet);
@@ -265,6 +279,7 @@ void initGlobalFuncs(GlobalState& g) {
     g.funcs.__cxa_end_catch = addFunc((void*)__cxa_end_catch, g.void_);
     GET(raise0);
     GET(raise3);
+    GET(catchCAPIException);
     GET(deopt);
 
     GET(div_float_float);
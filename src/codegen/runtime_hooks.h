@@ -38,11 +38,13 @@ struct GlobalFuncs {
         *decodeUTF8StringPtr;
     llvm::Value* getattr, *setattr, *delattr, *delitem, *delGlobal, *nonzero, *binop, *compare, *augbinop, *unboxedLen,
         *getitem, *getclsattr, *getGlobal, *setitem, *unaryop, *import, *importFrom, *importStar, *repr, *str,
-        *strOrUnicode, *exceptionMatches, *yield, *getiterHelper, *hasnext;
+        *strOrUnicode, *exceptionMatches, *yield, *astInterpretGeneratorSuspend, *getiterHelper, *hasnext;
+    llvm::Value* getattrCAPI, *getitemCAPI, *catchCAPIException;
 
     llvm::Value* unpackIntoArray, *raiseAttributeError, *raiseAttributeErrorStr, *raiseNotIterableError,
         *raiseIndexErrorStr, *assertNameDefined, *assertFail, *assertFailDerefNameDefined;
     llvm::Value* printFloat, *listAppendInternal, *getSysStdout;
+    llvm::Value* listGetitemUnboxed, *listSetitemUnboxed, *listSetitemUnboxedInt, *listSetitemUnboxedFloat;
     llvm::Value* runtimeCall0, *runtimeCall1, *runtimeCall2, *runtimeCall3, *runtimeCall, *runtimeCallN;
     llvm::Value* callattr0, *callattr1, *callattr2, *callattr3, *callattr, *callattrN;
     llvm::Value* reoptCompiledFunc, *compilePartialFunc;
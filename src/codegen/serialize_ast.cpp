@@ -14,546 +14,1342 @@
 
 #include "codegen/serialize_ast.h"
 
-#include "llvm/Support/SwapByteOrder.h"
+#include <cstring>
 
+#include "llvm/ADT/DenseMap.h"
+#include "llvm/ADT/StringMap.h"
+
+#include "codegen/entry.h"
 #include "core/ast.h"
+#include "core/cfg.h"
 
 namespace pyston {
-namespace {
 
-class SerializeASTVisitor : public ASTVisitor {
-private:
-    FILE* file;
-    uint8_t checksum;
+// Bump this whenever the encoding of any node changes (including renumbering AST_TYPE):
+static const uint32_t PARSE_CACHE_VERSION = 1;
 
-public:
-    static std::pair<unsigned int, uint8_t> write(AST_Module* module, FILE* file) {
-        SerializeASTVisitor visitor(file);
-        unsigned long start_pos = ftell(file);
-        visitor.writeASTMisc(module);
-        return std::make_pair(ftell(file) - start_pos, visitor.checksum);
+// All of the fields are in native (little-endian) byte order; offsets are relative to the end of the header.
+struct ParseCacheHeader {
+    char magic[4];
+    uint32_t version;
+    uint32_t length;   // of everything after the header
+    uint32_t checksum; // of everything after the header
+    uint32_t num_strings;
+    uint32_t nodes_offset;
+    uint32_t cfgs_offset; // 0 if there are no CFGs
+    char binary_id[16];   // the CFGs are only valid for the binary that wrote them
+};
+
+// Node encodings start with a tag byte, which is the AST_TYPE of the node except for these:
+static const uint8_t NULL_NODE_TAG = 0x00;
+static const uint8_t BACKREF_TAG = 0xff;
+
+// This gets computed on every load, so it works a word at a time.  It only has to catch truncated or otherwise
+// damaged files, not malicious ones.
+static uint32_t computeChecksum(const char* data, size_t size) {
+    const uint64_t prime = 0x100000001b3ULL;
+    uint64_t h = 0xcbf29ce484222325ULL;
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+        h = (h ^ word) * prime;
+    }
+    for (; i < size; i++)
+        h = (h ^ (uint8_t)data[i]) * prime;
+    return (uint32_t)(h ^ (h >> 32));
+}
+
+static void getBinaryId(char* binary_id) {
+    const std::string& id = getObjectCacheBinaryId();
+    memset(binary_id, 0, sizeof(ParseCacheHeader::binary_id));
+    memcpy(binary_id, id.data(), std::min(id.size(), sizeof(ParseCacheHeader::binary_id)));
+}
+
+static bool isExprType(int type) {
+    switch (type) {
+        case AST_TYPE::Attribute:
+        case AST_TYPE::AugBinOp:
+        case AST_TYPE::BinOp:
+        case AST_TYPE::BoolOp:
+        case AST_TYPE::Call:
+        case AST_TYPE::ClsAttribute:
+        case AST_TYPE::Compare:
+        case AST_TYPE::Dict:
+        case AST_TYPE::DictComp:
+        case AST_TYPE::Ellipsis:
+        case AST_TYPE::ExtSlice:
+        case AST_TYPE::GeneratorExp:
+        case AST_TYPE::IfExp:
+        case AST_TYPE::Index:
+        case AST_TYPE::Lambda:
+        case AST_TYPE::LangPrimitive:
+        case AST_TYPE::List:
+        case AST_TYPE::ListComp:
+        case AST_TYPE::MakeClass:
+        case AST_TYPE::MakeFunction:
+        case AST_TYPE::Name:
+        case AST_TYPE::Num:
+        case AST_TYPE::Repr:
+        case AST_TYPE::Set:
+        case AST_TYPE::SetComp:
+        case AST_TYPE::Slice:
+        case AST_TYPE::Str:
+        case AST_TYPE::Subscript:
+        case AST_TYPE::Tuple:
+        case AST_TYPE::UnaryOp:
+        case AST_TYPE::Yield:
+            return true;
+        default:
+            return false;
     }
+}
+
+static bool isStmtType(int type) {
+    switch (type) {
+        case AST_TYPE::Assert:
+        case AST_TYPE::Assign:
+        case AST_TYPE::AugAssign:
+        case AST_TYPE::Branch:
+        case AST_TYPE::Break:
+        case AST_TYPE::ClassDef:
+        case AST_TYPE::Continue:
+        case AST_TYPE::Delete:
+        case AST_TYPE::Exec:
+        case AST_TYPE::Expr:
+        case AST_TYPE::For:
+        case AST_TYPE::FunctionDef:
+        case AST_TYPE::Global:
+        case AST_TYPE::If:
+        case AST_TYPE::Import:
+        case AST_TYPE::ImportFrom:
+        case AST_TYPE::Invoke:
+        case AST_TYPE::Jump:
+        case AST_TYPE::Pass:
+        case AST_TYPE::Print:
+        case AST_TYPE::Raise:
+        case AST_TYPE::Return:
+        case AST_TYPE::TryExcept:
+        case AST_TYPE::TryFinally:
+        case AST_TYPE::While:
+        case AST_TYPE::With:
+            return true;
+        default:
+            return false;
+    }
+}
 
+namespace {
+
+class SerializeASTVisitor : public ASTVisitor {
 private:
-    SerializeASTVisitor(FILE* file) : file(file), checksum(0) {}
-    virtual ~SerializeASTVisitor() {}
+    std::string nodes;
+    llvm::StringMap<uint32_t> string_ids;
+    std::vector<llvm::StringRef> strings;
+    llvm::DenseMap<AST*, uint32_t> node_ids;
 
-    void writeByte(uint64_t v) {
-        assert(v < 256);
+    // The CFG whose blocks we're currently writing, and the position of each of its blocks in cfg->blocks:
+    llvm::DenseMap<CFGBlock*, uint32_t> block_positions;
+    bool failed;
 
-        uint8_t b = (uint8_t)v;
-        fwrite(&b, 1, 1, file);
-        checksum ^= b;
-    }
+public:
+    static std::string write(AST_Module* module, const char* magic, const std::vector<std::pair<AST*, CFG*>>& cfgs) {
+        SerializeASTVisitor visitor;
+        visitor.writeNode(module);
 
-    void writeShort(uint64_t v) {
-        RELEASE_ASSERT(v < (1 << 16), "");
-        // I guess we use big-endian:
-        for (int i = 1; i >= 0; i--) {
-            writeByte((v >> (i * 8)) & 0xff);
+        size_t cfgs_offset = 0;
+        if (cfgs.size()) {
+            cfgs_offset = visitor.nodes.size();
+            visitor.writeCFGs(cfgs);
+            if (visitor.failed) {
+                // Some CFG had a reference that we couldn't represent; the AST by itself is still fine.
+                visitor.nodes.resize(cfgs_offset);
+                cfgs_offset = 0;
+            }
         }
-    }
 
-    void writeUInt(uint64_t v) {
-        RELEASE_ASSERT(v < (1L << 32), "");
-        for (int i = 3; i >= 0; i--) {
-            writeByte((v >> (i * 8)) & 0xff);
+        std::string body;
+        std::vector<uint32_t> string_offsets;
+        size_t table_size = visitor.strings.size() * sizeof(uint32_t);
+        for (llvm::StringRef s : visitor.strings) {
+            string_offsets.push_back(table_size + body.size());
+            writeVarint(body, s.size());
+            body.append(s.data(), s.size());
         }
+
+        ParseCacheHeader header;
+        memcpy(header.magic, magic, sizeof(header.magic));
+        header.version = PARSE_CACHE_VERSION;
+        header.num_strings = visitor.strings.size();
+        header.nodes_offset = table_size + body.size();
+        header.cfgs_offset = cfgs_offset ? header.nodes_offset + cfgs_offset : 0;
+        getBinaryId(header.binary_id);
+
+        std::string rtn;
+        rtn.reserve(sizeof(header) + header.nodes_offset + visitor.nodes.size());
+        rtn.append(sizeof(header), '\0');
+        rtn.append(reinterpret_cast<const char*>(string_offsets.data()), table_size);
+        rtn.append(body);
+        rtn.append(visitor.nodes);
+
+        RELEASE_ASSERT(rtn.size() - sizeof(header) < (1UL << 32), "");
+        header.length = rtn.size() - sizeof(header);
+        header.checksum = computeChecksum(&rtn[sizeof(header)], header.length);
+        memcpy(&rtn[0], &header, sizeof(header));
+        return rtn;
     }
 
-    void writeULL(uint64_t v) {
-        for (int i = 7; i >= 0; i--) {
-            writeByte((v >> (i * 8)) & 0xff);
+private:
+    SerializeASTVisitor() : failed(false) {}
+    virtual ~SerializeASTVisitor() {}
+
+    static void writeVarint(std::string& out, uint64_t v) {
+        while (v >= 0x80) {
+            out.push_back((char)(v | 0x80));
+            v >>= 7;
         }
+        out.push_back((char)v);
     }
 
-    void writeDouble(double v) {
-        union {
-            double v;
-            uint64_t u;
-        } u{.v = v };
-        writeULL(u.u);
+    void writeByte(uint64_t v) {
+        assert(v < 256);
+        nodes.push_back((char)v);
     }
 
-    void writeString(const std::string& v) {
-        writeUInt(v.size());
-        fwrite(v.c_str(), 1, v.size(), file);
-        for (int i = 0; i < v.size(); i++) {
-            checksum ^= v[i];
-        }
+    void writeVarint(uint64_t v) { writeVarint(nodes, v); }
+
+    void writeSigned(int64_t v) { writeVarint(((uint64_t)v << 1) ^ (uint64_t)(v >> 63)); }
+
+    void writeDouble(double v) { nodes.append(reinterpret_cast<const char*>(&v), sizeof(v)); }
+
+    void writeString(llvm::StringRef s) {
+        auto r = string_ids.insert(std::make_pair(s, (uint32_t)strings.size()));
+        if (r.second)
+            strings.push_back(r.first->getKey());
+        writeVarint(r.first->getValue());
     }
 
-    void writeString(const InternedString v) { writeString(v.str()); }
+    void writeString(InternedString s) { writeString(llvm::StringRef(s.str())); }
 
     void writeStringVector(const std::vector<InternedString>& vec) {
-        writeShort(vec.size());
-        for (auto&& e : vec) {
-            writeString(e);
-        }
+        writeVarint(vec.size());
+        for (auto s : vec)
+            writeString(s);
     }
 
-    void writeExpr(AST_expr* e) {
-        if (!e) {
-            writeByte(0x00);
-        } else {
-            writeByte(e->type);
-            writeByte(0xae); // check byte
-            e->accept(this);
+    void writeNode(AST* node) {
+        if (!node) {
+            writeByte(NULL_NODE_TAG);
+            return;
         }
-    }
 
-    void writeExprVector(const std::vector<AST_expr*>& vec) {
-        writeShort(vec.size());
-        for (auto* e : vec) {
-            writeExpr(e);
+        auto r = node_ids.insert(std::make_pair(node, (uint32_t)node_ids.size()));
+        if (!r.second) {
+            writeByte(BACKREF_TAG);
+            writeVarint(r.first->second);
+            return;
         }
+
+        assert(node->type != NULL_NODE_TAG && node->type != BACKREF_TAG);
+        writeByte(node->type);
+        writeVarint(node->lineno);
+        writeVarint(node->col_offset);
+        node->accept(this);
     }
 
-    void writeStmt(AST_stmt* e) {
-        writeByte(e->type);
-        writeByte(0xae); // check byte
-        e->accept(this);
+    template <class T> void writeNodeVector(const std::vector<T*>& vec) {
+        writeVarint(vec.size());
+        for (auto* e : vec)
+            writeNode(e);
     }
 
-    void writeStmtVector(const std::vector<AST_stmt*>& vec) {
-        writeShort(vec.size());
-        for (auto* e : vec) {
-            writeStmt(e);
+    void writeBlock(CFGBlock* block) {
+        if (!block) {
+            writeVarint(0);
+            return;
         }
+
+        auto it = block_positions.find(block);
+        if (it == block_positions.end()) {
+            failed = true;
+            writeVarint(0);
+            return;
+        }
+        writeVarint(it->second + 1);
     }
 
-    void writeColOffset(uint32_t v) {
-        assert(v < 100000 || v == -1);
-        writeULL(v == -1 ? 0 : v);
+    void writeBlockVector(const std::vector<CFGBlock*>& vec) {
+        writeVarint(vec.size());
+        for (auto* b : vec)
+            writeBlock(b);
     }
 
-    void writeLineno(uint64_t v) { writeULL(v); }
+    void writeCFGs(const std::vector<std::pair<AST*, CFG*>>& cfgs) {
+        writeVarint(cfgs.size());
+        for (auto&& p : cfgs) {
+            CFG* cfg = p.second;
+            writeNode(p.first);
 
-    void writeASTMisc(AST* e) {
-        writeByte(e->type);
-        writeByte(0xae); // check byte
-        switch (e->type) {
-            case AST_TYPE::alias:
-            case AST_TYPE::arguments:
-            case AST_TYPE::comprehension:
-            case AST_TYPE::ExceptHandler:
-            case AST_TYPE::keyword:
-            case AST_TYPE::Module:
-                return e->accept(this);
-            default:
-                assert(0);
-        }
-    }
+            block_positions.clear();
+            writeVarint(cfg->blocks.size());
+            for (int i = 0; i < cfg->blocks.size(); i++) {
+                CFGBlock* b = cfg->blocks[i];
+                block_positions[b] = i;
+                writeVarint(b->idx);
+                if (b->info) {
+                    writeVarint(1);
+                    writeString(b->info);
+                } else {
+                    writeVarint(0);
+                }
+            }
+            for (CFGBlock* b : cfg->blocks) {
+                writeBlockVector(b->predecessors);
+                writeBlockVector(b->successors);
+            }
+            for (CFGBlock* b : cfg->blocks)
+                writeNodeVector(b->body);
+
+            writeVarint(cfg->scope_replacements.size());
+            for (auto&& r : cfg->scope_replacements) {
+                writeNode(r.first);
+                writeNode(r.second);
+            }
 
-    template <class T> void writeMiscVector(std::vector<T*>& vec) {
-        writeShort(vec.size());
-        for (auto&& e : vec) {
-            writeASTMisc(e);
+            if (failed)
+                return;
         }
+        block_positions.clear();
     }
 
-
-
     virtual bool visit_alias(AST_alias* node) {
-        writeString(node->asname);
         writeString(node->name);
+        writeString(node->asname);
         return true;
     }
     virtual bool visit_arguments(AST_arguments* node) {
-        writeExprVector(node->args);
-        writeExprVector(node->defaults);
+        writeNodeVector(node->args);
+        writeNodeVector(node->defaults);
         writeString(node->kwarg);
         writeString(node->vararg);
         return true;
     }
     virtual bool visit_assert(AST_Assert* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->msg);
-        writeExpr(node->test);
+        writeNode(node->msg);
+        writeNode(node->test);
         return true;
     }
     virtual bool visit_assign(AST_Assign* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExprVector(node->targets);
-        writeExpr(node->value);
+        writeNodeVector(node->targets);
+        writeNode(node->value);
         return true;
     }
     virtual bool visit_augassign(AST_AugAssign* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
         writeByte(node->op_type);
-        writeExpr(node->target);
-        writeExpr(node->value);
+        writeNode(node->target);
+        writeNode(node->value);
+        return true;
+    }
+    virtual bool visit_augbinop(AST_AugBinOp* node) {
+        writeByte(node->op_type);
+        writeNode(node->left);
+        writeNode(node->right);
         return true;
     }
     virtual bool visit_attribute(AST_Attribute* node) {
-        writeString(node->attr);
-        writeColOffset(node->col_offset);
+        writeNode(node->value);
         writeByte(node->ctx_type);
-        writeLineno(node->lineno);
-        writeExpr(node->value);
+        writeString(node->attr);
         return true;
     }
     virtual bool visit_binop(AST_BinOp* node) {
-        writeColOffset(node->col_offset);
-        writeExpr(node->left);
-        writeLineno(node->lineno);
         writeByte(node->op_type);
-        writeExpr(node->right);
+        writeNode(node->left);
+        writeNode(node->right);
         return true;
     }
     virtual bool visit_boolop(AST_BoolOp* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
         writeByte(node->op_type);
-        writeExprVector(node->values);
+        writeNodeVector(node->values);
         return true;
     }
-    virtual bool visit_break(AST_Break* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
+    virtual bool visit_break(AST_Break* node) { return true; }
+    virtual bool visit_call(AST_Call* node) {
+        writeNode(node->func);
+        writeNodeVector(node->args);
+        writeNodeVector(node->keywords);
+        writeNode(node->starargs);
+        writeNode(node->kwargs);
         return true;
     }
-    virtual bool visit_call(AST_Call* node) {
-        writeExprVector(node->args);
-        writeColOffset(node->col_offset);
-        writeExpr(node->func);
-        writeMiscVector(node->keywords);
-        writeExpr(node->kwargs);
-        writeLineno(node->lineno);
-        writeExpr(node->starargs);
+    virtual bool visit_clsattribute(AST_ClsAttribute* node) {
+        writeNode(node->value);
+        writeString(node->attr);
         return true;
     }
     virtual bool visit_compare(AST_Compare* node) {
-        writeColOffset(node->col_offset);
-        writeExprVector(node->comparators);
-        writeExpr(node->left);
-        writeLineno(node->lineno);
-
-        writeShort(node->comparators.size());
-        for (auto& e : node->ops) {
-            writeByte(e);
-        }
+        writeNode(node->left);
+        writeVarint(node->ops.size());
+        for (auto op : node->ops)
+            writeByte(op);
+        writeNodeVector(node->comparators);
         return true;
     }
     virtual bool visit_comprehension(AST_comprehension* node) {
-        writeExprVector(node->ifs);
-        writeExpr(node->iter);
-        writeExpr(node->target);
+        writeNode(node->target);
+        writeNode(node->iter);
+        writeNodeVector(node->ifs);
         return true;
     }
     virtual bool visit_classdef(AST_ClassDef* node) {
-        writeExprVector(node->bases);
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeExprVector(node->decorator_list);
-        writeLineno(node->lineno);
         writeString(node->name);
+        writeNodeVector(node->bases);
+        writeNodeVector(node->body);
+        writeNodeVector(node->decorator_list);
         return true;
     }
-    virtual bool visit_continue(AST_Continue* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        return true;
-    }
+    virtual bool visit_continue(AST_Continue* node) { return true; }
     virtual bool visit_delete(AST_Delete* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExprVector(node->targets);
+        writeNodeVector(node->targets);
         return true;
     }
     virtual bool visit_dict(AST_Dict* node) {
-        writeColOffset(node->col_offset);
-        writeExprVector(node->keys);
-        writeLineno(node->lineno);
-        writeExprVector(node->values);
+        writeNodeVector(node->keys);
+        writeNodeVector(node->values);
         return true;
     }
     virtual bool visit_dictcomp(AST_DictComp* node) {
-        writeColOffset(node->col_offset);
-        writeMiscVector(node->generators);
-        writeExpr(node->key);
-        writeLineno(node->lineno);
-        writeExpr(node->value);
+        writeNode(node->key);
+        writeNode(node->value);
+        writeNodeVector(node->generators);
         return true;
     }
+    virtual bool visit_ellipsis(AST_Ellipsis* node) { return true; }
     virtual bool visit_excepthandler(AST_ExceptHandler* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->name);
-        writeExpr(node->type);
+        writeNode(node->type);
+        writeNode(node->name);
+        writeNodeVector(node->body);
         return true;
     }
     virtual bool visit_exec(AST_Exec* node) {
-        writeExpr(node->body);
-        writeColOffset(node->col_offset);
-        writeExpr(node->globals);
-        writeLineno(node->lineno);
-        writeExpr(node->locals);
+        writeNode(node->body);
+        writeNode(node->globals);
+        writeNode(node->locals);
         return true;
     }
     virtual bool visit_expr(AST_Expr* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->value);
+        writeNode(node->value);
         return true;
     }
     virtual bool visit_extslice(AST_ExtSlice* node) {
-        writeExprVector(node->dims);
+        writeNodeVector(node->dims);
         return true;
     }
     virtual bool visit_for(AST_For* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeExpr(node->iter);
-        writeLineno(node->lineno);
-        writeStmtVector(node->orelse);
-        writeExpr(node->target);
+        writeNode(node->target);
+        writeNode(node->iter);
+        writeNodeVector(node->body);
+        writeNodeVector(node->orelse);
         return true;
     }
     virtual bool visit_functiondef(AST_FunctionDef* node) {
-        writeASTMisc(node->args);
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeExprVector(node->decorator_list);
-        writeLineno(node->lineno);
         writeString(node->name);
+        writeNode(node->args);
+        writeNodeVector(node->body);
+        writeNodeVector(node->decorator_list);
         return true;
     }
     virtual bool visit_generatorexp(AST_GeneratorExp* node) {
-        writeColOffset(node->col_offset);
-        writeExpr(node->elt);
-        writeMiscVector(node->generators);
-        writeLineno(node->lineno);
+        writeNode(node->elt);
+        writeNodeVector(node->generators);
         return true;
     }
     virtual bool visit_global(AST_Global* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
         writeStringVector(node->names);
         return true;
     }
     virtual bool visit_if(AST_If* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeStmtVector(node->orelse);
-        writeExpr(node->test);
+        writeNode(node->test);
+        writeNodeVector(node->body);
+        writeNodeVector(node->orelse);
         return true;
     }
     virtual bool visit_ifexp(AST_IfExp* node) {
-        writeExpr(node->body);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->orelse);
-        writeExpr(node->test);
+        writeNode(node->test);
+        writeNode(node->body);
+        writeNode(node->orelse);
         return true;
     }
     virtual bool visit_import(AST_Import* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeMiscVector(node->names);
+        writeNodeVector(node->names);
         return true;
     }
     virtual bool visit_importfrom(AST_ImportFrom* node) {
-        writeColOffset(node->col_offset);
-        writeULL(node->level);
-        writeLineno(node->lineno);
         writeString(node->module);
-        writeMiscVector(node->names);
+        writeNodeVector(node->names);
+        writeSigned(node->level);
         return true;
     }
     virtual bool visit_index(AST_Index* node) {
-        writeExpr(node->value);
+        writeNode(node->value);
+        return true;
+    }
+    virtual bool visit_invoke(AST_Invoke* node) {
+        writeNode(node->stmt);
+        writeBlock(node->normal_dest);
+        writeBlock(node->exc_dest);
         return true;
     }
     virtual bool visit_keyword(AST_keyword* node) {
         writeString(node->arg);
-        writeExpr(node->value);
+        writeNode(node->value);
         return true;
     }
     virtual bool visit_lambda(AST_Lambda* node) {
-        writeASTMisc(node->args);
-        writeExpr(node->body);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
+        writeNode(node->args);
+        writeNode(node->body);
+        return true;
+    }
+    virtual bool visit_langprimitive(AST_LangPrimitive* node) {
+        writeByte(node->opcode);
+        writeNodeVector(node->args);
         return true;
     }
     virtual bool visit_list(AST_List* node) {
-        writeColOffset(node->col_offset);
         writeByte(node->ctx_type);
-        writeExprVector(node->elts);
-        writeLineno(node->lineno);
+        writeNodeVector(node->elts);
         return true;
     }
     virtual bool visit_listcomp(AST_ListComp* node) {
-        writeColOffset(node->col_offset);
-        writeExpr(node->elt);
-        writeMiscVector(node->generators);
-        writeLineno(node->lineno);
+        writeNode(node->elt);
+        writeNodeVector(node->generators);
         return true;
     }
     virtual bool visit_module(AST_Module* node) {
-        writeStmtVector(node->body);
+        writeNodeVector(node->body);
         return true;
     }
     virtual bool visit_name(AST_Name* node) {
-        writeColOffset(node->col_offset);
+        // lookup_type and vreg get recomputed from the scoping analysis, so they don't get saved.
         writeByte(node->ctx_type);
         writeString(node->id);
-        writeLineno(node->lineno);
         return true;
     }
     virtual bool visit_num(AST_Num* node) {
         writeByte(node->num_type);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
         if (node->num_type == AST_Num::INT) {
-            writeULL(node->n_int);
+            writeSigned(node->n_int);
         } else if (node->num_type == AST_Num::LONG) {
             writeString(node->n_long);
-        } else if (node->num_type == AST_Num::FLOAT) {
-            writeDouble(node->n_float);
-        } else if (node->num_type == AST_Num::COMPLEX) {
+        } else if (node->num_type == AST_Num::FLOAT || node->num_type == AST_Num::COMPLEX) {
             writeDouble(node->n_float);
         } else {
             RELEASE_ASSERT(0, "%d", node->num_type);
         }
         return true;
     }
-    virtual bool visit_pass(AST_Pass* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        return true;
-    }
+    virtual bool visit_pass(AST_Pass* node) { return true; }
     virtual bool visit_print(AST_Print* node) {
-        writeColOffset(node->col_offset);
-        writeExpr(node->dest);
-        writeLineno(node->lineno);
+        writeNode(node->dest);
         writeByte(node->nl);
-        writeExprVector(node->values);
+        writeNodeVector(node->values);
         return true;
     }
     virtual bool visit_raise(AST_Raise* node) {
-        // "arg0" "arg1" "arg2" are called "type", "inst", and "tback" in the python ast,
-        // so that's the order we have to write them:
-        writeColOffset(node->col_offset);
-        writeExpr(node->arg1 /*inst*/);
-        writeLineno(node->lineno);
-        writeExpr(node->arg2 /*tback*/);
-        writeExpr(node->arg0 /*type*/);
+        writeNode(node->arg0);
+        writeNode(node->arg1);
+        writeNode(node->arg2);
         return true;
     }
     virtual bool visit_repr(AST_Repr* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->value);
+        writeNode(node->value);
         return true;
     }
     virtual bool visit_return(AST_Return* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->value);
+        writeNode(node->value);
         return true;
     }
     virtual bool visit_set(AST_Set* node) {
-        writeColOffset(node->col_offset);
-        writeExprVector(node->elts);
-        writeLineno(node->lineno);
+        writeNodeVector(node->elts);
         return true;
     }
     virtual bool visit_setcomp(AST_SetComp* node) {
-        writeColOffset(node->col_offset);
-        writeExpr(node->elt);
-        writeMiscVector(node->generators);
-        writeLineno(node->lineno);
+        writeNode(node->elt);
+        writeNodeVector(node->generators);
         return true;
     }
     virtual bool visit_slice(AST_Slice* node) {
-        writeExpr(node->lower);
-        writeExpr(node->step);
-        writeExpr(node->upper);
+        writeNode(node->lower);
+        writeNode(node->upper);
+        writeNode(node->step);
         return true;
     }
     virtual bool visit_str(AST_Str* node) {
         writeByte(node->str_type);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        if (node->str_type == AST_Str::STR) {
-            writeString(node->str_data);
-        } else if (node->str_type == AST_Str::UNICODE) {
-            writeString(node->str_data);
-        } else {
-            RELEASE_ASSERT(0, "%d", node->str_type);
-        }
+        writeString(node->str_data);
         return true;
     }
     virtual bool visit_subscript(AST_Subscript* node) {
-        writeColOffset(node->col_offset);
+        writeNode(node->value);
+        writeNode(node->slice);
         writeByte(node->ctx_type);
-        writeLineno(node->lineno);
-        writeExpr(node->slice);
-        writeExpr(node->value);
         return true;
     }
     virtual bool visit_tryexcept(AST_TryExcept* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeMiscVector(node->handlers);
-        writeLineno(node->lineno);
-        writeStmtVector(node->orelse);
+        writeNodeVector(node->body);
+        writeNodeVector(node->handlers);
+        writeNodeVector(node->orelse);
         return true;
     }
     virtual bool visit_tryfinally(AST_TryFinally* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeStmtVector(node->finalbody);
-        writeLineno(node->lineno);
+        writeNodeVector(node->body);
+        writeNodeVector(node->finalbody);
         return true;
     }
     virtual bool visit_tuple(AST_Tuple* node) {
-        writeColOffset(node->col_offset);
         writeByte(node->ctx_type);
-        writeExprVector(node->elts);
-        writeLineno(node->lineno);
+        writeNodeVector(node->elts);
         return true;
     }
     virtual bool visit_unaryop(AST_UnaryOp* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
         writeByte(node->op_type);
-        writeExpr(node->operand);
+        writeNode(node->operand);
         return true;
     }
     virtual bool visit_while(AST_While* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeStmtVector(node->orelse);
-        writeExpr(node->test);
+        writeNode(node->test);
+        writeNodeVector(node->body);
+        writeNodeVector(node->orelse);
         return true;
     }
     virtual bool visit_with(AST_With* node) {
-        writeStmtVector(node->body);
-        writeColOffset(node->col_offset);
-        writeExpr(node->context_expr);
-        writeLineno(node->lineno);
-        writeExpr(node->optional_vars);
+        writeNode(node->context_expr);
+        writeNode(node->optional_vars);
+        writeNodeVector(node->body);
         return true;
     }
     virtual bool visit_yield(AST_Yield* node) {
-        writeColOffset(node->col_offset);
-        writeLineno(node->lineno);
-        writeExpr(node->value);
+        writeNode(node->value);
+        return true;
+    }
+    virtual bool visit_makeclass(AST_MakeClass* node) {
+        writeNode(node->class_def);
+        return true;
+    }
+    virtual bool visit_makefunction(AST_MakeFunction* node) {
+        writeNode(node->function_def);
+        return true;
+    }
+    virtual bool visit_branch(AST_Branch* node) {
+        writeNode(node->test);
+        writeBlock(node->iftrue);
+        writeBlock(node->iffalse);
+        return true;
+    }
+    virtual bool visit_jump(AST_Jump* node) {
+        writeBlock(node->target);
         return true;
     }
 };
+
+template <class T> bool hasNodeKind(AST* node) {
+    return node->type == T::TYPE;
+}
+template <> bool hasNodeKind<AST>(AST* node) {
+    return true;
+}
+template <> bool hasNodeKind<AST_expr>(AST* node) {
+    return isExprType(node->type);
 }
+template <> bool hasNodeKind<AST_stmt>(AST* node) {
+    return isStmtType(node->type);
+}
+
+// Reads the format written by SerializeASTVisitor.  Errors don't abort the read immediately; they set `failed', after
+// which every read returns a dummy value, and the caller checks the flag once it's done.
+class ASTDeserializer {
+private:
+    const char* base; // the start of the data after the header
+    const uint8_t* p, *end;
+    bool failed;
+
+    const uint8_t* string_offsets;
+    uint32_t num_strings;
+    std::unique_ptr<InternedStringPool> owned_pool;
+    InternedStringPool* pool;
+    // Strings get interned the first time they're used:
+    std::vector<InternedString> interned;
+    std::vector<bool> is_interned;
+
+    std::vector<AST*> nodes;
+    std::vector<CFGBlock*> cur_blocks;
+
+public:
+    ASTDeserializer(const char* base, size_t size, uint32_t num_strings)
+        : base(base),
+          p(NULL),
+          end(reinterpret_cast<const uint8_t*>(base) + size),
+          failed(false),
+          string_offsets(reinterpret_cast<const uint8_t*>(base)),
+          num_strings(num_strings),
+          owned_pool(new InternedStringPool()),
+          pool(owned_pool.get()),
+          interned(num_strings),
+          is_interned(num_strings, false) {}
+
+    bool hasFailed() { return failed; }
+
+    void seek(size_t offset) { p = reinterpret_cast<const uint8_t*>(base) + offset; }
+    bool atEnd(size_t offset) { return p == reinterpret_cast<const uint8_t*>(base) + offset; }
+
+    AST_Module* readModule() {
+        AST_Module* module = readNode<AST_Module>();
+        if (failed || !module)
+            return NULL;
+        return module;
+    }
+
+    bool readCFGs(std::vector<std::pair<AST*, CFG*>>& cfgs) {
+        uint64_t num_cfgs = readCount();
+        for (uint64_t i = 0; i < num_cfgs && !failed; i++) {
+            AST* scope = readNode<AST>();
+            if (!scope)
+                fail();
+
+            CFG* cfg = new CFG();
+            uint64_t num_blocks = readCount();
+            cur_blocks.clear();
+            for (uint64_t j = 0; j < num_blocks && !failed; j++) {
+                CFGBlock* block = new CFGBlock(cfg, readVarint());
+                if (readVarint())
+                    block->info = readIString().c_str();
+                cfg->blocks.push_back(block);
+                cur_blocks.push_back(block);
+            }
+            for (CFGBlock* b : cur_blocks) {
+                readBlockVector(b->predecessors);
+                readBlockVector(b->successors);
+            }
+            for (CFGBlock* b : cur_blocks)
+                readNodeVector(b->body);
+
+            uint64_t num_replacements = readCount();
+            for (uint64_t j = 0; j < num_replacements && !failed; j++) {
+                AST* original = readNode<AST>();
+                AST* replacement = readNode<AST>();
+                cfg->scope_replacements.push_back(std::make_pair(original, replacement));
+            }
+
+            if (failed || cfg->blocks.empty())
+                return false;
+            cfgs.push_back(std::make_pair(scope, cfg));
+        }
+        cur_blocks.clear();
+        return !failed;
+    }
+
+private:
+    void fail() {
+        failed = true;
+        p = end;
+    }
+
+    uint8_t readByte() {
+        if (p == end) {
+            fail();
+            return 0;
+        }
+        return *p++;
+    }
+
+    uint64_t readVarint() {
+        if (likely(p != end && *p < 0x80))
+            return *p++;
+
+        uint64_t v = 0;
+        for (int shift = 0; shift < 64; shift += 7) {
+            uint8_t b = readByte();
+            v |= (uint64_t)(b & 0x7f) << shift;
+            if (!(b & 0x80))
+                return v;
+        }
+        fail();
+        return 0;
+    }
+
+    int64_t readSigned() {
+        uint64_t v = readVarint();
+        return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+    }
+
+    // Every element takes at least one byte, so this bounds the size of any vector we allocate:
+    uint64_t readCount() {
+        uint64_t n = readVarint();
+        if (n > (uint64_t)(end - p)) {
+            fail();
+            return 0;
+        }
+        return n;
+    }
+
+    double readDouble() {
+        double v = 0;
+        if (end - p < (ptrdiff_t)sizeof(v)) {
+            fail();
+            return v;
+        }
+        memcpy(&v, p, sizeof(v));
+        p += sizeof(v);
+        return v;
+    }
+
+    llvm::StringRef readStringRef() {
+        uint64_t id = readVarint();
+        if (id >= num_strings) {
+            fail();
+            return "";
+        }
+
+        uint32_t offset;
+        memcpy(&offset, string_offsets + id * sizeof(uint32_t), sizeof(offset));
+        const uint8_t* saved_p = p;
+        p = reinterpret_cast<const uint8_t*>(base) + offset;
+        if (p >= end) {
+            fail();
+            return "";
+        }
+        uint64_t size = readVarint();
+        const uint8_t* data = p;
+        if (failed || size > (uint64_t)(end - data)) {
+            fail();
+            return "";
+        }
+        p = saved_p;
+        return llvm::StringRef(reinterpret_cast<const char*>(data), size);
+    }
+
+    std::string readString() { return readStringRef().str(); }
+
+    InternedString readIString() {
+        const uint8_t* saved_p = p;
+        uint64_t id = readVarint();
+        if (id < num_strings && is_interned[id])
+            return interned[id];
+
+        p = saved_p;
+        llvm::StringRef s = readStringRef();
+        if (failed)
+            return pool->get("");
+
+        interned[id] = pool->get(s);
+        is_interned[id] = true;
+        return interned[id];
+    }
+
+    void readIStringVector(std::vector<InternedString>& vec) {
+        uint64_t n = readCount();
+        vec.reserve(n);
+        for (uint64_t i = 0; i < n && !failed; i++)
+            vec.push_back(readIString());
+    }
+
+    template <class T> T* readNode() {
+        AST* node = readAnyNode();
+        if (node && !hasNodeKind<T>(node)) {
+            fail();
+            return NULL;
+        }
+        return static_cast<T*>(node);
+    }
+
+    template <class T> void readNodeVector(std::vector<T*>& vec) {
+        uint64_t n = readCount();
+        vec.reserve(n);
+        for (uint64_t i = 0; i < n && !failed; i++)
+            vec.push_back(readNode<T>());
+    }
+
+    CFGBlock* readBlock() {
+        uint64_t pos = readVarint();
+        if (pos == 0)
+            return NULL;
+        if (pos > cur_blocks.size()) {
+            fail();
+            return NULL;
+        }
+        return cur_blocks[pos - 1];
+    }
+
+    void readBlockVector(std::vector<CFGBlock*>& vec) {
+        uint64_t n = readCount();
+        vec.reserve(n);
+        for (uint64_t i = 0; i < n && !failed; i++)
+            vec.push_back(readBlock());
+    }
+
+    template <class T> T readEnum() { return (T)readByte(); }
+
+    AST* readAnyNode() {
+        uint8_t tag = readByte();
+        if (tag == NULL_NODE_TAG || failed)
+            return NULL;
+
+        if (tag == BACKREF_TAG) {
+            uint64_t id = readVarint();
+            // A node can't refer to one of its ancestors, so it's an error to see a node that we haven't finished yet:
+            if (id >= nodes.size() || !nodes[id]) {
+                fail();
+                return NULL;
+            }
+            return nodes[id];
+        }
+
+        uint32_t lineno = readVarint();
+        uint32_t col_offset = readVarint();
+
+        size_t id = nodes.size();
+        nodes.push_back(NULL);
+        AST* node = readNodeFields(tag);
+        if (!node) {
+            fail();
+            return NULL;
+        }
+        node->lineno = lineno;
+        node->col_offset = col_offset;
+        nodes[id] = node;
+        return node;
+    }
+
+    AST* readNodeFields(uint8_t type) {
+        switch (type) {
+            case AST_TYPE::alias: {
+                InternedString name = readIString();
+                InternedString asname = readIString();
+                return new AST_alias(name, asname);
+            }
+            case AST_TYPE::arguments: {
+                AST_arguments* rtn = new AST_arguments();
+                readNodeVector(rtn->args);
+                readNodeVector(rtn->defaults);
+                rtn->kwarg = readIString();
+                rtn->vararg = readIString();
+                return rtn;
+            }
+            case AST_TYPE::Assert: {
+                AST_Assert* rtn = new AST_Assert();
+                rtn->msg = readNode<AST_expr>();
+                rtn->test = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Assign: {
+                AST_Assign* rtn = new AST_Assign();
+                readNodeVector(rtn->targets);
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::AugAssign: {
+                AST_AugAssign* rtn = new AST_AugAssign();
+                rtn->op_type = readEnum<AST_TYPE::AST_TYPE>();
+                rtn->target = readNode<AST_expr>();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::AugBinOp: {
+                AST_AugBinOp* rtn = new AST_AugBinOp();
+                rtn->op_type = readEnum<AST_TYPE::AST_TYPE>();
+                rtn->left = readNode<AST_expr>();
+                rtn->right = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Attribute: {
+                AST_Attribute* rtn = new AST_Attribute();
+                rtn->value = readNode<AST_expr>();
+                rtn->ctx_type = readEnum<AST_TYPE::AST_TYPE>();
+                rtn->attr = readIString();
+                return rtn;
+            }
+            case AST_TYPE::BinOp: {
+                AST_BinOp* rtn = new AST_BinOp();
+                rtn->op_type = readEnum<AST_TYPE::AST_TYPE>();
+                rtn->left = readNode<AST_expr>();
+                rtn->right = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::BoolOp: {
+                AST_BoolOp* rtn = new AST_BoolOp();
+                rtn->op_type = readEnum<AST_TYPE::AST_TYPE>();
+                readNodeVector(rtn->values);
+                return rtn;
+            }
+            case AST_TYPE::Break:
+                return new AST_Break();
+            case AST_TYPE::Call: {
+                AST_Call* rtn = new AST_Call();
+                rtn->func = readNode<AST_expr>();
+                readNodeVector(rtn->args);
+                readNodeVector(rtn->keywords);
+                rtn->starargs = readNode<AST_expr>();
+                rtn->kwargs = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::ClsAttribute: {
+                AST_ClsAttribute* rtn = new AST_ClsAttribute();
+                rtn->value = readNode<AST_expr>();
+                rtn->attr = readIString();
+                return rtn;
+            }
+            case AST_TYPE::Compare: {
+                AST_Compare* rtn = new AST_Compare();
+                rtn->left = readNode<AST_expr>();
+                uint64_t num_ops = readCount();
+                for (uint64_t i = 0; i < num_ops && !failed; i++)
+                    rtn->ops.push_back(readEnum<AST_TYPE::AST_TYPE>());
+                readNodeVector(rtn->comparators);
+                return rtn;
+            }
+            case AST_TYPE::comprehension: {
+                AST_comprehension* rtn = new AST_comprehension();
+                rtn->target = readNode<AST_expr>();
+                rtn->iter = readNode<AST_expr>();
+                readNodeVector(rtn->ifs);
+                return rtn;
+            }
+            case AST_TYPE::ClassDef: {
+                AST_ClassDef* rtn = new AST_ClassDef();
+                rtn->name = readIString();
+                readNodeVector(rtn->bases);
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->decorator_list);
+                return rtn;
+            }
+            case AST_TYPE::Continue:
+                return new AST_Continue();
+            case AST_TYPE::Delete: {
+                AST_Delete* rtn = new AST_Delete();
+                readNodeVector(rtn->targets);
+                return rtn;
+            }
+            case AST_TYPE::Dict: {
+                AST_Dict* rtn = new AST_Dict();
+                readNodeVector(rtn->keys);
+                readNodeVector(rtn->values);
+                return rtn;
+            }
+            case AST_TYPE::DictComp: {
+                AST_DictComp* rtn = new AST_DictComp();
+                rtn->key = readNode<AST_expr>();
+                rtn->value = readNode<AST_expr>();
+                readNodeVector(rtn->generators);
+                return rtn;
+            }
+            case AST_TYPE::Ellipsis:
+                return new AST_Ellipsis();
+            case AST_TYPE::ExceptHandler: {
+                AST_ExceptHandler* rtn = new AST_ExceptHandler();
+                rtn->type = readNode<AST_expr>();
+                rtn->name = readNode<AST_expr>();
+                readNodeVector(rtn->body);
+                return rtn;
+            }
+            case AST_TYPE::Exec: {
+                AST_Exec* rtn = new AST_Exec();
+                rtn->body = readNode<AST_expr>();
+                rtn->globals = readNode<AST_expr>();
+                rtn->locals = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Expr: {
+                AST_Expr* rtn = new AST_Expr();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::ExtSlice: {
+                AST_ExtSlice* rtn = new AST_ExtSlice();
+                readNodeVector(rtn->dims);
+                return rtn;
+            }
+            case AST_TYPE::For: {
+                AST_For* rtn = new AST_For();
+                rtn->target = readNode<AST_expr>();
+                rtn->iter = readNode<AST_expr>();
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->orelse);
+                return rtn;
+            }
+            case AST_TYPE::FunctionDef: {
+                AST_FunctionDef* rtn = new AST_FunctionDef();
+                rtn->name = readIString();
+                rtn->args = readNode<AST_arguments>();
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->decorator_list);
+                return rtn;
+            }
+            case AST_TYPE::GeneratorExp: {
+                AST_GeneratorExp* rtn = new AST_GeneratorExp();
+                rtn->elt = readNode<AST_expr>();
+                readNodeVector(rtn->generators);
+                return rtn;
+            }
+            case AST_TYPE::Global: {
+                AST_Global* rtn = new AST_Global();
+                readIStringVector(rtn->names);
+                return rtn;
+            }
+            case AST_TYPE::If: {
+                AST_If* rtn = new AST_If();
+                rtn->test = readNode<AST_expr>();
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->orelse);
+                return rtn;
+            }
+            case AST_TYPE::IfExp: {
+                AST_IfExp* rtn = new AST_IfExp();
+                rtn->test = readNode<AST_expr>();
+                rtn->body = readNode<AST_expr>();
+                rtn->orelse = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Import: {
+                AST_Import* rtn = new AST_Import();
+                readNodeVector(rtn->names);
+                return rtn;
+            }
+            case AST_TYPE::ImportFrom: {
+                AST_ImportFrom* rtn = new AST_ImportFrom();
+                rtn->module = readIString();
+                readNodeVector(rtn->names);
+                rtn->level = readSigned();
+                return rtn;
+            }
+            case AST_TYPE::Index: {
+                AST_Index* rtn = new AST_Index();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Invoke: {
+                AST_Invoke* rtn = new AST_Invoke(readNode<AST_stmt>());
+                rtn->normal_dest = readBlock();
+                rtn->exc_dest = readBlock();
+                return rtn;
+            }
+            case AST_TYPE::keyword: {
+                AST_keyword* rtn = new AST_keyword();
+                rtn->arg = readIString();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Lambda: {
+                AST_Lambda* rtn = new AST_Lambda();
+                rtn->args = readNode<AST_arguments>();
+                rtn->body = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::LangPrimitive: {
+                AST_LangPrimitive* rtn = new AST_LangPrimitive(readEnum<AST_LangPrimitive::Opcodes>());
+                readNodeVector(rtn->args);
+                return rtn;
+            }
+            case AST_TYPE::List: {
+                AST_List* rtn = new AST_List();
+                rtn->ctx_type = readEnum<AST_TYPE::AST_TYPE>();
+                readNodeVector(rtn->elts);
+                return rtn;
+            }
+            case AST_TYPE::ListComp: {
+                AST_ListComp* rtn = new AST_ListComp();
+                rtn->elt = readNode<AST_expr>();
+                readNodeVector(rtn->generators);
+                return rtn;
+            }
+            case AST_TYPE::MakeClass:
+                return new AST_MakeClass(readNode<AST_ClassDef>());
+            case AST_TYPE::MakeFunction:
+                return new AST_MakeFunction(readNode<AST_FunctionDef>());
+            case AST_TYPE::Module: {
+                // Only the root node can be a module, since it owns the string pool:
+                if (!owned_pool)
+                    return NULL;
+                AST_Module* rtn = new AST_Module(std::move(owned_pool));
+                readNodeVector(rtn->body);
+                return rtn;
+            }
+            case AST_TYPE::Name: {
+                AST_TYPE::AST_TYPE ctx_type = readEnum<AST_TYPE::AST_TYPE>();
+                InternedString id = readIString();
+                return new AST_Name(id, ctx_type, 0);
+            }
+            case AST_TYPE::Num: {
+                AST_Num* rtn = new AST_Num();
+                rtn->num_type = readEnum<AST_Num::NumType>();
+                if (rtn->num_type == AST_Num::INT)
+                    rtn->n_int = readSigned();
+                else if (rtn->num_type == AST_Num::LONG)
+                    rtn->n_long = readString();
+                else if (rtn->num_type == AST_Num::FLOAT || rtn->num_type == AST_Num::COMPLEX)
+                    rtn->n_float = readDouble();
+                else
+                    fail();
+                return rtn;
+            }
+            case AST_TYPE::Pass:
+                return new AST_Pass();
+            case AST_TYPE::Print: {
+                AST_Print* rtn = new AST_Print();
+                rtn->dest = readNode<AST_expr>();
+                rtn->nl = readByte();
+                readNodeVector(rtn->values);
+                return rtn;
+            }
+            case AST_TYPE::Raise: {
+                AST_Raise* rtn = new AST_Raise();
+                rtn->arg0 = readNode<AST_expr>();
+                rtn->arg1 = readNode<AST_expr>();
+                rtn->arg2 = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Repr: {
+                AST_Repr* rtn = new AST_Repr();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Return: {
+                AST_Return* rtn = new AST_Return();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Set: {
+                AST_Set* rtn = new AST_Set();
+                readNodeVector(rtn->elts);
+                return rtn;
+            }
+            case AST_TYPE::SetComp: {
+                AST_SetComp* rtn = new AST_SetComp();
+                rtn->elt = readNode<AST_expr>();
+                readNodeVector(rtn->generators);
+                return rtn;
+            }
+            case AST_TYPE::Slice: {
+                AST_Slice* rtn = new AST_Slice();
+                rtn->lower = readNode<AST_expr>();
+                rtn->upper = readNode<AST_expr>();
+                rtn->step = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Str: {
+                AST_Str* rtn = new AST_Str();
+                rtn->str_type = readEnum<AST_Str::StrType>();
+                rtn->str_data = readString();
+                return rtn;
+            }
+            case AST_TYPE::Subscript: {
+                AST_Subscript* rtn = new AST_Subscript();
+                rtn->value = readNode<AST_expr>();
+                rtn->slice = readNode<AST_expr>();
+                rtn->ctx_type = readEnum<AST_TYPE::AST_TYPE>();
+                return rtn;
+            }
+            case AST_TYPE::TryExcept: {
+                AST_TryExcept* rtn = new AST_TryExcept();
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->handlers);
+                readNodeVector(rtn->orelse);
+                return rtn;
+            }
+            case AST_TYPE::TryFinally: {
+                AST_TryFinally* rtn = new AST_TryFinally();
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->finalbody);
+                return rtn;
+            }
+            case AST_TYPE::Tuple: {
+                AST_Tuple* rtn = new AST_Tuple();
+                rtn->ctx_type = readEnum<AST_TYPE::AST_TYPE>();
+                readNodeVector(rtn->elts);
+                return rtn;
+            }
+            case AST_TYPE::UnaryOp: {
+                AST_UnaryOp* rtn = new AST_UnaryOp();
+                rtn->op_type = readEnum<AST_TYPE::AST_TYPE>();
+                rtn->operand = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::While: {
+                AST_While* rtn = new AST_While();
+                rtn->test = readNode<AST_expr>();
+                readNodeVector(rtn->body);
+                readNodeVector(rtn->orelse);
+                return rtn;
+            }
+            case AST_TYPE::With: {
+                AST_With* rtn = new AST_With();
+                rtn->context_expr = readNode<AST_expr>();
+                rtn->optional_vars = readNode<AST_expr>();
+                readNodeVector(rtn->body);
+                return rtn;
+            }
+            case AST_TYPE::Yield: {
+                AST_Yield* rtn = new AST_Yield();
+                rtn->value = readNode<AST_expr>();
+                return rtn;
+            }
+            case AST_TYPE::Branch: {
+                AST_Branch* rtn = new AST_Branch();
+                rtn->test = readNode<AST_expr>();
+                rtn->iftrue = readBlock();
+                rtn->iffalse = readBlock();
+                return rtn;
+            }
+            case AST_TYPE::Jump: {
+                AST_Jump* rtn = new AST_Jump();
+                rtn->target = readBlock();
+                return rtn;
+            }
+            default:
+                return NULL;
+        }
+    }
+};
+}
+
+std::string serializeAST(AST_Module* module, const char* magic, const std::vector<std::pair<AST*, CFG*>>& cfgs) {
+    return SerializeASTVisitor::write(module, magic, cfgs);
+}
+
+AST_Module* deserializeAST(const char* data, size_t size, const char* magic,
+                           std::vector<std::pair<AST*, CFG*>>* cfgs) {
+    ParseCacheHeader header;
+    if (size < sizeof(header))
+        return NULL;
+    memcpy(&header, data, sizeof(header));
+
+    if (memcmp(header.magic, magic, sizeof(header.magic)) != 0 || header.version != PARSE_CACHE_VERSION)
+        return NULL;
+    if (header.length != size - sizeof(header))
+        return NULL;
+
+    const char* body = data + sizeof(header);
+    if (computeChecksum(body, header.length) != header.checksum)
+        return NULL;
+    if ((uint64_t)header.num_strings * sizeof(uint32_t) > header.nodes_offset || header.nodes_offset > header.length
+        || header.cfgs_offset > header.length)
+        return NULL;
+
+    ASTDeserializer reader(body, header.length, header.num_strings);
+    reader.seek(header.nodes_offset);
+    AST_Module* module = reader.readModule();
+    if (!module || !reader.atEnd(header.cfgs_offset ? header.cfgs_offset : header.length))
+        return NULL;
+
+    if (cfgs && header.cfgs_offset) {
+        char binary_id[sizeof(header.binary_id)];
+        getBinaryId(binary_id);
+        if (memcmp(binary_id, header.binary_id, sizeof(binary_id)) == 0) {
+            std::vector<std::pair<AST*, CFG*>> read_cfgs;
+            if (reader.readCFGs(read_cfgs) && reader.atEnd(header.length))
+                *cfgs = std::move(read_cfgs);
+        }
+    }
 
-std::pair<unsigned long, uint8_t> serializeAST(AST_Module* module, FILE* file) {
-    return SerializeASTVisitor::write(module, file);
+    return module;
 }
 }
@@ -15,13 +15,31 @@
 #ifndef PYSTON_CODEGEN_SERIALIZEAST_H
 #define PYSTON_CODEGEN_SERIALIZEAST_H
 
-#include <cstdint>
-#include <cstdio>
+#include <cstddef>
+#include <string>
 #include <utility>
+#include <vector>
 
 namespace pyston {
+class AST;
 class AST_Module;
-std::pair<unsigned long, uint8_t> serializeAST(AST_Module* module, FILE* file);
+class CFG;
+
+// The format of the parse cache (the .pyc files that caching_parse_file() writes next to the sources).  It's designed
+// to be read straight out of an mmap'd file:
+// - a fixed-size header with a magic string, the format version, and the length and checksum of the rest of the file
+// - a string table, so that every distinct string gets stored (and interned) only once
+// - the nodes in preorder, with varint-encoded integers.  A node that is reachable from more than one place (CFGs
+//   share a lot of nodes with the AST they were built from) is written once and then referred to by its index.
+// - optionally, the CFGs that were computed for the module's scopes.  These depend on the details of the CFG
+//   construction, so they are only read back by the same binary that wrote them.
+std::string serializeAST(AST_Module* module, const char* magic,
+                         const std::vector<std::pair<AST*, CFG*>>& cfgs = std::vector<std::pair<AST*, CFG*>>());
+
+// Returns NULL if the data is truncated, corrupt, or was written by an incompatible version.  If cfgs is non-NULL, it
+// gets filled in with any usable CFGs that were stored along with the AST.
+AST_Module* deserializeAST(const char* data, size_t size, const char* magic,
+                           std::vector<std::pair<AST*, CFG*>>* cfgs = NULL);
 }
 
 #endif // PYSTON_CODEGEN_SERIALIZEAST_H
@@ -0,0 +1,877 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "codegen/template_jit.h"
+
+#include <algorithm>
+#include <climits>
+#include <cstring>
+#include <sys/mman.h>
+#include <unordered_map>
+
+#include "analysis/scoping_analysis.h"
+#include "asm_writing/assembler.h"
+#include "asm_writing/icinfo.h"
+#include "asm_writing/rewriter.h"
+#include "codegen/ast_interpreter.h"
+#include "codegen/memmgr.h"
+#include "codegen/patchpoints.h"
+#include "codegen/profiling/perf_jit.h"
+#include "codegen/unwinding.h" // registerDynamicEhFrame
+#include "core/ast.h"
+#include "core/cfg.h"
+#include "core/common.h"
+#include "core/options.h"
+#include "core/stats.h"
+#include "core/types.h"
+#include "core/util.h"
+#include "runtime/objmodel.h"
+#include "runtime/types.h"
+
+namespace pyston {
+
+// All of the generated code runs inside of a frame that the entry trampoline sets up:
+//
+//   %r12: the ASTInterpreter
+//   %r14: the interpreter's vregs
+//
+// and the stack, from %rsp up, contains:
+//
+//   [0, 32): outgoing stack arguments (callattr() takes 9 arguments)
+//   [32, 192): scratch space for the ICs
+//   [192, 448): temporaries, for holding subexpressions that have already been evaluated
+//
+// Nothing is kept in registers across statements, other than r12 and r14 which are callee-save.
+static const int STACK_ARGS_SIZE = 32;
+static const int IC_SCRATCH_SIZE = 160;
+static const int NUM_TEMPS = 32;
+static const int TEMPS_OFFSET = STACK_ARGS_SIZE + IC_SCRATCH_SIZE;
+static const int FRAME_SIZE = TEMPS_OFFSET + NUM_TEMPS * 8;
+// We push three registers, so the frame has to be a multiple of 16 to keep the stack aligned for calls.
+static_assert(FRAME_SIZE % 16 == 0, "");
+
+static const assembler::Register INTERP_REG = assembler::R12;
+static const assembler::Register VREGS_REG = assembler::R14;
+
+static const int CODE_BLOCK_SIZE = 256 * 1024;
+
+static bool isInRel32Range(uint8_t* from, uint8_t* to) {
+    int64_t offset = to - from;
+    // Leave some slack for the size of the jump instruction itself:
+    return offset > INT_MIN + 16 && offset < INT_MAX - 16;
+}
+
+// A chunk of executable memory that compiled blocks get appended to.  It starts with the entry trampoline and the
+// shared epilogue, and has a single eh_frame entry describing the frame for the whole chunk, so that exceptions can
+// get unwound through the generated code.
+// The chunk gets freed once none of the blocks in it are in use any more (see freeTemplateJitCode()).
+class JitCodeBlock {
+private:
+    uint8_t* code;
+    int size_used;
+    int epilogue_offset;
+    int num_live_fragments;
+
+    uint8_t* eh_frame;
+    int eh_frame_size;
+
+    std::vector<std::unique_ptr<ICInfo>> ics;
+
+    void writeAndRegisterEhFrame(int after_push_rbp, int after_mov_rbp, int after_push_interp, int after_push_vregs,
+                                 int after_pop_rbp, int after_ret);
+
+public:
+    JitCodeBlock();
+    ~JitCodeBlock();
+
+    bool contains(void* addr) { return (uint8_t*)addr >= code && (uint8_t*)addr < code + CODE_BLOCK_SIZE; }
+    // Returns the number of blocks that are still using this chunk.
+    int releaseFragment() {
+        assert(num_live_fragments > 0);
+        return --num_live_fragments;
+    }
+    bool isUnused() { return num_live_fragments == 0; }
+
+    uint8_t* getEntry() { return code; }
+    uint8_t* getEpilogue() { return code + epilogue_offset; }
+    uint8_t* getCursor() { return code + size_used; }
+    int bytesLeft() { return CODE_BLOCK_SIZE - size_used; }
+
+    void commit(int bytes, std::vector<std::unique_ptr<ICInfo>>&& new_ics) {
+        assert(bytes <= bytesLeft());
+        size_used += bytes;
+        num_live_fragments++;
+        for (auto& ic : new_ics)
+            ics.push_back(std::move(ic));
+        new_ics.clear();
+    }
+};
+
+JitCodeBlock::JitCodeBlock()
+    : size_used(0), epilogue_offset(0), num_live_fragments(0), eh_frame(NULL), eh_frame_size(0) {
+    code = (uint8_t*)mmap(NULL, CODE_BLOCK_SIZE, PROT_READ | PROT_WRITE | PROT_EXEC, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                          0);
+    RELEASE_ASSERT(code != MAP_FAILED, "");
+
+    static StatCounter num_code_blocks("num_template_jit_code_blocks");
+    num_code_blocks.log();
+
+    assembler::Assembler a(code, CODE_BLOCK_SIZE);
+
+    // Entry trampoline, called as entry(interpreter, block_code, vregs):
+    a.push(assembler::RBP);
+    int after_push_rbp = a.bytesWritten();
+    a.mov(assembler::RSP, assembler::RBP);
+    int after_mov_rbp = a.bytesWritten();
+    a.push(INTERP_REG);
+    int after_push_interp = a.bytesWritten();
+    a.push(VREGS_REG);
+    int after_push_vregs = a.bytesWritten();
+    a.sub(assembler::Immediate(FRAME_SIZE), assembler::RSP);
+    a.mov(assembler::RDI, INTERP_REG);
+    a.mov(assembler::RDX, VREGS_REG);
+    a.jmpq(assembler::RSI);
+
+    // The epilogue that every block jumps to when it wants to return to the interpreter.  The return value
+    // is already in rax.
+    epilogue_offset = a.bytesWritten();
+    a.add(assembler::Immediate(FRAME_SIZE), assembler::RSP);
+    a.pop(VREGS_REG);
+    a.pop(INTERP_REG);
+    a.pop(assembler::RBP);
+    int after_pop_rbp = a.bytesWritten();
+    a.retq();
+    int after_ret = a.bytesWritten();
+
+    assert(!a.hasFailed());
+    size_used = a.bytesWritten();
+
+    writeAndRegisterEhFrame(after_push_rbp, after_mov_rbp, after_push_interp, after_push_vregs, after_pop_rbp,
+                            after_ret);
+
+    if (isPerfJitEnabled()) {
+        registerPerfJitCode("template_jit_entry", code, epilogue_offset);
+        registerPerfJitCode("template_jit_epilogue", code + epilogue_offset, size_used - epilogue_offset);
+    }
+}
+
+JitCodeBlock::~JitCodeBlock() {
+    assert(isUnused());
+
+    static StatCounter num_code_blocks_freed("num_template_jit_code_blocks_freed");
+    num_code_blocks_freed.log();
+
+    for (auto& ic : ics)
+        deregisterCompiledPatchpoint(ic.get());
+
+    if (isPerfJitEnabled()) {
+        deregisterPerfJitCode(code);
+        deregisterPerfJitCode(code + epilogue_offset);
+    }
+
+    deregisterDynamicEhFrame((uint64_t)code);
+    deregisterEHFrames(eh_frame, (uint64_t)eh_frame, eh_frame_size);
+    free(eh_frame);
+
+    munmap(code, CODE_BLOCK_SIZE);
+}
+
+// See runtime/ics.cpp for more about the eh_frame format; this is the same CIE that RuntimeIC uses, but with an FDE
+// that we build based on the prologue and epilogue that we emitted.
+static const char _eh_frame_cie[] = "\x14\x00\x00\x00" // size of the CIE
+                                    "\x00\x00\x00\x00" // specifies this is an CIE
+                                    "\x03"             // version number
+                                    "\x7a\x52\x00"     // augmentation string "zR"
+                                    "\x01\x78\x10"     // code factor 1, data factor -8, return address 16
+                                    "\x01\x1b" // augmentation data: 1b (CIE pointers as 4-byte-signed pcrel values)
+                                    "\x0c\x07\x08\x90\x01\x00\x00";
+// Instructions:
+// - DW_CFA_def_cfa: r7 (rsp) ofs 8
+// - DW_CFA_offset: r16 (rip) at cfa-8
+// - nop, nop
+#define EH_FRAME_CIE_SIZE (sizeof(_eh_frame_cie) - 1)
+
+static void emitAdvanceLoc(std::vector<uint8_t>& cfi, int delta) {
+    assert(0 < delta && delta < 0x40);
+    cfi.push_back(0x40 | delta); // DW_CFA_advance_loc
+}
+
+void JitCodeBlock::writeAndRegisterEhFrame(int after_push_rbp, int after_mov_rbp, int after_push_interp,
+                                           int after_push_vregs, int after_pop_rbp, int after_ret) {
+    static_assert(EH_FRAME_CIE_SIZE == 0x18, "");
+
+    std::vector<uint8_t> cfi;
+    emitAdvanceLoc(cfi, after_push_rbp);
+    cfi.insert(cfi.end(), { 0x0e, 0x10 }); // DW_CFA_def_cfa_offset: 16
+    cfi.insert(cfi.end(), { 0x86, 0x02 }); // DW_CFA_offset: r6 (rbp) at cfa-16
+    emitAdvanceLoc(cfi, after_mov_rbp - after_push_rbp);
+    cfi.insert(cfi.end(), { 0x0d, 0x06 }); // DW_CFA_def_cfa_register: r6 (rbp)
+    emitAdvanceLoc(cfi, after_push_interp - after_mov_rbp);
+    cfi.insert(cfi.end(), { 0x8c, 0x03 }); // DW_CFA_offset: r12 at cfa-24
+    emitAdvanceLoc(cfi, after_push_vregs - after_push_interp);
+    cfi.insert(cfi.end(), { 0x8e, 0x04 }); // DW_CFA_offset: r14 at cfa-32
+    // The only place where the frame isn't described by the above is in the epilogue, between the pop of rbp and
+    // the ret; all the block code after that runs with the full frame set up again.
+    emitAdvanceLoc(cfi, after_pop_rbp - after_push_vregs);
+    cfi.insert(cfi.end(), { 0x0c, 0x07, 0x08 }); // DW_CFA_def_cfa: r7 (rsp) ofs 8
+    emitAdvanceLoc(cfi, after_ret - after_pop_rbp);
+    cfi.insert(cfi.end(), { 0x0c, 0x06, 0x10 }); // DW_CFA_def_cfa: r6 (rbp) ofs 16
+
+    // FDE: size, CIE offset, pcrel function address, function size, augmentation data size, instructions,
+    // padded with DW_CFA_nop's to a multiple of 8 bytes.
+    int fde_size = 4 + 4 + 4 + 4 + 1 + cfi.size();
+    fde_size = (fde_size + 7) / 8 * 8;
+
+    eh_frame_size = EH_FRAME_CIE_SIZE + fde_size + 4 /* terminator */;
+    eh_frame = (uint8_t*)malloc(eh_frame_size);
+    memset(eh_frame, 0, eh_frame_size);
+    memcpy(eh_frame, _eh_frame_cie, EH_FRAME_CIE_SIZE);
+
+    uint8_t* fde = eh_frame + EH_FRAME_CIE_SIZE;
+    *(int32_t*)(fde + 0) = fde_size - 4;
+    *(int32_t*)(fde + 4) = EH_FRAME_CIE_SIZE + 4;
+    int32_t* offset_ptr = (int32_t*)(fde + 8);
+    int64_t offset = (int8_t*)code - (int8_t*)offset_ptr;
+    RELEASE_ASSERT(offset >= INT_MIN && offset <= INT_MAX, "");
+    *offset_ptr = offset;
+    *(int32_t*)(fde + 12) = CODE_BLOCK_SIZE;
+    fde[16] = 0; // no augmentation data
+    memcpy(fde + 17, &cfi[0], cfi.size());
+
+    // (eh_frame_size - 4) to omit the terminator, same as EHFrameManager
+    registerDynamicEhFrame((uint64_t)code, CODE_BLOCK_SIZE, (uint64_t)eh_frame, eh_frame_size - 4);
+    registerEHFrames(eh_frame, (uint64_t)eh_frame, eh_frame_size);
+}
+
+static JitCodeBlock* current_code_block = NULL;
+static std::vector<JitCodeBlock*> code_blocks;
+
+// Jumps to blocks that didn't have code when the jump was emitted; these exit to the interpreter for now, and get
+// redirected to the block once it gets compiled.  The value is the address right after the jump's rel32.
+// A jump always goes to a block of the same CFG, so freeTemplateJitCode() can drop all of the ones that a CFG's
+// code contains by removing the ones to its blocks.
+static std::unordered_multimap<CFGBlock*, uint8_t*> pending_jumps;
+
+static void freeCodeBlockIfUnused(JitCodeBlock* code_block) {
+    if (code_block == current_code_block || !code_block->isUnused())
+        return;
+
+    code_blocks.erase(std::find(code_blocks.begin(), code_blocks.end(), code_block));
+    delete code_block;
+}
+
+void freeTemplateJitCode(CFG* cfg) {
+    for (CFGBlock* block : cfg->blocks) {
+        pending_jumps.erase(block);
+
+        if (!block->code)
+            continue;
+
+        if (isPerfJitEnabled())
+            deregisterPerfJitCode(block->code);
+
+        auto it = std::find_if(code_blocks.begin(), code_blocks.end(),
+                               [block](JitCodeBlock* code_block) { return code_block->contains(block->code); });
+        assert(it != code_blocks.end());
+        JitCodeBlock* code_block = *it;
+
+        block->code = NULL;
+        block->entry_code = NULL;
+        if (code_block->releaseFragment() == 0)
+            freeCodeBlockIfUnused(code_block);
+    }
+}
+
+class JitFragmentWriter {
+private:
+    JitCodeBlock* code_block;
+    CFGBlock* block;
+    SourceInfo* source_info;
+    ScopeInfo* scope_info;
+
+    assembler::Assembler a;
+    uint8_t* const start_addr;
+    int num_temps_used;
+    bool failed;
+
+    std::vector<std::unique_ptr<ICInfo>> ics;
+    std::vector<std::pair<CFGBlock*, uint8_t*>> new_pending_jumps;
+    // Where each statement's code starts, for perf (only filled in if that's enabled):
+    PerfLineTable line_table;
+
+    int allocTemps(int n) {
+        int rtn = num_temps_used;
+        num_temps_used += n;
+        if (num_temps_used > NUM_TEMPS)
+            failed = true;
+        return rtn;
+    }
+    void freeTemps(int first) { num_temps_used = first; }
+    int tempOffset(int idx) { return TEMPS_OFFSET + idx * 8; }
+    assembler::Indirect temp(int idx) { return assembler::Indirect(assembler::RSP, tempOffset(idx)); }
+
+    assembler::JumpDestination destinationOf(uint8_t* addr) {
+        return assembler::JumpDestination::fromStart(addr - start_addr);
+    }
+
+    void emitCall(void* func_addr) { a.emitCall(func_addr, assembler::R11); }
+    void emitExit() { a.jmp(destinationOf(code_block->getEpilogue())); }
+    void emitGoto(CFGBlock* target);
+    void emitIC(ICSetupInfo* setup_info, void* func_addr, bool use_ic);
+
+    void emitBinExp(AST_expr* left, AST_expr* right, int op, void* func_addr);
+    bool emitCallExpr(AST_Call* node);
+    void emitExpr(AST_expr* node);
+    void emitGenericExpr(AST_expr* node);
+    void emitGenericStmt(AST_stmt* node);
+    bool emitName(AST_Name* node);
+    void emitNonzero(AST_expr* node);
+    void emitStmt(AST_stmt* node);
+    void emitStoreName(AST_Name* node);
+
+    ScopeInfo::VarScopeType getLookupType(AST_Name* node) {
+        if (node->lookup_type == ScopeInfo::VarScopeType::UNKNOWN)
+            node->lookup_type = scope_info->getScopeTypeOfName(node->id);
+        return node->lookup_type;
+    }
+
+public:
+    JitFragmentWriter(JitCodeBlock* code_block, CFGBlock* block, SourceInfo* source_info, ScopeInfo* scope_info)
+        : code_block(code_block),
+          block(block),
+          source_info(source_info),
+          scope_info(scope_info),
+          a(code_block->getCursor(), code_block->bytesLeft()),
+          start_addr(code_block->getCursor()),
+          num_temps_used(0),
+          failed(false) {}
+
+    ~JitFragmentWriter() {
+        // If we didn't get committed, the ICs we registered are about to point at garbage:
+        for (auto& ic : ics)
+            deregisterCompiledPatchpoint(ic.get());
+    }
+
+    bool hasFailed() { return failed || a.hasFailed(); }
+    bool ranOutOfSpace() { return a.hasFailed(); }
+
+    void emitBlock();
+    void commit();
+};
+
+void JitFragmentWriter::emitIC(ICSetupInfo* _setup_info, void* func_addr, bool use_ic) {
+    std::unique_ptr<ICSetupInfo> setup_info(_setup_info);
+    if (!use_ic) {
+        emitCall(func_addr);
+        return;
+    }
+
+    int size = setup_info->totalSize();
+    uint8_t* pp_start = a.curInstPointer();
+    for (int i = 0; i < size; i++)
+        a.nop();
+    if (a.hasFailed())
+        return;
+    uint8_t* pp_end = a.curInstPointer();
+
+    // r12 and r14 (and the other callee-save registers) need to make it through the IC:
+    std::unordered_set<int> live_outs({ 3, 12, 13, 14, 15 });
+
+    SpillMap _spill_map;
+    std::pair<uint8_t*, uint8_t*> p
+        = initializePatchpoint3(func_addr, pp_start, pp_end, 0 /* scratch_offset */, 0 /* scratch_size */,
+                                std::unordered_set<int>(), _spill_map);
+    assert(_spill_map.size() == 0);
+
+    ics.push_back(registerCompiledPatchpoint(pp_start, p.first, pp_end, p.second, setup_info.get(),
+                                             StackInfo(IC_SCRATCH_SIZE, STACK_ARGS_SIZE), std::move(live_outs)));
+}
+
+void JitFragmentWriter::emitGoto(CFGBlock* target) {
+    if (target->code && isInRel32Range(a.curInstPointer(), (uint8_t*)target->code)) {
+        a.jmp(destinationOf((uint8_t*)target->code));
+        return;
+    }
+
+    // Emit a jump that for now just goes to the next instruction, and remember to point it at the target once it
+    // has code.
+    a.jmp(assembler::JumpDestination::fromStart(a.bytesWritten() + 0x100));
+    if (a.hasFailed())
+        return;
+    uint8_t* jmp_end = a.curInstPointer();
+    *(int32_t*)(jmp_end - 4) = 0;
+    new_pending_jumps.push_back(std::make_pair(target, jmp_end));
+
+    a.mov(assembler::Immediate(target), assembler::RAX);
+    a.mov(assembler::RAX, assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getNextBlockOffset()));
+    emitExit();
+}
+
+void JitFragmentWriter::emitGenericExpr(AST_expr* node) {
+    a.mov(INTERP_REG, assembler::RDI);
+    a.mov(assembler::Immediate(node), assembler::RSI);
+    emitCall((void*)ASTInterpreterJitInterface::visitExprHelper);
+}
+
+void JitFragmentWriter::emitGenericStmt(AST_stmt* node) {
+    a.mov(INTERP_REG, assembler::RDI);
+    a.mov(assembler::Immediate(node), assembler::RSI);
+    emitCall((void*)ASTInterpreterJitInterface::visitStmtHelper);
+}
+
+void JitFragmentWriter::emitBinExp(AST_expr* left, AST_expr* right, int op, void* func_addr) {
+    if (op == AST_TYPE::Div && (source_info->parent_module->future_flags & FF_DIVISION))
+        op = AST_TYPE::TrueDiv;
+
+    int t = allocTemps(1);
+    emitExpr(left);
+    a.mov(assembler::RAX, temp(t));
+    emitExpr(right);
+    a.mov(assembler::RAX, assembler::RSI);
+    a.mov(temp(t), assembler::RDI);
+    a.mov(assembler::Immediate(op), assembler::RDX);
+    emitIC(createBinexpIC(NULL), func_addr, ENABLE_ICBINEXPS);
+    freeTemps(t);
+}
+
+bool JitFragmentWriter::emitCallExpr(AST_Call* node) {
+    // Keyword arguments would need their names to live somewhere; leave those to the interpreter.
+    if (node->keywords.size() || node->starargs || node->kwargs)
+        return false;
+
+    AST_expr* func;
+    InternedString attr;
+    bool is_callattr = true, callattr_clsonly = false;
+    if (node->func->type == AST_TYPE::Attribute) {
+        func = ast_cast<AST_Attribute>(node->func)->value;
+        attr = ast_cast<AST_Attribute>(node->func)->attr;
+    } else if (node->func->type == AST_TYPE::ClsAttribute) {
+        func = ast_cast<AST_ClsAttribute>(node->func)->value;
+        attr = ast_cast<AST_ClsAttribute>(node->func)->attr;
+        callattr_clsonly = true;
+    } else {
+        func = node->func;
+        is_callattr = false;
+    }
+
+    int nargs = node->args.size();
+    int func_temp = allocTemps(1);
+    int args_temp = allocTemps(nargs);
+    if (failed)
+        return true;
+
+    emitExpr(func);
+    a.mov(assembler::RAX, temp(func_temp));
+    for (int i = 0; i < nargs; i++) {
+        emitExpr(node->args[i]);
+        a.mov(assembler::RAX, temp(args_temp + i));
+    }
+
+    // Loads the i'th argument (or NULL if there aren't that many) into dest.  Arguments past the third get passed
+    // as an array, which is just the rest of the temporaries.
+    auto load_arg = [&](int i, assembler::Register dest) {
+        if (i == 3 && nargs > 3) {
+            a.mov(assembler::RSP, dest);
+            a.add(assembler::Immediate(tempOffset(args_temp + 3)), dest);
+        } else if (i < 3 && i < nargs) {
+            a.mov(temp(args_temp + i), dest);
+        } else {
+            a.mov(assembler::Immediate(0ul), dest);
+        }
+    };
+
+    ArgPassSpec argspec(nargs);
+    a.mov(temp(func_temp), assembler::RDI);
+    if (is_callattr) {
+        CallattrFlags flags({.cls_only = callattr_clsonly, .null_on_nonexistent = false });
+        a.mov(assembler::Immediate((void*)&attr.str()), assembler::RSI);
+        a.mov(assembler::Immediate((uint64_t)flags.asInt()), assembler::RDX);
+        a.mov(assembler::Immediate((uint64_t)argspec.asInt()), assembler::RCX);
+        load_arg(0, assembler::R8);
+        load_arg(1, assembler::R9);
+        load_arg(2, assembler::RAX);
+        a.mov(assembler::RAX, assembler::Indirect(assembler::RSP, 0));
+        load_arg(3, assembler::RAX);
+        a.mov(assembler::RAX, assembler::Indirect(assembler::RSP, 8));
+        a.movq(assembler::Immediate(0ul), assembler::Indirect(assembler::RSP, 16)); // keyword_names
+        emitIC(createCallsiteIC(NULL, nargs), (void*)callattr, ENABLE_ICCALLSITES);
+    } else {
+        a.mov(assembler::Immediate((uint64_t)argspec.asInt()), assembler::RSI);
+        load_arg(0, assembler::RDX);
+        load_arg(1, assembler::RCX);
+        load_arg(2, assembler::R8);
+        load_arg(3, assembler::R9);
+        a.movq(assembler::Immediate(0ul), assembler::Indirect(assembler::RSP, 0)); // keyword_names
+        emitIC(createCallsiteIC(NULL, nargs), (void*)runtimeCall, ENABLE_ICCALLSITES);
+    }
+
+    freeTemps(func_temp);
+    return true;
+}
+
+bool JitFragmentWriter::emitName(AST_Name* node) {
+    switch (getLookupType(node)) {
+        case ScopeInfo::VarScopeType::GLOBAL:
+            a.mov(assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getGlobalsOffset()), assembler::RDI);
+            a.mov(assembler::Immediate((void*)&node->id.str()), assembler::RSI);
+            emitIC(createGetGlobalIC(NULL), (void*)getGlobal,
+                   ENABLE_ICGETGLOBALS && source_info->scoping->areGlobalsFromModule());
+            return true;
+        case ScopeInfo::VarScopeType::FAST:
+        case ScopeInfo::VarScopeType::CLOSURE: {
+            assert(node->vreg >= 0);
+            a.mov(assembler::Indirect(VREGS_REG, 8 * node->vreg), assembler::RAX);
+            a.test(assembler::RAX, assembler::RAX);
+            {
+                // Let the interpreter raise the UnboundLocalError:
+                assembler::ForwardJump defined(a, assembler::COND_NOT_EQUAL);
+                emitGenericExpr(node);
+            }
+            return true;
+        }
+        default:
+            return false;
+    }
+}
+
+void JitFragmentWriter::emitNonzero(AST_expr* node) {
+    emitExpr(node);
+    a.mov(assembler::RAX, assembler::RDI);
+    emitIC(createNonzeroIC(NULL), (void*)nonzero, ENABLE_ICNONZEROS);
+    // nonzero() returns a bool, which only defines the low byte of rax:
+    a.movzbl(assembler::RAX, assembler::RAX);
+}
+
+void JitFragmentWriter::emitExpr(AST_expr* node) {
+    switch (node->type) {
+        case AST_TYPE::Attribute: {
+            AST_Attribute* attr = ast_cast<AST_Attribute>(node);
+            emitExpr(attr->value);
+            a.mov(assembler::RAX, assembler::RDI);
+            a.mov(assembler::Immediate((void*)attr->attr.c_str()), assembler::RSI);
+            emitIC(createGetattrIC(NULL), (void*)getattr, ENABLE_ICGETATTRS);
+            return;
+        }
+        case AST_TYPE::AugBinOp: {
+            AST_AugBinOp* binop = ast_cast<AST_AugBinOp>(node);
+            emitBinExp(binop->left, binop->right, binop->op_type, (void*)augbinop);
+            return;
+        }
+        case AST_TYPE::BinOp: {
+            AST_BinOp* binop = ast_cast<AST_BinOp>(node);
+            emitBinExp(binop->left, binop->right, binop->op_type, (void*)pyston::binop);
+            return;
+        }
+        case AST_TYPE::Call:
+            if (emitCallExpr(ast_cast<AST_Call>(node)))
+                return;
+            break;
+        case AST_TYPE::Compare: {
+            AST_Compare* cmp = ast_cast<AST_Compare>(node);
+            if (cmp->comparators.size() != 1)
+                break;
+            emitBinExp(cmp->left, cmp->comparators[0], cmp->ops[0], (void*)compare);
+            return;
+        }
+        case AST_TYPE::Index:
+            emitExpr(ast_cast<AST_Index>(node)->value);
+            return;
+        case AST_TYPE::LangPrimitive: {
+            AST_LangPrimitive* primitive = ast_cast<AST_LangPrimitive>(node);
+            if (primitive->opcode == AST_LangPrimitive::NONE) {
+                a.mov(assembler::Immediate(None), assembler::RAX);
+                return;
+            }
+            if (primitive->opcode == AST_LangPrimitive::NONZERO) {
+                assert(primitive->args.size() == 1);
+                emitNonzero(primitive->args[0]);
+                a.test(assembler::RAX, assembler::RAX);
+                a.mov(assembler::Immediate(True), assembler::RAX); // doesn't affect the flags
+                {
+                    assembler::ForwardJump is_true(a, assembler::COND_NOT_EQUAL);
+                    a.mov(assembler::Immediate(False), assembler::RAX);
+                }
+                return;
+            }
+            break;
+        }
+        case AST_TYPE::Name:
+            if (emitName(ast_cast<AST_Name>(node)))
+                return;
+            break;
+        case AST_TYPE::Num: {
+            AST_Num* num = ast_cast<AST_Num>(node);
+            if (num->num_type != AST_Num::INT)
+                break;
+            a.mov(assembler::Immediate(num->n_int), assembler::RDI);
+            emitCall((void*)boxInt);
+            return;
+        }
+        case AST_TYPE::Str: {
+            AST_Str* str = ast_cast<AST_Str>(node);
+            if (str->str_type != AST_Str::STR)
+                break;
+            a.mov(assembler::Immediate(source_info->parent_module->getStringConstant(str->str_data)),
+                  assembler::RAX);
+            return;
+        }
+        case AST_TYPE::Subscript: {
+            AST_Subscript* subscript = ast_cast<AST_Subscript>(node);
+            int t = allocTemps(1);
+            emitExpr(subscript->value);
+            a.mov(assembler::RAX, temp(t));
+            emitExpr(subscript->slice);
+            a.mov(assembler::RAX, assembler::RSI);
+            a.mov(temp(t), assembler::RDI);
+            emitIC(createGetitemIC(NULL), (void*)getitem, ENABLE_ICGETITEMS);
+            freeTemps(t);
+            return;
+        }
+        default:
+            break;
+    }
+
+    emitGenericExpr(node);
+}
+
+void JitFragmentWriter::emitStoreName(AST_Name* node) {
+    if (getLookupType(node) == ScopeInfo::VarScopeType::FAST) {
+        assert(node->vreg >= 0);
+        a.mov(assembler::RAX, assembler::Indirect(VREGS_REG, 8 * node->vreg));
+        return;
+    }
+
+    a.mov(assembler::RAX, assembler::RDX);
+    a.mov(INTERP_REG, assembler::RDI);
+    a.mov(assembler::Immediate(node), assembler::RSI);
+    emitCall((void*)ASTInterpreterJitInterface::doStoreHelper);
+}
+
+void JitFragmentWriter::emitStmt(AST_stmt* node) {
+    // Tracebacks and frame introspection get the current statement from the interpreter:
+    a.mov(assembler::Immediate(node), assembler::RAX);
+    a.mov(assembler::RAX, assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getCurrentInstOffset()));
+
+    switch (node->type) {
+        case AST_TYPE::Assign: {
+            AST_Assign* assign = ast_cast<AST_Assign>(node);
+            assert(assign->targets.size() == 1 && "cfg should have lowered it to a single target");
+            AST_expr* target = assign->targets[0];
+
+            if (assign->value->type == AST_TYPE::Yield) {
+                // A stackless generator returns out of the interpreter when it yields, and the interpreter takes care
+                // of the rest of the statement once it gets resumed.
+                emitGenericStmt(node);
+                a.movzbl(assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getSuspendedOffset()),
+                         assembler::RCX);
+                a.test(assembler::RCX, assembler::RCX);
+                {
+                    assembler::ForwardJump not_suspended(a, assembler::COND_EQUAL);
+                    emitExit();
+                }
+                return;
+            }
+
+            if (target->type == AST_TYPE::Name) {
+                emitExpr(assign->value);
+                emitStoreName(ast_cast<AST_Name>(target));
+                return;
+            }
+
+            if (target->type == AST_TYPE::Attribute) {
+                AST_Attribute* attr = ast_cast<AST_Attribute>(target);
+                int t = allocTemps(1);
+                emitExpr(assign->value);
+                a.mov(assembler::RAX, temp(t));
+                emitExpr(attr->value);
+                a.mov(assembler::RAX, assembler::RDI);
+                a.mov(assembler::Immediate((void*)attr->attr.c_str()), assembler::RSI);
+                a.mov(temp(t), assembler::RDX);
+                emitIC(createSetattrIC(NULL), (void*)setattr, ENABLE_ICSETATTRS);
+                freeTemps(t);
+                return;
+            }
+
+            if (target->type == AST_TYPE::Subscript) {
+                AST_Subscript* subscript = ast_cast<AST_Subscript>(target);
+                int t = allocTemps(2);
+                emitExpr(assign->value);
+                a.mov(assembler::RAX, temp(t));
+                emitExpr(subscript->value);
+                a.mov(assembler::RAX, temp(t + 1));
+                emitExpr(subscript->slice);
+                a.mov(assembler::RAX, assembler::RSI);
+                a.mov(temp(t + 1), assembler::RDI);
+                a.mov(temp(t), assembler::RDX);
+                emitIC(createSetitemIC(NULL), (void*)setitem, ENABLE_ICSETITEMS);
+                freeTemps(t);
+                return;
+            }
+            break;
+        }
+        case AST_TYPE::Branch: {
+            AST_Branch* branch = ast_cast<AST_Branch>(node);
+            AST_LangPrimitive* test = NULL;
+            if (branch->test->type == AST_TYPE::LangPrimitive)
+                test = ast_cast<AST_LangPrimitive>(branch->test);
+
+            assembler::ConditionCode if_false;
+            if (test && test->opcode == AST_LangPrimitive::NONZERO) {
+                // Skip boxing the bool just to compare it against True:
+                emitNonzero(test->args[0]);
+                a.test(assembler::RAX, assembler::RAX);
+                if_false = assembler::COND_EQUAL;
+            } else {
+                emitExpr(branch->test);
+                a.mov(assembler::Immediate(True), assembler::RCX);
+                a.cmp(assembler::RAX, assembler::RCX);
+                if_false = assembler::COND_NOT_EQUAL;
+            }
+
+            {
+                assembler::ForwardJump is_false(a, if_false);
+                emitGoto(branch->iftrue);
+            }
+            emitGoto(branch->iffalse);
+            return;
+        }
+        case AST_TYPE::Expr: {
+            AST_Expr* expr = ast_cast<AST_Expr>(node);
+            // docstrings are str constant expression statements, which the interpreter skips as well.
+            if (expr->value->type != AST_TYPE::Str)
+                emitExpr(expr->value);
+            return;
+        }
+        case AST_TYPE::Jump: {
+            AST_Jump* jump = ast_cast<AST_Jump>(node);
+            if (jump->target->idx < block->idx) {
+                // Backedges go through the interpreter, which handles preemption, the switch to the template JIT,
+                // and OSR.  If it OSR'd, it returns the function's return value and leaves next_block NULL; that
+                // includes the case where the compiled code yielded out of a stackless generator, which execute()
+                // tells apart by the suspended flag.
+                a.mov(INTERP_REG, assembler::RDI);
+                a.mov(assembler::Immediate(node), assembler::RSI);
+                emitCall((void*)ASTInterpreterJitInterface::doJumpHelper);
+                a.mov(assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getNextBlockOffset()),
+                      assembler::RCX);
+                a.test(assembler::RCX, assembler::RCX);
+                {
+                    assembler::ForwardJump not_osr(a, assembler::COND_NOT_EQUAL);
+                    emitExit();
+                }
+            }
+            emitGoto(jump->target);
+            return;
+        }
+        case AST_TYPE::Pass:
+            return;
+        case AST_TYPE::Return: {
+            AST_Return* ret = ast_cast<AST_Return>(node);
+            if (ret->value)
+                emitExpr(ret->value);
+            else
+                a.mov(assembler::Immediate(None), assembler::RAX);
+            emitExit();
+            return;
+        }
+        default:
+            break;
+    }
+
+    emitGenericStmt(node);
+}
+
+void JitFragmentWriter::emitBlock() {
+    a.mov(assembler::Immediate(block), assembler::RAX);
+    a.mov(assembler::RAX, assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getCurrentBlockOffset()));
+    a.movq(assembler::Immediate(0ul),
+           assembler::Indirect(INTERP_REG, ASTInterpreterJitInterface::getNextBlockOffset()));
+
+    for (AST_stmt* stmt : block->body) {
+        if (isPerfJitEnabled())
+            line_table.push_back(std::make_pair((uint64_t)a.curInstPointer(), stmt->lineno));
+        emitStmt(stmt);
+        if (hasFailed())
+            return;
+        assert(num_temps_used == 0);
+    }
+
+    // Statements that the interpreter handled (invokes, raises) have set next_block already:
+    emitExit();
+}
+
+void JitFragmentWriter::commit() {
+    assert(!hasFailed());
+
+    block->code = start_addr;
+    block->entry_code = code_block->getEntry();
+    code_block->commit(a.bytesWritten(), std::move(ics));
+    ics.clear();
+
+    if (isPerfJitEnabled())
+        registerPerfJitCode(source_info->getName() + "_tjit_block" + std::to_string(block->idx), start_addr,
+                            a.bytesWritten(), source_info->fn, line_table);
+
+    for (auto& p : new_pending_jumps)
+        pending_jumps.insert(p);
+
+    // Point the jumps that were waiting for this block (possibly including our own) at it:
+    auto range = pending_jumps.equal_range(block);
+    for (auto it = range.first; it != range.second; ++it) {
+        uint8_t* jmp_end = it->second;
+        if (isInRel32Range(jmp_end, start_addr))
+            *(int32_t*)(jmp_end - 4) = start_addr - jmp_end;
+    }
+    pending_jumps.erase(range.first, range.second);
+}
+
+void compileBlockForTemplateJit(CFGBlock* block, SourceInfo* source_info, ScopeInfo* scope_info) {
+    assert(!block->code && !block->template_jit_failed);
+
+    Timer _t("for compileBlockForTemplateJit()", 1000);
+
+    // Try the current code block, and if that runs out of space, try once more with a fresh one.
+    for (int attempt = 0; attempt < 2; attempt++) {
+        if (!current_code_block) {
+            current_code_block = new JitCodeBlock();
+            code_blocks.push_back(current_code_block);
+        }
+
+        JitFragmentWriter writer(current_code_block, block, source_info, scope_info);
+        writer.emitBlock();
+
+        if (!writer.hasFailed()) {
+            writer.commit();
+
+            long us = _t.end();
+            static StatCounter us_compiling("us_compiling_template_jit");
+            us_compiling.log(us);
+            static StatCounter num_compiles("num_compiles_template_jit");
+            num_compiles.log();
+            return;
+        }
+
+        if (!writer.ranOutOfSpace())
+            break;
+
+        JitCodeBlock* full_block = current_code_block;
+        current_code_block = NULL;
+        freeCodeBlockIfUnused(full_block);
+    }
+
+    static StatCounter num_failed("num_template_jit_failed_blocks");
+    num_failed.log();
+    block->template_jit_failed = true;
+}
+}
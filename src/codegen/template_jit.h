@@ -0,0 +1,50 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_CODEGEN_TEMPLATEJIT_H
+#define PYSTON_CODEGEN_TEMPLATEJIT_H
+
+namespace pyston {
+
+class Box;
+class CFG;
+class CFGBlock;
+class ScopeInfo;
+class SourceInfo;
+
+// The template JIT is a tier between the AST interpreter and the LLVM tiers: once an interpreted frame gets hot,
+// the interpreter hands each CFG block it reaches to the template JIT, which turns it directly into machine code
+// with the assembler.  The generated code mirrors what the interpreter would do for each statement, but does its
+// attribute lookups, calls, binops, etc. through the same kind of ICs that the LLVM tiers use, and keeps the
+// interpreter's frame (vregs, current statement, next block) up to date so that tracebacks, OSR, and falling back
+// to the interpreter all keep working.  Anything it doesn't know how to emit gets handed back to the interpreter
+// one expression or statement at a time.
+//
+// Blocks jump straight to each other once both have been compiled; a jump to a block without code returns to the
+// interpreter with next_block set, which then compiles that block and comes back.
+
+// Signature of a block's entry_code: it runs the code at block_code, in the context of the given ASTInterpreter
+// and its vregs, and returns the value that ASTInterpreter::execute() should return if next_block is NULL.
+typedef Box* (*TemplateJitEntryFunc)(void* interpreter, void* block_code, Box** vregs);
+
+// Fills in block->code and block->entry_code, or sets block->template_jit_failed if the block can't be compiled
+// (in which case the interpreter just keeps running it itself).
+void compileBlockForTemplateJit(CFGBlock* block, SourceInfo* source_info, ScopeInfo* scope_info);
+
+// Frees the code of all of the CFG's blocks, along with any jumps that were waiting for them to get compiled.
+// Nothing can be running the code any more; the code chunks get freed once none of their blocks are in use.
+void freeTemplateJitCode(CFG* cfg);
+}
+
+#endif
@@ -14,6 +14,7 @@
 
 #include "codegen/type_recording.h"
 
+#include <algorithm>
 #include <unordered_map>
 
 #include "core/options.h"
@@ -38,11 +39,42 @@ Box* recordType(TypeRecorder* self, Box* obj) {
         self->last_count++;
     }
 
+    if (!self->megamorphic)
+        self->recordClass(cls);
+
     // printf("Seen %s %ld times\n", getNameOfClass(cls)->c_str(), self->last_count);
 
     return obj;
 }
 
+void TypeRecorder::recordClass(BoxedClass* cls) {
+    int i;
+    for (i = 0; i < MAX_CLASSES; i++) {
+        if (seen[i].cls == cls) {
+            seen[i].count++;
+            break;
+        }
+        if (seen[i].cls == NULL) {
+            seen[i].cls = cls;
+            seen[i].count = 1;
+            break;
+        }
+    }
+
+    if (i == MAX_CLASSES) {
+        megamorphic = true;
+        return;
+    }
+
+    // Counts only go up by one at a time, but the entry can still have to move past a run of equal counts:
+    while (i > 0 && seen[i].count > seen[i - 1].count) {
+        std::swap(seen[i], seen[i - 1]);
+        i--;
+    }
+
+    total_count++;
+}
+
 BoxedClass* predictClassFor(AST* node) {
     auto it = type_recorders.find(node);
     if (it == type_recorders.end())
@@ -61,4 +93,31 @@ BoxedClass* TypeRecorder::predict() {
 
     return NULL;
 }
+
+bool predictClassesFor(AST* node, std::vector<PolymorphicClass>& classes) {
+    auto it = type_recorders.find(node);
+    if (it == type_recorders.end())
+        return false;
+
+    TypeRecorder* r = it->second;
+    return r->predictPolymorphic(classes);
+}
+
+bool TypeRecorder::predictPolymorphic(std::vector<PolymorphicClass>& classes) {
+    if (!ENABLE_TYPE_FEEDBACK)
+        return false;
+
+    if (megamorphic || total_count <= SPECULATION_THRESHOLD)
+        return false;
+
+    assert(classes.empty());
+    for (int i = 0; i < MAX_CLASSES && seen[i].cls; i++) {
+        // Classes that only showed up a handful of times aren't worth a check; they'll go down the generic path.
+        if (seen[i].count * 32 < total_count)
+            continue;
+        classes.push_back(PolymorphicClass{ seen[i].cls, (double)seen[i].count / total_count });
+    }
+
+    return !classes.empty();
+}
 }
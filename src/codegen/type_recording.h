@@ -16,6 +16,7 @@
 #define PYSTON_CODEGEN_TYPERECORDING_H
 
 #include <cstdint>
+#include <vector>
 
 namespace pyston {
 
@@ -23,6 +24,12 @@ class AST;
 class Box;
 class BoxedClass;
 
+// One of the classes that a polymorphic site has been seeing, and the fraction of the times that it was this one.
+struct PolymorphicClass {
+    BoxedClass* cls;
+    double frequency;
+};
+
 class TypeRecorder;
 // Have this be a non-function-scoped friend function;
 // the benefit of doing it this way, as opposed to being a member function,
@@ -32,14 +39,35 @@ class TypeRecorder;
 // specified.)
 extern "C" Box* recordType(TypeRecorder* recorder, Box* obj);
 class TypeRecorder {
+public:
+    // How many different classes we keep counts for; a site that sees more than this is "megamorphic" and we stop
+    // trying to speculate on it.
+    static const int MAX_CLASSES = 4;
+
 private:
+    struct ClassCount {
+        BoxedClass* cls;
+        int64_t count;
+    };
+
+    // The streak of the most-recently-seen class, which is what monomorphic speculations are based on:
     BoxedClass* last_seen;
     int64_t last_count;
 
+    // Counts for the first MAX_CLASSES classes that we have seen, kept sorted with the most common first:
+    ClassCount seen[MAX_CLASSES];
+    int64_t total_count;
+    bool megamorphic;
+
+    void recordClass(BoxedClass* cls);
+
 public:
-    constexpr TypeRecorder() : last_seen(nullptr), last_count(0) {}
+    constexpr TypeRecorder() : last_seen(nullptr), last_count(0), seen(), total_count(0), megamorphic(false) {}
 
     BoxedClass* predict();
+    // Fills in the classes that this site has been seeing, most common first, if it has been seeing a small set of them
+    // for long enough to be worth dispatching on.
+    bool predictPolymorphic(std::vector<PolymorphicClass>& classes);
 
     friend Box* recordType(TypeRecorder*, Box*);
 };
@@ -47,6 +75,7 @@ public:
 TypeRecorder* getTypeRecorderForNode(AST* node);
 
 BoxedClass* predictClassFor(AST* node);
+bool predictClassesFor(AST* node, std::vector<PolymorphicClass>& classes);
 }
 
 #endif
@@ -91,6 +91,8 @@ void parseEhFrame(uint64_t start_addr, uint64_t size, uint64_t func_addr, uint64
     *out_len = nentries;
 }
 
+static std::unordered_map<uint64_t, unw_dyn_info_t*> dyn_infos_by_code_addr;
+
 void registerDynamicEhFrame(uint64_t code_addr, size_t code_size, uint64_t eh_frame_addr, size_t eh_frame_size) {
     unw_dyn_info_t* dyn_info = new unw_dyn_info_t();
     dyn_info->start_ip = code_addr;
@@ -109,12 +111,28 @@ void registerDynamicEhFrame(uint64_t code_addr, size_t code_size, uint64_t eh_fr
         printf("dyn_info = %p, table_data = %p\n", dyn_info, (void*)dyn_info->u.rti.table_data);
     _U_dyn_register(dyn_info);
 
+    assert(!dyn_infos_by_code_addr.count(code_addr));
+    dyn_infos_by_code_addr[code_addr] = dyn_info;
+
     // TODO: it looks like libunwind does a linear search over anything dynamically registered,
     // as opposed to the binary search it can do within a dyn_info.
     // If we're registering a lot of dyn_info's, it might make sense to coalesce them into a single
     // dyn_info that contains a binary search table.
 }
 
+void deregisterDynamicEhFrame(uint64_t code_addr) {
+    auto it = dyn_infos_by_code_addr.find(code_addr);
+    RELEASE_ASSERT(it != dyn_infos_by_code_addr.end(), "%lx", code_addr);
+
+    unw_dyn_info_t* dyn_info = it->second;
+    _U_dyn_cancel(dyn_info);
+    uw_table_entry* table_data = (uw_table_entry*)dyn_info->u.rti.table_data;
+    delete[] table_data;
+    delete dyn_info;
+
+    dyn_infos_by_code_addr.erase(it);
+}
+
 class CFRegistry {
 private:
     std::vector<CompiledFunction*> cfs;
@@ -158,6 +176,13 @@ public:
         cfs.insert(cfs.begin() + (-idx - 1), cf);
     }
 
+    void deregisterCF(CompiledFunction* cf) {
+        // find_cf() looks for return addresses, which are after the start of the function:
+        int idx = find_cf((uint64_t)cf->code_start + 1);
+        RELEASE_ASSERT(idx >= 0 && cfs[idx] == cf, "CompiledFunction wasn't registered?");
+        cfs.erase(cfs.begin() + idx);
+    }
+
     CompiledFunction* getCFForAddress(uint64_t addr) {
         if (cfs.empty())
             return NULL;
@@ -168,6 +193,8 @@ public:
 
         return NULL;
     }
+
+    const std::vector<CompiledFunction*>& getAll() { return cfs; }
 };
 
 static CFRegistry cf_registry;
@@ -176,6 +203,16 @@ CompiledFunction* getCFForAddress(uint64_t addr) {
     return cf_registry.getCFForAddress(addr);
 }
 
+std::vector<CompiledFunction*> getRegisteredCompiledFunctions() {
+    return cf_registry.getAll();
+}
+
+void deregisterCompiledFunction(CompiledFunction* cf) {
+    assert(cf->code_start && !cf->is_interpreted);
+    cf_registry.deregisterCF(cf);
+    deregisterDynamicEhFrame(cf->code_start);
+}
+
 class TracebacksEventListener : public llvm::JITEventListener {
 public:
     virtual void NotifyObjectEmitted(const llvm::object::ObjectFile& Obj,
@@ -324,7 +361,9 @@ public:
         }
     }
 
-    AST_stmt* getCurrentStatement() {
+    // Returns NULL if the frame is stopped somewhere that doesn't have frame info, which can only be a safepoint that
+    // was compiled without safepoint_frame_info.
+    AST_stmt* findCurrentStatement() {
         if (id.type == PythonFrameId::COMPILED) {
             CompiledFunction* cf = getCF();
             uint64_t ip = getId().ip;
@@ -345,13 +384,19 @@ public:
                     return reinterpret_cast<AST_stmt*>(readLocation(e.locations[0]));
                 }
             }
-            RELEASE_ASSERT(0, "no frame info found at offset 0x%x / ip 0x%lx!", offset, ip);
+            return NULL;
         } else if (id.type == PythonFrameId::INTERPRETED) {
             return getCurrentStatementForInterpretedFrame((void*)id.bp);
         }
         abort();
     }
 
+    AST_stmt* getCurrentStatement() {
+        AST_stmt* stmt = findCurrentStatement();
+        RELEASE_ASSERT(stmt, "no frame info found at ip 0x%lx!", getId().ip);
+        return stmt;
+    }
+
     Box* getGlobals() {
         if (id.type == PythonFrameId::COMPILED) {
             CompiledFunction* cf = getCF();
@@ -410,6 +455,23 @@ static unw_word_t getFunctionEnd(unw_word_t ip) {
     return pip.end_ip;
 }
 
+// Try getting all the callee-save registers, and save the ones we were able to get.
+// Some of them may be inaccessible, I think because they weren't defined by that
+// stack frame, which can show up as a -UNW_EBADREG return code.
+static void saveCalleeSaveRegs(PythonFrameIteratorImpl& frame_it, unw_cursor_t* cursor) {
+    for (int i = 0; i < 16; i++) {
+        if (!assembler::Register::fromDwarf(i).isCalleeSave())
+            continue;
+        unw_word_t r;
+        int code = unw_get_reg(cursor, i, &r);
+        ASSERT(code == 0 || code == -UNW_EBADREG, "%d %d", code, i);
+        if (code == 0) {
+            frame_it.regs[i] = r;
+            frame_it.regs_valid |= (1 << i);
+        }
+    }
+}
+
 // While I'm not a huge fan of the callback-passing style, libunwind cursors are only valid for
 // the stack frame that they were created in, so we need to use this approach (as opposed to
 // C++11 range loops, for example).
@@ -449,20 +511,7 @@ void unwindPythonStack(std::function<bool(std::unique_ptr<PythonFrameIteratorImp
             info->cf = cf;
 
             if (!was_osr) {
-                // Try getting all the callee-save registers, and save the ones we were able to get.
-                // Some of them may be inaccessible, I think because they weren't defined by that
-                // stack frame, which can show up as a -UNW_EBADREG return code.
-                for (int i = 0; i < 16; i++) {
-                    if (!assembler::Register::fromDwarf(i).isCalleeSave())
-                        continue;
-                    unw_word_t r;
-                    int code = unw_get_reg(&cursor, i, &r);
-                    ASSERT(code == 0 || code == -UNW_EBADREG, "%d %d", code, i);
-                    if (code == 0) {
-                        info->regs[i] = r;
-                        info->regs_valid |= (1 << i);
-                    }
-                }
+                saveCalleeSaveRegs(*info, &cursor);
 
                 bool stop = func(std::move(info));
                 if (stop)
@@ -591,14 +640,87 @@ BoxedTraceback* getTraceback() {
         return false;
     });
 
-    std::reverse(entries.begin(), entries.end());
-
     long us = _t.end();
     us_gettraceback.log(us);
 
     return new BoxedTraceback(std::move(entries));
 }
 
+// Rather than calling getTraceback() when raising an exception, which would walk the entire stack, exceptions start out
+// with an empty traceback and get a line added for each Python frame that they propagate through, the way that
+// CPython's PyTraceBack_Here works.  This way we only pay for the frames between the raise and the handler.
+//
+// This gets called from inside the unwinder, so it must not do any GC allocations.
+static bool shouldAddTracebackFrames(Box* traceback) {
+    return ENABLE_FRAME_INTROSPECTION && ENABLE_TRACEBACKS && traceback->cls == traceback_cls;
+}
+
+static void addTracebackFrame(BoxedTraceback* tb, PythonFrameIteratorImpl& frame_it) {
+    CompiledFunction* cf = frame_it.getCF();
+
+    // We've already been through this frame: it ran a cleanup and resumed unwinding, or it caught the exception as a
+    // C API error and rethrew it.  (Raise statements get a new traceback instead; see BoxedTraceback::base.)
+    if (frame_it.getId().bp == tb->last_frame_bp && cf == tb->last_frame_cf)
+        return;
+
+    // Same as in unwindPythonStack: if the previous frame was entered through OSR, this one is the frame that it
+    // replaced.
+    bool skip = tb->last_frame_was_osr || tb->skip_next_frame;
+
+    tb->skip_next_frame = false;
+    tb->last_frame_bp = frame_it.getId().bp;
+    tb->last_frame_cf = cf;
+    tb->last_frame_was_osr = (bool)cf->entry_descriptor;
+
+    if (skip)
+        return;
+
+    tb->lines.push_back(lineInfoForFrame(frame_it));
+    tb->py_lines = NULL;
+}
+
+void addTracebackFrame(Box* traceback, unw_cursor* cursor) {
+    static unw_word_t interpreter_instr_end = getFunctionEnd((unw_word_t)interpreter_instr_addr);
+
+    if (!shouldAddTracebackFrames(traceback))
+        return;
+
+    unw_word_t ip, bp;
+    unw_get_reg(cursor, UNW_REG_IP, &ip);
+    unw_get_reg(cursor, UNW_TDEP_BP, &bp);
+
+    PythonFrameIteratorImpl frame_it;
+    frame_it.id.ip = ip;
+    frame_it.id.bp = bp;
+    if ((frame_it.cf = getCFForAddress(ip))) {
+        frame_it.id.type = PythonFrameId::COMPILED;
+        saveCalleeSaveRegs(frame_it, cursor);
+    } else if ((unw_word_t)interpreter_instr_addr <= ip && ip < interpreter_instr_end) {
+        frame_it.id.type = PythonFrameId::INTERPRETED;
+        // An interpreter frame that's running its cleanups has unregistered itself, and already got added (or
+        // skipped) on the way in.
+        frame_it.cf = findCFForInterpretedFrame((void*)bp);
+        if (!frame_it.cf)
+            return;
+    } else {
+        return;
+    }
+
+    addTracebackFrame(static_cast<BoxedTraceback*>(traceback), frame_it);
+}
+
+void addTracebackFrameForInterpretedFrame(Box* traceback, void* frame_addr) {
+    if (!shouldAddTracebackFrames(traceback))
+        return;
+
+    PythonFrameIteratorImpl frame_it;
+    frame_it.id.type = PythonFrameId::INTERPRETED;
+    frame_it.id.ip = 0;
+    frame_it.id.bp = (uint64_t)frame_addr;
+    frame_it.cf = getCFForInterpretedFrame(frame_addr);
+    addTracebackFrame(static_cast<BoxedTraceback*>(traceback), frame_it);
+}
+
 ExcInfo* getFrameExcInfo() {
     std::vector<ExcInfo*> to_update;
     ExcInfo* copy_from_exc = NULL;
@@ -934,6 +1056,13 @@ ExecutionPoint getExecutionPoint() {
     return ExecutionPoint({.cf = cf, .current_stmt = current_stmt });
 }
 
+void unwindExecutionPoints(std::function<bool(const ExecutionPoint&)> func) {
+    unwindPythonStack([&](std::unique_ptr<PythonFrameIteratorImpl> frame) {
+        ExecutionPoint point({.cf = frame->getCF(), .current_stmt = frame->findCurrentStatement() });
+        return func(point);
+    });
+}
+
 std::unique_ptr<ExecutionPoint> PythonFrameIterator::getExecutionPoint() {
     assert(impl.get());
     auto cf = impl->getCF();
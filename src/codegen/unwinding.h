@@ -15,10 +15,14 @@
 #ifndef PYSTON_CODEGEN_UNWINDING_H
 #define PYSTON_CODEGEN_UNWINDING_H
 
+#include <functional>
 #include <unordered_map>
+#include <vector>
 
 #include "codegen/codegen.h"
 
+struct unw_cursor;
+
 namespace pyston {
 
 class Box;
@@ -28,19 +32,33 @@ class BoxedTraceback;
 struct FrameInfo;
 
 void registerDynamicEhFrame(uint64_t code_addr, size_t code_size, uint64_t eh_frame_addr, size_t eh_frame_size);
+// Undoes registerDynamicEhFrame(); needs to be called before the code or the eh_frame get freed.
+void deregisterDynamicEhFrame(uint64_t code_addr);
 
 BoxedModule* getCurrentModule();
 Box* getGlobals();     // returns either the module or a globals dict
 Box* getGlobalsDict(); // always returns a dict-like object
 CompiledFunction* getCFForAddress(uint64_t addr);
+// All of the LLVM-tier code that's currently registered, including versions that have been retired but not freed.
+std::vector<CompiledFunction*> getRegisteredCompiledFunctions();
+// Forgets about a JIT'd CompiledFunction that's about to be freed, including its registration with libunwind.
+void deregisterCompiledFunction(CompiledFunction* cf);
 
 BoxedTraceback* getTraceback();
+// Incremental traceback construction: the unwinder calls addTracebackFrame() for every stack frame that an exception
+// passes through, and it adds a line to the exception's traceback if that is a Python frame.  The interpreter catches
+// exceptions below its execute() frame, so it adds its own frame when it catches one.
+void addTracebackFrame(Box* traceback, unw_cursor* cursor);
+void addTracebackFrameForInterpretedFrame(Box* traceback, void* frame_addr);
 
 struct ExecutionPoint {
     CompiledFunction* cf;
     AST_stmt* current_stmt;
 };
 ExecutionPoint getExecutionPoint();
+// Calls func with the execution point of each Python frame on the stack, newest first; return true to stop.
+// The current_stmt is NULL for a frame that's at a safepoint compiled without safepoint_frame_info.
+void unwindExecutionPoints(std::function<bool(const ExecutionPoint&)> func);
 
 // Adds stack locals and closure locals into the locals dict, and returns it.
 Box* fastLocalsToBoxedLocals();
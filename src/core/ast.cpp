@@ -21,6 +21,7 @@
 #include <stdint.h>
 
 #include "core/cfg.h"
+#include "core/options.h"
 
 namespace pyston {
 
@@ -636,6 +637,20 @@ void AST_Invoke::accept_stmt(StmtVisitor* v) {
     return v->visit_invoke(this);
 }
 
+bool AST_Invoke::shouldUseCAPIExceptions() const {
+    if (!ENABLE_CAPI_EXCEPTIONS || num_exceptions_caught < CAPI_EXCEPTION_THRESHOLD)
+        return false;
+    if (num_exceptions_caught * 100 < num_executions * CAPI_EXCEPTION_PERCENT)
+        return false;
+
+    if (stmt->type != AST_TYPE::Assign)
+        return false;
+    AST_Assign* asgn = ast_cast<AST_Assign>(stmt);
+    if (asgn->targets.size() != 1 || asgn->targets[0]->type != AST_TYPE::Name)
+        return false;
+    return asgn->value->type == AST_TYPE::Attribute || asgn->value->type == AST_TYPE::Subscript;
+}
+
 void AST_keyword::accept(ASTVisitor* v) {
     bool skip = v->visit_keyword(this);
     if (skip)
@@ -703,6 +703,10 @@ public:
     // different bytecodes.
     ScopeInfo::VarScopeType lookup_type;
 
+    // For FAST and CLOSURE names, the index of the interpreter frame slot that holds this name's value.
+    // Assigned by CFG::assignVRegs(); -1 otherwise.
+    int vreg;
+
     virtual void accept(ASTVisitor* v);
     virtual void* accept_expr(ExprVisitor* v);
 
@@ -710,7 +714,8 @@ public:
         : AST_expr(AST_TYPE::Name, lineno, col_offset),
           ctx_type(ctx_type),
           id(id),
-          lookup_type(ScopeInfo::VarScopeType::UNKNOWN) {}
+          lookup_type(ScopeInfo::VarScopeType::UNKNOWN),
+          vreg(-1) {}
 
     static const AST_TYPE::AST_TYPE TYPE = AST_TYPE::Name;
 };
@@ -1044,10 +1049,20 @@ public:
 
     CFGBlock* normal_dest, *exc_dest;
 
+    // Profiling feedback: how many times the interpreter has run this statement, and how many of those times it took
+    // the exceptional edge.
+    int64_t num_executions, num_exceptions_caught;
+
     virtual void accept(ASTVisitor* v);
     virtual void accept_stmt(StmtVisitor* v);
 
-    AST_Invoke(AST_stmt* stmt) : AST_stmt(AST_TYPE::Invoke), stmt(stmt) {}
+    AST_Invoke(AST_stmt* stmt)
+        : AST_stmt(AST_TYPE::Invoke), stmt(stmt), num_executions(0), num_exceptions_caught(0) {}
+
+    // Whether this statement raises often enough that we'd rather have the runtime report errors by returning NULL
+    // than by throwing.  Only `#tmp = a.b' and `#tmp = a[b]' have entry points that support that, and they don't go
+    // through the getattr/getitem ICs, so a statement that usually succeeds is better off throwing.
+    bool shouldUseCAPIExceptions() const;
 
     static const AST_TYPE::AST_TYPE TYPE = AST_TYPE::Invoke;
 };
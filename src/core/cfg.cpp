@@ -22,6 +22,7 @@
 #include "analysis/scoping_analysis.h"
 #include "core/ast.h"
 #include "core/options.h"
+#include "core/stats.h"
 #include "core/types.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
@@ -863,6 +864,11 @@ private:
         return rtn;
     }
 
+    void registerScopeReplacement(AST* original_node, AST* new_node) {
+        scoping_analysis->registerScopeReplacement(original_node, new_node);
+        cfg->scope_replacements.push_back(std::make_pair(original_node, new_node));
+    }
+
     // This is a helper function used for generators expressions and comprehensions.
     //
     // Generates a FunctionDef which produces scope for `node'. The function produced is empty, so you'd better fill it.
@@ -878,7 +884,7 @@ private:
         func->args = new AST_arguments();
         func->args->vararg = internString("");
         func->args->kwarg = internString("");
-        scoping_analysis->registerScopeReplacement(node, func); // critical bit
+        registerScopeReplacement(node, func); // critical bit
         return new AST_MakeFunction(func);
     }
 
@@ -1035,7 +1041,7 @@ private:
         rtn->body = node->body; // don't remap now; will be CFG'ed later
         rtn->args = remapArguments(node->args);
         // lambdas create scope, need to register as replacement
-        scoping_analysis->registerScopeReplacement(node, rtn);
+        registerScopeReplacement(node, rtn);
         return rtn;
     }
 
@@ -1422,7 +1428,7 @@ public:
         for (auto expr : node->bases)
             def->bases.push_back(remapExpr(expr));
 
-        scoping_analysis->registerScopeReplacement(node, def);
+        registerScopeReplacement(node, def);
 
         auto tmp = nodeName();
         pushAssign(tmp, new AST_MakeClass(def));
@@ -1444,7 +1450,7 @@ public:
             def->decorator_list.push_back(remapExpr(expr));
         def->args = remapArguments(node->args);
 
-        scoping_analysis->registerScopeReplacement(node, def);
+        registerScopeReplacement(node, def);
 
         auto tmp = nodeName();
         pushAssign(tmp, new AST_MakeFunction(def));
@@ -2454,6 +2460,85 @@ public:
     }
 };
 
+class AssignVRegsVisitor : public NoopASTVisitor {
+private:
+    ScopeInfo* scope_info;
+    CFG* cfg;
+
+public:
+    AssignVRegsVisitor(ScopeInfo* scope_info, CFG* cfg) : scope_info(scope_info), cfg(cfg) {}
+
+    int getVReg(InternedString name) {
+        auto it = cfg->sym_vreg_map.find(name);
+        if (it != cfg->sym_vreg_map.end())
+            return it->second;
+
+        int vreg = cfg->vreg_names.size();
+        cfg->sym_vreg_map[name] = vreg;
+        cfg->vreg_names.push_back(name);
+        return vreg;
+    }
+
+    bool visit_name(AST_Name* node) override {
+        if (node->lookup_type == ScopeInfo::VarScopeType::UNKNOWN)
+            node->lookup_type = scope_info->getScopeTypeOfName(node->id);
+
+        if (node->lookup_type == ScopeInfo::VarScopeType::FAST || node->lookup_type == ScopeInfo::VarScopeType::CLOSURE)
+            node->vreg = getVReg(node->id);
+        return true;
+    }
+
+    // The bodies of nested scopes have their own CFGs (and their own name nodes); only visit the parts that get
+    // evaluated in this scope.
+    bool visit_functiondef(AST_FunctionDef* node) override {
+        for (auto* d : node->decorator_list)
+            d->accept(this);
+        for (auto* d : node->args->defaults)
+            d->accept(this);
+        return true;
+    }
+
+    bool visit_classdef(AST_ClassDef* node) override {
+        for (auto* b : node->bases)
+            b->accept(this);
+        for (auto* d : node->decorator_list)
+            d->accept(this);
+        return true;
+    }
+
+    bool visit_lambda(AST_Lambda* node) override {
+        for (auto* d : node->args->defaults)
+            d->accept(this);
+        return true;
+    }
+};
+
+void CFG::assignVRegs(const ParamNames& param_names, ScopeInfo* scope_info, InternedStringPool& interned_strings) {
+    assert(!has_vregs_assigned);
+
+    AssignVRegsVisitor visitor(scope_info, this);
+
+    // Give the parameters the first slots, even if the body never refers to them:
+    for (auto& name : param_names.args)
+        visitor.getVReg(interned_strings.get(name));
+    if (!param_names.vararg.str().empty())
+        visitor.getVReg(interned_strings.get(param_names.vararg));
+    if (!param_names.kwarg.str().empty())
+        visitor.getVReg(interned_strings.get(param_names.kwarg));
+
+    for (CFGBlock* b : blocks) {
+        for (AST_stmt* stmt : b->body)
+            stmt->accept(&visitor);
+    }
+
+    has_vregs_assigned = true;
+}
+
+CFG::~CFG() {
+    for (CFGBlock* block : blocks)
+        delete block;
+}
+
 void CFG::print() {
     printf("CFG:\n");
     printf("%ld blocks\n", blocks.size());
@@ -2461,7 +2546,89 @@ void CFG::print() {
         blocks[i]->print();
 }
 
+namespace {
+struct TrackedCFGs {
+    std::vector<std::pair<AST*, CFG*>> cfgs;
+    bool has_new;
+};
+}
+static std::unordered_map<AST_Module*, TrackedCFGs> tracked_cfgs;
+// CFGs from the parse cache that haven't been used yet, keyed on the node of their scope:
+static std::unordered_map<AST*, CFG*> cached_cfgs;
+
+void trackCFGs(AST_Module* module, const std::vector<std::pair<AST*, CFG*>>& cfgs) {
+    TrackedCFGs& tracked = tracked_cfgs[module];
+    tracked.cfgs = cfgs;
+    tracked.has_new = false;
+
+    for (auto&& p : cfgs)
+        cached_cfgs[p.first] = p.second;
+}
+
+bool finishTrackingCFGs(AST_Module* module, std::vector<std::pair<AST*, CFG*>>& cfgs) {
+    auto it = tracked_cfgs.find(module);
+    if (it == tracked_cfgs.end())
+        return false;
+
+    bool has_new = it->second.has_new;
+    cfgs = std::move(it->second.cfgs);
+    tracked_cfgs.erase(it);
+    return has_new;
+}
+
+void freeCFG(SourceInfo* source) {
+    CFG* cfg = source->cfg;
+    assert(cfg);
+
+    AST_Module* module = source->scoping->getModuleAST();
+    auto it = module ? tracked_cfgs.find(module) : tracked_cfgs.end();
+    if (it != tracked_cfgs.end()) {
+        auto& cfgs = it->second.cfgs;
+        cfgs.erase(std::remove_if(cfgs.begin(), cfgs.end(),
+                                  [cfg](const std::pair<AST*, CFG*>& tracked) { return tracked.second == cfg; }),
+                   cfgs.end());
+    }
+
+    source->cfg = NULL;
+    delete cfg;
+}
+
+// The cached CFG has to end up the same as the one that we would compute, so this redoes the parts of computeCFG()
+// that have side effects or that depend on more than the AST.  Returns NULL if the CFG isn't usable after all.
+static CFG* getCachedCFG(SourceInfo* source) {
+    auto it = cached_cfgs.find(source->ast);
+    if (it == cached_cfgs.end())
+        return NULL;
+
+    CFG* cfg = it->second;
+    cached_cfgs.erase(it);
+
+    if (source->ast->type == AST_TYPE::ClassDef && source->scoping->areGlobalsFromModule()) {
+        // The name of the module is a constant in the "__module__ = ..." assignment that every class starts with:
+        CFGBlock* entry = cfg->getStartingBlock();
+        if (entry->body.empty() || entry->body[0]->type != AST_TYPE::Assign)
+            return NULL;
+        AST_Assign* module_assign = ast_cast<AST_Assign>(entry->body[0]);
+        if (!module_assign->value || module_assign->value->type != AST_TYPE::Str)
+            return NULL;
+
+        Box* module_name = source->parent_module->getattr("__name__", NULL);
+        assert(module_name->cls == str_cls);
+        ast_cast<AST_Str>(module_assign->value)->str_data = static_cast<BoxedString*>(module_name)->s().str();
+    }
+
+    for (auto&& p : cfg->scope_replacements)
+        source->scoping->registerScopeReplacement(p.first, p.second);
+
+    static StatCounter num_cfgs_from_cache("num_cfgs_from_parse_cache");
+    num_cfgs_from_cache.log();
+    return cfg;
+}
+
 CFG* computeCFG(SourceInfo* source, std::vector<AST_stmt*> body) {
+    if (CFG* cached = getCachedCFG(source))
+        return cached;
+
     CFG* rtn = new CFG();
 
     ScopingAnalysis* scoping_analysis = source->scoping;
@@ -2699,6 +2866,14 @@ CFG* computeCFG(SourceInfo* source, std::vector<AST_stmt*> body) {
         rtn->print();
     }
 
+    AST_Module* module = source->scoping->getModuleAST();
+    if (module) {
+        auto it = tracked_cfgs.find(module);
+        if (it != tracked_cfgs.end()) {
+            it->second.cfgs.push_back(std::make_pair(source->ast, rtn));
+            it->second.has_new = true;
+        }
+    }
 
     return rtn;
 }
@@ -29,6 +29,8 @@
 
 #include <vector>
 
+#include "llvm/ADT/DenseMap.h"
+
 #include "core/ast.h"
 #include "core/common.h"
 #include "core/stringpool.h"
@@ -38,6 +40,9 @@ namespace pyston {
 class AST_stmt;
 
 class CFG;
+class ScopeInfo;
+struct ParamNames;
+
 class CFGBlock {
 private:
     CFG* cfg;
@@ -48,9 +53,15 @@ public:
     int idx; // index in the CFG
     const char* info;
 
+    // Filled in once the template JIT (codegen/template_jit.h) has compiled this block: code is the block's machine
+    // code, and entry_code the trampoline that sets up the frame it runs in.
+    void* code, *entry_code;
+    bool template_jit_failed;
+
     typedef std::vector<AST_stmt*>::iterator iterator;
 
-    CFGBlock(CFG* cfg, int idx) : cfg(cfg), idx(idx), info(NULL) {}
+    CFGBlock(CFG* cfg, int idx)
+        : cfg(cfg), idx(idx), info(NULL), code(NULL), entry_code(NULL), template_jit_failed(false) {}
 
     void connectTo(CFGBlock* successor, bool allow_backedge = false);
     void unconnectFrom(CFGBlock* successor);
@@ -63,11 +74,23 @@ public:
 class CFG {
 private:
     int next_idx;
+    bool has_vregs_assigned;
 
 public:
     std::vector<CFGBlock*> blocks;
 
-    CFG() : next_idx(0) {}
+    // Every name that the interpreter keeps in its frame (FAST and CLOSURE names) gets a dense slot index, so that
+    // local variable accesses are array indexing instead of symbol table lookups.  vreg_names is the inverse mapping,
+    // used for OSR, deopt, and locals().
+    llvm::DenseMap<InternedString, int> sym_vreg_map;
+    std::vector<InternedString> vreg_names;
+
+    // The (original, replacement) pairs that the CFG construction registered with the scoping analysis, so that they
+    // can be registered again when this CFG gets loaded from the parse cache instead of being recomputed.
+    std::vector<std::pair<AST*, AST*>> scope_replacements;
+
+    CFG() : next_idx(0), has_vregs_assigned(false) {}
+    ~CFG();
 
     CFGBlock* getStartingBlock() { return blocks[0]; }
 
@@ -95,11 +118,24 @@ public:
         blocks.push_back(block);
     }
 
+    bool hasVregsAssigned() { return has_vregs_assigned; }
+    void assignVRegs(const ParamNames& param_names, ScopeInfo* scope_info, InternedStringPool& interned_strings);
+
     void print();
 };
 
 class SourceInfo;
 CFG* computeCFG(SourceInfo* source, std::vector<AST_stmt*> body);
+
+// The parse cache can also store the CFGs of a module's scopes, so that a warm import doesn't have to recompute them.
+// trackCFGs() hands computeCFG() the CFGs that came from the cache (keyed on the scope's node), and starts recording
+// the CFGs that get computed for the module's scopes.  finishTrackingCFGs() returns all of the module's CFGs that
+// would be worth caching, and whether any of them are new.
+void trackCFGs(AST_Module* module, const std::vector<std::pair<AST*, CFG*>>& cached_cfgs);
+bool finishTrackingCFGs(AST_Module* module, std::vector<std::pair<AST*, CFG*>>& cfgs);
+// Frees the source's CFG once nothing can be running it any more (see freeDeadCompiledFunctions()), and stops
+// tracking it.
+void freeCFG(SourceInfo* source);
 }
 
 #endif
@@ -50,9 +50,15 @@ int REOPT_THRESHOLD_BASELINE = 250;
 int OSR_THRESHOLD_T2 = 10000;
 int REOPT_THRESHOLD_T2 = 10000;
 int SPECULATION_THRESHOLD = 100;
+int CAPI_EXCEPTION_THRESHOLD = 10;
+int CAPI_EXCEPTION_PERCENT = 5;
+int TEMPLATE_JIT_THRESHOLD_CALLS = 10;
+int TEMPLATE_JIT_THRESHOLD_BACKEDGES = 50;
 
 int MAX_OBJECT_CACHE_ENTRIES = 500;
 
+int GC_MARK_THREADS = 0;
+
 static bool _GLOBAL_ENABLE = 1;
 bool ENABLE_ICS = 1 && _GLOBAL_ENABLE;
 bool ENABLE_ICGENERICS = 1 && ENABLE_ICS;
@@ -70,11 +76,17 @@ bool ENABLE_SPECULATION = 1 && _GLOBAL_ENABLE;
 bool ENABLE_OSR = 1 && _GLOBAL_ENABLE;
 bool ENABLE_LLVMOPTS = 1 && _GLOBAL_ENABLE;
 bool ENABLE_INLINING = 1 && _GLOBAL_ENABLE;
+bool ENABLE_DIRECT_CALLS = 1 && _GLOBAL_ENABLE;
 bool ENABLE_REOPT = 1 && _GLOBAL_ENABLE;
+bool ENABLE_BACKGROUND_COMPILE = 1 && _GLOBAL_ENABLE;
+bool ENABLE_TEMPLATE_JIT = 1 && _GLOBAL_ENABLE;
 bool ENABLE_PYSTON_PASSES = 1 && _GLOBAL_ENABLE;
 bool ENABLE_TYPE_FEEDBACK = 1 && _GLOBAL_ENABLE;
 bool ENABLE_RUNTIME_ICS = 1 && _GLOBAL_ENABLE;
 bool ENABLE_JIT_OBJECT_CACHE = 1 && _GLOBAL_ENABLE;
+bool ENABLE_LIST_STRATEGIES = 1 && _GLOBAL_ENABLE;
+bool ENABLE_CAPI_EXCEPTIONS = 1 && _GLOBAL_ENABLE;
+bool ENABLE_STACKLESS_GENERATORS = 1 && _GLOBAL_ENABLE;
 
 bool ENABLE_FRAME_INTROSPECTION = 1;
 bool BOOLS_AS_I64 = ENABLE_FRAME_INTROSPECTION;
@@ -35,20 +35,27 @@ extern int OSR_THRESHOLD_INTERPRETER, REOPT_THRESHOLD_INTERPRETER;
 extern int OSR_THRESHOLD_BASELINE, REOPT_THRESHOLD_BASELINE;
 extern int OSR_THRESHOLD_T2, REOPT_THRESHOLD_T2;
 extern int SPECULATION_THRESHOLD;
+// How many times an invoke has to go to its exception handler before we switch it to the C API calling convention,
+// and what percentage of its executions that has to be.
+extern int CAPI_EXCEPTION_THRESHOLD, CAPI_EXCEPTION_PERCENT;
+extern int TEMPLATE_JIT_THRESHOLD_CALLS, TEMPLATE_JIT_THRESHOLD_BACKEDGES;
 extern int MAX_OBJECT_CACHE_ENTRIES;
 
+// Number of threads to use for the gc's mark phase; 0 means pick based on the number of cores.
+extern int GC_MARK_THREADS;
+
 extern bool SHOW_DISASM, FORCE_INTERPRETER, FORCE_OPTIMIZE, PROFILE, DUMPJIT, TRAP, USE_STRIPPED_STDLIB,
     CONTINUE_AFTER_FATAL, ENABLE_INTERPRETER, ENABLE_PYPA_PARSER, USE_REGALLOC_BASIC, PAUSE_AT_ABORT, ENABLE_TRACEBACKS;
 
 extern bool ENABLE_ICS, ENABLE_ICGENERICS, ENABLE_ICGETITEMS, ENABLE_ICSETITEMS, ENABLE_ICDELITEMS, ENABLE_ICBINEXPS,
     ENABLE_ICNONZEROS, ENABLE_ICCALLSITES, ENABLE_ICSETATTRS, ENABLE_ICGETATTRS, ENALBE_ICDELATTRS, ENABLE_ICGETGLOBALS,
-    ENABLE_SPECULATION, ENABLE_OSR, ENABLE_LLVMOPTS, ENABLE_INLINING, ENABLE_REOPT, ENABLE_PYSTON_PASSES,
-    ENABLE_TYPE_FEEDBACK, ENABLE_FRAME_INTROSPECTION, ENABLE_RUNTIME_ICS, ENABLE_JIT_OBJECT_CACHE;
+    ENABLE_SPECULATION, ENABLE_OSR, ENABLE_LLVMOPTS, ENABLE_INLINING, ENABLE_DIRECT_CALLS, ENABLE_REOPT,
+    ENABLE_PYSTON_PASSES, ENABLE_TYPE_FEEDBACK, ENABLE_FRAME_INTROSPECTION, ENABLE_RUNTIME_ICS, ENABLE_JIT_OBJECT_CACHE,
+    ENABLE_BACKGROUND_COMPILE, ENABLE_TEMPLATE_JIT, ENABLE_LIST_STRATEGIES, ENABLE_CAPI_EXCEPTIONS,
+    ENABLE_STACKLESS_GENERATORS;
 
 // Due to a temporary LLVM limitation, represent bools as i64's instead of i1's.
 extern bool BOOLS_AS_I64;
-
-#define ENABLE_SAMPLING_PROFILER 0
 }
 }
 
@@ -15,23 +15,25 @@
 #include "core/threading.h"
 
 #include <atomic>
+#include <cerrno>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
 #include <err.h>
 #include <setjmp.h>
 #include <sys/syscall.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "Python.h"
 
-#include "codegen/codegen.h" // sigprof_pending
+#include "codegen/profiling/sampling_profiler.h"
 #include "core/common.h"
 #include "core/options.h"
 #include "core/stats.h"
 #include "core/thread_utils.h"
 #include "core/util.h"
 #include "gc/collector.h"
-#include "runtime/objmodel.h" // _printStacktrace
 
 namespace pyston {
 namespace threading {
@@ -127,9 +129,9 @@ public:
         for (auto& stack_info : previous_stacks) {
             v->visit(stack_info.next_generator);
 #if STACK_GROWS_DOWN
-            v->visitPotentialRange((void**)stack_info.stack_limit, (void**)stack_info.stack_start);
+            v->visitPotentialStackRange((void**)stack_info.stack_limit, (void**)stack_info.stack_start);
 #else
-            v->visitPotentialRange((void**)stack_info.stack_start, (void**)stack_info.stack_limit);
+            v->visitPotentialStackRange((void**)stack_info.stack_start, (void**)stack_info.stack_limit);
 #endif
         }
     }
@@ -156,7 +158,7 @@ static gc::GCVisitor* cur_visitor = NULL;
 // This function should only be called with the threading_lock held:
 static void pushThreadState(ThreadStateInternal* thread_state, ucontext_t* context) {
     assert(cur_visitor);
-    cur_visitor->visitPotentialRange((void**)context, (void**)(context + 1));
+    cur_visitor->visitPotentialStackRange((void**)context, (void**)(context + 1));
 
 #if STACK_GROWS_DOWN
     void* stack_low = (void*)context->uc_mcontext.gregs[REG_RSP];
@@ -167,7 +169,7 @@ static void pushThreadState(ThreadStateInternal* thread_state, ucontext_t* conte
 #endif
 
     assert(stack_low < stack_high);
-    cur_visitor->visitPotentialRange((void**)stack_low, (void**)stack_high);
+    cur_visitor->visitPotentialStackRange((void**)stack_low, (void**)stack_high);
 
     thread_state->accept(cur_visitor);
 }
@@ -183,7 +185,7 @@ static void visitLocalStack(gc::GCVisitor* v) {
     jmp_buf registers __attribute__((aligned(sizeof(void*))));
     setjmp(registers);
     assert(sizeof(registers) % 8 == 0);
-    v->visitPotentialRange((void**)&registers, (void**)((&registers) + 1));
+    v->visitPotentialStackRange((void**)&registers, (void**)((&registers) + 1));
 
     assert(current_internal_thread_state);
 #if STACK_GROWS_DOWN
@@ -195,7 +197,7 @@ static void visitLocalStack(gc::GCVisitor* v) {
 #endif
 
     assert(stack_low < stack_high);
-    v->visitPotentialRange((void**)stack_low, (void**)stack_high);
+    v->visitPotentialStackRange((void**)stack_low, (void**)stack_high);
 
     current_internal_thread_state->accept(v);
 }
@@ -282,14 +284,7 @@ struct ThreadStartArgs {
     Box* arg1, *arg2, *arg3;
 };
 
-static void* _thread_start(void* _arg) {
-    ThreadStartArgs* arg = static_cast<ThreadStartArgs*>(_arg);
-    auto start_func = arg->start_func;
-    Box* arg1 = arg->arg1;
-    Box* arg2 = arg->arg2;
-    Box* arg3 = arg->arg3;
-    delete arg;
-
+static void registerThread(bool started_by_start_thread) {
     pthread_t current_thread = pthread_self();
 
     {
@@ -315,30 +310,54 @@ static void* _thread_start(void* _arg) {
         current_internal_thread_state = new ThreadStateInternal(stack_bottom, current_thread, &cur_thread_state);
         current_threads[current_thread] = current_internal_thread_state;
 
-        num_starting_threads--;
+        if (started_by_start_thread)
+            num_starting_threads--;
 
         if (VERBOSITY() >= 2)
             printf("child initialized; tid=%ld\n", current_thread);
     }
+}
 
-    threading::GLReadRegion _glock;
-    assert(!PyErr_Occurred());
-
-    void* rtn = start_func(arg1, arg2, arg3);
+static void unregisterThread() {
     current_internal_thread_state->assertNoGenerators();
 
     {
         LOCK_REGION(&threading_lock);
 
-        current_threads.erase(current_thread);
+        current_threads.erase(pthread_self());
         if (VERBOSITY() >= 2)
-            printf("thread tid=%ld exited\n", current_thread);
+            printf("thread tid=%ld exited\n", pthread_self());
     }
     current_internal_thread_state = 0;
+}
 
+static void* _thread_start(void* _arg) {
+    ThreadStartArgs* arg = static_cast<ThreadStartArgs*>(_arg);
+    auto start_func = arg->start_func;
+    Box* arg1 = arg->arg1;
+    Box* arg2 = arg->arg2;
+    Box* arg3 = arg->arg3;
+    delete arg;
+
+    registerThread(true);
+
+    threading::GLReadRegion _glock;
+    assert(!PyErr_Occurred());
+
+    void* rtn = start_func(arg1, arg2, arg3);
+
+    unregisterThread();
     return rtn;
 }
 
+void registerRuntimeThread() {
+    registerThread(false);
+}
+
+void unregisterRuntimeThread() {
+    unregisterThread();
+}
+
 static bool thread_was_started = false;
 bool threadWasStarted() {
     return thread_was_started;
@@ -468,15 +487,46 @@ extern "C" void endAllowThreads() noexcept {
     acquireGLRead();
 }
 
+// CPython 3's default switch interval is 5ms.
+static std::atomic<int64_t> gil_switch_interval_us(5000);
+
+void setGILSwitchInterval(int64_t us) {
+    assert(us > 0);
+    gil_switch_interval_us.store(us, std::memory_order_relaxed);
+}
+
+int64_t getGILSwitchInterval() {
+    return gil_switch_interval_us.load(std::memory_order_relaxed);
+}
+
 #if THREADING_USE_GIL
 #if THREADING_USE_GRWL
 #error "Can't turn on both the GIL and the GRWL!"
 #endif
 
-static pthread_mutex_t gil = PTHREAD_MUTEX_INITIALIZER;
+// The GIL is handed off explicitly, in the style of CPython 3.2's "new GIL":
+// - Threads that want the GIL queue up in FIFO order, each waiting on its own condition variable.
+// - Releasing the GIL while anyone is waiting passes ownership straight to the head of the queue,
+//   so the releasing thread can't immediately grab it back, and no waiter can starve.
+// - The head of the queue waits for at most the switch interval; if the GIL still hasn't been
+//   released by then, it sets gil_drop_request.  The holder checks that flag at every
+//   allowGLReadPreemption() call, and when it sees it, hands the GIL over and requeues at the back.
+// So a thread that wants the GIL gets it within roughly (its position in the queue) * switch interval.
+struct GILWaiter {
+    pthread_cond_t cond;
+    bool granted;
+};
+
+static pthread_mutex_t gil_mutex = PTHREAD_MUTEX_INITIALIZER;
+static bool gil_locked = false;
+static std::deque<GILWaiter*> gil_waiters;
+static std::atomic<bool> gil_drop_request(false);
 
-static std::atomic<int> threads_waiting_on_gil(0);
-static pthread_cond_t gil_acquired = PTHREAD_COND_INITIALIZER;
+static uint64_t monotonicUs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000UL + ts.tv_nsec / 1000;
+}
 
 extern "C" void PyEval_ReInitThreads() noexcept {
     pthread_t current_thread = pthread_self();
@@ -501,65 +551,121 @@ extern "C" void PyEval_ReInitThreads() noexcept {
     threading_lock.unlock();
 
     num_starting_threads = 0;
-    threads_waiting_on_gil = 0;
+
+    // We hold the GIL; the threads that were waiting for it don't exist in the child.
+    pthread_mutex_init(&gil_mutex, NULL);
+    gil_locked = true;
+    gil_waiters.clear();
+    gil_drop_request = false;
 
     // TODO we should clean up all created PerThreadSets, such as the one used in the heap for thread-local-caches.
 }
 
 void acquireGLWrite() {
-    threads_waiting_on_gil++;
-    pthread_mutex_lock(&gil);
-    threads_waiting_on_gil--;
+    pthread_mutex_lock(&gil_mutex);
+    if (!gil_locked) {
+        assert(gil_waiters.empty());
+        gil_locked = true;
+        pthread_mutex_unlock(&gil_mutex);
+        return;
+    }
+
+    uint64_t start = monotonicUs();
+
+    GILWaiter waiter;
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&waiter.cond, &attr);
+    pthread_condattr_destroy(&attr);
+    waiter.granted = false;
+    gil_waiters.push_back(&waiter);
+
+    while (!waiter.granted) {
+        if (gil_waiters.front() != &waiter) {
+            // Whoever is ahead of us will wake us up when we get to the front.
+            pthread_cond_wait(&waiter.cond, &gil_mutex);
+            continue;
+        }
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_MONOTONIC, &deadline);
+        uint64_t ns = deadline.tv_nsec + getGILSwitchInterval() * 1000;
+        deadline.tv_sec += ns / 1000000000;
+        deadline.tv_nsec = ns % 1000000000;
+
+        int r = pthread_cond_timedwait(&waiter.cond, &gil_mutex, &deadline);
+        if (r == ETIMEDOUT && !waiter.granted)
+            gil_drop_request.store(true, std::memory_order_relaxed);
+    }
+    // releaseGLWrite took us off the queue and left gil_locked set for us.
+    assert(gil_locked);
 
-    pthread_cond_signal(&gil_acquired);
+    pthread_mutex_unlock(&gil_mutex);
+    pthread_cond_destroy(&waiter.cond);
+
+    // We hold the GIL now, so it's safe to log stats:
+    uint64_t waited_us = monotonicUs() - start;
+    static StatCounter sc_gil_waits("num_gil_waits");
+    static StatCounter sc_gil_wait_us("gil_wait_us");
+    static StatCounter sc_gil_long_waits("num_gil_waits_over_10ms");
+    sc_gil_waits.log();
+    sc_gil_wait_us.log(waited_us);
+    if (waited_us > 10000)
+        sc_gil_long_waits.log();
 }
 
 void releaseGLWrite() {
-    pthread_mutex_unlock(&gil);
+    pthread_mutex_lock(&gil_mutex);
+    assert(gil_locked);
+    gil_drop_request.store(false, std::memory_order_relaxed);
+
+    if (gil_waiters.empty()) {
+        gil_locked = false;
+    } else {
+        // Hand the GIL directly to the longest-waiting thread; gil_locked stays set on its behalf.
+        GILWaiter* next = gil_waiters.front();
+        gil_waiters.pop_front();
+        next->granted = true;
+        pthread_cond_signal(&next->cond);
+
+        // The new head of the queue needs to start its timed wait:
+        if (!gil_waiters.empty())
+            pthread_cond_signal(&gil_waiters.front()->cond);
+    }
+
+    pthread_mutex_unlock(&gil_mutex);
 }
 
-#define GIL_CHECK_INTERVAL 1000
-// Note: this doesn't need to be an atomic, since it should
-// only be accessed by the thread that holds the gil:
-int gil_check_count = 0;
+void requestSafePoint() {
+    gil_drop_request.store(true, std::memory_order_relaxed);
+}
 
-// TODO: this function is fair in that it forces a thread to give up the GIL
-// after a bounded amount of time, but currently we have no guarantees about
-// who it will release the GIL to.  So we could have two threads that are
-// switching back and forth, and a third that never gets run.
-// We could enforce fairness by having a FIFO of events (implementd with mutexes?)
-// and make sure to always wake up the longest-waiting one.
 void allowGLReadPreemption() {
-#if ENABLE_SAMPLING_PROFILER
-    if (unlikely(sigprof_pending)) {
-        // Output multiple stacktraces if we received multiple signals
-        // between being able to handle it (such as being in LLVM or the GC),
-        // to try to fully account for that time.
-        while (sigprof_pending) {
-            _printStacktrace();
-            sigprof_pending--;
-        }
-    }
-#endif
-
-    // Double-checked locking: first read with no ordering constraint:
-    if (!threads_waiting_on_gil.load(std::memory_order_relaxed))
+    // This is the check that the interpreter and the jitted code do all the time, so keep it to a
+    // single relaxed load:
+    if (likely(!gil_drop_request.load(std::memory_order_relaxed)))
         return;
 
-    gil_check_count++;
-    if (gil_check_count >= GIL_CHECK_INTERVAL) {
-        gil_check_count = 0;
+    if (unlikely(hasPendingProfilerSamples())) {
+        takePendingProfilerSamples();
 
-        // Double check this, since if we are wrong about there being a thread waiting on the gil,
-        // we're going to get stuck in the following pthread_cond_wait:
-        if (!threads_waiting_on_gil.load(std::memory_order_seq_cst))
+        // We might only be here for the profiler:
+        pthread_mutex_lock(&gil_mutex);
+        bool have_waiters = !gil_waiters.empty();
+        if (!have_waiters)
+            gil_drop_request.store(false, std::memory_order_relaxed);
+        pthread_mutex_unlock(&gil_mutex);
+        if (!have_waiters)
             return;
-
-        threads_waiting_on_gil++;
-        pthread_cond_wait(&gil_acquired, &gil);
-        threads_waiting_on_gil--;
-        pthread_cond_signal(&gil_acquired);
     }
+
+    static StatCounter sc_forced_switches("num_gil_forced_switches");
+    sc_forced_switches.log();
+
+    // Releasing hands the GIL to the head of the queue, and reacquiring puts us at the back of it.
+    releaseGLWrite();
+    acquireGLWrite();
 }
 #elif THREADING_USE_GRWL
 static pthread_rwlock_t grwl = PTHREAD_RWLOCK_WRITER_NONRECURSIVE_INITIALIZER_NP;
@@ -618,10 +724,17 @@ void demoteGL() {
     acquireGLRead();
 }
 
+void requestSafePoint() {
+    // allowGLReadPreemption() checks for profiler samples on its own.
+}
+
 static __thread int gl_check_count = 0;
 void allowGLReadPreemption() {
     assert(grwl_state == GRWLHeldState::R);
 
+    if (unlikely(hasPendingProfilerSamples()))
+        takePendingProfilerSamples();
+
     // gl_check_count++;
     // if (gl_check_count < 10)
     // return;
@@ -43,6 +43,11 @@ intptr_t start_thread(void* (*start_func)(Box*, Box*, Box*), Box* arg1, Box* arg
 void registerMainThread();
 void finishMainThread();
 
+// For threads that the runtime starts for its own use with pthread_create, rather than through start_thread():
+// lets them take the GIL and allocate, by telling the GC about their stacks.  They don't count as started threads.
+void registerRuntimeThread();
+void unregisterRuntimeThread();
+
 // Hook for the GC; will visit all the threads (including the current one), visiting their
 // stacks and thread-local PyThreadState objects
 void visitAllStacks(gc::GCVisitor* v);
@@ -82,11 +87,16 @@ void releaseGLRead();
 void acquireGLWrite();
 void releaseGLWrite();
 void allowGLReadPreemption();
+// Makes whoever holds the GL take the slow path through its next allowGLReadPreemption() call.  Async-signal-safe.
+void requestSafePoint();
 // Note: promoteGL is free to drop the lock and then reacquire
 void promoteGL();
 void demoteGL();
 
-
+// How long, in microseconds, a thread waiting for the GIL lets the current holder keep running before
+// forcing it to hand the GIL over.  Exposed as sys.setswitchinterval / sys.setcheckinterval.
+void setGILSwitchInterval(int64_t us);
+int64_t getGILSwitchInterval();
 
 #define MAKE_REGION(name, start, end)                                                                                  \
     class name {                                                                                                       \
@@ -139,6 +149,8 @@ inline void demoteGL() {
 }
 inline void allowGLReadPreemption() {
 }
+inline void requestSafePoint() {
+}
 #endif
 
 
@@ -92,6 +92,9 @@ public:
     void visitRange(void* const* start, void* const* end);
     void visitPotential(void* p);
     void visitPotentialRange(void* const* start, void* const* end);
+    // For thread and generator stacks (and saved registers): these are where the return addresses of running
+    // compiled code are, so full collections also check them for retired code.
+    void visitPotentialStackRange(void* const* start, void* const* end);
 };
 
 } // namespace gc
@@ -147,8 +150,10 @@ private:
 
 public:
     ICInvalidator() : cur_version(0) {}
+    ~ICInvalidator();
 
     void addDependent(ICSlotInfo* icentry);
+    void removeDependent(ICSlotInfo* icentry);
     int64_t version();
     void invalidateAll();
 };
@@ -198,6 +203,14 @@ public:
 
     std::vector<ICInfo*> ics;
 
+    // The number of ASTInterpreter frames that exist for this version, including the ones of stackless generators,
+    // which live on the heap rather than on a stack.
+    int num_interpreter_frames;
+
+    // Set once the address of this version's code has been baked into some other compiled code (rather than going
+    // through an IC that depends on dependent_callsites), which means it can never be freed.
+    bool pinned;
+
     CompiledFunction(llvm::Function* func, FunctionSpecialization* spec, bool is_interpreted, void* code,
                      EffortLevel effort, const OSREntryDescriptor* entry_descriptor)
         : clfunc(NULL),
@@ -209,16 +222,16 @@ public:
           effort(effort),
           times_called(0),
           times_speculation_failed(0),
-          location_map(nullptr) {
+          location_map(nullptr),
+          num_interpreter_frames(0),
+          pinned(false) {
         assert((spec != NULL) + (entry_descriptor != NULL) == 1);
     }
 
     ConcreteCompilerType* getReturnType();
 
-    // TODO this will need to be implemented eventually; things to delete:
-    // - line_table if it exists
-    // - location_map if it exists
-    // - all entries in ics (after deregistering them)
+    // Frees the code and everything that goes along with it (ics, location_map, eh_frame registrations).  Only
+    // safe once nothing can be running this version any more; see retireCompiledFunction().
     ~CompiledFunction();
 
     // Call this when a speculation inside this version failed
@@ -262,6 +275,10 @@ public:
     // body and we have to create one.  Ideally, we'd be able to avoid the space duplication for non-lambdas.
     const std::vector<AST_stmt*> body;
 
+    // The CLFunctions of the functions, lambdas and classes that are defined directly in this scope, keyed on their
+    // node, so that different compilations of this scope use the same ones.  See wrapFunction().
+    std::unordered_map<AST*, CLFunction*> nested_functions;
+
     const std::string getName();
     InternedString mangleName(InternedString id);
 
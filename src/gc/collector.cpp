@@ -14,17 +14,24 @@
 
 #include "gc/collector.h"
 
+#include <atomic>
 #include <cassert>
 #include <cstdio>
 #include <cstdlib>
+#include <deque>
+#include <pthread.h>
+#include <unistd.h>
 
 #include "codegen/ast_interpreter.h"
 #include "codegen/codegen.h"
+#include "codegen/irgen/hooks.h"
 #include "core/common.h"
+#include "core/options.h"
 #include "core/threading.h"
 #include "core/types.h"
 #include "core/util.h"
 #include "gc/heap.h"
+#include "gc/softdirty.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
 
@@ -44,74 +51,125 @@
 namespace pyston {
 namespace gc {
 
+// Wakes up the markers that are waiting for work; defined with the rest of the parallel marking code below.
+static std::atomic<int> num_idle_markers(0);
+static void notifyIdleMarkers();
+
 class TraceStack {
 private:
     const int CHUNK_SIZE = 256;
     const int MAX_FREE_CHUNKS = 50;
 
-    std::vector<void**> chunks;
+    struct Chunk {
+        void** data;
+        int size;
+    };
+
+    // The chunks of this stack other than the current one.  When marking in parallel, other marker threads will
+    // steal chunks from the bottom of this when they run out of work, so access to it is guarded by chunks_lock.
+    // That only happens once per CHUNK_SIZE pushes or pops, so it should be uncontended.
+    // Most of these are full, but shareWork() can add partial ones.
+    std::deque<Chunk> chunks;
+    threading::PthreadSpinLock chunks_lock;
+    std::atomic<int> num_chunks;
+
     static std::vector<void**> free_chunks;
+    static threading::PthreadSpinLock free_chunks_lock;
 
     void** cur;
     void** start;
     void** end;
 
-    void get_chunk() {
-        if (free_chunks.size()) {
-            start = free_chunks.back();
-            free_chunks.pop_back();
-        } else {
-            start = (void**)malloc(sizeof(void*) * CHUNK_SIZE);
-        }
+public:
+    // The total size of the objects that got marked by pushing them onto this stack:
+    size_t marked_bytes = 0;
 
+private:
+    void** alloc_chunk() {
+        {
+            LOCK_REGION(&free_chunks_lock);
+            if (free_chunks.size()) {
+                void** chunk = free_chunks.back();
+                free_chunks.pop_back();
+                return chunk;
+            }
+        }
+        return (void**)malloc(sizeof(void*) * CHUNK_SIZE);
+    }
+    void get_chunk() {
+        start = alloc_chunk();
         cur = start;
         end = start + CHUNK_SIZE;
     }
     void release_chunk(void** chunk) {
+        LOCK_REGION(&free_chunks_lock);
         if (free_chunks.size() == MAX_FREE_CHUNKS)
             free(chunk);
         else
             free_chunks.push_back(chunk);
     }
-    void pop_chunk() {
-        start = chunks.back();
-        chunks.pop_back();
+    void set_chunk(Chunk chunk) {
+        release_chunk(start);
+        start = chunk.data;
         end = start + CHUNK_SIZE;
-        cur = end;
+        cur = start + chunk.size;
+    }
+    void queue_chunk(Chunk chunk) {
+        {
+            LOCK_REGION(&chunks_lock);
+            chunks.push_back(chunk);
+            num_chunks++;
+        }
+        // This pairs with the idle markers incrementing num_idle_markers before they check for work, so at least
+        // one side sees the other:
+        if (num_idle_markers.load())
+            notifyIdleMarkers();
     }
 
 public:
-    TraceStack() { get_chunk(); }
-    TraceStack(const std::unordered_set<void*>& rhs) {
+    TraceStack() : num_chunks(0) { get_chunk(); }
+    TraceStack(const std::unordered_set<void*>& rhs) : num_chunks(0) {
         get_chunk();
         for (void* p : rhs) {
-            assert(!isMarked(GCAllocation::fromUserData(p)));
+            // In a minor collection, roots that are already in the old generation will be marked;
+            // push() skips those.
             push(p);
         }
     }
+    ~TraceStack() {
+        assert(cur == start);
+        assert(chunks.empty());
+        release_chunk(start);
+    }
 
     void push(void* p) {
         GCAllocation* al = GCAllocation::fromUserData(p);
-        if (isMarked(al))
+        if (!trySetMarkAtomic(al))
             return;
 
-        setMark(al);
+        marked_bytes += global_heap.allocationSize(al);
 
         *cur++ = p;
         if (cur == end) {
-            chunks.push_back(start);
+            queue_chunk({ start, CHUNK_SIZE });
             get_chunk();
         }
     }
 
     void* pop_chunk_and_item() {
-        release_chunk(start);
-        if (chunks.size()) {
-            pop_chunk();
-            assert(cur == end);
-            return *--cur; // no need for any bounds checks here since we're guaranteed we're CHUNK_SIZE from the start
+        Chunk chunk;
+        {
+            LOCK_REGION(&chunks_lock);
+            if (chunks.empty())
+                return NULL;
+            chunk = chunks.back();
+            chunks.pop_back();
+            num_chunks--;
         }
-        return NULL;
+
+        set_chunk(chunk);
+        assert(cur > start);
+        return *--cur;
     }
 
 
@@ -121,8 +179,55 @@ public:
 
         return pop_chunk_and_item();
     }
+
+    // Takes a chunk from the bottom of another marker's stack.  That's the oldest work in the
+    // stack, which is the least likely to still be in the other thread's cache, and usually
+    // represents the largest amount of remaining tracing.
+    // Should only be called once this stack is empty.
+    bool stealFrom(TraceStack* victim) {
+        assert(cur == start);
+
+        if (!victim->num_chunks.load(std::memory_order_relaxed))
+            return false;
+
+        Chunk chunk;
+        {
+            LOCK_REGION(&victim->chunks_lock);
+            if (victim->chunks.empty())
+                return false;
+            chunk = victim->chunks.front();
+            victim->chunks.pop_front();
+            victim->num_chunks--;
+        }
+
+        set_chunk(chunk);
+        return true;
+    }
+
+    // Called by the owner while other markers are out of work: if there's nothing that they could steal,
+    // moves the bottom half of the current chunk into a chunk of its own so that they can take it.
+    // Otherwise a marker that is working through a partial chunk could keep the rest of them idle.
+    void shareWork() {
+        if (num_chunks.load(std::memory_order_relaxed))
+            return;
+
+        int n = (cur - start) / 2;
+        if (n == 0)
+            return;
+
+        void** chunk = alloc_chunk();
+        memcpy(chunk, start, n * sizeof(void*));
+        memmove(start, start + n, (cur - start - n) * sizeof(void*));
+        cur -= n;
+        queue_chunk({ chunk, n });
+    }
+
+    bool hasStealableWork() {
+        return num_chunks.load() != 0;
+    }
 };
 std::vector<void**> TraceStack::free_chunks;
+threading::PthreadSpinLock TraceStack::free_chunks_lock;
 
 
 static std::unordered_set<void*> roots;
@@ -156,6 +261,29 @@ extern "C" PyObject* PyGC_AddRoot(PyObject* obj) noexcept {
     return obj;
 }
 
+// The small arena gets swept lazily, in whatever order allocation gets to its blocks, so a few kinds of
+// objects need some extra attention from the collector:
+// - the weakrefs to a dead object need to get cleared (and their callbacks called) as part of the
+//   collection, and a dead weakref needs to unlink itself from its referent before either gets freed.
+// - freeing an object looks at its class, so a dead class needs to stay intact until all of its instances
+//   have been freed.  We hold onto dead classes until the start of the next collection, at which point
+//   everything from the previous one has been swept.
+static std::unordered_set<PyWeakReference*> registered_weakrefs;
+static std::unordered_set<BoxedClass*> heap_classes;
+static std::vector<BoxedClass*> dead_classes;
+
+void registerWeakReference(PyWeakReference* ref) {
+    registered_weakrefs.insert(ref);
+}
+
+extern "C" void PyGC_RegisterWeakReference(PyObject* ref) noexcept {
+    registerWeakReference((PyWeakReference*)ref);
+}
+
+void registerHeapClass(BoxedClass* cls) {
+    heap_classes.insert(cls);
+}
+
 static std::unordered_set<void*> nonheap_roots;
 // Track the highest-addressed nonheap root; the assumption is that the nonheap roots will
 // typically all have lower addresses than the heap roots, so this can serve as a cheap
@@ -246,6 +374,9 @@ void GCVisitor::visitRange(void* const* start, void* const* end) {
     }
 }
 
+// Set during full collections that need to find out which retired compiled code is still in use.
+static bool scanning_retired_code = false;
+
 void GCVisitor::visitPotential(void* p) {
     GCAllocation* a = global_heap.getAllocationFromInteriorPointer(p);
     if (a) {
@@ -266,7 +397,257 @@ void GCVisitor::visitPotentialRange(void* const* start, void* const* end) {
     }
 }
 
-void markPhase() {
+void GCVisitor::visitPotentialStackRange(void* const* start, void* const* end) {
+    visitPotentialRange(start, end);
+
+    if (scanning_retired_code) {
+        for (void* const* p = start; p < end; p++)
+            noteRetiredCodePointer(*p);
+    }
+}
+
+// Visits all of the references out of the (already-marked) allocation at p.
+void visitByGCKind(void* p, GCVisitor& visitor) {
+    assert(((intptr_t)p) % 8 == 0);
+    GCAllocation* al = GCAllocation::fromUserData(p);
+
+    assert(isMarked(al));
+
+    // printf("Marking + scanning %p\n", p);
+
+    GCKind kind_id = al->kind_id;
+    if (kind_id == GCKind::UNTRACKED) {
+        return;
+    } else if (kind_id == GCKind::CONSERVATIVE || kind_id == GCKind::CONSERVATIVE_PYTHON) {
+        uint32_t bytes = al->kind_data;
+        if (DEBUG >= 2) {
+            if (global_heap.small_arena.contains(p)) {
+                SmallArena::Block* b = SmallArena::Block::forPointer(p);
+                assert(b->size >= bytes + sizeof(GCAllocation));
+            }
+        }
+        visitor.visitPotentialRange((void**)p, (void**)((char*)p + bytes));
+    } else if (kind_id == GCKind::PRECISE) {
+        uint32_t bytes = al->kind_data;
+        if (DEBUG >= 2) {
+            if (global_heap.small_arena.contains(p)) {
+                SmallArena::Block* b = SmallArena::Block::forPointer(p);
+                assert(b->size >= bytes + sizeof(GCAllocation));
+            }
+        }
+        visitor.visitRange((void**)p, (void**)((char*)p + bytes));
+    } else if (kind_id == GCKind::PYTHON) {
+        Box* b = reinterpret_cast<Box*>(p);
+        BoxedClass* cls = b->cls;
+
+        if (cls) {
+            // The cls can be NULL since we use 'new' to construct them.
+            // An arbitrary amount of stuff can happen between the 'new' and
+            // the call to the constructor (ie the args get evaluated), which
+            // can trigger a collection.
+            ASSERT(cls->gc_visit, "%s", getTypeName(b));
+            cls->gc_visit(&visitor, b);
+        }
+    } else if (kind_id == GCKind::HIDDEN_CLASS) {
+        HiddenClass* hcls = reinterpret_cast<HiddenClass*>(p);
+        hcls->gc_visit(&visitor);
+    } else {
+        RELEASE_ASSERT(0, "Unhandled kind: %d", (int)kind_id);
+    }
+}
+
+//
+// Parallel marking.
+//
+// Once the roots have been found, the transitive marking gets split across several threads.  Each
+// marker drains its own TraceStack, and when it runs out of work it steals chunks from the
+// other markers' stacks.  While some markers are idle, the busy ones split their current chunk
+// so that there's always something to steal.  The collecting thread takes part as marker #0,
+// with the stack that the roots got pushed onto; the other markers are long-lived helper threads
+// that sleep between collections.  The number of markers is GC_MARK_THREADS, which can be
+// changed at runtime with __pyston__.setOption and takes effect at the next collection.
+//
+// Termination: a marker only counts itself as idle once its own stack is empty and it failed to steal
+// anything.  Idle markers wait on marker_work_cond, which gets signaled whenever a chunk is published.
+// Idle markers can't create new work, so once every marker is idle at the same time, all
+// of the stacks are empty and we're done.
+//
+static pthread_mutex_t marker_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t marker_start_cond = PTHREAD_COND_INITIALIZER;
+static pthread_cond_t marker_done_cond = PTHREAD_COND_INITIALIZER;
+static int marker_generation = 0;  // incremented every time we start a parallel mark
+static int helpers_running = 0;    // how many helpers haven't finished the current mark
+static int num_helper_threads = 0; // how many helpers have been started
+static std::vector<TraceStack*> mark_stacks;
+static int num_markers = 0; // the number of markers participating in the current mark
+// num_idle_markers only changes with this held, so that a marker can't miss the wakeup for new work:
+static pthread_mutex_t marker_work_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t marker_work_cond = PTHREAD_COND_INITIALIZER;
+
+static void notifyIdleMarkers() {
+    pthread_mutex_lock(&marker_work_mutex);
+    pthread_cond_broadcast(&marker_work_cond);
+    pthread_mutex_unlock(&marker_work_mutex);
+}
+
+int numMarkThreads() {
+    int n = GC_MARK_THREADS;
+    if (n <= 0) {
+        // By default use every core, but past a certain point the marking becomes memory-bound
+        // and more threads only add contention:
+        static int default_n = std::min((int)sysconf(_SC_NPROCESSORS_ONLN), 8);
+        n = default_n;
+    }
+    return std::max(n, 1);
+}
+
+static bool tryStealWork(int marker_idx) {
+    TraceStack* stack = mark_stacks[marker_idx];
+    for (int i = 1; i < num_markers; i++) {
+        TraceStack* victim = mark_stacks[(marker_idx + i) % num_markers];
+        if (stack->stealFrom(victim))
+            return true;
+    }
+    return false;
+}
+
+static bool anyStealableWork() {
+    for (int i = 0; i < num_markers; i++) {
+        if (mark_stacks[i]->hasStealableWork())
+            return true;
+    }
+    return false;
+}
+
+static void drainMarkStack(int marker_idx, GCVisitor& visitor) {
+    TraceStack* stack = mark_stacks[marker_idx];
+    assert(visitor.stack == stack);
+
+    while (true) {
+        while (void* p = stack->pop()) {
+            visitByGCKind(p, visitor);
+            if (num_idle_markers.load(std::memory_order_relaxed))
+                stack->shareWork();
+        }
+
+        if (tryStealWork(marker_idx))
+            continue;
+
+        pthread_mutex_lock(&marker_work_mutex);
+        num_idle_markers++;
+        while (true) {
+            if (num_idle_markers == num_markers) {
+                pthread_cond_broadcast(&marker_work_cond);
+                pthread_mutex_unlock(&marker_work_mutex);
+                return;
+            }
+
+            if (anyStealableWork()) {
+                num_idle_markers--;
+                pthread_mutex_unlock(&marker_work_mutex);
+                if (tryStealWork(marker_idx))
+                    break;
+                pthread_mutex_lock(&marker_work_mutex);
+                num_idle_markers++;
+                continue;
+            }
+
+            pthread_cond_wait(&marker_work_cond, &marker_work_mutex);
+        }
+    }
+}
+
+static void* markHelperThreadMain(void* arg) {
+    int marker_idx = (intptr_t)arg;
+    int seen_generation = 0;
+
+    while (true) {
+        pthread_mutex_lock(&marker_mutex);
+        while (marker_generation == seen_generation)
+            pthread_cond_wait(&marker_start_cond, &marker_mutex);
+        seen_generation = marker_generation;
+        // GC_MARK_THREADS might have been lowered since this helper got started:
+        bool participating = marker_idx < num_markers;
+        pthread_mutex_unlock(&marker_mutex);
+
+        if (!participating)
+            continue;
+
+        GCVisitor visitor(mark_stacks[marker_idx]);
+        drainMarkStack(marker_idx, visitor);
+
+        pthread_mutex_lock(&marker_mutex);
+        helpers_running--;
+        if (helpers_running == 0)
+            pthread_cond_signal(&marker_done_cond);
+        pthread_mutex_unlock(&marker_mutex);
+    }
+    return NULL;
+}
+
+static void resetMarkHelpersAfterFork() {
+    // Only the forking thread exists in the child; the helpers will get restarted on the next collection.
+    num_helper_threads = 0;
+    mark_stacks.clear();
+    pthread_mutex_init(&marker_mutex, NULL);
+    pthread_cond_init(&marker_start_cond, NULL);
+    pthread_cond_init(&marker_done_cond, NULL);
+    pthread_mutex_init(&marker_work_mutex, NULL);
+    pthread_cond_init(&marker_work_cond, NULL);
+}
+
+static void startMarkHelpers(int nhelpers) {
+    if (num_helper_threads == 0) {
+        static bool atfork_registered = false;
+        if (!atfork_registered) {
+            pthread_atfork(NULL, NULL, &resetMarkHelpersAfterFork);
+            atfork_registered = true;
+        }
+        mark_stacks.push_back(NULL); // slot for the collecting thread's stack
+    }
+
+    while (num_helper_threads < nhelpers) {
+        num_helper_threads++;
+        mark_stacks.push_back(new TraceStack());
+
+        pthread_t thread_id;
+        int code = pthread_create(&thread_id, NULL, &markHelperThreadMain, (void*)(intptr_t)num_helper_threads);
+        RELEASE_ASSERT(code == 0, "");
+        pthread_detach(thread_id);
+    }
+}
+
+static void parallelMark(TraceStack* stack, GCVisitor& visitor) {
+    int nhelpers = numMarkThreads() - 1;
+    startMarkHelpers(nhelpers);
+
+    mark_stacks[0] = stack;
+    num_idle_markers = 0;
+
+    pthread_mutex_lock(&marker_mutex);
+    num_markers = nhelpers + 1;
+    helpers_running = nhelpers;
+    marker_generation++;
+    pthread_cond_broadcast(&marker_start_cond);
+    pthread_mutex_unlock(&marker_mutex);
+
+    drainMarkStack(0, visitor);
+
+    pthread_mutex_lock(&marker_mutex);
+    while (helpers_running)
+        pthread_cond_wait(&marker_done_cond, &marker_mutex);
+    pthread_mutex_unlock(&marker_mutex);
+
+    for (int i = 1; i < num_markers; i++) {
+        stack->marked_bytes += mark_stacks[i]->marked_bytes;
+        mark_stacks[i]->marked_bytes = 0;
+    }
+
+    mark_stacks[0] = NULL;
+}
+
+// Returns the number of bytes that got marked.
+size_t markPhase(bool minor) {
 #ifndef NVALGRIND
     // Have valgrind close its eyes while we do the conservative stack and data scanning,
     // since we'll be looking at potentially-uninitialized values:
@@ -287,65 +668,99 @@ void markPhase() {
         visitor.visitPotentialRange((void* const*)e.first, (void* const*)e.second);
     }
 
-    // if (VERBOSITY()) printf("Found %d roots\n", stack.size());
-    while (void* p = stack.pop()) {
-        assert(((intptr_t)p) % 8 == 0);
-        GCAllocation* al = GCAllocation::fromUserData(p);
+    if (minor) {
+        // Old objects are already marked, so tracing won't go through them; the only way
+        // to reach a young object from an old one is through an old object that has been
+        // written to since the last collection.
+        std::vector<GCAllocation*> remembered;
+        global_heap.findRememberedObjects(remembered);
 
-        assert(isMarked(al));
+        static StatCounter sc_remembered("gc_minor_remembered_objects");
+        sc_remembered.log(remembered.size());
 
-        // printf("Marking + scanning %p\n", p);
+        for (GCAllocation* al : remembered) {
+            visitByGCKind(al->user_data, visitor);
+        }
 
-        GCKind kind_id = al->kind_id;
-        if (kind_id == GCKind::UNTRACKED) {
-            continue;
-        } else if (kind_id == GCKind::CONSERVATIVE || kind_id == GCKind::CONSERVATIVE_PYTHON) {
-            uint32_t bytes = al->kind_data;
-            if (DEBUG >= 2) {
-                if (global_heap.small_arena.contains(p)) {
-                    SmallArena::Block* b = SmallArena::Block::forPointer(p);
-                    assert(b->size >= bytes + sizeof(GCAllocation));
-                }
-            }
-            visitor.visitPotentialRange((void**)p, (void**)((char*)p + bytes));
-        } else if (kind_id == GCKind::PRECISE) {
-            uint32_t bytes = al->kind_data;
-            if (DEBUG >= 2) {
-                if (global_heap.small_arena.contains(p)) {
-                    SmallArena::Block* b = SmallArena::Block::forPointer(p);
-                    assert(b->size >= bytes + sizeof(GCAllocation));
-                }
-            }
-            visitor.visitRange((void**)p, (void**)((char*)p + bytes));
-        } else if (kind_id == GCKind::PYTHON) {
-            Box* b = reinterpret_cast<Box*>(p);
-            BoxedClass* cls = b->cls;
-
-            if (cls) {
-                // The cls can be NULL since we use 'new' to construct them.
-                // An arbitrary amount of stuff can happen between the 'new' and
-                // the call to the constructor (ie the args get evaluated), which
-                // can trigger a collection.
-                ASSERT(cls->gc_visit, "%s", getTypeName(b));
-                cls->gc_visit(&visitor, b);
-            }
-        } else if (kind_id == GCKind::HIDDEN_CLASS) {
-            HiddenClass* hcls = reinterpret_cast<HiddenClass*>(p);
-            hcls->gc_visit(&visitor);
-        } else {
-            RELEASE_ASSERT(0, "Unhandled kind: %d", (int)kind_id);
+        visitDirtyNonheapMemory(&visitor);
+    }
+
+    // if (VERBOSITY()) printf("Found %d roots\n", stack.size());
+    if (numMarkThreads() > 1) {
+        parallelMark(&stack, visitor);
+    } else {
+        while (void* p = stack.pop()) {
+            visitByGCKind(p, visitor);
         }
     }
 
 #ifndef NVALGRIND
     VALGRIND_ENABLE_ERROR_REPORTING;
 #endif
+
+    return stack.marked_bytes;
 }
 
-static void sweepPhase(std::vector<Box*>& weakly_referenced) {
-    // we need to use the allocator here because these objects are referenced only here, and calling the weakref
-    // callbacks could start another gc
-    global_heap.freeUnmarked(weakly_referenced);
+static bool isUnmarkedHeapObject(void* p) {
+    return !isNonheapRoot(p) && !isMarked(GCAllocation::fromUserData(p));
+}
+
+// Clears all of the weakrefs that are dead or that point to dead objects, and returns the ones whose
+// callbacks we need to call.
+static void clearDeadWeakReferences(std::vector<PyWeakReference*>& callbacks) {
+    // Do the dead weakrefs first, since we don't want to call their callbacks.
+    for (auto it = registered_weakrefs.begin(); it != registered_weakrefs.end();) {
+        PyWeakReference* ref = *it;
+        if (!isMarked(GCAllocation::fromUserData(ref))) {
+            _PyWeakref_ClearRef(ref);
+            it = registered_weakrefs.erase(it);
+        } else {
+            ++it;
+        }
+    }
+
+    for (PyWeakReference* ref : registered_weakrefs) {
+        PyObject* o = ref->wr_object;
+        if (o == Py_None || !isUnmarkedHeapObject(o))
+            continue;
+
+        PyWeakReference** list = (PyWeakReference**)PyObject_GET_WEAKREFS_LISTPTR(o);
+        while (PyWeakReference* head = *list) {
+            assert(isValidGCObject(head));
+            assert(head->wr_object == o);
+            _PyWeakref_ClearRef(head);
+
+            if (head->wr_callback)
+                callbacks.push_back(head);
+        }
+    }
+}
+
+static void deferFreeingDeadClasses() {
+    for (auto it = heap_classes.begin(); it != heap_classes.end();) {
+        GCAllocation* al = GCAllocation::fromUserData(*it);
+        if (!isMarked(al)) {
+            setDeferredFree(al);
+            dead_classes.push_back(*it);
+            it = heap_classes.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+static void freeDeadClasses() {
+    // Some of these classes can be each others' metaclasses, and destructing a class looks at its
+    // metaclass, so destruct all of them before freeing any.
+    for (BoxedClass* cls : dead_classes)
+        global_heap.destructContents(GCAllocation::fromUserData(cls));
+    for (BoxedClass* cls : dead_classes)
+        global_heap.freeWithoutDestructing(GCAllocation::fromUserData(cls));
+    dead_classes.clear();
+}
+
+static void sweepPhase(bool minor) {
+    global_heap.freeUnmarked(minor);
 }
 
 static bool gc_enabled = true;
@@ -372,16 +787,53 @@ void endGCUnexpectedRegion() {
     should_not_reenter_gc = false;
 }
 
-void runCollection() {
+// Since objects get promoted after surviving a single minor collection, the full collections are what
+// reclaim any garbage that has made it into the old generation.
+static CollectionPolicy policy = { /* min_bytes */ 10000000, /* growth_percent */ 100, /* minors_per_full */ 8 };
+
+static int minor_collections_since_full = 0;
+
+static CollectionStats stats;
+
+static void updateCollectionTrigger() {
+    // Like in CPython, setting threshold0 to 0 turns off automatic collection:
+    if (policy.min_bytes == 0) {
+        setBytesUntilCollection(INT64_MAX);
+        return;
+    }
+    setBytesUntilCollection(std::max(policy.min_bytes, stats.live_bytes / 100 * policy.growth_percent));
+}
+
+CollectionPolicy getCollectionPolicy() {
+    return policy;
+}
+
+void setCollectionPolicy(const CollectionPolicy& new_policy) {
+    policy = new_policy;
+    updateCollectionTrigger();
+}
+
+CollectionStats getCollectionStats() {
+    return stats;
+}
+
+static void doCollection(bool minor) {
     static StatCounter sc("gc_collections");
     sc.log();
 
+    static StatCounter sc_minor("gc_collections_minor");
+    static StatCounter sc_full("gc_collections_full");
+    if (minor)
+        sc_minor.log();
+    else
+        sc_full.log();
+
     STAT_TIMER(t0, "us_timer_gc_collection");
 
     ncollections++;
 
     if (VERBOSITY("gc") >= 2)
-        printf("Collection #%d\n", ncollections);
+        printf("%s collection #%d\n", minor ? "Minor" : "Full", ncollections);
 
     // The bulk of the GC work is not reentrant-safe.
     // In theory we should never try to reenter that section, but it's happened due to bugs,
@@ -394,40 +846,64 @@ void runCollection() {
 
     Timer _t("collecting", /*min_usec=*/10000);
 
-    markPhase();
+    // Finish off the previous collection; the mark bits of any garbage it left behind would get
+    // misread once we start marking.
+    global_heap.finishLazySweep();
+    freeDeadClasses();
+
+    // Unmark everything, so that the old generation gets traced too:
+    if (!minor)
+        global_heap.clearAllMarks();
+
+    // Minor collections don't rescan the old generation, so only the full ones can tell that a retired version
+    // of some function isn't referenced by anything any more.
+    scanning_retired_code = !minor && startRetiredCodeScan();
+
+    size_t marked_bytes = markPhase(minor);
+
+    if (scanning_retired_code) {
+        finishRetiredCodeScan();
+        scanning_retired_code = false;
+    }
 
-    // The sweep phase will not free weakly-referenced objects, so that we can inspect their
-    // weakrefs_list.  We want to defer looking at those lists until the end of the sweep phase,
-    // since the deallocation of other objects (namely, the weakref objects themselves) can affect
-    // those lists, and we want to see the final versions.
-    std::vector<Box*> weakly_referenced;
-    sweepPhase(weakly_referenced);
+    // A minor collection doesn't find out about old objects that have died, so this can overestimate
+    // until the next full collection.
+    if (minor)
+        stats.live_bytes += marked_bytes;
+    else
+        stats.live_bytes = marked_bytes;
+    resetBytesAllocatedSinceCollection();
+    updateCollectionTrigger();
+
+    static StatCounter sc_marked_bytes("gc_marked_bytes");
+    sc_marked_bytes.log(marked_bytes);
 
     // Handle weakrefs in two passes:
-    // - first, find all of the weakref objects whose callbacks we need to call.  we need to iterate
-    //   over the garbage-and-corrupt-but-still-alive weakly_referenced list in order to find these objects,
-    //   so the gc is not reentrant during this section.  after this we discard that list.
+    // - first, before anything gets swept, clear the weakrefs that are dead or point to dead objects,
+    //   and find all of the weakref objects whose callbacks we need to call.  The gc is not reentrant
+    //   during this section.
     // - then, call all the weakref callbacks we collected from the first pass.
+    std::vector<PyWeakReference*> weakrefs_with_callbacks;
+    clearDeadWeakReferences(weakrefs_with_callbacks);
+    deferFreeingDeadClasses();
+
+    sweepPhase(minor);
 
     // Use a StlCompatAllocator to keep the pending weakref objects alive in case we trigger a new collection.
-    // In theory we could push so much onto this list that we would cause a new collection to start:
-    std::list<PyWeakReference*, StlCompatAllocator<PyWeakReference*>> weak_references;
+    // In theory we could push so much onto this list that we would cause a new collection to start.
+    // This has to get allocated after the sweep phase has been set up, since it isn't marked.
+    std::list<PyWeakReference*, StlCompatAllocator<PyWeakReference*>> weak_references(
+        weakrefs_with_callbacks.begin(), weakrefs_with_callbacks.end());
 
-    for (auto o : weakly_referenced) {
-        assert(isValidGCObject(o));
-        PyWeakReference** list = (PyWeakReference**)PyObject_GET_WEAKREFS_LISTPTR(o);
-        while (PyWeakReference* head = *list) {
-            assert(isValidGCObject(head));
-            if (head->wr_object != Py_None) {
-                assert(head->wr_object == o);
-                _PyWeakref_ClearRef(head);
+    // Every surviving object is now old, and there can't be any old->young pointers, so start
+    // tracking writes from here.  This has to come after the sweep, since the sweep writes to the heap.
+    if (softDirtyIsSupported())
+        clearSoftDirtyBits();
 
-                if (head->wr_callback)
-                    weak_references.push_back(head);
-            }
-        }
-        global_heap.free(GCAllocation::fromUserData(o));
-    }
+    if (minor)
+        minor_collections_since_full++;
+    else
+        minor_collections_since_full = 0;
 
     should_not_reenter_gc = false; // end non-reentrant section
 
@@ -449,8 +925,29 @@ void runCollection() {
     static StatCounter sc_us("gc_collections_us");
     sc_us.log(us);
 
+    static StatCounter sc_minor_us("gc_collections_minor_us");
+    static StatCounter sc_full_us("gc_collections_full_us");
+    if (minor) {
+        sc_minor_us.log(us);
+        stats.minor_collections++;
+        stats.minor_us += us;
+    } else {
+        sc_full_us.log(us);
+        stats.full_collections++;
+        stats.full_us += us;
+    }
+
     // dumpHeapStatistics();
 }
 
+void runCollection() {
+    doCollection(/* minor = */ false);
+}
+
+void runAutomaticCollection() {
+    bool minor = softDirtyIsSupported() && minor_collections_since_full < policy.minors_per_full;
+    doCollection(minor);
+}
+
 } // namespace gc
 } // namespace pyston
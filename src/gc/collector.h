@@ -36,6 +36,11 @@ void registerNonheapRootObject(void* obj, int size);
 
 void registerPotentialRootRange(void* start, void* end);
 
+// Objects that the collector needs to handle specially when they die, since the heap gets swept
+// lazily.  Every weakref object and every gc-allocated class that can die needs to be registered.
+void registerWeakReference(PyWeakReference* ref);
+void registerHeapClass(BoxedClass* cls);
+
 // If you want to have a static root "location" where multiple values could be stored, use this:
 class GCRootHandle {
 public:
@@ -50,8 +55,32 @@ public:
     Box* operator->() { return value; }
 };
 
+// Runs a full collection of the entire heap.
 void runCollection();
 
+// Runs a collection on behalf of the allocator.  This will usually be a minor collection, which only
+// traces the young generation (objects allocated since the last collection) plus the old objects that
+// have been written to since then; every so often it will be a full collection instead.
+void runAutomaticCollection();
+
+// Automatic collections happen once the program has allocated some multiple of the bytes that the
+// last collection found to be live: growth_percent percent of them, but at least min_bytes.
+// After minors_per_full minor collections, the next automatic collection is a full one.
+struct CollectionPolicy {
+    int64_t min_bytes;
+    int growth_percent;
+    int minors_per_full;
+};
+CollectionPolicy getCollectionPolicy();
+void setCollectionPolicy(const CollectionPolicy& policy);
+
+struct CollectionStats {
+    int64_t minor_collections = 0, full_collections = 0;
+    int64_t minor_us = 0, full_us = 0; // total time spent in each kind of collection
+    int64_t live_bytes = 0;            // as estimated by the last collection
+};
+CollectionStats getCollectionStats();
+
 // Python programs are allowed to pause the GC.  This is supposed to pause automatic GC,
 // but does not seem to pause manual calls to gc.collect().  So, callers should check gcIsEnabled(),
 // if appropriate, before calling runCollection().
@@ -16,6 +16,7 @@
 #include <cstdio>
 #include <cstdlib>
 #include <cstring>
+#include <sched.h>
 #include <stdint.h>
 
 #include "core/common.h"
@@ -43,7 +44,7 @@ template <> void return_temporary_buffer<pyston::Box*>(pyston::Box** p) {
 namespace pyston {
 namespace gc {
 
-bool _doFree(GCAllocation* al, std::vector<Box*>* weakly_referenced);
+void _doFree(GCAllocation* al);
 
 // lots of linked lists around here, so let's just use template functions for operations on them.
 template <class ListT> inline void nullNextPrev(ListT* node) {
@@ -85,42 +86,54 @@ template <class ListT, typename Func> inline void forEach(ListT* list, Func func
     }
 }
 
-template <class ListT, typename Free>
-inline void sweepList(ListT* head, std::vector<Box*>& weakly_referenced, Free free_func) {
+template <class ListT, typename Free> inline void sweepList(ListT* head, Free free_func) {
     auto cur = head;
     while (cur) {
         GCAllocation* al = cur->data;
-        if (isMarked(al)) {
-            clearMark(al);
+        if (isMarked(al) || isDeferredFree(al)) {
+            // Leave the mark set: the object has now been promoted to the old generation.
             cur = cur->next;
         } else {
-            if (_doFree(al, &weakly_referenced)) {
-                removeFromLL(cur);
-
-                auto to_free = cur;
-                cur = cur->next;
-                free_func(to_free);
-            } else {
-                cur = cur->next;
-            }
+            _doFree(al);
+            removeFromLL(cur);
+
+            auto to_free = cur;
+            cur = cur->next;
+            free_func(to_free);
         }
     }
 }
 
-static unsigned bytesAllocatedSinceCollection;
+static int64_t bytesAllocatedSinceCollection;
 static __thread unsigned thread_bytesAllocatedSinceCollection;
-#define ALLOCBYTES_PER_COLLECTION 10000000
+
+static int64_t bytes_until_collection = 10000000;
+// How much a thread allocates before adding it to the global count:
+static unsigned thread_bytes_flush_threshold = bytes_until_collection / 4;
 
 static StatCounter gc_registered_bytes("gc_registered_bytes");
 
+void setBytesUntilCollection(int64_t bytes) {
+    bytes_until_collection = bytes;
+    thread_bytes_flush_threshold = std::min(bytes / 4, (int64_t)10000000);
+}
+
+int64_t getBytesAllocatedSinceCollection() {
+    return bytesAllocatedSinceCollection;
+}
+
+void resetBytesAllocatedSinceCollection() {
+    bytesAllocatedSinceCollection = 0;
+}
+
 void registerGCManagedBytes(size_t bytes) {
     thread_bytesAllocatedSinceCollection += bytes;
-    if (unlikely(thread_bytesAllocatedSinceCollection > ALLOCBYTES_PER_COLLECTION / 4)) {
+    if (unlikely(thread_bytesAllocatedSinceCollection > thread_bytes_flush_threshold)) {
         gc_registered_bytes.log(thread_bytesAllocatedSinceCollection);
         bytesAllocatedSinceCollection += thread_bytesAllocatedSinceCollection;
         thread_bytesAllocatedSinceCollection = 0;
 
-        if (bytesAllocatedSinceCollection >= ALLOCBYTES_PER_COLLECTION) {
+        if (bytesAllocatedSinceCollection >= bytes_until_collection) {
             if (!gcIsEnabled())
                 return;
 
@@ -129,10 +142,8 @@ void registerGCManagedBytes(size_t bytes) {
             // runCollection();
 
             threading::GLPromoteRegion _lock;
-            if (bytesAllocatedSinceCollection >= ALLOCBYTES_PER_COLLECTION) {
-                runCollection();
-                bytesAllocatedSinceCollection = 0;
-            }
+            if (bytesAllocatedSinceCollection >= bytes_until_collection)
+                runAutomaticCollection();
         }
     }
 }
@@ -140,7 +151,19 @@ void registerGCManagedBytes(size_t bytes) {
 
 Heap global_heap;
 
-bool _doFree(GCAllocation* al, std::vector<Box*>* weakly_referenced) {
+PageMarkTable::PageMarkTable(uintptr_t arena_start, uintptr_t arena_size) : arena_start(arena_start) {
+    size_t table_size = arena_size / PAGE_SIZE / 8;
+    void* mrtn = mmap(NULL, table_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    RELEASE_ASSERT((uintptr_t)mrtn != -1, "failed to reserve memory for the mark table");
+    bits = (uint64_t*)mrtn;
+}
+
+void PageMarkTable::clearUpTo(void* end) {
+    uintptr_t npages = ((uintptr_t)end - arena_start) / PAGE_SIZE;
+    memset(bits, 0, (npages + 63) / 64 * sizeof(uint64_t));
+}
+
+void _doFree(GCAllocation* al) {
     if (VERBOSITY() >= 4)
         printf("Freeing %p\n", al->user_data);
 
@@ -162,12 +185,9 @@ bool _doFree(GCAllocation* al, std::vector<Box*>* weakly_referenced) {
 #endif
 
         if (PyType_SUPPORTS_WEAKREFS(b->cls)) {
+            // The collector clears the weakrefs to dead objects before anything gets swept.
             PyWeakReference** list = (PyWeakReference**)PyObject_GET_WEAKREFS_LISTPTR(b);
-            if (list && *list) {
-                assert(weakly_referenced && "attempting to free a weakly referenced object manually");
-                weakly_referenced->push_back(b);
-                return false;
-            }
+            assert((!list || !*list) && "attempting to free a weakly referenced object");
         }
 
         // XXX: we are currently ignoring destructors (tp_dealloc) for extension objects, since we have
@@ -178,11 +198,17 @@ bool _doFree(GCAllocation* al, std::vector<Box*>* weakly_referenced) {
         if (b->cls->simple_destructor)
             b->cls->simple_destructor(b);
     }
-    return true;
 }
 
 void Heap::destructContents(GCAllocation* al) {
-    _doFree(al, NULL);
+    _doFree(al);
+}
+
+// Whether _doFree() would run any code for this object other than assertions.
+static bool hasDestructor(GCAllocation* al) {
+    if (al->kind_id != GCKind::PYTHON && al->kind_id != GCKind::CONSERVATIVE_PYTHON)
+        return false;
+    return ((Box*)al->user_data)->cls->simple_destructor != NULL;
 }
 
 struct HeapStatistics {
@@ -297,6 +323,9 @@ void Heap::dumpHeapStatistics(int level) {
 
     HeapStatistics stats(collect_cls_stats, collect_hcls_stats);
 
+    // Otherwise we'd count the garbage that hasn't been swept yet:
+    small_arena.finishLazySweep();
+
     small_arena.getStatistics(&stats);
     large_arena.getStatistics(&stats);
     huge_arena.getStatistics(&stats);
@@ -333,6 +362,19 @@ void dumpHeapStatistics(int level) {
     global_heap.dumpHeapStatistics(level);
 }
 
+void Heap::findRememberedObjects(std::vector<GCAllocation*>& remembered) {
+    DirtyPageMap dirty_pages;
+
+    dirty_pages.read(small_arena.start(), small_arena.frontier());
+    small_arena.findRememberedObjects(dirty_pages, remembered);
+
+    dirty_pages.read(large_arena.start(), large_arena.frontier());
+    large_arena.findRememberedObjects(dirty_pages, remembered);
+
+    dirty_pages.read(huge_arena.start(), huge_arena.frontier());
+    huge_arena.findRememberedObjects(dirty_pages, remembered);
+}
+
 //////
 /// Small Arena
 
@@ -390,8 +432,40 @@ GCAllocation* SmallArena::allocationFrom(void* ptr) {
     return reinterpret_cast<GCAllocation*>(&b->atoms[atom_idx]);
 }
 
-void SmallArena::freeUnmarked(std::vector<Box*>& weakly_referenced) {
-    thread_caches.forEachValue([this, &weakly_referenced](ThreadBlockCache* cache) {
+// Allocation sweeps a few of the flagged blocks every time a thread claims a new block, aiming to be done
+// with them about halfway to the next collection, so that finishLazySweep() has little left to do.
+#define LAZY_SWEEP_TARGET_CLAIMS std::max(bytes_until_collection / (int64_t)BLOCK_SIZE / 2, (int64_t)1)
+
+void SmallArena::freeUnmarked(bool minor) {
+    assert(blocks_to_sweep.empty() && "finishLazySweep() should have been called before marking");
+
+    if (minor) {
+        // Nothing has been allocated into the blocks in the global lists since they were last swept,
+        // except for the ones that threads left behind when they exited.  Those are also the only
+        // blocks that can be in full_heads.
+        for (Block* b : orphaned_blocks)
+            _flagForSweep(b);
+
+        for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
+            while (Block* b = full_heads[bidx]) {
+                removeFromLLAndNull(b);
+                insertIntoLL(&heads[bidx], b);
+            }
+        }
+    } else {
+        for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
+            Block** chain_end = _flagChainForSweep(&heads[bidx]);
+            _flagChainForSweep(&full_heads[bidx]);
+
+            while (Block* b = full_heads[bidx]) {
+                removeFromLLAndNull(b);
+                insertIntoLL(chain_end, b);
+            }
+        }
+    }
+    orphaned_blocks.clear();
+
+    thread_caches.forEachValue([this](ThreadBlockCache* cache) {
         for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
             Block* h = cache->cache_free_heads[bidx];
             // Try to limit the amount of unused memory a thread can hold onto;
@@ -409,10 +483,11 @@ void SmallArena::freeUnmarked(std::vector<Box*>& weakly_referenced) {
             if (h) {
                 removeFromLLAndNull(h);
                 insertIntoLL(&heads[bidx], h);
+                _flagForSweep(h);
             }
 
-            Block** chain_end = _freeChain(&cache->cache_free_heads[bidx], weakly_referenced);
-            _freeChain(&cache->cache_full_heads[bidx], weakly_referenced);
+            Block** chain_end = _flagChainForSweep(&cache->cache_free_heads[bidx]);
+            _flagChainForSweep(&cache->cache_full_heads[bidx]);
 
             while (Block* b = cache->cache_full_heads[bidx]) {
                 removeFromLLAndNull(b);
@@ -421,15 +496,70 @@ void SmallArena::freeUnmarked(std::vector<Box*>& weakly_referenced) {
         }
     });
 
-    for (int bidx = 0; bidx < NUM_BUCKETS; bidx++) {
-        Block** chain_end = _freeChain(&heads[bidx], weakly_referenced);
-        _freeChain(&full_heads[bidx], weakly_referenced);
+    blocks_to_sweep_per_claim = blocks_to_sweep.size() / LAZY_SWEEP_TARGET_CLAIMS + 1;
 
-        while (Block* b = full_heads[bidx]) {
-            removeFromLLAndNull(b);
-            insertIntoLL(chain_end, b);
-        }
+    static StatCounter sc_flagged("gc_lazy_sweep_blocks");
+    sc_flagged.log(blocks_to_sweep.size());
+}
+
+void SmallArena::clearMarks() {
+    // Blocks never get returned to the OS, so everything up to the frontier is a block:
+    for (char* p = (char*)start(); p < (char*)frontier(); p += BLOCK_SIZE)
+        reinterpret_cast<Block*>(p)->marked.setAllZero();
+}
+
+void SmallArena::finishLazySweep() {
+    int nswept = 0;
+    for (Block* b : blocks_to_sweep) {
+        if (_trySweepBlock(b))
+            nswept++;
+        assert(b->sweep_state == SWEPT);
     }
+    blocks_to_sweep.clear();
+
+    static StatCounter sc_finished("gc_lazy_sweep_finished_blocks");
+    sc_finished.log(nswept);
+
+    // The objects' classes might not survive the upcoming collection:
+    runPendingDestructors();
+}
+
+void SmallArena::runPendingDestructors() {
+    std::vector<GCAllocation*> destructors;
+    {
+        LOCK_REGION(heap->lock);
+        destructors.swap(pending_destructors);
+        __atomic_store_n(&num_pending_destructors, 0, __ATOMIC_RELAXED);
+    }
+
+    // These can allocate, and can even end up back in here:
+    for (GCAllocation* al : destructors) {
+        _doFree(al);
+        free(al);
+    }
+}
+
+void SmallArena::findRememberedObjects(const DirtyPageMap& dirty_pages, std::vector<GCAllocation*>& remembered) {
+    dirty_pages.forEachDirtyPage([&remembered](void* page) {
+        Block* b = Block::forPointer(page);
+        int size = b->size;
+        int offset = (char*)page - (char*)b;
+
+        // Every object that overlaps this page, including one that starts on the previous page:
+        int first_obj = std::max(b->minObjIndex(), offset / size);
+        int last_obj = std::min(b->numObjects() - 1, (int)((offset + PAGE_SIZE - 1) / size));
+        int atoms_per_obj = b->atomsPerObj();
+
+        for (int obj_idx = first_obj; obj_idx <= last_obj; obj_idx++) {
+            int atom_idx = obj_idx * atoms_per_obj;
+            if (b->isfree.isSet(atom_idx))
+                continue;
+
+            GCAllocation* al = reinterpret_cast<GCAllocation*>(&b->atoms[atom_idx]);
+            if (isMarked(al))
+                remembered.push_back(al);
+        }
+    });
 }
 
 // TODO: copy-pasted from freeUnmarked()
@@ -450,36 +580,152 @@ void SmallArena::getStatistics(HeapStatistics* stats) {
 }
 
 
-SmallArena::Block** SmallArena::_freeChain(Block** head, std::vector<Box*>& weakly_referenced) {
-    while (Block* b = *head) {
-        int num_objects = b->numObjects();
-        int first_obj = b->minObjIndex();
-        int atoms_per_obj = b->atomsPerObj();
+void SmallArena::_flagForSweep(Block* b) {
+    b->sweep_state = NEEDS_SWEEP;
+    blocks_to_sweep.push_back(b);
+}
 
-        for (int atom_idx = first_obj * atoms_per_obj; atom_idx < num_objects * atoms_per_obj;
-             atom_idx += atoms_per_obj) {
+SmallArena::Block** SmallArena::_flagChainForSweep(Block** head) {
+    while (Block* b = *head) {
+        _flagForSweep(b);
+        head = &b->next;
+    }
+    return head;
+}
 
-            if (b->isfree.isSet(atom_idx))
-                continue;
+void SmallArena::_sweepObject(Block* b, int atom_idx, std::vector<GCAllocation*>& destructors) {
+    GCAllocation* al = reinterpret_cast<GCAllocation*>(&b->atoms[atom_idx]);
+    if (isDeferredFree(al))
+        return;
 
-            void* p = &b->atoms[atom_idx];
-            GCAllocation* al = reinterpret_cast<GCAllocation*>(p);
+    if (hasDestructor(al)) {
+        // Keep the object intact until runPendingDestructors() gets to it:
+        setDeferredFree(al);
+        destructors.push_back(al);
+        return;
+    }
 
-            if (isMarked(al)) {
-                clearMark(al);
-            } else {
-                if (_doFree(al, &weakly_referenced)) {
-                    b->isfree.set(atom_idx);
+    _doFree(al);
+    b->isfree.set(atom_idx);
 #ifndef NDEBUG
-                    memset(al->user_data, 0xbb, b->size - sizeof(GCAllocation));
+    memset(al->user_data, 0xbb, b->size - sizeof(GCAllocation));
 #endif
-                }
+}
+
+// If the objects in a block are a power-of-two number of atoms, the bits of the bitmaps that correspond
+// to the start of an object form the same pattern in every word.  Returns that pattern, or 0 if there isn't one.
+static uint64_t objectStartMask(int atoms_per_obj) {
+    switch (atoms_per_obj) {
+        case 1:
+            return ~0UL;
+        case 2:
+            return 0x5555555555555555UL;
+        case 4:
+            return 0x1111111111111111UL;
+        case 8:
+            return 0x0101010101010101UL;
+        case 16:
+            return 0x0001000100010001UL;
+        case 32:
+            return 0x0000000100000001UL;
+        case 64:
+            return 0x0000000000000001UL;
+        default:
+            return 0;
+    }
+}
+
+// Only the block's bitmaps get looked at to find the dead objects; the live ones don't get touched.
+void SmallArena::_sweepBlock(Block* b, std::vector<GCAllocation*>& destructors) {
+    int atoms_per_obj = b->atomsPerObj();
+    int first_atom = b->minObjIndex() * atoms_per_obj;
+    int end_atom = b->numObjects() * atoms_per_obj;
+
+    uint64_t start_mask = objectStartMask(atoms_per_obj);
+    if (start_mask) {
+        // We can find the dead objects a word of the bitmaps at a time:
+        int first_word = first_atom / 64;
+        int last_word = (end_atom - 1) / 64;
+        for (int word_idx = first_word; word_idx <= last_word; word_idx++) {
+            uint64_t unmarked = ~b->marked.word(word_idx);
+            uint64_t dead = unmarked & ~b->isfree.word(word_idx) & start_mask;
+
+            // Ignore the atoms that are part of the header, or past the last object:
+            if (word_idx == first_word)
+                dead &= ~0UL << (first_atom % 64);
+            if (word_idx == last_word && end_atom % 64)
+                dead &= (1UL << (end_atom % 64)) - 1;
+
+            while (dead) {
+                int bit = __builtin_ctzll(dead);
+                dead &= dead - 1;
+                _sweepObject(b, word_idx * 64 + bit, destructors);
             }
         }
+    } else {
+        for (int atom_idx = first_atom; atom_idx < end_atom; atom_idx += atoms_per_obj) {
+            if (b->isfree.isSet(atom_idx))
+                continue;
 
-        head = &b->next;
+            uint64_t mask;
+            uint64_t* word = b->marked.wordFor(atom_idx, &mask);
+            if (!isMarkBitSet(word, mask))
+                _sweepObject(b, atom_idx, destructors);
+        }
+    }
+
+    // We might have freed objects that the allocation scan has already gone past:
+    b->next_to_check.reset();
+}
+
+// Sweeps the block if nobody else has, returning whether we did.
+bool SmallArena::_trySweepBlock(Block* b) {
+    uint8_t expected = NEEDS_SWEEP;
+    if (!__atomic_compare_exchange_n(&b->sweep_state, &expected, (uint8_t)SWEEPING, /* weak */ false,
+                                     __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+        return false;
+
+    std::vector<GCAllocation*> destructors;
+    _sweepBlock(b, destructors);
+
+    __atomic_store_n(&b->sweep_state, (uint8_t)SWEPT, __ATOMIC_RELEASE);
+
+    if (!destructors.empty()) {
+        LOCK_REGION(heap->lock);
+        pending_destructors.insert(pending_destructors.end(), destructors.begin(), destructors.end());
+        __atomic_store_n(&num_pending_destructors, (int)pending_destructors.size(), __ATOMIC_RELAXED);
+    }
+    return true;
+}
+
+// Makes sure the block is swept before we allocate from it.  This is on the allocation fast path, so the
+// common case is just a single load.
+inline void SmallArena::_ensureSwept(Block* b) {
+    if (likely(__atomic_load_n(&b->sweep_state, __ATOMIC_ACQUIRE) == SWEPT))
+        return;
+
+    if (_trySweepBlock(b))
+        return;
+
+    // Another thread is sweeping it as part of _sweepSomeBlocks().  Sweeping doesn't run any destructors, so
+    // this can't be this thread, and it won't take long:
+    while (__atomic_load_n(&b->sweep_state, __ATOMIC_ACQUIRE) != SWEPT)
+        sched_yield();
+}
+
+void SmallArena::_sweepSomeBlocks(int max_blocks) {
+    for (int i = 0; i < max_blocks; i++) {
+        Block* b;
+        {
+            LOCK_REGION(heap->lock);
+            if (blocks_to_sweep.empty())
+                return;
+            b = blocks_to_sweep.back();
+            blocks_to_sweep.pop_back();
+        }
+
+        _trySweepBlock(b);
     }
-    return head;
 }
 
 
@@ -502,7 +748,9 @@ SmallArena::Block* SmallArena::_allocBlock(uint64_t size, Block** prev) {
 
     // Don't think I need to do this:
     rtn->isfree.setAllZero();
+    rtn->marked.setAllZero();
     rtn->next_to_check.reset();
+    rtn->sweep_state = SWEPT;
 
     int num_objects = rtn->numObjects();
     int num_lost = rtn->minObjIndex();
@@ -526,11 +774,13 @@ SmallArena::ThreadBlockCache::~ThreadBlockCache() {
         while (Block* b = cache_free_heads[i]) {
             removeFromLLAndNull(b);
             insertIntoLL(&small->heads[i], b);
+            small->orphaned_blocks.push_back(b);
         }
 
         while (Block* b = cache_full_heads[i]) {
             removeFromLLAndNull(b);
             insertIntoLL(&small->full_heads[i], b);
+            small->orphaned_blocks.push_back(b);
         }
     }
 }
@@ -540,6 +790,10 @@ GCAllocation* SmallArena::_allocFromBlock(Block* b) {
     if (idx == -1)
         return NULL;
 
+    uint64_t mask;
+    uint64_t* mark_word = b->marked.wordFor(idx, &mask);
+    setMarkBit(mark_word, mask, false);
+
     void* rtn = &b->atoms[idx];
     return reinterpret_cast<GCAllocation*>(rtn);
 }
@@ -573,6 +827,14 @@ GCAllocation* SmallArena::_alloc(size_t rounded_size, int bucket_idx) {
 
     while (true) {
         while (Block* cache_block = *cache_head) {
+            _ensureSwept(cache_block);
+
+            // The destructors might have allocated from this block, or moved it to the full list:
+            if (unlikely(__atomic_load_n(&num_pending_destructors, __ATOMIC_RELAXED))) {
+                runPendingDestructors();
+                continue;
+            }
+
             GCAllocation* rtn = _allocFromBlock(cache_block);
             if (rtn)
                 return rtn;
@@ -585,23 +847,29 @@ GCAllocation* SmallArena::_alloc(size_t rounded_size, int bucket_idx) {
         // static StatCounter sc_fallback("gc_allocs_cachemiss");
         // sc_fallback.log();
 
-        LOCK_REGION(heap->lock);
+        {
+            LOCK_REGION(heap->lock);
 
-        assert(*cache_head == NULL);
+            assert(*cache_head == NULL);
 
-        // should probably be called allocBlock:
-        Block* myblock = _claimBlock(rounded_size, &heads[bucket_idx]);
-        assert(myblock);
-        assert(!myblock->next);
-        assert(!myblock->prev);
+            // should probably be called allocBlock:
+            Block* myblock = _claimBlock(rounded_size, &heads[bucket_idx]);
+            assert(myblock);
+            assert(!myblock->next);
+            assert(!myblock->prev);
 
-        // printf("%d claimed new block %p with %d objects\n", threading::gettid(), myblock, myblock->numObjects());
+            // printf("%d claimed new block %p with %d objects\n", threading::gettid(), myblock,
+            // myblock->numObjects());
 
-        insertIntoLL(cache_head, myblock);
+            insertIntoLL(cache_head, myblock);
+        }
+
+        // Pay down some of the sweeping that the last collection left us:
+        _sweepSomeBlocks(blocks_to_sweep_per_claim);
     }
 }
 
-// TODO: copy-pasted from _freeChain
+// TODO: copy-pasted from _sweepBlock
 void SmallArena::_getChainStatistics(HeapStatistics* stats, Block** head) {
     while (Block* b = *head) {
         int num_objects = b->numObjects();
@@ -646,6 +914,10 @@ GCAllocation* LargeArena::alloc(size_t size) {
     nullNextPrev(obj);
     insertIntoLL(&head, obj);
 
+    uint64_t mask;
+    uint64_t* mark_word = markWordFor(obj->data, &mask);
+    setMarkBit(mark_word, mask, false);
+
     return obj->data;
 }
 
@@ -679,8 +951,16 @@ GCAllocation* LargeArena::allocationFrom(void* ptr) {
     return NULL;
 }
 
-void LargeArena::freeUnmarked(std::vector<Box*>& weakly_referenced) {
-    sweepList(head, weakly_referenced, [this](LargeObj* ptr) { _freeLargeObj(ptr); });
+void LargeArena::freeUnmarked() {
+    sweepList(head, [this](LargeObj* ptr) { _freeLargeObj(ptr); });
+}
+
+void LargeArena::findRememberedObjects(const DirtyPageMap& dirty_pages, std::vector<GCAllocation*>& remembered) {
+    forEach(head, [&dirty_pages, &remembered](LargeObj* obj) {
+        GCAllocation* al = obj->data;
+        if (isMarked(al) && dirty_pages.anyDirty(obj, (char*)al + obj->size))
+            remembered.push_back(al);
+    });
 }
 
 void LargeArena::getStatistics(HeapStatistics* stats) {
@@ -840,6 +1120,10 @@ GCAllocation* HugeArena::alloc(size_t size) {
     nullNextPrev(rtn);
     insertIntoLL(&head, rtn);
 
+    uint64_t mask;
+    uint64_t* mark_word = markWordFor(rtn->data, &mask);
+    setMarkBit(mark_word, mask, false);
+
     return rtn->data;
 }
 
@@ -861,6 +1145,10 @@ void HugeArena::free(GCAllocation* al) {
     _freeHugeObj(HugeObj::fromAllocation(al));
 }
 
+size_t HugeArena::allocationSize(GCAllocation* al) {
+    return HugeObj::fromAllocation(al)->obj_size;
+}
+
 GCAllocation* HugeArena::allocationFrom(void* ptr) {
     HugeObj* cur = head;
     while (cur) {
@@ -871,8 +1159,16 @@ GCAllocation* HugeArena::allocationFrom(void* ptr) {
     return NULL;
 }
 
-void HugeArena::freeUnmarked(std::vector<Box*>& weakly_referenced) {
-    sweepList(head, weakly_referenced, [this](HugeObj* ptr) { _freeHugeObj(ptr); });
+void HugeArena::freeUnmarked() {
+    sweepList(head, [this](HugeObj* ptr) { _freeHugeObj(ptr); });
+}
+
+void HugeArena::findRememberedObjects(const DirtyPageMap& dirty_pages, std::vector<GCAllocation*>& remembered) {
+    forEach(head, [&dirty_pages, &remembered](HugeObj* obj) {
+        GCAllocation* al = obj->data;
+        if (isMarked(al) && dirty_pages.anyDirty(obj, (char*)al + obj->obj_size))
+            remembered.push_back(al);
+    });
 }
 
 void HugeArena::getStatistics(HeapStatistics* stats) {
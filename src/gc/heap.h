@@ -23,6 +23,7 @@
 #include "core/common.h"
 #include "core/threading.h"
 #include "core/types.h"
+#include "gc/softdirty.h"
 
 namespace pyston {
 
@@ -82,6 +83,13 @@ namespace gc {
 // such as memory that will get freed by a gc destructor.
 void registerGCManagedBytes(size_t bytes);
 
+// The next automatic collection will happen once this many bytes have been registered since the last
+// collection.  The collector calls this after every collection, based on how much of the heap it found
+// to be live, but it can also be changed in between without losing count of what has been allocated.
+void setBytesUntilCollection(int64_t bytes);
+int64_t getBytesAllocatedSinceCollection();
+void resetBytesAllocatedSinceCollection();
+
 class Heap;
 struct HeapStatistics;
 
@@ -102,23 +110,50 @@ struct GCAllocation {
 static_assert(sizeof(GCAllocation) <= sizeof(void*),
               "we should try to make sure the gc header is word-sized or smaller");
 
-#define MARK_BIT 0x1
+// The collector is generational, using "sticky" mark bits: the sweep phase doesn't clear the
+// marks of surviving objects, so anything that has survived a collection stays marked, and
+// being marked is what it means to be in the old generation.  A minor collection only traces
+// from unmarked (young) objects.
+// A full collection needs to start with every mark cleared, which Heap::clearAllMarks() does.
+//
+// The mark bits themselves are kept off to the side, in bitmaps that are dense compared to the
+// objects (see SmallArena::Block::marked and PageMarkTable), so that marking an object doesn't
+// write to it.  That keeps marking from pulling every live object into the cache, and keeps a
+// collection in a forked child from unsharing the entire heap with its parent.  It also means
+// that clearing all of the marks only has to write about 1/128th of the size of the heap.
+
+inline bool isMarkBitSet(const uint64_t* word, uint64_t mask) {
+    return *word & mask;
+}
 
-inline bool isMarked(GCAllocation* header) {
-    return (header->gc_flags & MARK_BIT) != 0;
+inline void setMarkBit(uint64_t* word, uint64_t mask, bool marked) {
+    if (marked)
+        *word |= mask;
+    else
+        *word &= ~mask;
 }
 
-inline void setMark(GCAllocation* header) {
-    assert(!isMarked(header));
-    header->gc_flags |= MARK_BIT;
+// Sets the mark bit, returning false if it was already set.  This is safe to call from several
+// marking threads at once.
+inline bool trySetMarkBitAtomic(uint64_t* word, uint64_t mask) {
+    if (__atomic_load_n(word, __ATOMIC_RELAXED) & mask)
+        return false;
+    return !(__atomic_fetch_or(word, mask, __ATOMIC_RELAXED) & mask);
 }
 
-inline void clearMark(GCAllocation* header) {
-    assert(isMarked(header));
-    header->gc_flags &= ~MARK_BIT;
+#define DEFERRED_FREE_BIT 0x1
+
+// The collector sets this on dead objects that need to stay intact for a while longer; the sweepers
+// leave these objects alone, and the collector frees them itself once it is safe to.
+inline bool isDeferredFree(GCAllocation* header) {
+    return header->gc_flags & DEFERRED_FREE_BIT;
+}
+
+inline void setDeferredFree(GCAllocation* header) {
+    header->gc_flags |= DEFERRED_FREE_BIT;
 }
 
-#undef MARK_BIT
+#undef DEFERRED_FREE_BIT
 
 #define PAGE_SIZE 4096
 
@@ -144,6 +179,32 @@ public:
     }
 
     bool contains(void* addr) { return (void*)arena_start <= addr && addr < cur; }
+
+    // The range of memory this arena has mapped so far:
+    void* start() const { return (void*)arena_start; }
+    void* frontier() const { return cur; }
+};
+
+// A mark bitmap with one bit for every page of an arena.  The large and huge arenas start every
+// object on a page of its own, so this gives each of their objects its own bit.  We reserve
+// enough address space for the entire arena up front, but only the parts of the table that
+// cover memory the arena has mapped will ever get touched.
+class PageMarkTable {
+private:
+    uintptr_t arena_start;
+    uint64_t* bits;
+
+public:
+    PageMarkTable(uintptr_t arena_start, uintptr_t arena_size);
+
+    uint64_t* wordFor(void* p, uint64_t* mask) {
+        uintptr_t idx = ((uintptr_t)p - arena_start) / PAGE_SIZE;
+        *mask = 1UL << (idx % 64);
+        return &bits[idx / 64];
+    }
+
+    // Clears the bits of every page from the start of the arena up to end:
+    void clearUpTo(void* end);
 };
 
 constexpr uintptr_t ARENA_SIZE = 0x1000000000L;
@@ -167,7 +228,8 @@ static constexpr size_t NUM_BUCKETS = sizeof(sizes) / sizeof(sizes[0]);
 
 class SmallArena : public Arena<SMALL_ARENA_START, ARENA_SIZE> {
 public:
-    SmallArena(Heap* heap) : Arena(), heap(heap), thread_caches(heap, this) {
+    SmallArena(Heap* heap)
+        : Arena(), blocks_to_sweep_per_claim(0), num_pending_destructors(0), heap(heap), thread_caches(heap, this) {
 #ifndef NDEBUG
         // Various things will crash if we instantiate multiple Heaps/Arenas
         static bool already_created = false;
@@ -196,7 +258,24 @@ public:
     void free(GCAllocation* al);
 
     GCAllocation* allocationFrom(void* ptr);
-    void freeUnmarked(std::vector<Box*>& weakly_referenced);
+
+    // The small arena gets swept lazily: freeUnmarked() only flags the blocks that might contain garbage,
+    // and a flagged block gets swept the next time an allocation touches it.  Threads that need a new
+    // block also sweep a few of the flagged blocks, and finishLazySweep() takes care of whatever is left
+    // at the start of the next collection.
+    // A minor collection only needs to flag the blocks that objects have been allocated into since the
+    // last collection; every other block contains only old objects.
+    void freeUnmarked(bool minor);
+    void clearMarks();
+    void finishLazySweep();
+
+    // Sweeping a block doesn't run the destructors of the dead objects in it: a destructor can allocate, and the
+    // allocation could need the very block that is being swept.  Instead, those objects get flagged as
+    // deferred-free and queued up, and the allocator runs their destructors (and then frees them) once it is
+    // no longer in the middle of sweeping anything.
+    void runPendingDestructors();
+
+    void findRememberedObjects(const DirtyPageMap& dirty_pages, std::vector<GCAllocation*>& remembered);
 
     void getStatistics(HeapStatistics* stats);
 
@@ -221,6 +300,13 @@ private:
 
         bool isSet(int idx) { return (data[idx / 64] >> (idx % 64)) & 1; }
 
+        uint64_t word(int word_idx) const { return data[word_idx]; }
+
+        uint64_t* wordFor(int idx, uint64_t* mask) {
+            *mask = 1UL << (idx % 64);
+            return &data[idx / 64];
+        }
+
         void set(int idx) { data[idx / 64] |= 1UL << (idx % 64); }
 
         void toggle(int idx) { data[idx / 64] ^= 1UL << (idx % 64); }
@@ -266,7 +352,7 @@ private:
 #define BITFIELD_SIZE (ATOMS_PER_BLOCK / 8)
 #define BITFIELD_ELTS (BITFIELD_SIZE / 8)
 
-#define BLOCK_HEADER_SIZE (BITFIELD_SIZE + 4 * sizeof(void*))
+#define BLOCK_HEADER_SIZE (2 * BITFIELD_SIZE + 4 * sizeof(void*))
 #define BLOCK_HEADER_ATOMS ((BLOCK_HEADER_SIZE + ATOM_SIZE - 1) / ATOM_SIZE)
 
     struct Atoms {
@@ -274,6 +360,12 @@ private:
     };
 
 public:
+    enum SweepState : uint8_t {
+        SWEPT = 0,
+        NEEDS_SWEEP = 1,
+        SWEEPING = 2, // some thread is currently sweeping the block
+    };
+
     struct Block {
         union {
             struct {
@@ -283,7 +375,10 @@ public:
                 uint8_t min_obj_index;
                 uint8_t atoms_per_obj;
                 Bitmap<ATOMS_PER_BLOCK> isfree;
+                // Indexed the same way as isfree; only the bits of allocated objects mean anything.
+                Bitmap<ATOMS_PER_BLOCK> marked;
                 Bitmap<ATOMS_PER_BLOCK>::Scanner next_to_check;
+                uint8_t sweep_state;
                 void* _header_end[0];
             };
             Atoms atoms[ATOMS_PER_BLOCK];
@@ -296,11 +391,20 @@ public:
         inline int atomsPerObj() const { return atoms_per_obj; }
 
         static Block* forPointer(void* ptr) { return (Block*)((uintptr_t)ptr & ~(BLOCK_SIZE - 1)); }
+
+        int atomIndexFor(void* ptr) { return ((char*)ptr - (char*)this) / ATOM_SIZE; }
     };
     static_assert(sizeof(Block) == BLOCK_SIZE, "bad size");
     static_assert(offsetof(Block, _header_end) >= BLOCK_HEADER_SIZE, "bad header size");
     static_assert(offsetof(Block, _header_end) <= BLOCK_HEADER_SIZE, "bad header size");
 
+    static uint64_t* markWordFor(GCAllocation* al, uint64_t* mask) {
+        Block* b = Block::forPointer(al);
+        return b->marked.wordFor(b->atomIndexFor(al), mask);
+    }
+
+    static size_t allocationSize(GCAllocation* al) { return Block::forPointer(al)->size; }
+
 private:
     struct ThreadBlockCache {
         Heap* heap;
@@ -319,6 +423,19 @@ private:
     Block* heads[NUM_BUCKETS];
     Block* full_heads[NUM_BUCKETS];
 
+    // The blocks that the last collection flagged as needing a sweep.  Allocation sweeps blocks without
+    // removing them from here, so not all of these still need it.
+    std::vector<Block*> blocks_to_sweep;
+    // How many of blocks_to_sweep to sweep every time a thread claims a new block:
+    int blocks_to_sweep_per_claim;
+    // Blocks that got handed back by threads that exited since the last collection, which might
+    // contain young objects:
+    std::vector<Block*> orphaned_blocks;
+    // Swept objects whose destructors still need to run; see runPendingDestructors().  Guarded by heap->lock,
+    // but num_pending_destructors can be read without it as a hint.
+    std::vector<GCAllocation*> pending_destructors;
+    int num_pending_destructors;
+
     friend struct ThreadBlockCache;
 
     Heap* heap;
@@ -328,7 +445,13 @@ private:
     Block* _allocBlock(uint64_t size, Block** prev);
     GCAllocation* _allocFromBlock(Block* b);
     Block* _claimBlock(size_t rounded_size, Block** free_head);
-    Block** _freeChain(Block** head, std::vector<Box*>& weakly_referenced);
+    Block** _flagChainForSweep(Block** head);
+    void _flagForSweep(Block* b);
+    void _sweepBlock(Block* b, std::vector<GCAllocation*>& destructors);
+    void _sweepObject(Block* b, int atom_idx, std::vector<GCAllocation*>& destructors);
+    bool _trySweepBlock(Block* b);
+    inline void _ensureSwept(Block* b);
+    void _sweepSomeBlocks(int max_blocks);
     void _getChainStatistics(HeapStatistics* stats, Block** head);
 
     GCAllocation* __attribute__((__malloc__)) _alloc(size_t bytes, int bucket_idx);
@@ -384,6 +507,7 @@ private:
     LargeObj* head;
     LargeBlock* blocks;
     LargeFreeChunk* free_lists[NUM_FREE_LISTS]; /* 0 is for larger sizes */
+    PageMarkTable mark_table;
 
     void add_free_chunk(LargeFreeChunk* free_chunks, size_t size);
     LargeFreeChunk* get_from_size_list(LargeFreeChunk** list, size_t size);
@@ -391,7 +515,8 @@ private:
     void _freeLargeObj(LargeObj* obj);
 
 public:
-    LargeArena(Heap* heap) : heap(heap), head(NULL), blocks(NULL) {}
+    LargeArena(Heap* heap)
+        : heap(heap), head(NULL), blocks(NULL), mark_table(LARGE_ARENA_START, ARENA_SIZE) {}
 
     /* Largest object that can be allocated in a large block. */
     static constexpr size_t ALLOC_SIZE_LIMIT = BLOCK_SIZE - CHUNK_SIZE - sizeof(LargeObj);
@@ -401,9 +526,14 @@ public:
     void free(GCAllocation* alloc);
 
     GCAllocation* allocationFrom(void* ptr);
-    void freeUnmarked(std::vector<Box*>& weakly_referenced);
+    void freeUnmarked();
+    void findRememberedObjects(const DirtyPageMap& dirty_pages, std::vector<GCAllocation*>& remembered);
+    void clearMarks() { mark_table.clearUpTo(frontier()); }
 
     void getStatistics(HeapStatistics* stats);
+
+    uint64_t* markWordFor(GCAllocation* al, uint64_t* mask) { return mark_table.wordFor(al, mask); }
+    size_t allocationSize(GCAllocation* al) { return LargeObj::fromAllocation(al)->size; }
 };
 
 // The HugeArena allocates objects where size > 1024*1024 bytes.
@@ -412,17 +542,22 @@ public:
 // linked list.  They are not reused.
 class HugeArena : public Arena<HUGE_ARENA_START, ARENA_SIZE> {
 public:
-    HugeArena(Heap* heap) : heap(heap) {}
+    HugeArena(Heap* heap) : heap(heap), mark_table(HUGE_ARENA_START, ARENA_SIZE) {}
 
     GCAllocation* __attribute__((__malloc__)) alloc(size_t bytes);
     GCAllocation* realloc(GCAllocation* alloc, size_t bytes);
     void free(GCAllocation* alloc);
 
     GCAllocation* allocationFrom(void* ptr);
-    void freeUnmarked(std::vector<Box*>& weakly_referenced);
+    void freeUnmarked();
+    void findRememberedObjects(const DirtyPageMap& dirty_pages, std::vector<GCAllocation*>& remembered);
+    void clearMarks() { mark_table.clearUpTo(frontier()); }
 
     void getStatistics(HeapStatistics* stats);
 
+    uint64_t* markWordFor(GCAllocation* al, uint64_t* mask) { return mark_table.wordFor(al, mask); }
+    size_t allocationSize(GCAllocation* al);
+
 private:
     struct HugeObj {
         HugeObj* next, **prev;
@@ -449,6 +584,7 @@ private:
     HugeObj* head;
 
     Heap* heap;
+    PageMarkTable mark_table;
 };
 
 
@@ -501,7 +637,11 @@ public:
 
     void free(GCAllocation* alloc) {
         destructContents(alloc);
+        freeWithoutDestructing(alloc);
+    }
 
+    // For when the caller has already called destructContents():
+    void freeWithoutDestructing(GCAllocation* alloc) {
         if (large_arena.contains(alloc)) {
             large_arena.free(alloc);
             return;
@@ -516,6 +656,29 @@ public:
         small_arena.free(alloc);
     }
 
+    // Finds the word and bit that hold the mark bit of an allocation:
+    uint64_t* markWordFor(GCAllocation* al, uint64_t* mask) {
+        if ((uintptr_t)al < LARGE_ARENA_START) {
+            assert(small_arena.contains(al));
+            return SmallArena::markWordFor(al, mask);
+        } else if ((uintptr_t)al < HUGE_ARENA_START) {
+            assert(large_arena.contains(al));
+            return large_arena.markWordFor(al, mask);
+        } else {
+            assert(huge_arena.contains(al));
+            return huge_arena.markWordFor(al, mask);
+        }
+    }
+
+    size_t allocationSize(GCAllocation* al) {
+        if ((uintptr_t)al < LARGE_ARENA_START)
+            return SmallArena::allocationSize(al);
+        else if ((uintptr_t)al < HUGE_ARENA_START)
+            return large_arena.allocationSize(al);
+        else
+            return huge_arena.allocationSize(al);
+    }
+
     // not thread safe:
     GCAllocation* getAllocationFromInteriorPointer(void* ptr) {
         if (large_arena.contains(ptr)) {
@@ -530,20 +693,69 @@ public:
     }
 
     // not thread safe:
-    void freeUnmarked(std::vector<Box*>& weakly_referenced) {
-        small_arena.freeUnmarked(weakly_referenced);
-        large_arena.freeUnmarked(weakly_referenced);
-        huge_arena.freeUnmarked(weakly_referenced);
+    // The large and huge arenas get swept right away; the small arena gets swept lazily.
+    void freeUnmarked(bool minor) {
+        small_arena.freeUnmarked(minor);
+        large_arena.freeUnmarked();
+        huge_arena.freeUnmarked();
+    }
+
+    // not thread safe:
+    // Unmarks every object, young and old, so that a full collection traces all of them.
+    void clearAllMarks() {
+        small_arena.clearMarks();
+        large_arena.clearMarks();
+        huge_arena.clearMarks();
     }
 
+    // not thread safe:
+    // Sweeps whatever the previous collection left unswept.  This has to happen before the next
+    // collection starts marking, since the garbage in an unswept block looks just like live objects.
+    void finishLazySweep() { small_arena.finishLazySweep(); }
+
+    // not thread safe:
+    // Finds the old (marked) objects that live on pages that have been written to since the
+    // last collection.  These may contain pointers to young objects, so they form the
+    // remembered set of a minor collection.
+    void findRememberedObjects(std::vector<GCAllocation*>& remembered);
+
     void dumpHeapStatistics(int level);
 
-    friend void markPhase();
+    friend size_t markPhase(bool minor);
+    friend void visitByGCKind(void* p, GCVisitor& visitor);
 };
 
 extern Heap global_heap;
 void dumpHeapStatistics(int level);
 
+inline bool isMarked(GCAllocation* header) {
+    uint64_t mask;
+    uint64_t* word = global_heap.markWordFor(header, &mask);
+    return isMarkBitSet(word, mask);
+}
+
+inline void setMark(GCAllocation* header) {
+    assert(!isMarked(header));
+    uint64_t mask;
+    uint64_t* word = global_heap.markWordFor(header, &mask);
+    setMarkBit(word, mask, true);
+}
+
+inline void clearMark(GCAllocation* header) {
+    assert(isMarked(header));
+    uint64_t mask;
+    uint64_t* word = global_heap.markWordFor(header, &mask);
+    setMarkBit(word, mask, false);
+}
+
+// Sets the mark bit, returning false if the object was already marked.  This is safe to call from
+// several marking threads at once.
+inline bool trySetMarkAtomic(GCAllocation* header) {
+    uint64_t mask;
+    uint64_t* word = global_heap.markWordFor(header, &mask);
+    return trySetMarkBitAtomic(word, mask);
+}
+
 } // namespace gc
 } // namespace pyston
 
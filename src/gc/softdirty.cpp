@@ -0,0 +1,167 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "gc/softdirty.h"
+
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "core/types.h"
+#include "gc/heap.h"
+
+namespace pyston {
+namespace gc {
+
+static_assert(DirtyPageMap::PAGE_BYTES == PAGE_SIZE, "");
+
+#define PAGEMAP_SOFT_DIRTY_BIT (1UL << 55)
+#define PAGEMAP_PRESENT_BIT (1UL << 63)
+#define PAGEMAP_SWAPPED_BIT (1UL << 62)
+
+static int pagemap_fd = -1;
+
+static bool writeClearRefs() {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    if (fd < 0)
+        return false;
+    // "4" means clear the soft-dirty bits, as opposed to the referenced bits.
+    bool ok = (write(fd, "4", 1) == 1);
+    close(fd);
+    return ok;
+}
+
+bool softDirtyIsSupported() {
+    static int supported = -1;
+    if (supported == -1) {
+        supported = 0;
+
+        pagemap_fd = open("/proc/self/pagemap", O_RDONLY);
+        if (pagemap_fd >= 0 && writeClearRefs()) {
+            // Kernels without CONFIG_MEM_SOFT_DIRTY will accept the write but never set the bit,
+            // which would make every page look clean.  Check that a page we write to shows up dirty.
+            static volatile uint64_t probe[PAGE_SIZE / sizeof(uint64_t)] __attribute__((aligned(PAGE_SIZE)));
+            probe[0]++;
+
+            DirtyPageMap map;
+            map.read((void*)probe, (void*)((char*)probe + PAGE_SIZE));
+            supported = map.isDirty((void*)probe);
+        }
+
+        if (!supported && pagemap_fd >= 0) {
+            close(pagemap_fd);
+            pagemap_fd = -1;
+        }
+    }
+    return supported;
+}
+
+void clearSoftDirtyBits() {
+    assert(pagemap_fd >= 0);
+    bool ok = writeClearRefs();
+    RELEASE_ASSERT(ok, "failed to clear soft-dirty bits");
+}
+
+void DirtyPageMap::read(void* start, void* end) {
+    assert((uintptr_t)start % PAGE_BYTES == 0);
+    assert((uintptr_t)end % PAGE_BYTES == 0);
+    assert(pagemap_fd >= 0);
+
+    this->start = (uintptr_t)start;
+    this->end = (uintptr_t)end;
+
+    size_t npages = (this->end - this->start) / PAGE_BYTES;
+    dirty.assign(npages, false);
+
+    const size_t CHUNK = 512;
+    uint64_t entries[CHUNK];
+    for (size_t i = 0; i < npages; i += CHUNK) {
+        size_t n = std::min(CHUNK, npages - i);
+        off_t offset = (this->start / PAGE_BYTES + i) * sizeof(uint64_t);
+        ssize_t r = pread(pagemap_fd, entries, n * sizeof(uint64_t), offset);
+        RELEASE_ASSERT(r == n * sizeof(uint64_t), "short read from /proc/self/pagemap");
+
+        for (size_t j = 0; j < n; j++) {
+            // Pages that were never touched (neither present nor swapped) can't contain any pointers.
+            if (!(entries[j] & (PAGEMAP_PRESENT_BIT | PAGEMAP_SWAPPED_BIT)))
+                continue;
+            if (entries[j] & PAGEMAP_SOFT_DIRTY_BIT)
+                dirty[i + j] = true;
+        }
+    }
+}
+
+bool DirtyPageMap::anyDirty(void* start, void* end) const {
+    uintptr_t first = std::max((uintptr_t)start, this->start);
+    uintptr_t last = std::min((uintptr_t)end, this->end);
+    if (first >= last)
+        return false;
+
+    for (size_t i = (first - this->start) / PAGE_BYTES; i <= (last - 1 - this->start) / PAGE_BYTES; i++) {
+        if (dirty[i])
+            return true;
+    }
+    return false;
+}
+
+static bool isHeapAddress(uintptr_t addr) {
+    return addr >= SMALL_ARENA_START && addr < HUGE_ARENA_START + ARENA_SIZE;
+}
+
+static void readNonheapMappings(std::vector<std::pair<uintptr_t, uintptr_t>>& ranges) {
+    FILE* maps = fopen("/proc/self/maps", "r");
+    RELEASE_ASSERT(maps, "couldn't open /proc/self/maps");
+
+    ranges.clear();
+
+    char line[512];
+    while (fgets(line, sizeof(line), maps)) {
+        uintptr_t start, end;
+        char perms[5];
+        int path_offset = 0;
+        if (sscanf(line, "%lx-%lx %4s %*s %*s %*s %n", &start, &end, perms, &path_offset) < 3)
+            continue;
+
+        if (perms[0] != 'r' || perms[1] != 'w')
+            continue;
+        // Skip device mappings, which can have side effects when read:
+        if (path_offset && strncmp(line + path_offset, "/dev/", 5) == 0)
+            continue;
+        if (isHeapAddress(start))
+            continue;
+
+        ranges.push_back(std::make_pair(start, end));
+    }
+    fclose(maps);
+}
+
+void visitDirtyNonheapMemory(GCVisitor* visitor) {
+    // We re-read the mappings on every minor collection.  Caching them isn't safe: memory can become writable without
+    // the address space changing size (malloc grows its per-thread arenas with mprotect, and a mapping can get
+    // replaced by a different one of the same size), and we'd never scan the dirty pages there.
+    static std::vector<std::pair<uintptr_t, uintptr_t>> ranges;
+    readNonheapMappings(ranges);
+
+    DirtyPageMap map;
+    for (auto& r : ranges) {
+        map.read((void*)r.first, (void*)r.second);
+        map.forEachDirtyPage([visitor](void* page) {
+            visitor->visitPotentialRange((void* const*)page,
+                                         (void* const*)((char*)page + DirtyPageMap::PAGE_BYTES));
+        });
+    }
+}
+}
+}
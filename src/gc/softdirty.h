@@ -0,0 +1,82 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_GC_SOFTDIRTY_H
+#define PYSTON_GC_SOFTDIRTY_H
+
+#include <cstdint>
+#include <vector>
+
+#include "core/common.h"
+
+namespace pyston {
+namespace gc {
+
+class GCVisitor;
+
+// The generational collector needs to know about old->young pointers, which normally means
+// putting a write barrier on every pointer store.  We can't do that: stores happen from the JIT,
+// from the runtime, and from arbitrary C extension code.  Instead we use the kernel's soft-dirty
+// page tracking (see Documentation/vm/soft-dirty.txt) as a card table with one card per page:
+// writing "4" to /proc/self/clear_refs marks every page clean, and bit 55 of each
+// /proc/self/pagemap entry tells us whether the page has been written to since then.
+
+// Returns whether the kernel supports soft-dirty tracking; if it doesn't, every collection
+// has to be a full one.
+bool softDirtyIsSupported();
+
+// Marks every page in the process as clean.
+void clearSoftDirtyBits();
+
+// A snapshot of the soft-dirty bits for a contiguous range of pages.
+class DirtyPageMap {
+public:
+    static constexpr uintptr_t PAGE_BYTES = 4096;
+
+private:
+    uintptr_t start, end;
+    std::vector<bool> dirty;
+
+public:
+    DirtyPageMap() : start(0), end(0) {}
+
+    // Reads the soft-dirty state of the pages in [start, end).  Both should be page-aligned.
+    void read(void* start, void* end);
+
+    bool isDirty(void* p) const {
+        if ((uintptr_t)p < start || (uintptr_t)p >= end)
+            return false;
+        return dirty[((uintptr_t)p - start) / PAGE_BYTES];
+    }
+
+    // Returns whether any of the pages overlapping [start, end) are dirty.
+    bool anyDirty(void* start, void* end) const;
+
+    template <typename Func> void forEachDirtyPage(Func func) const {
+        for (size_t i = 0; i < dirty.size(); i++) {
+            if (dirty[i])
+                func((void*)(start + i * PAGE_BYTES));
+        }
+    }
+};
+
+// Conservatively scans every dirty page of writable memory that is not part of the gc heap.
+// Some objects keep references in memory we don't manage (ex std::vector members that their
+// gc handlers visit), and stores into that memory won't dirty any heap page; treating the
+// dirty parts of it as roots keeps minor collections correct for those objects.
+void visitDirtyNonheapMemory(GCVisitor* visitor);
+}
+}
+
+#endif
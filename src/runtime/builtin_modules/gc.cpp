@@ -14,6 +14,9 @@
 
 #include "core/types.h"
 #include "gc/collector.h"
+#include "gc/heap.h"
+#include "runtime/capi.h"
+#include "runtime/objmodel.h"
 #include "runtime/types.h"
 
 namespace pyston {
@@ -37,6 +40,60 @@ static Box* enable() {
     return None;
 }
 
+// Our thresholds don't mean the same thing as CPython's, but we keep the same shape:
+// - threshold0 is the minimum number of bytes allocated between automatic collections
+// - threshold1 is how much the heap can grow between automatic collections, as a percentage of the
+//   bytes that the last collection found to be live
+// - threshold2 is how many minor collections happen between full collections
+static Box* getThreshold() {
+    gc::CollectionPolicy policy = gc::getCollectionPolicy();
+    return BoxedTuple::create(
+        { boxInt(policy.min_bytes), boxInt(policy.growth_percent), boxInt(policy.minors_per_full) });
+}
+
+static long thresholdArg(Box* arg) {
+    long r = PyInt_AsLong(arg);
+    checkAndThrowCAPIException();
+    if (r < 0)
+        raiseExcHelper(ValueError, "gc thresholds must be non-negative");
+    return r;
+}
+
+static Box* setThreshold(Box* threshold0, Box* threshold1, Box* threshold2) {
+    gc::CollectionPolicy policy = gc::getCollectionPolicy();
+    policy.min_bytes = thresholdArg(threshold0);
+    if (threshold1)
+        policy.growth_percent = thresholdArg(threshold1);
+    if (threshold2)
+        policy.minors_per_full = thresholdArg(threshold2);
+    gc::setCollectionPolicy(policy);
+    return None;
+}
+
+static Box* getCount() {
+    return boxInt(gc::getBytesAllocatedSinceCollection());
+}
+
+static Box* makeGenerationStats(int64_t collections, int64_t us) {
+    BoxedDict* d = new BoxedDict();
+    PyDict_SetItemString(d, "collections", boxInt(collections));
+    PyDict_SetItemString(d, "time", boxFloat(us / 1000000.0));
+    return d;
+}
+
+// Like CPython's get_stats(), returns a list with a dict per generation (young, then old).
+static Box* getStats() {
+    gc::CollectionStats stats = gc::getCollectionStats();
+
+    BoxedList* rtn = new BoxedList();
+    Box* young = makeGenerationStats(stats.minor_collections, stats.minor_us);
+    Box* old = makeGenerationStats(stats.full_collections, stats.full_us);
+    PyDict_SetItemString(old, "live_bytes", boxInt(stats.live_bytes));
+    listAppendInternal(rtn, young);
+    listAppendInternal(rtn, old);
+    return rtn;
+}
+
 void setupGC() {
     BoxedModule* gc_module = createModule("gc");
 
@@ -46,5 +103,14 @@ void setupGC() {
                         new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)isEnabled, BOXED_BOOL, 0), "isenabled"));
     gc_module->giveAttr("disable", new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)disable, NONE, 0), "disable"));
     gc_module->giveAttr("enable", new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)enable, NONE, 0), "enable"));
+    gc_module->giveAttr("get_threshold", new BoxedBuiltinFunctionOrMethod(
+                                             boxRTFunction((void*)getThreshold, UNKNOWN, 0), "get_threshold"));
+    gc_module->giveAttr("set_threshold", new BoxedBuiltinFunctionOrMethod(
+                                             boxRTFunction((void*)setThreshold, NONE, 3, 2, false, false),
+                                             "set_threshold", { NULL, NULL }));
+    gc_module->giveAttr("get_count",
+                        new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)getCount, UNKNOWN, 0), "get_count"));
+    gc_module->giveAttr("get_stats",
+                        new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)getStats, UNKNOWN, 0), "get_stats"));
 }
 }
@@ -12,6 +12,7 @@
 // See the License for the specific language governing permissions and
 // limitations under the License.
 
+#include "codegen/profiling/sampling_profiler.h"
 #include "core/types.h"
 #include "runtime/objmodel.h"
 #include "runtime/types.h"
@@ -42,7 +43,20 @@ static Box* setOption(Box* option, Box* value) {
     else CHECK(OSR_THRESHOLD_INTERPRETER);
     else CHECK(REOPT_THRESHOLD_BASELINE);
     else CHECK(OSR_THRESHOLD_BASELINE);
+    else CHECK(REOPT_THRESHOLD_T2);
+    else CHECK(OSR_THRESHOLD_T2);
+    else CHECK(ENABLE_BACKGROUND_COMPILE);
     else CHECK(SPECULATION_THRESHOLD);
+    else CHECK(ENABLE_TEMPLATE_JIT);
+    else CHECK(TEMPLATE_JIT_THRESHOLD_CALLS);
+    else CHECK(TEMPLATE_JIT_THRESHOLD_BACKEDGES);
+    else CHECK(ENABLE_DIRECT_CALLS);
+    else CHECK(ENABLE_LIST_STRATEGIES);
+    else CHECK(ENABLE_CAPI_EXCEPTIONS);
+    else CHECK(CAPI_EXCEPTION_THRESHOLD);
+    else CHECK(CAPI_EXCEPTION_PERCENT);
+    else CHECK(ENABLE_STACKLESS_GENERATORS);
+    else CHECK(GC_MARK_THREADS);
     else raiseExcHelper(ValueError, "unknown option name '%s", option_string->data());
 
     return None;
@@ -61,6 +75,25 @@ static Box* dumpStats(Box* includeZeros) {
     return None;
 }
 
+static Box* startProfiler(Box* interval) {
+    if (interval->cls != int_cls)
+        raiseExcHelper(TypeError, "interval must be a 'int' object but received a '%s'", getTypeName(interval));
+    int64_t interval_us = ((BoxedInt*)interval)->n;
+    if (interval_us <= 0 || interval_us > INT_MAX)
+        raiseExcHelper(ValueError, "interval must be a positive number of microseconds");
+    if (isSamplingProfilerRunning())
+        raiseExcHelper(RuntimeError, "the profiler is already running");
+
+    startSamplingProfiler(interval_us);
+    return None;
+}
+
+static Box* stopProfiler() {
+    if (!isSamplingProfilerRunning())
+        raiseExcHelper(RuntimeError, "the profiler isn't running");
+    return boxString(stopSamplingProfiler());
+}
+
 void setupPyston() {
     pyston_module = createModule("__pyston__");
 
@@ -72,5 +105,11 @@ void setupPyston() {
     pyston_module->giveAttr("dumpStats",
                             new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)dumpStats, NONE, 1, 1, false, false),
                                                              "dumpStats", { False }));
+
+    CLFunction* start_profiler = boxRTFunction((void*)startProfiler, NONE, 1, 1, false, false);
+    pyston_module->giveAttr("startProfiler",
+                            new BoxedBuiltinFunctionOrMethod(start_profiler, "startProfiler", { boxInt(1000) }));
+    pyston_module->giveAttr("stopProfiler", new BoxedBuiltinFunctionOrMethod(
+                                                boxRTFunction((void*)stopProfiler, STR, 0), "stopProfiler"));
 }
 }
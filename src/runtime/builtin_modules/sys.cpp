@@ -13,6 +13,7 @@
 // limitations under the License.
 
 #include <algorithm>
+#include <climits>
 #include <cmath>
 #include <langinfo.h>
 #include <sstream>
@@ -24,6 +25,7 @@
 #include "codegen/unwinding.h"
 #include "core/types.h"
 #include "gc/collector.h"
+#include "runtime/capi.h"
 #include "runtime/file.h"
 #include "runtime/inline/boxing.h"
 #include "runtime/int.h"
@@ -131,6 +133,50 @@ Box* sysGetRecursionLimit() {
     return PyInt_FromLong(Py_GetRecursionLimit());
 }
 
+// The GIL's switch interval is in microseconds.  Keep it between 1us and a day, which also keeps the GIL's deadline
+// arithmetic from overflowing.
+static const double MAX_SWITCH_INTERVAL_US = 24 * 60 * 60 * 1000000.0;
+static void setSwitchIntervalUS(double us) {
+    threading::setGILSwitchInterval((int64_t)std::min(std::max(us, 1.0), MAX_SWITCH_INTERVAL_US));
+}
+
+// CPython 2 counts its check interval in bytecodes, and defaults to 100.  We don't have bytecodes, so
+// treat each unit as 50us; that maps the default check interval onto the default switch interval.
+static const int64_t CHECK_INTERVAL_UNIT_US = 50;
+static int check_interval = 100;
+
+Box* sysSetCheckInterval(Box* val) {
+    if (!isSubclass(val->cls, int_cls))
+        raiseExcHelper(TypeError, "an integer is required");
+    // CPython parses the argument as a C int:
+    int64_t n = static_cast<BoxedInt*>(val)->n;
+    if (n > INT_MAX)
+        raiseExcHelper(OverflowError, "signed integer is greater than maximum");
+    if (n < INT_MIN)
+        raiseExcHelper(OverflowError, "signed integer is less than minimum");
+    check_interval = n;
+    setSwitchIntervalUS((double)check_interval * CHECK_INTERVAL_UNIT_US);
+    return None;
+}
+
+Box* sysGetCheckInterval() {
+    return boxInt(check_interval);
+}
+
+Box* sysSetSwitchInterval(Box* val) {
+    double interval = PyFloat_AsDouble(val);
+    checkAndThrowCAPIException();
+    // (Written this way to reject NaN as well.)
+    if (!(interval > 0.0))
+        raiseExcHelper(ValueError, "switch interval must be strictly positive");
+    setSwitchIntervalUS(interval * 1000000);
+    return None;
+}
+
+Box* sysGetSwitchInterval() {
+    return boxFloat(threading::getGILSwitchInterval() / 1000000.0);
+}
+
 extern "C" int PySys_SetObject(const char* name, PyObject* v) noexcept {
     try {
         if (!v) {
@@ -454,6 +500,19 @@ void setupSys() {
         "getrecursionlimit",
         new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)sysGetRecursionLimit, UNKNOWN, 0), "getrecursionlimit"));
 
+    sys_module->giveAttr("setcheckinterval",
+                         new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)sysSetCheckInterval, NONE, 1),
+                                                          "setcheckinterval"));
+    sys_module->giveAttr("getcheckinterval",
+                         new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)sysGetCheckInterval, BOXED_INT, 0),
+                                                          "getcheckinterval"));
+    sys_module->giveAttr("setswitchinterval",
+                         new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)sysSetSwitchInterval, NONE, 1),
+                                                          "setswitchinterval"));
+    sys_module->giveAttr("getswitchinterval",
+                         new BoxedBuiltinFunctionOrMethod(boxRTFunction((void*)sysGetSwitchInterval, BOXED_FLOAT, 0),
+                                                          "getswitchinterval"));
+
     sys_module->giveAttr("meta_path", new BoxedList());
     sys_module->giveAttr("path_hooks", new BoxedList());
     sys_module->giveAttr("path_importer_cache", new BoxedDict());
@@ -24,6 +24,7 @@
 #include "llvm/Support/Path.h"
 
 #include "capi/types.h"
+#include "codegen/parser.h"
 #include "codegen/unwinding.h"
 #include "core/threading.h"
 #include "core/types.h"
@@ -905,46 +906,54 @@ void checkAndThrowCAPIException() {
     if (!_type)
         assert(!cur_thread_state.curexc_value);
 
-    if (_type) {
-        BoxedClass* type = static_cast<BoxedClass*>(_type);
-        assert(isSubclass(_type->cls, type_cls) && isSubclass(static_cast<BoxedClass*>(type), BaseException)
-               && "Only support throwing subclass of BaseException for now");
-
-        Box* value = cur_thread_state.curexc_value;
-        if (!value)
-            value = None;
-
-        Box* tb = cur_thread_state.curexc_traceback;
-        if (!tb)
-            tb = None;
-
-        // Make sure to call PyErr_Clear() *before* normalizing the exception, since otherwise
-        // the normalization can think that it had raised an exception, resulting to a call
-        // to checkAndThrowCAPIException, and boom.
-        PyErr_Clear();
-
-        // This is similar to PyErr_NormalizeException:
-        if (!isSubclass(value->cls, type)) {
-            if (value->cls == tuple_cls) {
-                value = runtimeCall(type, ArgPassSpec(0, 0, true, false), value, NULL, NULL, NULL, NULL);
-            } else if (value == None) {
-                value = runtimeCall(type, ArgPassSpec(0), NULL, NULL, NULL, NULL, NULL);
-            } else {
-                value = runtimeCall(type, ArgPassSpec(1), value, NULL, NULL, NULL, NULL);
-            }
+    if (_type)
+        raiseRaw(fetchCAPIException());
+}
+
+ExcInfo fetchCAPIException() {
+    Box* _type = cur_thread_state.curexc_type;
+    assert(_type);
+
+    BoxedClass* type = static_cast<BoxedClass*>(_type);
+    assert(isSubclass(_type->cls, type_cls) && isSubclass(static_cast<BoxedClass*>(type), BaseException)
+           && "Only support throwing subclass of BaseException for now");
+
+    Box* value = cur_thread_state.curexc_value;
+    if (!value)
+        value = None;
+
+    Box* tb = cur_thread_state.curexc_traceback;
+    if (!tb)
+        tb = None;
+
+    // Make sure to call PyErr_Clear() *before* normalizing the exception, since otherwise
+    // the normalization can think that it had raised an exception, resulting to a call
+    // to checkAndThrowCAPIException, and boom.
+    PyErr_Clear();
+
+    // This is similar to PyErr_NormalizeException:
+    if (!isSubclass(value->cls, type)) {
+        if (value->cls == tuple_cls) {
+            value = runtimeCall(type, ArgPassSpec(0, 0, true, false), value, NULL, NULL, NULL, NULL);
+        } else if (value == None) {
+            value = runtimeCall(type, ArgPassSpec(0), NULL, NULL, NULL, NULL, NULL);
+        } else {
+            value = runtimeCall(type, ArgPassSpec(1), value, NULL, NULL, NULL, NULL);
         }
+    }
 
-        RELEASE_ASSERT(value->cls == type, "unsupported");
+    RELEASE_ASSERT(value->cls == type, "unsupported");
 
-        if (tb != None)
-            raiseRaw(ExcInfo(value->cls, value, tb));
-        raiseExc(value);
-    }
+    // Same as raiseExc(): the traceback gets filled in as the exception propagates.
+    if (tb == None)
+        tb = new BoxedTraceback();
+    return ExcInfo(value->cls, value, tb);
 }
 
 extern "C" void Py_Exit(int sts) noexcept {
     // Py_Finalize();
 
+    writePendingParseCaches();
     Stats::dump(false);
     exit(sts);
 }
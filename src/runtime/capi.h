@@ -27,6 +27,9 @@ void checkAndThrowCAPIException();
 void throwCAPIException() __attribute__((noreturn));
 struct ExcInfo;
 void setCAPIException(const ExcInfo& e);
+// Takes the pending C API exception (which must be set), normalizes it, and clears it.  This is what
+// checkAndThrowCAPIException() throws.
+ExcInfo fetchCAPIException();
 
 #define fatalOrError(exception, message)                                                                               \
     do {                                                                                                               \
@@ -0,0 +1,504 @@
+// Copyright (c) 2014-2015 Dropbox, Inc.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//    http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PYSTON_RUNTIME_COMPACTTABLE_H
+#define PYSTON_RUNTIME_COMPACTTABLE_H
+
+#include <cstring>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+#include "core/common.h"
+#include "core/types.h"
+#include "gc/gc_alloc.h"
+
+namespace pyston {
+
+// An insertion-ordered hash table laid out the way CPython 3.6 lays out its dicts: the elements live
+// in a dense array of entries (in insertion order), and the hash table proper is a small array of
+// indices into it, using 1, 2, 4 or 8 bytes per slot depending on the size of the table.
+// Compared to a node-based std::unordered_map, that's a single allocation per table instead of one
+// per element, a lookup touches one or two cache lines, and iteration is a linear scan.
+//
+// Erasing an element leaves a hole (a null key) in the entries array, which gets squeezed out the
+// next time the table is resized; keys can therefore never be null.
+//
+// Iterators are a (table, position) pair rather than a pointer into the storage, so using one after
+// the table has been modified is safe, if not necessarily meaningful.  Erasing an element doesn't
+// invalidate iterators to other elements.
+//
+// The storage is a single CONSERVATIVE gc allocation; the owner's gc handler should call gcVisit().
+//
+// Hash and KeyEqual also provide a cheaper path for a common kind of key (for the runtime: exact str
+// instances): Hash::isFastKey() identifies them, and KeyEqual::fastEq() compares two of them without
+// being able to run arbitrary code.  While every key in the table is a fast key, lookups of fast keys
+// use a simpler loop that doesn't need to watch for the table changing underneath it.
+template <class TEntry, class Hash, class KeyEqual> class CompactHashTable {
+public:
+    typedef size_t size_type;
+    typedef typename TEntry::key_type key_type;
+
+protected:
+    // Besides positions in the entries array, slots in the index array can hold these:
+    static constexpr int64_t IX_EMPTY = -1;
+    static constexpr int64_t IX_DUMMY = -2; // the entry this slot pointed to has been erased
+    static constexpr int MIN_LOG_SIZE = 3;
+
+    char* storage;        // the index array followed by the entries array; NULL for an empty table
+    size_t num_entries;   // entries in use, including erased ones
+    size_t num_used;      // live entries
+    size_t num_filled;    // slots in the index array that are not IX_EMPTY
+    size_t num_slow_keys; // live keys that aren't fast keys
+    int log_size;         // log2 of the number of slots in the index array
+
+    size_t indexSize() const { return (size_t)1 << log_size; }
+    static int indexWidth(int log_size) {
+        // The entries array is at most 2/3 the size of the index array, so the positions always fit.
+        return log_size <= 7 ? 1 : log_size <= 15 ? 2 : log_size <= 31 ? 4 : 8;
+    }
+    static size_t usableFor(int log_size) { return (((size_t)1 << log_size) * 2) / 3; }
+    static size_t storageBytes(int log_size) {
+        return ((size_t)indexWidth(log_size) << log_size) + usableFor(log_size) * sizeof(TEntry);
+    }
+    size_t usable() const { return storage ? usableFor(log_size) : 0; }
+
+    TEntry* entries() const { return reinterpret_cast<TEntry*>(storage + ((size_t)indexWidth(log_size) << log_size)); }
+
+    int64_t getIndex(size_t slot) const {
+        switch (indexWidth(log_size)) {
+            case 1:
+                return reinterpret_cast<int8_t*>(storage)[slot];
+            case 2:
+                return reinterpret_cast<int16_t*>(storage)[slot];
+            case 4:
+                return reinterpret_cast<int32_t*>(storage)[slot];
+            default:
+                return reinterpret_cast<int64_t*>(storage)[slot];
+        }
+    }
+
+    void setIndex(size_t slot, int64_t ix) {
+        switch (indexWidth(log_size)) {
+            case 1:
+                reinterpret_cast<int8_t*>(storage)[slot] = ix;
+                break;
+            case 2:
+                reinterpret_cast<int16_t*>(storage)[slot] = ix;
+                break;
+            case 4:
+                reinterpret_cast<int32_t*>(storage)[slot] = ix;
+                break;
+            default:
+                reinterpret_cast<int64_t*>(storage)[slot] = ix;
+                break;
+        }
+    }
+
+    // The probe sequence is the same as CPython's, so that hashes which only differ in their high
+    // bits still end up spread out.
+    template <typename Func> size_t probe(size_t hash, Func done) const {
+        size_t mask = indexSize() - 1;
+        size_t slot = hash & mask;
+        size_t perturb = hash;
+        while (!done(slot)) {
+            perturb >>= 5;
+            slot = (slot * 5 + perturb + 1) & mask;
+        }
+        return slot;
+    }
+
+    size_t findEmptySlot(size_t hash) const {
+        return probe(hash, [this](size_t slot) { return getIndex(slot) == IX_EMPTY; });
+    }
+
+    size_t slotForPosition(size_t pos) const {
+        return probe(entries()[pos].hash, [this, pos](size_t slot) { return getIndex(slot) == (int64_t)pos; });
+    }
+
+    int64_t lookupFast(key_type key, size_t hash) const {
+        int64_t found = IX_EMPTY;
+        probe(hash, [&](size_t slot) {
+            int64_t ix = getIndex(slot);
+            if (ix == IX_EMPTY)
+                return true;
+            if (ix == IX_DUMMY)
+                return false;
+
+            const TEntry& e = entries()[ix];
+            if (e.key() == key || (e.hash == hash && KeyEqual::fastEq(e.key(), key))) {
+                found = ix;
+                return true;
+            }
+            return false;
+        });
+        return found;
+    }
+
+    // Returns the position of the entry for key, or -1 if there isn't one.
+    int64_t lookup(key_type key, size_t hash) {
+        if (num_slow_keys == 0 && Hash::isFastKey(key))
+            return storage ? lookupFast(key, hash) : IX_EMPTY;
+
+    restart:
+        if (!storage)
+            return IX_EMPTY;
+
+        char* const orig_storage = storage;
+        int64_t found = IX_EMPTY;
+        bool changed = false;
+        probe(hash, [&](size_t slot) {
+            int64_t ix = getIndex(slot);
+            if (ix == IX_EMPTY)
+                return true;
+            if (ix == IX_DUMMY)
+                return false;
+
+            const TEntry& e = entries()[ix];
+            key_type startkey = e.key();
+            if (startkey == key) {
+                found = ix;
+                return true;
+            }
+            if (e.hash != hash)
+                return false;
+
+            bool eq = KeyEqual()(startkey, key);
+            // The comparison can run arbitrary code, which might have modified the table:
+            if (storage != orig_storage || entries()[ix].key() != startkey) {
+                changed = true;
+                return true;
+            }
+            if (eq)
+                found = ix;
+            return eq;
+        });
+
+        if (changed)
+            goto restart;
+        return found;
+    }
+
+    void resize(size_t min_usable) {
+        int new_log_size = MIN_LOG_SIZE;
+        while (usableFor(new_log_size) < min_usable)
+            new_log_size++;
+
+        char* new_storage = (char*)gc_alloc(storageBytes(new_log_size), gc::GCKind::CONSERVATIVE);
+        // All ones is IX_EMPTY at every width:
+        memset(new_storage, 0xff, (size_t)indexWidth(new_log_size) << new_log_size);
+
+        char* old_storage = storage;
+        TEntry* old_entries = storage ? entries() : NULL;
+        size_t old_num_entries = num_entries;
+
+        storage = new_storage;
+        log_size = new_log_size;
+
+        TEntry* new_entries = entries();
+        size_t j = 0;
+        for (size_t i = 0; i < old_num_entries; i++) {
+            if (!old_entries[i].key())
+                continue;
+            new_entries[j] = old_entries[i];
+            setIndex(findEmptySlot(new_entries[j].hash), j);
+            j++;
+        }
+        assert(j == num_used);
+        num_entries = num_filled = j;
+        // gc_alloc doesn't zero memory, and the gc scans the whole allocation:
+        memset(&new_entries[j], 0, (usableFor(new_log_size) - j) * sizeof(TEntry));
+
+        if (old_storage)
+            gc::gc_free(old_storage);
+    }
+
+    // Adds an entry for a key that is known not to be in the table.
+    TEntry& insertNew(key_type key, size_t hash) {
+        assert(key);
+        if (num_filled >= usable())
+            resize(num_used * 3);
+
+        setIndex(findEmptySlot(hash), num_entries);
+        TEntry& e = entries()[num_entries];
+        new (&e) TEntry();
+        e.hash = hash;
+        e.key() = key;
+        if (!Hash::isFastKey(key))
+            num_slow_keys++;
+
+        num_entries++;
+        num_used++;
+        num_filled++;
+        return e;
+    }
+
+    size_t nextLive(size_t pos) const {
+        while (pos < num_entries && !entries()[pos].key())
+            pos++;
+        return pos;
+    }
+
+    size_t prevLive(size_t pos) const {
+        assert(pos > 0);
+        pos--;
+        while (!entries()[pos].key()) {
+            assert(pos > 0);
+            pos--;
+        }
+        return pos;
+    }
+
+    template <class TTable, class TRef> class Iterator {
+    private:
+        TTable* table;
+        size_t pos;
+
+    public:
+        typedef std::bidirectional_iterator_tag iterator_category;
+        typedef typename std::remove_reference<TRef>::type value_type;
+        typedef std::ptrdiff_t difference_type;
+        typedef value_type* pointer;
+        typedef TRef reference;
+
+        Iterator() : table(NULL), pos(0) {}
+        Iterator(TTable* table, size_t pos) : table(table), pos(pos) {}
+
+        TRef operator*() const {
+            assert(pos < table->num_entries);
+            return table->entries()[pos].get();
+        }
+        pointer operator->() const { return &**this; }
+
+        Iterator& operator++() {
+            pos = table->nextLive(pos + 1);
+            return *this;
+        }
+        Iterator operator++(int) {
+            Iterator rtn = *this;
+            ++*this;
+            return rtn;
+        }
+        Iterator& operator--() {
+            pos = table->prevLive(std::min(pos, table->num_entries));
+            return *this;
+        }
+
+        // An iterator that has been left past the end by erasures compares equal to end().
+        bool operator==(const Iterator& rhs) const {
+            return std::min(pos, table->num_entries) == std::min(rhs.pos, rhs.table->num_entries);
+        }
+        bool operator!=(const Iterator& rhs) const { return !(*this == rhs); }
+
+        size_t hash() const { return table->entries()[pos].hash; }
+        size_t position() const { return pos; }
+
+        friend class CompactHashTable;
+    };
+
+public:
+    typedef Iterator<CompactHashTable, typename TEntry::reference> iterator;
+    typedef Iterator<const CompactHashTable, typename TEntry::const_reference> const_iterator;
+
+    CompactHashTable() : storage(NULL), num_entries(0), num_used(0), num_filled(0), num_slow_keys(0), log_size(0) {}
+
+    CompactHashTable(const CompactHashTable& rhs) : CompactHashTable() {
+        if (rhs.storage) {
+            size_t bytes = storageBytes(rhs.log_size);
+            storage = (char*)gc_alloc(bytes, gc::GCKind::CONSERVATIVE);
+            memcpy(storage, rhs.storage, bytes);
+            num_entries = rhs.num_entries;
+            num_used = rhs.num_used;
+            num_filled = rhs.num_filled;
+            num_slow_keys = rhs.num_slow_keys;
+            log_size = rhs.log_size;
+        }
+    }
+
+    CompactHashTable(CompactHashTable&& rhs) : CompactHashTable() { swap(rhs); }
+
+    CompactHashTable& operator=(CompactHashTable rhs) {
+        swap(rhs);
+        return *this;
+    }
+
+    void swap(CompactHashTable& rhs) {
+        std::swap(storage, rhs.storage);
+        std::swap(num_entries, rhs.num_entries);
+        std::swap(num_used, rhs.num_used);
+        std::swap(num_filled, rhs.num_filled);
+        std::swap(num_slow_keys, rhs.num_slow_keys);
+        std::swap(log_size, rhs.log_size);
+    }
+
+    size_type size() const { return num_used; }
+    bool empty() const { return num_used == 0; }
+    // Whether every key in the table is a fast key.
+    bool onlyFastKeys() const { return num_slow_keys == 0; }
+
+    iterator begin() { return iterator(this, nextLive(0)); }
+    iterator end() { return iterator(this, num_entries); }
+    const_iterator begin() const { return const_iterator(this, nextLive(0)); }
+    const_iterator end() const { return const_iterator(this, num_entries); }
+
+    // Returns an iterator to the first live entry at or after the given position (as returned by
+    // iterator::position()).  This is what lets PyDict_Next get by with an integer cursor.
+    iterator iteratorAt(size_t pos) { return iterator(this, nextLive(pos)); }
+
+    iterator find(key_type key) { return find(key, Hash()(key)); }
+
+    // For callers that already know the key's hash.
+    iterator find(key_type key, size_t hash) {
+        int64_t ix = lookup(key, hash);
+        if (ix < 0)
+            return end();
+        return iterator(this, ix);
+    }
+
+    size_type count(key_type key) { return lookup(key, Hash()(key)) >= 0 ? 1 : 0; }
+
+    iterator erase(iterator it) {
+        size_t pos = it.pos;
+        assert(it.table == this);
+        assert(pos < num_entries && entries()[pos].key());
+
+        setIndex(slotForPosition(pos), IX_DUMMY);
+        if (!Hash::isFastKey(entries()[pos].key()))
+            num_slow_keys--;
+        // Clear out the whole entry so that the gc doesn't keep the old value alive:
+        new (&entries()[pos]) TEntry();
+        num_used--;
+
+        // Trim erased entries off the end, so that popping from the back of the table stays cheap.
+        // Their slots in the index array stay dummies until the next resize, so num_filled doesn't go
+        // down.
+        while (num_entries > 0 && !entries()[num_entries - 1].key())
+            num_entries--;
+
+        return iterator(this, nextLive(pos + 1));
+    }
+
+    size_type erase(key_type key) {
+        auto it = find(key);
+        if (it == end())
+            return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear() {
+        // Leave the old storage to the gc rather than freeing it, in case someone is iterating over it.
+        storage = NULL;
+        num_entries = num_used = num_filled = num_slow_keys = 0;
+        log_size = 0;
+    }
+
+    void gcVisit(GCVisitor* v) const {
+        if (storage)
+            v->visit(storage);
+    }
+};
+
+template <class TKey, class TVal> struct CompactMapEntry {
+    typedef TKey key_type;
+    typedef CompactMapEntry& reference;
+    typedef const CompactMapEntry& const_reference;
+
+    size_t hash;
+    TKey first;
+    TVal second;
+
+    TKey& key() { return first; }
+    const TKey& key() const { return first; }
+    reference get() { return *this; }
+    const_reference get() const { return *this; }
+};
+
+template <class TKey> struct CompactSetEntry {
+    typedef TKey key_type;
+    typedef const TKey& reference;
+    typedef const TKey& const_reference;
+
+    size_t hash;
+    TKey value;
+
+    TKey& key() { return value; }
+    const TKey& key() const { return value; }
+    const_reference get() const { return value; }
+};
+
+// A drop-in replacement for the parts of std::unordered_map that the runtime uses.  Iterating
+// gives entries with first and second members, like std::pair.
+template <class TKey, class TVal, class Hash, class KeyEqual>
+class CompactMap : public CompactHashTable<CompactMapEntry<TKey, TVal>, Hash, KeyEqual> {
+    typedef CompactHashTable<CompactMapEntry<TKey, TVal>, Hash, KeyEqual> Base;
+
+public:
+    typedef typename Base::iterator iterator;
+    typedef typename Base::const_iterator const_iterator;
+
+    TVal& operator[](TKey key) {
+        size_t hash = Hash()(key);
+        int64_t ix = this->lookup(key, hash);
+        if (ix >= 0)
+            return this->entries()[ix].second;
+        return this->insertNew(key, hash).second;
+    }
+
+    std::pair<iterator, bool> insert(const std::pair<TKey, TVal>& p) {
+        size_t hash = Hash()(p.first);
+        int64_t ix = this->lookup(p.first, hash);
+        if (ix >= 0)
+            return std::make_pair(iterator(this, ix), false);
+        this->insertNew(p.first, hash).second = p.second;
+        return std::make_pair(iterator(this, this->num_entries - 1), true);
+    }
+
+    // Only takes iterators from another CompactMap, so that the stored hashes can be reused.
+    template <class It> void insert(It first, It last) {
+        for (; first != last; ++first) {
+            if (this->lookup(first->first, first.hash()) < 0)
+                this->insertNew(first->first, first.hash()).second = first->second;
+        }
+    }
+};
+
+template <class TKey, class Hash, class KeyEqual>
+class CompactSet : public CompactHashTable<CompactSetEntry<TKey>, Hash, KeyEqual> {
+    typedef CompactHashTable<CompactSetEntry<TKey>, Hash, KeyEqual> Base;
+
+public:
+    typedef typename Base::iterator iterator;
+    typedef typename Base::const_iterator const_iterator;
+
+    std::pair<iterator, bool> insert(TKey key) {
+        size_t hash = Hash()(key);
+        int64_t ix = this->lookup(key, hash);
+        if (ix >= 0)
+            return std::make_pair(iterator(this, ix), false);
+        this->insertNew(key, hash);
+        return std::make_pair(iterator(this, this->num_entries - 1), true);
+    }
+
+    // Only takes iterators from another CompactSet, so that the stored hashes can be reused.
+    template <class It> void insert(It first, It last) {
+        for (; first != last; ++first) {
+            if (this->lookup(*first, first.hash()) < 0)
+                this->insertNew(*first, first.hash());
+        }
+    }
+};
+}
+
+#endif
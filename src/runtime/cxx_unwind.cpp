@@ -21,7 +21,7 @@
 #include "llvm/Support/LEB128.h" // for {U,S}LEB128 decoding
 
 #include "codegen/ast_interpreter.h" // interpreter_instr_addr
-#include "codegen/unwinding.h"       // getCFForAddress
+#include "codegen/unwinding.h"       // getCFForAddress, addTracebackFrame
 #include "core/stats.h"              // StatCounter
 #include "core/types.h"              // for ExcInfo
 #include "core/util.h"               // Timer
@@ -513,7 +513,6 @@ static inline int step(unw_cursor_t* cp) {
 }
 
 // The stack-unwinding loop.
-// TODO: integrate incremental traceback generation into this function
 static inline void unwind_loop(const ExcData* exc_data) {
     Timer t("unwind_loop", 50);
 
@@ -543,6 +542,9 @@ static inline void unwind_loop(const ExcData* exc_data) {
             print_frame(&cursor, &pip);
         }
 
+        // Most Python frames don't have a handler and get skipped below, so this has to come first:
+        addTracebackFrame(exc_data->exc.traceback, &cursor);
+
         // Skip frames without handlers
         if (pip.handler == 0) {
             continue;
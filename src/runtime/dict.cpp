@@ -206,9 +206,19 @@ Box* dictGetitem(BoxedDict* self, Box* k) {
         raiseExcHelper(KeyError, k);
     }
 
-    Box* pos = self->d[k];
+    return it->second;
+}
+
+Box* dictGetitemStr(BoxedDict* self, BoxedString* k) {
+    assert(self->cls == dict_cls);
+    assert(k->cls == str_cls);
 
-    return pos;
+    // Using the cached hash directly skips PyHasher's type dispatch, and if the dict only has str
+    // keys the probe only does identity and memcmp comparisons.
+    auto it = self->d.find(k, strHashUnboxed(k));
+    if (it == self->d.end())
+        raiseExcHelper(KeyError, k);
+    return it->second;
 }
 
 extern "C" PyObject* PyDict_New() noexcept {
@@ -276,37 +286,17 @@ extern "C" int PyDict_Next(PyObject* op, Py_ssize_t* ppos, PyObject** pkey, PyOb
 
     // Callers of PyDict_New() provide a pointer to some storage for this function to use, in
     // the form of a Py_ssize_t* -- ie they allocate a Py_ssize_t on their stack, and let us use
-    // it.
-    //
-    // We want to store an unordered_map::iterator in that.  In my glibc it would fit, but to keep
-    // things a little bit more portable, allocate separate storage for the iterator, and store the
-    // pointer to this storage in the Py_ssize_t slot.
+    // it.  Clients are supposed to zero-initialize it.
     //
-    // Results in lots of indirection unfortunately.  If it becomes an issue we can try to switch
-    // to storing the iterator directly in the stack slot.
-
-    typedef BoxedDict::DictMap::iterator iterator;
-
-    static_assert(sizeof(Py_ssize_t) == sizeof(iterator*), "");
-    iterator** it_ptr = reinterpret_cast<iterator**>(ppos);
-
-    // Clients are supposed to zero-initialize *ppos:
-    if (*it_ptr == NULL) {
-        *it_ptr = (iterator*)malloc(sizeof(iterator));
-        **it_ptr = self->d.begin();
-    }
-
-    iterator* it = *it_ptr;
-
-    if (*it == self->d.end()) {
-        free(it);
+    // Iterators into the dict's table are just positions in its entries array, so we can store
+    // the position of the next entry to look at directly in that slot.
+    auto it = self->d.iteratorAt(*ppos);
+    if (it == self->d.end())
         return 0;
-    }
-
-    *pkey = (*it)->first;
-    *pvalue = (*it)->second;
 
-    ++(*it);
+    *pkey = it->first;
+    *pvalue = it->second;
+    *ppos = it.position() + 1;
 
     return 1;
 }
@@ -396,11 +386,14 @@ Box* dictPopitem(BoxedDict* self) {
         raiseExcHelper(TypeError, "descriptor 'popitem' requires a 'dict' object but received a '%s'",
                        getTypeName(self));
 
-    auto it = self->d.begin();
-    if (it == self->d.end()) {
+    if (self->d.empty()) {
         raiseExcHelper(KeyError, "popitem(): dictionary is empty");
     }
 
+    // Pop from the back, so that repeated popitem() calls don't have to skip over the holes left
+    // at the front of the table:
+    auto it = --self->d.end();
+
     Box* key = it->first;
     Box* value = it->second;
     self->d.erase(it);
@@ -429,7 +422,7 @@ Box* dictSetdefault(BoxedDict* self, Box* k, Box* v) {
     if (it != self->d.end())
         return it->second;
 
-    self->d.insert(it, std::make_pair(k, v));
+    self->d.insert(std::make_pair(k, v));
     return v;
 }
 
@@ -551,7 +544,7 @@ void dictMergeFromSeq2(BoxedDict* self, Box* other) {
                 raiseExcHelper(ValueError, "dictionary update sequence element #%d has length %d; 2 is required", idx,
                                list->size);
 
-            self->d[list->elts->elts[0]] = list->elts->elts[1];
+            self->d[list->getElt(0)] = list->getElt(1);
         } else if (element->cls == tuple_cls) {
             BoxedTuple* tuple = static_cast<BoxedTuple*>(element);
             if (tuple->size() != 2)
@@ -664,8 +657,8 @@ static Box* dict_repr(PyObject* self) noexcept {
 }
 
 void setupDict() {
-    dict_iterator_cls = BoxedHeapClass::create(type_cls, object_cls, &dictIteratorGCHandler, 0, 0, sizeof(BoxedDict),
-                                               false, "dictionary-itemiterator");
+    dict_iterator_cls = BoxedHeapClass::create(type_cls, object_cls, &dictIteratorGCHandler, 0, 0,
+                                               sizeof(BoxedDictIterator), false, "dictionary-itemiterator");
 
     dict_keys_cls = BoxedHeapClass::create(type_cls, object_cls, &dictViewGCHandler, 0, 0, sizeof(BoxedDictView), false,
                                            "dict_keys");
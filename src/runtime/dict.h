@@ -30,7 +30,8 @@ public:
 
     BoxedDict* d;
     BoxedDict::DictMap::iterator it;
-    const BoxedDict::DictMap::iterator itEnd;
+    // The size of the dict when the iteration started, or -1 once we've reported that it changed.
+    int64_t size;
     const IteratorType type;
 
     BoxedDictIterator(BoxedDict* d, IteratorType type);
@@ -39,6 +40,8 @@ public:
 };
 
 Box* dictGetitem(BoxedDict* self, Box* k);
+// dictGetitem for the case that self is exactly a dict and k is exactly a str.
+Box* dictGetitemStr(BoxedDict* self, BoxedString* k);
 
 Box* dictIterKeys(Box* self);
 Box* dictIterValues(Box* self);
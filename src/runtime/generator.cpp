@@ -24,6 +24,7 @@
 #include <sys/mman.h>
 #include <ucontext.h>
 
+#include "codegen/ast_interpreter.h"
 #include "core/ast.h"
 #include "core/common.h"
 #include "core/stats.h"
@@ -63,7 +64,11 @@ public:
     }
 };
 
-static void freeGeneratorStack(BoxedGenerator* g) {
+// Frees whatever the generator was running on; only called once the generator has exited (or died).
+static void freeGeneratorFrame(BoxedGenerator* g) {
+    if (g->interpreter_frame)
+        astInterpretGeneratorFreeFrame(g);
+
     if (g->stack_begin == NULL)
         return;
 
@@ -112,24 +117,69 @@ void generatorEntry(BoxedGenerator* g) {
     swapContext(&g->context, g->returnContext, 0);
 }
 
-Box* generatorIter(Box* s) {
-    return s;
-}
+static void initGeneratorStack(BoxedGenerator* g) {
+    static StatCounter generator_stack_reused("generator_stack_reused");
+    static StatCounter generator_stack_created("generator_stack_created");
 
-// called from both generatorHasNext and generatorSend/generatorNext (but only if generatorHasNext hasn't been called)
-static void generatorSendInternal(BoxedGenerator* self, Box* v) {
-    if (self->running)
-        raiseExcHelper(ValueError, "generator already executing");
+    void* initial_stack_limit;
+    if (available_addrs.size() == 0) {
+        generator_stack_created.log();
 
-    // check if the generator already exited
-    if (self->entryExited) {
-        freeGeneratorStack(self);
-        return;
+        uint64_t stack_low = next_stack_addr;
+        uint64_t stack_high = stack_low + MAX_STACK_SIZE;
+        next_stack_addr = stack_high;
+
+#if STACK_GROWS_DOWN
+        g->stack_begin = (void*)stack_high;
+
+        initial_stack_limit = (void*)(stack_high - INITIAL_STACK_SIZE);
+        void* p = mmap(initial_stack_limit, INITIAL_STACK_SIZE, PROT_READ | PROT_WRITE,
+                       MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS | MAP_GROWSDOWN, -1, 0);
+        ASSERT(p == initial_stack_limit, "%p %s", p, strerror(errno));
+
+        // Create an inaccessible redzone so that the generator stack won't grow indefinitely.
+        // Looks like it throws a SIGBUS if we reach the redzone; it's unclear if that's better
+        // or worse than being able to consume all available memory.
+        void* p2
+            = mmap((void*)stack_low, STACK_REDZONE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
+        assert(p2 == (void*)stack_low);
+        // Interestingly, it seems like MAP_GROWSDOWN will leave a page-size gap between the redzone and the growable
+        // region.
+
+        if (VERBOSITY() >= 1) {
+            printf("Created new generator stack, starts at %p, currently extends to %p\n", (void*)stack_high,
+                   initial_stack_limit);
+            printf("Created a redzone from %p-%p\n", (void*)stack_low, (void*)(stack_low + STACK_REDZONE_SIZE));
+        }
+#else
+#error "implement me"
+#endif
+
+        // we're registering memory that isn't in the gc heap here,
+        // which may sound wrong.  Generators, however, can represent
+        // a larger tax on system resources than just their GC
+        // allocation, so we try to encode that here as additional gc
+        // heap pressure.
+        gc::registerGCManagedBytes(INITIAL_STACK_SIZE);
+    } else {
+        generator_stack_reused.log();
+
+#if STACK_GROWS_DOWN
+        uint64_t stack_high = available_addrs.back();
+        g->stack_begin = (void*)stack_high;
+        initial_stack_limit = (void*)(stack_high - INITIAL_STACK_SIZE);
+        available_addrs.pop_back();
+#else
+#error "implement me"
+#endif
     }
 
-    self->returnValue = v;
-    self->running = true;
+    assert(((intptr_t)g->stack_begin & (~(intptr_t)(0xF))) == (intptr_t)g->stack_begin && "stack must be aligned");
+
+    g->context = makeContext(g->stack_begin, (void (*)(intptr_t))generatorEntry);
+}
 
+static void switchToGenerator(BoxedGenerator* self) {
 #if STAT_TIMERS
     if (!self->prev_stack)
         self->prev_stack = StatTimer::createStack(self->my_timer);
@@ -146,13 +196,57 @@ static void generatorSendInternal(BoxedGenerator* self, Box* v) {
         assert(self->my_timer.isPaused());
     }
 #endif
+}
+
+Box* generatorIter(Box* s) {
+    return s;
+}
+
+// called from both generatorHasNext and generatorSend/generatorNext (but only if generatorHasNext hasn't been called)
+static void generatorSendInternal(BoxedGenerator* self, Box* v) {
+    if (self->running)
+        raiseExcHelper(ValueError, "generator already executing");
+
+    // check if the generator already exited
+    if (self->entryExited) {
+        freeGeneratorFrame(self);
+        return;
+    }
+
+    if (!self->context && !self->interpreter_frame) {
+        if (self->exception.type) {
+            // Like CPython, throwing an exception into a generator that hasn't started yet doesn't run any of it.
+            self->entryExited = true;
+        } else if (!ENABLE_STACKLESS_GENERATORS) {
+            initGeneratorStack(self);
+        }
+        // Otherwise the generator is stackless: astInterpretGeneratorResume() runs it on our stack, and it returns
+        // back out at each yield, which saves us from having to set up a stack and switch to it on every resume.
+    }
+
+    self->returnValue = v;
+    self->running = true;
+
+    if (self->entryExited) {
+        // exited without starting
+    } else if (!self->context) {
+        try {
+            if (!astInterpretGeneratorResume(self))
+                self->entryExited = true;
+        } catch (ExcInfo e) {
+            self->exception = e;
+            self->entryExited = true;
+        }
+    } else {
+        switchToGenerator(self);
+    }
 
     self->running = false;
 
     // propagate exception to the caller
     if (self->exception.type) {
         assert(self->entryExited);
-        freeGeneratorStack(self);
+        freeGeneratorFrame(self);
         // don't raise StopIteration exceptions because those are handled specially.
         if (!self->exception.matches(StopIteration))
             raiseRaw(self->exception);
@@ -160,7 +254,7 @@ static void generatorSendInternal(BoxedGenerator* self, Box* v) {
     }
 
     if (self->entryExited) {
-        freeGeneratorStack(self);
+        freeGeneratorFrame(self);
         self->exception = excInfoForRaise(StopIteration, None, None);
         return;
     }
@@ -256,6 +350,12 @@ Box* generatorHasnext(Box* s) {
 extern "C" Box* yield(BoxedGenerator* obj, Box* value) {
     assert(obj->cls == generator_cls);
     BoxedGenerator* self = static_cast<BoxedGenerator*>(obj);
+
+    // A stackless generator has no stack to switch away from.  Tell the compiled code to save its frame and return
+    // instead; see astInterpretGeneratorSuspend().
+    if (!self->context)
+        return NULL;
+
     self->returnValue = value;
 
     threading::popGenerator();
@@ -292,7 +392,9 @@ extern "C" BoxedGenerator::BoxedGenerator(BoxedFunctionBase* function, Box* arg1
       returnValue(nullptr),
       exception(nullptr, nullptr, nullptr),
       context(nullptr),
-      returnContext(nullptr)
+      returnContext(nullptr),
+      stack_begin(nullptr),
+      interpreter_frame(nullptr)
 #if STAT_TIMERS
       ,
       prev_stack(NULL),
@@ -306,66 +408,6 @@ extern "C" BoxedGenerator::BoxedGenerator(BoxedFunctionBase* function, Box* arg1
         this->args = new (numArgs) GCdArray();
         memcpy(&this->args->elts[0], args, numArgs * sizeof(Box*));
     }
-
-    static StatCounter generator_stack_reused("generator_stack_reused");
-    static StatCounter generator_stack_created("generator_stack_created");
-
-    void* initial_stack_limit;
-    if (available_addrs.size() == 0) {
-        generator_stack_created.log();
-
-        uint64_t stack_low = next_stack_addr;
-        uint64_t stack_high = stack_low + MAX_STACK_SIZE;
-        next_stack_addr = stack_high;
-
-#if STACK_GROWS_DOWN
-        this->stack_begin = (void*)stack_high;
-
-        initial_stack_limit = (void*)(stack_high - INITIAL_STACK_SIZE);
-        void* p = mmap(initial_stack_limit, INITIAL_STACK_SIZE, PROT_READ | PROT_WRITE,
-                       MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS | MAP_GROWSDOWN, -1, 0);
-        ASSERT(p == initial_stack_limit, "%p %s", p, strerror(errno));
-
-        // Create an inaccessible redzone so that the generator stack won't grow indefinitely.
-        // Looks like it throws a SIGBUS if we reach the redzone; it's unclear if that's better
-        // or worse than being able to consume all available memory.
-        void* p2
-            = mmap((void*)stack_low, STACK_REDZONE_SIZE, PROT_NONE, MAP_PRIVATE | MAP_FIXED | MAP_ANONYMOUS, -1, 0);
-        assert(p2 == (void*)stack_low);
-        // Interestingly, it seems like MAP_GROWSDOWN will leave a page-size gap between the redzone and the growable
-        // region.
-
-        if (VERBOSITY() >= 1) {
-            printf("Created new generator stack, starts at %p, currently extends to %p\n", (void*)stack_high,
-                   initial_stack_limit);
-            printf("Created a redzone from %p-%p\n", (void*)stack_low, (void*)(stack_low + STACK_REDZONE_SIZE));
-        }
-#else
-#error "implement me"
-#endif
-
-        // we're registering memory that isn't in the gc heap here,
-        // which may sound wrong.  Generators, however, can represent
-        // a larger tax on system resources than just their GC
-        // allocation, so we try to encode that here as additional gc
-        // heap pressure.
-        gc::registerGCManagedBytes(INITIAL_STACK_SIZE);
-    } else {
-        generator_stack_reused.log();
-
-#if STACK_GROWS_DOWN
-        uint64_t stack_high = available_addrs.back();
-        this->stack_begin = (void*)stack_high;
-        initial_stack_limit = (void*)(stack_high - INITIAL_STACK_SIZE);
-        available_addrs.pop_back();
-#else
-#error "implement me"
-#endif
-    }
-
-    assert(((intptr_t)stack_begin & (~(intptr_t)(0xF))) == (intptr_t)stack_begin && "stack must be aligned");
-
-    context = makeContext(stack_begin, (void (*)(intptr_t))generatorEntry);
 }
 
 extern "C" void generatorGCHandler(GCVisitor* v, Box* b) {
@@ -394,6 +436,8 @@ extern "C" void generatorGCHandler(GCVisitor* v, Box* b) {
         v->visit(g->exception.value);
     if (g->exception.traceback)
         v->visit(g->exception.traceback);
+    if (g->interpreter_frame)
+        visitGeneratorInterpreterFrame(v, g);
 
     if (g->running) {
         v->visitPotentialRange((void**)&g->returnContext,
@@ -403,7 +447,7 @@ extern "C" void generatorGCHandler(GCVisitor* v, Box* b) {
         // a generator in which case we can see a NULL context
         if (g->context) {
 #if STACK_GROWS_DOWN
-            v->visitPotentialRange((void**)g->context, (void**)g->stack_begin);
+            v->visitPotentialStackRange((void**)g->context, (void**)g->stack_begin);
 #endif
         }
     }
@@ -419,7 +463,7 @@ Box* generatorName(Box* _self, void* context) {
 void generatorDestructor(Box* b) {
     assert(isSubclass(b->cls, generator_cls));
     BoxedGenerator* self = static_cast<BoxedGenerator*>(b);
-    freeGeneratorStack(self);
+    freeGeneratorFrame(self);
 }
 
 void setupGenerator() {
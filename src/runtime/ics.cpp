@@ -16,9 +16,11 @@
 
 #include "asm_writing/icinfo.h"
 #include "asm_writing/rewriter.h"
+#include "codegen/codegen.h"
 #include "codegen/compvars.h"
 #include "codegen/memmgr.h"
 #include "codegen/patchpoints.h"
+#include "codegen/profiling/perf_jit.h"
 #include "codegen/stackmaps.h"
 #include "codegen/unwinding.h" // registerDynamicEhFrame
 #include "core/common.h"
@@ -164,6 +166,7 @@ static void writeTrivialEhFrame(void* eh_frame_addr, void* func_addr, uint64_t f
 void EHFrameManager::writeAndRegister(void* func_addr, uint64_t func_size) {
     assert(eh_frame_addr == NULL);
     eh_frame_addr = malloc(EH_FRAME_SIZE);
+    this->func_addr = func_addr;
     writeTrivialEhFrame(eh_frame_addr, func_addr, func_size);
     // (EH_FRAME_SIZE - 4) to omit the 4-byte null terminator, otherwise we trip an assert in parseEhFrame.
     // TODO: can we omit the terminator in general?
@@ -173,6 +176,7 @@ void EHFrameManager::writeAndRegister(void* func_addr, uint64_t func_size) {
 
 EHFrameManager::~EHFrameManager() {
     if (eh_frame_addr) {
+        deregisterDynamicEhFrame((uint64_t)func_addr);
         deregisterEHFrames((uint8_t*)eh_frame_addr, (uint64_t)eh_frame_addr, EH_FRAME_SIZE);
         free(eh_frame_addr);
     }
@@ -277,6 +281,10 @@ RuntimeIC::RuntimeIC(void* func_addr, int num_slots, int slot_size) {
         // TODO: ideally would be more intelligent about allocation strategies.
         // The code sections should be together and the eh sections together
         eh_frame.writeAndRegister(addr, total_size);
+
+        if (isPerfJitEnabled())
+            registerPerfJitCode(g.func_addr_registry.getFuncNameAtAddress(func_addr, true) + " runtime IC", addr,
+                                total_size);
     } else {
         addr = func_addr;
     }
@@ -285,6 +293,7 @@ RuntimeIC::RuntimeIC(void* func_addr, int num_slots, int slot_size) {
 RuntimeIC::~RuntimeIC() {
     if (ENABLE_RUNTIME_ICS) {
         deregisterCompiledPatchpoint(icinfo.get());
+        deregisterPerfJitCode(addr);
         free(addr);
     } else {
     }
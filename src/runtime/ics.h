@@ -25,9 +25,10 @@ class ICInfo;
 class EHFrameManager {
 private:
     void* eh_frame_addr;
+    void* func_addr;
 
 public:
-    EHFrameManager() : eh_frame_addr(NULL) {}
+    EHFrameManager() : eh_frame_addr(NULL), func_addr(NULL) {}
     ~EHFrameManager();
     void writeAndRegister(void* func_addr, uint64_t func_size);
 };
@@ -50,6 +50,7 @@ Box* createAndRunModule(const std::string& name, const std::string& fn) {
         removeModule(name);
         raiseRaw(e);
     }
+    addCFGsToParseCache(fn.c_str(), ast);
 
     Box* r = getSysModulesDict()->getOrNull(boxString(name));
     if (!r)
@@ -75,6 +76,7 @@ static Box* createAndRunModule(const std::string& name, const std::string& fn, c
         removeModule(name);
         raiseRaw(e);
     }
+    addCFGsToParseCache(fn.c_str(), ast);
 
     Box* r = getSysModulesDict()->getOrNull(boxString(name));
     if (!r)
@@ -188,7 +190,7 @@ SearchResult findModule(const std::string& name, const std::string& full_name, B
 
     const static std::string find_module_str("find_module");
     for (int i = 0; i < meta_path->size; i++) {
-        Box* finder = meta_path->elts->elts[i];
+        Box* finder = meta_path->getElt(i);
 
         auto path_pass = path_list ? path_list : None;
         Box* loader
@@ -216,7 +218,7 @@ SearchResult findModule(const std::string& name, const std::string& full_name, B
 
     llvm::SmallString<128> joined_path;
     for (int i = 0; i < path_list->size; i++) {
-        Box* _p = path_list->elts->elts[i];
+        Box* _p = path_list->getElt(i);
         if (_p->cls != str_cls)
             continue;
         BoxedString* p = static_cast<BoxedString*>(_p);
@@ -20,7 +20,7 @@
 namespace pyston {
 
 BoxedDictIterator::BoxedDictIterator(BoxedDict* d, IteratorType type)
-    : d(d), it(d->d.begin()), itEnd(d->d.end()), type(type) {
+    : d(d), it(d->d.begin()), size(d->d.size()), type(type) {
 }
 
 Box* dictIterKeys(Box* s) {
@@ -49,7 +49,13 @@ i1 dictIterHasnextUnboxed(Box* s) {
     assert(s->cls == dict_iterator_cls);
     BoxedDictIterator* self = static_cast<BoxedDictIterator*>(s);
 
-    return self->it != self->itEnd;
+    // Let next() raise the error:
+    if (self->size != (int64_t)self->d->d.size())
+        return true;
+
+    // The entry we were going to return next might have been erased since:
+    self->it = self->d->d.iteratorAt(self->it.position());
+    return self->it != self->d->d.end();
 }
 
 Box* dictIterHasnext(Box* s) {
@@ -60,7 +66,13 @@ Box* dictIterNext(Box* s) {
     assert(s->cls == dict_iterator_cls);
     BoxedDictIterator* self = static_cast<BoxedDictIterator*>(s);
 
-    if (self->it == self->itEnd)
+    if (self->size != (int64_t)self->d->d.size()) {
+        self->size = -1; // keep failing, like CPython
+        raiseExcHelper(RuntimeError, "dictionary changed size during iteration");
+    }
+
+    self->it = self->d->d.iteratorAt(self->it.position());
+    if (self->it == self->d->d.end())
         raiseExcHelper(StopIteration, "");
 
     Box* rtn = nullptr;
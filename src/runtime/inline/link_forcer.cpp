@@ -77,6 +77,8 @@ void force() {
     FORCE(augbinop);
     FORCE(unboxedLen);
     FORCE(getitem);
+    FORCE(getattrCAPI);
+    FORCE(getitemCAPI);
     FORCE(getclsattr);
     FORCE(getGlobal);
     FORCE(delGlobal);
@@ -107,11 +109,17 @@ void force() {
     FORCE(listAppendInternal);
     FORCE(getSysStdout);
 
+    FORCE(listGetitemUnboxed);
+    FORCE(listSetitemUnboxed);
+    FORCE(listSetitemUnboxedInt);
+    FORCE(listSetitemUnboxedFloat);
+
     FORCE(runtimeCall);
     FORCE(callattr);
 
     FORCE(raise0);
     FORCE(raise3);
+    FORCE(catchCAPIException);
     FORCE(deopt);
 
     FORCE(div_i64_i64);
@@ -15,6 +15,7 @@
 
 #include <cstring>
 
+#include "core/options.h"
 #include "runtime/list.h"
 #include "runtime/objmodel.h"
 
@@ -55,7 +56,7 @@ Box* listiterNext(Box* s) {
         raiseExcHelper(StopIteration, "");
     }
 
-    Box* rtn = self->l->elts->elts[self->pos];
+    Box* rtn = self->l->getElt(self->pos);
     self->pos++;
     return rtn;
 }
@@ -89,7 +90,7 @@ Box* listreviterNext(Box* s) {
         raiseExcHelper(StopIteration, "");
     }
 
-    Box* rtn = self->l->elts->elts[self->pos];
+    Box* rtn = self->l->getElt(self->pos);
     self->pos--;
     return rtn;
 }
@@ -128,6 +129,17 @@ void BoxedList::ensure(int space) {
     assert(capacity >= size + space);
 }
 
+void BoxedList::pickStrategyFor(Box* v) {
+    assert(size == 0);
+
+    if (ENABLE_LIST_STRATEGIES && v->cls == int_cls)
+        strategy = ListStrategy::INTS;
+    else if (ENABLE_LIST_STRATEGIES && v->cls == float_cls && isUnboxableFloat(static_cast<BoxedFloat*>(v)->d))
+        strategy = ListStrategy::FLOATS;
+    else
+        strategy = ListStrategy::OBJECTS;
+}
+
 // TODO the inliner doesn't want to inline these; is there any point to having them in the inline section?
 extern "C" void listAppendInternal(Box* s, Box* v) {
     // Lock must be held!
@@ -139,7 +151,9 @@ extern "C" void listAppendInternal(Box* s, Box* v) {
     self->ensure(1);
 
     assert(self->size < self->capacity);
-    self->elts->elts[self->size] = v;
+    if (self->size == 0)
+        self->pickStrategyFor(v);
+    self->setElt(self->size, v);
     self->size++;
 }
 
@@ -154,7 +168,7 @@ extern "C" void listAppendArrayInternal(Box* s, Box** v, int nelts) {
     self->ensure(nelts);
 
     assert(self->size <= self->capacity);
-    memcpy(&self->elts->elts[self->size], &v[0], nelts * sizeof(Box*));
+    memcpy(&self->objectElts()[self->size], &v[0], nelts * sizeof(Box*));
 
     self->size += nelts;
 }
@@ -170,4 +184,66 @@ extern "C" Box* listAppend(Box* s, Box* v) {
 
     return None;
 }
+
+// The element accessors take the index unboxed, and the JIT calls them directly when it knows that it's
+// subscripting an exact list.
+extern "C" Box* listGetitemUnboxed(Box* s, int64_t n) {
+    assert(isSubclass(s->cls, list_cls));
+    BoxedList* self = static_cast<BoxedList*>(s);
+
+    LOCK_REGION(self->lock.asRead());
+
+    if (n < 0)
+        n = self->size + n;
+
+    if (n < 0 || n >= self->size) {
+        raiseExcHelper(IndexError, "list index out of range");
+    }
+    return self->getElt(n);
+}
+
+// Wraps a negative index around, and raises an IndexError if it's still out of range.
+static void checkSetitemIndex(BoxedList* self, int64_t* n) {
+    assert(isSubclass(self->cls, list_cls));
+
+    if (*n < 0)
+        *n = self->size + *n;
+
+    if (*n < 0 || *n >= self->size) {
+        raiseExcHelper(IndexError, "list assignment index out of range");
+    }
+}
+
+extern "C" Box* listSetitemUnboxed(Box* s, int64_t n, Box* v) {
+    BoxedList* self = static_cast<BoxedList*>(s);
+    // Storing can generalize the list, which rewrites every slot:
+    LOCK_REGION(self->lock.asWrite());
+
+    checkSetitemIndex(self, &n);
+    self->setElt(n, v);
+    return None;
+}
+
+// These store an unboxed value, which only has to be boxed if the list doesn't have the matching strategy:
+extern "C" void listSetitemUnboxedInt(Box* s, int64_t n, int64_t v) {
+    BoxedList* self = static_cast<BoxedList*>(s);
+    LOCK_REGION(self->lock.asWrite());
+
+    checkSetitemIndex(self, &n);
+    if (self->strategy == ListStrategy::INTS)
+        self->intElts()[n] = v;
+    else
+        self->setElt(n, boxInt(v));
+}
+
+extern "C" void listSetitemUnboxedFloat(Box* s, int64_t n, double v) {
+    BoxedList* self = static_cast<BoxedList*>(s);
+    LOCK_REGION(self->lock.asWrite());
+
+    checkSetitemIndex(self, &n);
+    if (self->strategy == ListStrategy::FLOATS && BoxedList::isUnboxableFloat(v))
+        self->floatElts()[n] = v;
+    else
+        self->setElt(n, boxFloat(v));
+}
 }
@@ -78,7 +78,7 @@ private:
     uint64_t index;
 
     static bool hasnext(BoxedList* o, uint64_t i) { return i < o->size; }
-    static Box* getValue(BoxedList* o, uint64_t i) { return o->elts->elts[i]; }
+    static Box* getValue(BoxedList* o, uint64_t i) { return o->getElt(i); }
 
     static bool hasnext(BoxedTuple* o, uint64_t i) { return i < o->size(); }
     static Box* getValue(BoxedTuple* o, uint64_t i) { return o->elts[i]; }
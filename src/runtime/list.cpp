@@ -15,6 +15,7 @@
 #include "runtime/list.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstring>
 
 #include "llvm/Support/raw_ostream.h"
@@ -32,6 +33,25 @@
 
 namespace pyston {
 
+void BoxedList::generalize() {
+    assert(strategy != ListStrategy::OBJECTS);
+
+    static StatCounter num_list_generalizations("num_list_generalizations");
+    num_list_generalizations.log();
+
+    // Boxing the elements can trigger a collection, and the GC doesn't look inside unboxed storage, so box
+    // everything on the side and only switch the list over once we're done:
+    BoxedTuple::GCVector boxed;
+    boxed.reserve(size);
+    for (int64_t i = 0; i < size; i++) {
+        boxed.push_back(getElt(i));
+    }
+
+    strategy = ListStrategy::OBJECTS;
+    if (size)
+        memcpy(&elts->elts[0], &boxed[0], size * sizeof(Box*));
+}
+
 extern "C" int PyList_Append(PyObject* op, PyObject* newitem) noexcept {
     try {
         listAppend(op, newitem);
@@ -44,7 +64,7 @@ extern "C" int PyList_Append(PyObject* op, PyObject* newitem) noexcept {
 extern "C" PyObject** PyList_Items(PyObject* op) noexcept {
     RELEASE_ASSERT(PyList_Check(op), "");
 
-    return &static_cast<BoxedList*>(op)->elts->elts[0];
+    return static_cast<BoxedList*>(op)->objectElts();
 }
 
 extern "C" PyObject* PyList_AsTuple(PyObject* v) noexcept {
@@ -57,7 +77,7 @@ extern "C" PyObject* PyList_AsTuple(PyObject* v) noexcept {
     }
 
     auto l = static_cast<BoxedList*>(v);
-    return BoxedTuple::create(l->size, &l->elts->elts[0]);
+    return BoxedTuple::create(l->size, l->objectElts());
 }
 
 extern "C" Box* listRepr(BoxedList* self) {
@@ -72,7 +92,7 @@ extern "C" Box* listRepr(BoxedList* self) {
         if (i > 0)
             os << ", ";
 
-        Box* r = self->elts->elts[i]->reprICAsString();
+        Box* r = self->getElt(i)->reprICAsString();
 
         assert(r->cls == str_cls);
         BoxedString* s = static_cast<BoxedString*>(r);
@@ -94,8 +114,8 @@ extern "C" Box* listPop(BoxedList* self, Box* idx) {
             raiseExcHelper(IndexError, "pop from empty list");
         }
 
+        Box* rtn = self->getElt(self->size - 1);
         self->size--;
-        Box* rtn = self->elts->elts[self->size];
         return rtn;
     }
 
@@ -114,7 +134,7 @@ extern "C" Box* listPop(BoxedList* self, Box* idx) {
         raiseExcHelper(IndexError, "");
     }
 
-    Box* rtn = self->elts->elts[n];
+    Box* rtn = self->getElt(n);
     memmove(self->elts->elts + n, self->elts->elts + n + 1, (self->size - n - 1) * sizeof(Box*));
     self->size--;
 
@@ -145,26 +165,14 @@ Box* _listSlice(BoxedList* self, i64 start, i64 stop, i64 step, i64 length) {
     BoxedList* rtn = new BoxedList();
     if (length > 0) {
         rtn->ensure(length);
+        // Copying the raw slots keeps any unboxed storage:
+        rtn->strategy = self->strategy;
         copySlice(&rtn->elts->elts[0], &self->elts->elts[0], start, step, length);
         rtn->size += length;
     }
     return rtn;
 }
 
-extern "C" Box* listGetitemUnboxed(BoxedList* self, int64_t n) {
-    LOCK_REGION(self->lock.asRead());
-
-    assert(isSubclass(self->cls, list_cls));
-    if (n < 0)
-        n = self->size + n;
-
-    if (n < 0 || n >= self->size) {
-        raiseExcHelper(IndexError, "list index out of range");
-    }
-    Box* rtn = self->elts->elts[n];
-    return rtn;
-}
-
 extern "C" Box* listGetitemInt(BoxedList* self, BoxedInt* slice) {
     assert(isSubclass(slice->cls, int_cls));
     return listGetitemUnboxed(self, slice->n);
@@ -173,8 +181,11 @@ extern "C" Box* listGetitemInt(BoxedList* self, BoxedInt* slice) {
 extern "C" PyObject* PyList_GetItem(PyObject* op, Py_ssize_t i) noexcept {
     RELEASE_ASSERT(PyList_Check(op), "");
     RELEASE_ASSERT(i >= 0, ""); // unlike list.__getitem__, PyList_GetItem doesn't do index wrapping
+    BoxedList* self = static_cast<BoxedList*>(op);
+    // The result is a borrowed reference, so it has to be the object that the list holds rather than a fresh box:
+    self->objectElts();
     try {
-        return listGetitemUnboxed(static_cast<BoxedList*>(op), i);
+        return listGetitemUnboxed(self, i);
     } catch (ExcInfo e) {
         abort();
     }
@@ -204,25 +215,6 @@ extern "C" Box* listGetitem(BoxedList* self, Box* slice) {
     }
 }
 
-static void _listSetitem(BoxedList* self, int64_t n, Box* v) {
-    if (n < 0)
-        n = self->size + n;
-
-    if (n < 0 || n >= self->size) {
-        raiseExcHelper(IndexError, "list index out of range");
-    }
-
-    self->elts->elts[n] = v;
-}
-
-extern "C" Box* listSetitemUnboxed(BoxedList* self, int64_t n, Box* v) {
-    // I think r lock is ok here, since we don't change the list structure:
-    LOCK_REGION(self->lock.asRead());
-    assert(isSubclass(self->cls, list_cls));
-    _listSetitem(self, n, v);
-    return None;
-}
-
 extern "C" Box* listSetitemInt(BoxedList* self, BoxedInt* slice, Box* v) {
     assert(isSubclass(slice->cls, int_cls));
     return listSetitemUnboxed(self, slice->n, v);
@@ -361,7 +353,7 @@ int list_ass_ext_slice(BoxedList* self, PyObject* item, PyObject* value) {
             return -1;
         }
 
-        selfitems = self->elts->elts;
+        selfitems = self->objectElts();
         seqitems = PySequence_Fast_ITEMS(seq);
         for (cur = start, i = 0; i < slicelength; cur += step, i++) {
             garbage[i] = selfitems[cur];
@@ -451,10 +443,16 @@ extern "C" Box* listSetitemSlice(BoxedList* self, BoxedSlice* slice, Box* v) {
     int remaining_elts = self->size - stop;
     self->ensure(delts);
 
+    // The list is in an inconsistent state while we move things around, so make sure that none of the stores
+    // will need to generalize it:
+    for (int i = 0; i < v_size && self->strategy != ListStrategy::OBJECTS; i++) {
+        if (!self->canStore(v_elts[i]))
+            self->generalize();
+    }
+
     memmove(self->elts->elts + start + v_size, self->elts->elts + stop, remaining_elts * sizeof(Box*));
     for (int i = 0; i < v_size; i++) {
-        Box* r = v_elts[i];
-        self->elts->elts[start + i] = r;
+        self->setElt(start + i, v_elts[i]);
     }
 
     self->size += delts;
@@ -536,7 +534,7 @@ extern "C" Box* listInsert(BoxedList* self, Box* idx, Box* v) {
         memmove(self->elts->elts + n + 1, self->elts->elts + n, (self->size - n) * sizeof(Box*));
 
         self->size++;
-        self->elts->elts[n] = v;
+        self->setElt(n, v);
     }
 
     return None;
@@ -573,33 +571,56 @@ Box* listMul(BoxedList* self, Box* rhs) {
     int s = self->size;
 
     BoxedList* rtn = new BoxedList();
+    if (n <= 0 || s == 0)
+        return rtn;
+
+    // Copy the raw slots, so that the new list keeps any unboxed storage; this is how most numeric
+    // arrays get created (ex [0.0] * n).
     rtn->ensure(n * s);
+    rtn->strategy = self->strategy;
     if (s == 1) {
+        Box* e = self->elts->elts[0];
         for (int i = 0; i < n; i++) {
-            listAppendInternal(rtn, self->elts->elts[0]);
+            rtn->elts->elts[i] = e;
         }
     } else {
         for (int i = 0; i < n; i++) {
-            listAppendArrayInternal(rtn, &self->elts->elts[0], s);
+            memcpy(&rtn->elts->elts[i * s], &self->elts->elts[0], s * sizeof(Box*));
         }
     }
+    rtn->size = n * s;
 
     return rtn;
 }
 
-Box* listIAdd(BoxedList* self, Box* _rhs) {
-    LOCK_REGION(self->lock.asWrite());
-
-    if (_rhs->cls == list_cls) {
-        // This branch is safe if self==rhs:
-        BoxedList* rhs = static_cast<BoxedList*>(_rhs);
+// Appends the contents of rhs to self, copying the raw slots if the two lists use the same strategy.
+// Safe if self==rhs.
+static void listExtendInternal(BoxedList* self, BoxedList* rhs) {
+    int s1 = self->size;
+    int s2 = rhs->size;
+    if (s2 == 0)
+        return;
 
-        int s1 = self->size;
-        int s2 = rhs->size;
-        self->ensure(s1 + s2);
+    self->ensure(s2);
+    if (s1 == 0)
+        self->strategy = rhs->strategy;
 
+    if (self->strategy == rhs->strategy) {
         memcpy(self->elts->elts + s1, rhs->elts->elts, sizeof(rhs->elts->elts[0]) * s2);
         self->size = s1 + s2;
+        return;
+    }
+
+    for (int i = 0; i < s2; i++) {
+        listAppendInternal(self, rhs->getElt(i));
+    }
+}
+
+Box* listIAdd(BoxedList* self, Box* _rhs) {
+    LOCK_REGION(self->lock.asWrite());
+
+    if (_rhs->cls == list_cls) {
+        listExtendInternal(self, static_cast<BoxedList*>(_rhs));
         return self;
     }
 
@@ -621,14 +642,9 @@ Box* listAdd(BoxedList* self, Box* _rhs) {
     BoxedList* rhs = static_cast<BoxedList*>(_rhs);
 
     BoxedList* rtn = new BoxedList();
-
-    int s1 = self->size;
-    int s2 = rhs->size;
-    rtn->ensure(s1 + s2);
-
-    memcpy(rtn->elts->elts, self->elts->elts, sizeof(self->elts->elts[0]) * s1);
-    memcpy(rtn->elts->elts + s1, rhs->elts->elts, sizeof(rhs->elts->elts[0]) * s2);
-    rtn->size = s1 + s2;
+    rtn->ensure(self->size + rhs->size);
+    listExtendInternal(rtn, self);
+    listExtendInternal(rtn, rhs);
     return rtn;
 }
 
@@ -636,6 +652,7 @@ Box* listReverse(BoxedList* self) {
     LOCK_REGION(self->lock.asWrite());
 
     assert(isSubclass(self->cls, list_cls));
+    // This just swaps slots around, so it works for any strategy:
     for (int i = 0, j = self->size - 1; i < j; i++, j--) {
         Box* e = self->elts->elts[i];
         self->elts->elts[i] = self->elts->elts[j];
@@ -674,6 +691,23 @@ public:
     }
 };
 
+// Sorts an unboxed list in place without boxing anything, which gives the same order as comparing the boxed
+// elements would.  Returns false if the list has to be sorted the normal way.
+static bool sortUnboxed(BoxedList* self) {
+    if (self->strategy == ListStrategy::INTS) {
+        std::stable_sort(self->intElts(), self->intElts() + self->size);
+        return true;
+    }
+
+    // NaNs, which don't give std::stable_sort a consistent ordering, never get stored unboxed:
+    if (self->strategy == ListStrategy::FLOATS) {
+        std::stable_sort(self->floatElts(), self->floatElts() + self->size);
+        return true;
+    }
+
+    return false;
+}
+
 void listSort(BoxedList* self, Box* cmp, Box* key, Box* reverse) {
     LOCK_REGION(self->lock.asWrite());
     assert(isSubclass(self->cls, list_cls));
@@ -691,6 +725,16 @@ void listSort(BoxedList* self, Box* cmp, Box* key, Box* reverse) {
     // the current list being sorted.
     // I also don't know if std::stable_sort is exception-safe.
 
+    if (!cmp && !key && sortUnboxed(self)) {
+        if (nonzero(reverse))
+            listReverse(self);
+        return;
+    }
+
+    // Both the comparison functions and the key wrappers (which get stored into the list itself) need
+    // boxed elements:
+    self->objectElts();
+
     if (cmp) {
         std::stable_sort<Box**, PyCmpComparer>(self->elts->elts, self->elts->elts + self->size, PyCmpComparer(cmp));
     } else {
@@ -776,8 +820,14 @@ Box* listContains(BoxedList* self, Box* elt) {
     LOCK_REGION(self->lock.asRead());
 
     int size = self->size;
+    if (self->strategy == ListStrategy::INTS && elt->cls == int_cls) {
+        int64_t n = static_cast<BoxedInt*>(elt)->n;
+        int64_t* elts = self->intElts();
+        return boxBool(std::find(elts, elts + size, n) != elts + size);
+    }
+
     for (int i = 0; i < size; i++) {
-        Box* e = self->elts->elts[i];
+        Box* e = self->getElt(i);
 
         bool identity_eq = e == elt;
         if (identity_eq)
@@ -798,7 +848,7 @@ Box* listCount(BoxedList* self, Box* elt) {
     int count = 0;
 
     for (int i = 0; i < size; i++) {
-        Box* e = self->elts->elts[i];
+        Box* e = self->getElt(i);
         Box* cmp = compareInternal(e, elt, AST_TYPE::Eq, NULL);
         bool b = nonzero(cmp);
         if (b)
@@ -827,10 +877,12 @@ Box* listIndex(BoxedList* self, Box* elt, BoxedInt* _start, Box** args) {
         stop += self->size;
         if (stop < 0)
             stop = 0;
+    } else if (stop > self->size) {
+        stop = self->size;
     }
 
     for (int64_t i = start; i < stop; i++) {
-        Box* e = self->elts->elts[i];
+        Box* e = self->getElt(i);
         Box* cmp = compareInternal(e, elt, AST_TYPE::Eq, NULL);
         bool b = nonzero(cmp);
         if (b)
@@ -847,7 +899,7 @@ Box* listRemove(BoxedList* self, Box* elt) {
     assert(isSubclass(self->cls, list_cls));
 
     for (int i = 0; i < self->size; i++) {
-        Box* e = self->elts->elts[i];
+        Box* e = self->getElt(i);
         Box* cmp = compareInternal(e, elt, AST_TYPE::Eq, NULL);
         bool b = nonzero(cmp);
 
@@ -925,11 +977,14 @@ Box* _listCmp(BoxedList* lhs, BoxedList* rhs, AST_TYPE::AST_TYPE op_type) {
 
     int n = std::min(lsz, rsz);
     for (int i = 0; i < n; i++) {
-        bool identity_eq = lhs->elts->elts[i] == rhs->elts->elts[i];
+        Box* lhs_elt = lhs->getElt(i);
+        Box* rhs_elt = rhs->getElt(i);
+
+        bool identity_eq = lhs_elt == rhs_elt;
         if (identity_eq)
             continue;
 
-        Box* is_eq = compareInternal(lhs->elts->elts[i], rhs->elts->elts[i], AST_TYPE::Eq, NULL);
+        Box* is_eq = compareInternal(lhs_elt, rhs_elt, AST_TYPE::Eq, NULL);
         bool bis_eq = nonzero(is_eq);
 
         if (bis_eq)
@@ -940,7 +995,7 @@ Box* _listCmp(BoxedList* lhs, BoxedList* rhs, AST_TYPE::AST_TYPE op_type) {
         } else if (op_type == AST_TYPE::NotEq) {
             return boxBool(true);
         } else {
-            Box* r = compareInternal(lhs->elts->elts[i], rhs->elts->elts[i], op_type, NULL);
+            Box* r = compareInternal(lhs_elt, rhs_elt, op_type, NULL);
             return r;
         }
     }
@@ -42,6 +42,10 @@ i1 listreviterHasnextUnboxed(Box* self);
 Box* listreviterNext(Box* self);
 void listSort(BoxedList* self, Box* cmp, Box* key, Box* reverse);
 extern "C" Box* listAppend(Box* self, Box* v);
+extern "C" Box* listGetitemUnboxed(Box* self, int64_t n);
+extern "C" Box* listSetitemUnboxed(Box* self, int64_t n, Box* v);
+extern "C" void listSetitemUnboxedInt(Box* self, int64_t n, int64_t v);
+extern "C" void listSetitemUnboxedFloat(Box* self, int64_t n, double v);
 }
 
 #endif
@@ -132,11 +132,8 @@ size_t PyHasher::operator()(Box* b) const {
 #if EXPENSIVE_STAT_TIMERS
     ScopedStatTimer _st(pyhasher_timer_counter);
 #endif
-    if (b->cls == str_cls) {
-        StringHash<char> H;
-        auto s = static_cast<BoxedString*>(b);
-        return H(s->data(), s->size());
-    }
+    if (b->cls == str_cls)
+        return strHashUnboxed(static_cast<BoxedString*>(b));
 
     return hashUnboxed(b);
 }
@@ -292,7 +289,15 @@ extern "C" Box** unpackIntoArray(Box* obj, int64_t expected_size) {
     if (obj->cls == list_cls) {
         BoxedList* l = static_cast<BoxedList*>(obj);
         _checkUnpackingLength(expected_size, l->size);
-        return &l->elts->elts[0];
+        if (l->strategy == ListStrategy::OBJECTS)
+            return &l->elts->elts[0];
+
+        // Box the elements on the side rather than generalizing the list just for this:
+        BoxedTuple* t = BoxedTuple::create(l->size);
+        for (int64_t i = 0; i < l->size; i++) {
+            t->elts[i] = l->getElt(i);
+        }
+        return &t->elts[0];
     }
 
     BoxedTuple::GCVector elts;
@@ -336,6 +341,7 @@ BoxedClass::BoxedClass(BoxedClass* base, gcvisit_func gc_visit, int attrs_offset
     tp_weaklistoffset = weaklist_offset;
 
     tp_flags |= Py_TPFLAGS_DEFAULT_EXTERNAL;
+    tp_flags |= Py_TPFLAGS_HAVE_VERSION_TAG;
     tp_flags |= Py_TPFLAGS_CHECKTYPES;
     tp_flags |= Py_TPFLAGS_BASETYPE;
     tp_flags |= Py_TPFLAGS_HAVE_GC;
@@ -427,6 +433,8 @@ BoxedHeapClass::BoxedHeapClass(BoxedClass* base, gcvisit_func gc_visit, int attr
     memset(&as_mapping, 0, sizeof(as_mapping));
     memset(&as_sequence, 0, sizeof(as_sequence));
     memset(&as_buffer, 0, sizeof(as_buffer));
+
+    gc::registerHeapClass(this);
 }
 
 BoxedHeapClass* BoxedHeapClass::create(BoxedClass* metaclass, BoxedClass* base, gcvisit_func gc_visit, int attrs_offset,
@@ -840,6 +848,14 @@ void Box::setattr(llvm::StringRef attr, Box* val, SetattrRewriteArgs* rewrite_ar
             }
         }
 
+        // Lookups on types are cached (see typeLookup), so changing a type's attributes has to invalidate them,
+        // including from the rewritten version of this function:
+        if (hcls->type == HiddenClass::SINGLETON && PyType_Check(this)) {
+            PyType_Modified(static_cast<BoxedClass*>(this));
+            if (rewrite_args)
+                rewrite_args->rewriter->call(false, (void*)PyType_Modified, rewrite_args->obj);
+        }
+
         if (offset >= 0) {
             assert(offset < hcls->attributeArraySize());
             Box* prev = attrs->attr_list->attrs[offset];
@@ -915,6 +931,67 @@ extern "C" PyObject* _PyType_Lookup(PyTypeObject* type, PyObject* name) noexcept
     }
 }
 
+// A global cache of type attribute lookups, like CPython's method cache.  Entries are keyed on the type's version
+// tag and the attribute name, and also remember negative results.  Call sites that we don't rewrite -- in particular
+// megamorphic ones, which we give up on rewriting -- go through here instead of walking the mro and doing a hash
+// lookup in each base.
+// A type gets a version tag the first time it is looked up, and PyType_Modified() takes it away (from the type and all
+// of its subclasses) whenever the attributes or the mro change.
+#define MCACHE_SIZE_EXP 12
+#define MCACHE_MAX_ATTR_SIZE 39
+
+struct MethodCacheEntry {
+    unsigned int version;
+    unsigned int attr_size;
+    Box* value;
+    char attr[MCACHE_MAX_ATTR_SIZE + 1];
+};
+static MethodCacheEntry method_cache[1 << MCACHE_SIZE_EXP];
+static unsigned int next_version_tag = 1;
+
+static bool assignVersionTag(BoxedClass* cls) {
+    if (PyType_HasFeature(cls, Py_TPFLAGS_VALID_VERSION_TAG))
+        return true;
+    if (!PyType_HasFeature(cls, Py_TPFLAGS_HAVE_VERSION_TAG) || !cls->tp_mro)
+        return false;
+    // Dict-backed types can have their attributes changed behind our back:
+    if (cls->attrs.hcls->type != HiddenClass::SINGLETON)
+        return false;
+
+    cls->tp_version_tag = next_version_tag++;
+    if (cls->tp_version_tag == 0) {
+        // Wrapped around: none of the existing tags can be trusted anymore.
+        static StatCounter num_version_tag_wraps("num_type_version_tag_wraps");
+        num_version_tag_wraps.log();
+
+        memset(method_cache, 0, sizeof(method_cache));
+        PyType_Modified(object_cls);
+        cls->tp_version_tag = next_version_tag++;
+    }
+
+    // A type's tag is only valid if all of its bases have valid tags, which is what lets PyType_Modified() stop
+    // recursing at types that don't have one.
+    for (auto b : *static_cast<BoxedTuple*>(cls->tp_mro)) {
+        if (b == cls)
+            continue;
+        if (!PyType_Check(b) || !assignVersionTag(static_cast<BoxedClass*>(b)))
+            return false;
+    }
+    cls->tp_flags |= Py_TPFLAGS_VALID_VERSION_TAG;
+    return true;
+}
+
+static Box* typeLookupUncached(BoxedClass* cls, llvm::StringRef attr) {
+    assert(cls->tp_mro);
+    assert(cls->tp_mro->cls == tuple_cls);
+    for (auto b : *static_cast<BoxedTuple*>(cls->tp_mro)) {
+        Box* val = b->getattr(attr, NULL);
+        if (val)
+            return val;
+    }
+    return NULL;
+}
+
 Box* typeLookup(BoxedClass* cls, llvm::StringRef attr, GetattrRewriteArgs* rewrite_args) {
     Box* val;
 
@@ -954,14 +1031,32 @@ Box* typeLookup(BoxedClass* cls, llvm::StringRef attr, GetattrRewriteArgs* rewri
 
         return NULL;
     } else {
-        assert(cls->tp_mro);
-        assert(cls->tp_mro->cls == tuple_cls);
-        for (auto b : *static_cast<BoxedTuple*>(cls->tp_mro)) {
-            val = b->getattr(attr, NULL);
-            if (val)
-                return val;
+        if (attr.size() > MCACHE_MAX_ATTR_SIZE || !assignVersionTag(cls))
+            return typeLookupUncached(cls, attr);
+
+        static StatCounter num_hits("num_type_cache_hits");
+        static StatCounter num_misses("num_type_cache_misses");
+
+        unsigned int version = cls->tp_version_tag;
+        size_t h = (version * (size_t)llvm::hash_value(attr)) >> (8 * sizeof(size_t) - MCACHE_SIZE_EXP);
+        MethodCacheEntry& entry = method_cache[h];
+        if (entry.version == version && entry.attr_size == attr.size()
+            && memcmp(entry.attr, attr.data(), attr.size()) == 0) {
+            num_hits.log();
+            return entry.value;
         }
-        return NULL;
+
+        num_misses.log();
+        val = typeLookupUncached(cls, attr);
+
+        // The lookup can't run arbitrary code, but check the tag anyway before filling the entry:
+        if (PyType_HasFeature(cls, Py_TPFLAGS_VALID_VERSION_TAG) && cls->tp_version_tag == version) {
+            entry.version = version;
+            entry.attr_size = attr.size();
+            memcpy(entry.attr, attr.data(), attr.size());
+            entry.value = val;
+        }
+        return val;
     }
 }
 
@@ -1813,6 +1908,30 @@ extern "C" Box* getattr(Box* obj, const char* attr) {
     raiseAttributeError(obj, attr);
 }
 
+// Like getattr(), but reports a failure by setting the C API exception and returning NULL rather than by throwing.
+// The JIT calls this from sites that are known to catch their exceptions most of the time, where a C++ throw would
+// cost far more than the lookup itself.
+extern "C" Box* getattrCAPI(Box* obj, const char* attr) noexcept {
+    static StatCounter slowpath_getattr_capi("slowpath_getattr_capi");
+    slowpath_getattr_capi.log();
+
+    try {
+        Box* val = getattrInternal(obj, attr, NULL);
+        if (val)
+            return val;
+
+        if (obj->cls == type_cls)
+            PyErr_Format(AttributeError, "type object '%s' has no attribute '%s'",
+                         getNameOfClass(static_cast<BoxedClass*>(obj)), attr);
+        else
+            PyErr_Format(AttributeError, "'%s' object has no attribute '%s'", getTypeName(obj), attr);
+        return NULL;
+    } catch (ExcInfo e) {
+        setCAPIException(e);
+        return NULL;
+    }
+}
+
 bool dataDescriptorSetSpecialCases(Box* obj, Box* val, Box* descr, SetattrRewriteArgs* rewrite_args,
                                    RewriterVar* r_descr, llvm::StringRef attr_name) {
 
@@ -2470,7 +2589,7 @@ extern "C" void dumpEx(void* p, int levels) {
                 int i = 0;
                 for (int i = 0; i < l->size; i++) {
                     printf("\nElement %d:", i);
-                    dumpEx(l->elts->elts[i], levels - 1);
+                    dumpEx(l->getElt(i), levels - 1);
                 }
             }
         }
@@ -2749,8 +2868,7 @@ static inline Box*& getArg(int idx, Box*& arg1, Box*& arg2, Box*& arg3, Box** ar
 }
 
 static StatCounter slowpath_pickversion("slowpath_pickversion");
-static CompiledFunction* pickVersion(CLFunction* f, int num_output_args, Box* oarg1, Box* oarg2, Box* oarg3,
-                                     Box** oargs) {
+CompiledFunction* pickVersion(CLFunction* f, int num_output_args, Box* oarg1, Box* oarg2, Box* oarg3, Box** oargs) {
     LOCK_REGION(codegen_rwlock.asWrite());
 
     if (f->always_use_version)
@@ -3924,17 +4042,56 @@ extern "C" Box* getitem(Box* value, Box* slice) {
     std::unique_ptr<Rewriter> rewriter(
         Rewriter::createRewriter(__builtin_extract_return_addr(__builtin_return_address(0)), 2, "getitem"));
 
+    // Subscripts feed the same polymorphic profiles that attributes do (ex a list that holds both ints and floats):
+    TypeRecorder* recorder = rewriter.get() ? rewriter->getTypeRecorder() : NULL;
+
+    // Looking up a str in a plain dict (**kwargs, module dicts, JSON-like data) is common enough to
+    // be worth skipping the __getitem__ lookup for, and going straight to the str-keyed probe.
+    if (value->cls == dict_cls && slice->cls == str_cls) {
+        if (rewriter.get()) {
+            RewriterVar* r_dict = rewriter->getArg(0);
+            RewriterVar* r_key = rewriter->getArg(1);
+            r_dict->addAttrGuard(offsetof(Box, cls), (intptr_t)dict_cls);
+            r_key->addAttrGuard(offsetof(Box, cls), (intptr_t)str_cls);
+            RewriterVar* r_rtn = rewriter->call(true, (void*)dictGetitemStr, r_dict, r_key);
+            if (recorder) {
+                r_rtn = rewriter->call(false, (void*)recordType,
+                                       rewriter->loadConst((intptr_t)recorder, Location::forArg(0)), r_rtn);
+            }
+            rewriter->commitReturning(r_rtn);
+        }
+        Box* rtn = dictGetitemStr(static_cast<BoxedDict*>(value), static_cast<BoxedString*>(slice));
+        if (recorder)
+            recordType(recorder, rtn);
+        return rtn;
+    }
+
     Box* rtn;
     if (rewriter.get()) {
-        CallRewriteArgs rewrite_args(rewriter.get(), rewriter->getArg(0), rewriter->getReturnDestination());
+        Location dest;
+        if (recorder)
+            dest = Location::forArg(1);
+        else
+            dest = rewriter->getReturnDestination();
+        CallRewriteArgs rewrite_args(rewriter.get(), rewriter->getArg(0), dest);
         rewrite_args.arg1 = rewriter->getArg(1);
 
         rtn = callattrInternal1(value, getitem_str, CLASS_ONLY, &rewrite_args, ArgPassSpec(1), slice);
 
         if (!rewrite_args.out_success) {
             rewriter.reset(NULL);
-        } else if (rtn)
-            rewriter->commitReturning(rewrite_args.out_rtn);
+        } else if (rtn) {
+            if (recorder) {
+                RewriterVar* record_rtn = rewriter->call(false, (void*)recordType,
+                                                         rewriter->loadConst((intptr_t)recorder, Location::forArg(0)),
+                                                         rewrite_args.out_rtn);
+                rewriter->commitReturning(record_rtn);
+
+                recordType(recorder, rtn);
+            } else {
+                rewriter->commitReturning(rewrite_args.out_rtn);
+            }
+        }
     } else {
         rtn = callattrInternal1(value, getitem_str, CLASS_ONLY, NULL, ArgPassSpec(1), slice);
     }
@@ -3955,6 +4112,43 @@ extern "C" Box* getitem(Box* value, Box* slice) {
     return rtn;
 }
 
+// The return-code version of getitem(); see getattrCAPI().  Missing dict keys and out-of-range list indices are the
+// usual reasons for an exception to be caught, so those set the error without going through a throw at all.
+extern "C" Box* getitemCAPI(Box* value, Box* slice) noexcept {
+    static StatCounter slowpath_getitem_capi("slowpath_getitem_capi");
+    slowpath_getitem_capi.log();
+
+    try {
+        if (value->cls == dict_cls) {
+            BoxedDict* d = static_cast<BoxedDict*>(value);
+            auto it = d->d.find(slice);
+            if (it != d->d.end())
+                return it->second;
+            PyErr_SetObject(KeyError, runtimeCall(KeyError, ArgPassSpec(1), slice, NULL, NULL, NULL, NULL));
+            return NULL;
+        }
+
+        if (value->cls == list_cls && slice->cls == int_cls) {
+            BoxedList* l = static_cast<BoxedList*>(value);
+            LOCK_REGION(l->lock.asRead());
+
+            int64_t n = static_cast<BoxedInt*>(slice)->n;
+            if (n < 0)
+                n = l->size + n;
+            if (n < 0 || n >= l->size) {
+                PyErr_SetString(IndexError, "list index out of range");
+                return NULL;
+            }
+            return l->getElt(n);
+        }
+
+        return getitem(value, slice);
+    } catch (ExcInfo e) {
+        setCAPIException(e);
+        return NULL;
+    }
+}
+
 // target[slice] = value
 extern "C" void setitem(Box* target, Box* slice, Box* value) {
     STAT_TIMER(t0, "us_timer_slowpath_setitem");
@@ -4058,6 +4252,8 @@ void Box::delattr(llvm::StringRef attr, DelattrRewriteArgs* rewrite_args) {
         } else {
             assert(hcls->type == HiddenClass::SINGLETON);
             hcls->delAttribute(attr);
+            if (PyType_Check(this))
+                PyType_Modified(static_cast<BoxedClass*>(this));
         }
 
         // guarantee the size of the attr_list equals the number of attrs
@@ -37,6 +37,9 @@ extern "C" void raise0() __attribute__((__noreturn__));
 extern "C" void raise3(Box*, Box*, Box*) __attribute__((__noreturn__));
 void raiseExc(Box* exc_obj) __attribute__((__noreturn__));
 void raiseRaw(const ExcInfo& e) __attribute__((__noreturn__));
+// Called by the JIT when a getattrCAPI/getitemCAPI call signals an exception that the current statement
+// catches: takes the pending exception and returns it in a thread-local ExcInfo.
+extern "C" ExcInfo* catchCAPIException();
 void _printStacktrace();
 
 extern "C" Box* deopt(AST_expr* expr, Box* value);
@@ -75,6 +78,9 @@ extern "C" i64 unboxedLen(Box* obj);
 extern "C" Box* binop(Box* lhs, Box* rhs, int op_type);
 extern "C" Box* augbinop(Box* lhs, Box* rhs, int op_type);
 extern "C" Box* getitem(Box* value, Box* slice);
+// Versions of getattr and getitem that return NULL and set the C API exception instead of throwing:
+extern "C" Box* getattrCAPI(Box* obj, const char* attr) noexcept;
+extern "C" Box* getitemCAPI(Box* value, Box* slice) noexcept;
 extern "C" void setitem(Box* target, Box* slice, Box* value);
 extern "C" void delitem(Box* target, Box* slice);
 extern "C" Box* getclsattr(Box* obj, const char* attr);
@@ -154,6 +160,8 @@ Box* processDescriptor(Box* obj, Box* inst, Box* owner);
 
 Box* callCLFunc(CLFunction* f, CallRewriteArgs* rewrite_args, int num_output_args, BoxedClosure* closure,
                 BoxedGenerator* generator, Box* globals, Box* oarg1, Box* oarg2, Box* oarg3, Box** oargs);
+// Returns the version of f that callCLFunc() would call with these arguments, compiling one if needed.
+CompiledFunction* pickVersion(CLFunction* f, int num_output_args, Box* oarg1, Box* oarg2, Box* oarg3, Box** oargs);
 
 static const char* objectNewParameterTypeErrorMsg() {
     if (PYTHON_VERSION_HEX >= version_hex(2, 7, 4)) {
@@ -34,14 +34,32 @@ class BoxedSetIterator : public Box {
 public:
     BoxedSet* s;
     decltype(BoxedSet::s)::iterator it;
+    // The size of the set when the iteration started, or -1 once we've reported that it changed.
+    int64_t size;
 
-    BoxedSetIterator(BoxedSet* s) : s(s), it(s->s.begin()) {}
+    BoxedSetIterator(BoxedSet* s) : s(s), it(s->s.begin()), size(s->s.size()) {}
 
     DEFAULT_CLASS(set_iterator_cls);
 
-    bool hasNext() { return it != s->s.end(); }
+    bool hasNext() {
+        // Let next() raise the error:
+        if (size != (int64_t)s->s.size())
+            return true;
+
+        // The element we were going to return next might have been removed since:
+        it = s->s.iteratorAt(it.position());
+        return it != s->s.end();
+    }
 
     Box* next() {
+        if (size != (int64_t)s->s.size()) {
+            size = -1; // keep failing, like CPython
+            raiseExcHelper(RuntimeError, "Set changed size during iteration");
+        }
+
+        it = s->s.iteratorAt(it.position());
+        if (it == s->s.end())
+            raiseExcHelper(StopIteration, "");
         Box* rtn = *it;
         ++it;
         return rtn;
@@ -402,7 +420,7 @@ Box* setPop(BoxedSet* self) {
     if (!self->s.size())
         raiseExcHelper(KeyError, "pop from an empty set");
 
-    auto it = self->s.begin();
+    auto it = --self->s.end();
     Box* rtn = *it;
     self->s.erase(it);
     return rtn;
@@ -480,8 +498,8 @@ extern "C" PyObject* PyFrozenSet_New(PyObject* iterable) noexcept {
 using namespace pyston::set;
 
 void setupSet() {
-    set_iterator_cls = BoxedHeapClass::create(type_cls, object_cls, &setIteratorGCHandler, 0, 0, sizeof(BoxedSet),
-                                              false, "setiterator");
+    set_iterator_cls = BoxedHeapClass::create(type_cls, object_cls, &setIteratorGCHandler, 0, 0,
+                                              sizeof(BoxedSetIterator), false, "setiterator");
     set_iterator_cls->giveAttr(
         "__iter__", new BoxedFunction(boxRTFunction((void*)setiteratorIter, typeFromClass(set_iterator_cls), 1)));
     set_iterator_cls->giveAttr("__hasnext__",
@@ -29,7 +29,7 @@ extern "C" Box* createSet();
 
 class BoxedSet : public Box {
 public:
-    typedef std::unordered_set<Box*, PyHasher, PyEq, StlCompatAllocator<Box*>> Set;
+    typedef CompactSet<Box*, PyHasher, PyEq> Set;
     Set s;
     Box** weakreflist; /* List of weak references */
 
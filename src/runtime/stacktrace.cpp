@@ -19,6 +19,7 @@
 #include "codegen/unwinding.h"
 #include "core/options.h"
 #include "gc/collector.h"
+#include "runtime/capi.h"
 #include "runtime/objmodel.h"
 #include "runtime/traceback.h"
 #include "runtime/types.h"
@@ -59,8 +60,18 @@ void raiseRaw(const ExcInfo& e) {
     throw e;
 }
 
+// For the raise statements that reuse a traceback, which Python code might be holding on to: the unwinder adds to
+// a new traceback that continues it.
+static void reraiseRaw(const ExcInfo& e) __attribute__((__noreturn__));
+static void reraiseRaw(const ExcInfo& e) {
+    if (e.traceback->cls != traceback_cls)
+        raiseRaw(e);
+    raiseRaw(ExcInfo(e.type, e.value, new BoxedTraceback(static_cast<BoxedTraceback*>(e.traceback))));
+}
+
 void raiseExc(Box* exc_obj) {
-    raiseRaw(ExcInfo(exc_obj->cls, exc_obj, getTraceback()));
+    // The traceback gets filled in as the exception propagates; see addTracebackFrame().
+    raiseRaw(ExcInfo(exc_obj->cls, exc_obj, new BoxedTraceback()));
 }
 
 // Have a special helper function for syntax errors, since we want to include the location
@@ -68,8 +79,8 @@ void raiseExc(Box* exc_obj) {
 void raiseSyntaxError(const char* msg, int lineno, int col_offset, const std::string& file, const std::string& func) {
     Box* exc = runtimeCall(SyntaxError, ArgPassSpec(1), boxStrConstant(msg), NULL, NULL, NULL, NULL);
 
-    auto tb = getTraceback();
-    std::vector<const LineInfo*> entries = tb->lines;
+    // The frames that the exception propagates through will get added in front of this:
+    std::vector<const LineInfo*> entries;
     entries.push_back(new LineInfo(lineno, col_offset, file, func));
     raiseRaw(ExcInfo(exc->cls, exc, new BoxedTraceback(std::move(entries))));
 }
@@ -189,7 +200,7 @@ extern "C" void raise0() {
     if (exc_info->type == None)
         raiseExcHelper(TypeError, "exceptions must be old-style classes or derived from BaseException, not NoneType");
 
-    raiseRaw(*exc_info);
+    reraiseRaw(*exc_info);
 }
 
 #ifndef NDEBUG
@@ -214,7 +225,7 @@ ExcInfo excInfoForRaise(Box* type, Box* value, Box* tb) {
     // TODO switch this to PyErr_Normalize
 
     if (tb == None)
-        tb = getTraceback();
+        tb = new BoxedTraceback();
 
     /* Next, repeatedly, replace a tuple exception with its first item */
     while (PyTuple_Check(type) && PyTuple_Size(type) > 0) {
@@ -256,7 +267,30 @@ ExcInfo excInfoForRaise(Box* type, Box* value, Box* tb) {
 }
 
 extern "C" void raise3(Box* arg0, Box* arg1, Box* arg2) {
-    raiseRaw(excInfoForRaise(arg0, arg1, arg2));
+    if (arg2 == None)
+        raiseRaw(excInfoForRaise(arg0, arg1, arg2));
+    reraiseRaw(excInfoForRaise(arg0, arg1, arg2));
+}
+
+// Not scanned by the GC; the JIT copies the fields out right after the call returns.
+static __thread ExcInfo* caught_capi_exception;
+
+extern "C" ExcInfo* catchCAPIException() {
+    ExcInfo e = fetchCAPIException();
+
+    // The exception never got thrown through our caller, so the unwinder didn't get a chance to add it
+    // to the traceback; do that here.
+    unw_cursor_t cursor;
+    unw_context_t uc;
+    unw_getcontext(&uc);
+    unw_init_local(&cursor, &uc);
+    if (unw_step(&cursor) > 0)
+        addTracebackFrame(e.traceback, &cursor);
+
+    if (!caught_capi_exception)
+        caught_capi_exception = new ExcInfo(NULL, NULL, NULL);
+    *caught_capi_exception = e;
+    return caught_capi_exception;
 }
 
 void raiseExcHelper(BoxedClass* cls, Box* arg) {
@@ -54,7 +54,7 @@ extern "C" PyObject* string__format__(PyObject* self, PyObject* args) noexcept;
 
 namespace pyston {
 
-BoxedString::BoxedString(const char* s, size_t n) : interned_state(SSTATE_NOT_INTERNED) {
+BoxedString::BoxedString(const char* s, size_t n) : hash(-1), interned_state(SSTATE_NOT_INTERNED) {
     RELEASE_ASSERT(n != llvm::StringRef::npos, "");
     if (s) {
         memmove(data(), s, n);
@@ -64,20 +64,20 @@ BoxedString::BoxedString(const char* s, size_t n) : interned_state(SSTATE_NOT_IN
     }
 }
 
-BoxedString::BoxedString(llvm::StringRef lhs, llvm::StringRef rhs) : interned_state(SSTATE_NOT_INTERNED) {
+BoxedString::BoxedString(llvm::StringRef lhs, llvm::StringRef rhs) : hash(-1), interned_state(SSTATE_NOT_INTERNED) {
     RELEASE_ASSERT(lhs.size() + rhs.size() != llvm::StringRef::npos, "");
     memmove(data(), lhs.data(), lhs.size());
     memmove(data() + lhs.size(), rhs.data(), rhs.size());
     data()[lhs.size() + rhs.size()] = 0;
 }
 
-BoxedString::BoxedString(llvm::StringRef s) : interned_state(SSTATE_NOT_INTERNED) {
+BoxedString::BoxedString(llvm::StringRef s) : hash(-1), interned_state(SSTATE_NOT_INTERNED) {
     RELEASE_ASSERT(s.size() != llvm::StringRef::npos, "");
     memmove(data(), s.data(), s.size());
     data()[s.size()] = 0;
 }
 
-BoxedString::BoxedString(size_t n, char c) : interned_state(SSTATE_NOT_INTERNED) {
+BoxedString::BoxedString(size_t n, char c) : hash(-1), interned_state(SSTATE_NOT_INTERNED) {
     RELEASE_ASSERT(n != llvm::StringRef::npos, "");
     memset(data(), c, n);
     data()[n] = 0;
@@ -1527,15 +1527,17 @@ extern "C" size_t unicodeHashUnboxed(PyUnicodeObject* self) {
     Py_ssize_t len = PyUnicode_GET_SIZE(self);
     Py_UNICODE* p = PyUnicode_AS_UNICODE(self);
     pyston::StringHash<Py_UNICODE> H;
-    return H(p, len);
+    long h = H(p, len);
+    // Has to match strHashUnboxed for strings that compare equal:
+    self->hash = (h == -1) ? -2 : h;
+    return self->hash;
 }
 
 extern "C" Box* strHash(BoxedString* self) {
     STAT_TIMER(t0, "us_timer_strHash");
     assert(isSubclass(self->cls, str_cls));
 
-    StringHash<char> H;
-    return boxInt(H(self->data(), self->size()));
+    return boxInt(strHashUnboxed(self));
 }
 
 extern "C" Box* strNonzero(BoxedString* self) {
@@ -2363,6 +2365,7 @@ extern "C" int _PyString_Resize(PyObject** pv, Py_ssize_t newsize) noexcept {
     if (newsize < s->size()) {
         // XXX resize the box (by reallocating) smaller if it makes sense
         s->ob_size = newsize;
+        s->hash = -1;
         s->data()[newsize] = 0;
         return 0;
     }
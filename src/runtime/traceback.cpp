@@ -38,6 +38,8 @@ void BoxedTraceback::gcHandler(GCVisitor* v, Box* b) {
     assert(b->cls == traceback_cls);
     BoxedTraceback* self = static_cast<BoxedTraceback*>(b);
 
+    if (self->base)
+        v->visit(self->base);
     if (self->py_lines)
         v->visit(self->py_lines);
 
@@ -53,7 +55,7 @@ void printTraceback(Box* b) {
 
     fprintf(stderr, "Traceback (most recent call last):\n");
 
-    for (auto line : tb->lines) {
+    for (auto line : tb->allLines()) {
         fprintf(stderr, "  File \"%s\", line %d, in %s:\n", line->file.c_str(), line->line, line->func.c_str());
 
         if (line->line < 0)
@@ -90,15 +92,25 @@ void printTraceback(Box* b) {
     }
 }
 
+std::vector<const LineInfo*> BoxedTraceback::allLines() {
+    // A traceback's lines are for frames further out than its base's:
+    std::vector<const LineInfo*> rtn;
+    for (BoxedTraceback* tb = this; tb; tb = tb->base) {
+        rtn.insert(rtn.end(), tb->lines.rbegin(), tb->lines.rend());
+    }
+    return rtn;
+}
+
 Box* BoxedTraceback::getLines(Box* b) {
     assert(b->cls == traceback_cls);
 
     BoxedTraceback* tb = static_cast<BoxedTraceback*>(b);
 
     if (!tb->py_lines) {
+        std::vector<const LineInfo*> all_lines = tb->allLines();
         BoxedList* lines = new BoxedList();
-        lines->ensure(tb->lines.size());
-        for (auto line : tb->lines) {
+        lines->ensure(all_lines.size());
+        for (auto line : all_lines) {
             auto l = BoxedTuple::create({ boxString(line->file), boxString(line->func), boxInt(line->line) });
             listAppendInternal(lines, l);
         }
@@ -27,14 +27,55 @@ class GCVisitor;
 extern "C" BoxedClass* traceback_cls;
 class BoxedTraceback : public Box {
 public:
+    // Innermost frame first, which is the order that the unwinder finds them in; allLines() gives them in the usual
+    // outermost-first order.
     std::vector<const LineInfo*> lines;
+    // Tracebacks are immutable as far as Python code can tell, so a raise statement that reuses a traceback (a bare
+    // `raise`, or `raise t, v, tb`, which is also how cleanups reraise) gives the exception a new traceback that
+    // continues that one, rather than adding to it.  The lines of base come first.
+    BoxedTraceback* base;
     Box* py_lines;
 
-    BoxedTraceback(std::vector<const LineInfo*> lines) : lines(std::move(lines)), py_lines(NULL) {}
-    BoxedTraceback() : py_lines(NULL) {}
+    // Raising an exception starts it off with an empty traceback, and the unwinder adds a line for each Python frame
+    // that the exception propagates through (see addTracebackFrame() in codegen/unwinding.cpp).  To do that it needs
+    // to remember the last frame it saw: an exception can pass through the same frame more than once (cleanups,
+    // rethrows), and the frame after an OSR'd frame is the one that it replaced, which shouldn't show up.  The frame
+    // is identified by its function as well as its frame pointer.
+    uint64_t last_frame_bp;
+    CompiledFunction* last_frame_cf;
+    bool last_frame_was_osr;
+    // Like CPython's WHY_RERAISE: a raise statement that reuses a traceback doesn't add the frame that it's in.  The
+    // frame that the traceback was last added to might be long gone by then, so this doesn't go by last_frame_bp.
+    bool skip_next_frame;
+
+    BoxedTraceback(std::vector<const LineInfo*> lines)
+        : lines(std::move(lines)),
+          base(NULL),
+          py_lines(NULL),
+          last_frame_bp(0),
+          last_frame_cf(NULL),
+          last_frame_was_osr(false),
+          skip_next_frame(false) {}
+    BoxedTraceback()
+        : base(NULL),
+          py_lines(NULL),
+          last_frame_bp(0),
+          last_frame_cf(NULL),
+          last_frame_was_osr(false),
+          skip_next_frame(false) {}
+    // For reraising an exception that has base as its traceback:
+    BoxedTraceback(BoxedTraceback* base)
+        : base(base),
+          py_lines(NULL),
+          last_frame_bp(0),
+          last_frame_cf(NULL),
+          last_frame_was_osr(false),
+          skip_next_frame(true) {}
 
     DEFAULT_CLASS(traceback_cls);
 
+    std::vector<const LineInfo*> allLines();
+
     void addLine(const LineInfo* line);
 
     static Box* getLines(Box* b);
@@ -24,6 +24,7 @@
 
 #include "capi/typeobject.h"
 #include "capi/types.h"
+#include "codegen/irgen/hooks.h"
 #include "codegen/unwinding.h"
 #include "core/options.h"
 #include "core/stats.h"
@@ -368,6 +369,8 @@ extern "C" void functionGCHandler(GCVisitor* v, Box* b) {
 
     BoxedFunction* f = (BoxedFunction*)b;
 
+    noteCLFunctionReference(f->f);
+
     // TODO eventually f->name should always be non-NULL, then there'd be no need for this check
     if (f->name)
         v->visit(f->name);
@@ -528,6 +531,8 @@ static void typeSubSetDict(Box* obj, Box* val, void* context) {
 
         HCAttrs* hcattrs = obj->getHCAttrsPtr();
 
+        if (PyType_Check(obj))
+            PyType_Modified(static_cast<BoxedClass*>(obj));
         hcattrs->hcls = HiddenClass::dict_backed;
         hcattrs->attr_list = new_attr_list;
         return;
@@ -592,7 +597,8 @@ extern "C" void listGCHandler(GCVisitor* v, Box* b) {
     assert(capacity >= size);
     if (capacity)
         v->visit(l->elts);
-    if (size)
+    // Unboxed lists don't have anything else to visit:
+    if (size && l->strategy == ListStrategy::OBJECTS)
         v->visitRange((void**)&l->elts->elts[0], (void**)&l->elts->elts[size]);
 }
 
@@ -600,15 +606,7 @@ extern "C" void setGCHandler(GCVisitor* v, Box* b) {
     boxGCHandler(v, b);
 
     BoxedSet* s = (BoxedSet*)b;
-
-    // This feels like a cludge, but we need to find anything that
-    // the unordered_map might have allocated.
-    // Another way to handle this would be to rt_alloc the unordered_map
-    // as well, though that incurs extra memory dereferences which would
-    // be nice to avoid.
-    void** start = (void**)&s->s;
-    void** end = start + (sizeof(s->s) / 8);
-    v->visitPotentialRange(start, end);
+    s->s.gcVisit(v);
 }
 
 extern "C" void sliceGCHandler(GCVisitor* v, Box* b) {
@@ -655,15 +653,7 @@ extern "C" void dictGCHandler(GCVisitor* v, Box* b) {
     boxGCHandler(v, b);
 
     BoxedDict* d = (BoxedDict*)b;
-
-    // This feels like a cludge, but we need to find anything that
-    // the unordered_map might have allocated.
-    // Another way to handle this would be to rt_alloc the unordered_map
-    // as well, though that incurs extra memory dereferences which would
-    // be nice to avoid.
-    void** start = (void**)&d->d;
-    void** end = start + (sizeof(d->d) / 8);
-    v->visitPotentialRange(start, end);
+    d->d.gcVisit(v);
 }
 
 extern "C" void closureGCHandler(GCVisitor* v, Box* b) {
@@ -15,6 +15,8 @@
 #ifndef PYSTON_RUNTIME_TYPES_H
 #define PYSTON_RUNTIME_TYPES_H
 
+#include <cmath>
+#include <cstring>
 #include <llvm/ADT/StringMap.h>
 #include <llvm/ADT/Twine.h>
 #include <ucontext.h>
@@ -27,6 +29,7 @@
 #include "core/threading.h"
 #include "core/types.h"
 #include "gc/gc_alloc.h"
+#include "runtime/compact_table.h"
 
 namespace pyston {
 
@@ -423,6 +426,11 @@ public:
     // optimizations and inlining, creating a new one each time shouldn't have any cost.
     llvm::StringRef s() const { return llvm::StringRef(s_data, ob_size); };
 
+    // The hash of the string, computed on first use; -1 if it hasn't been computed yet.
+    // Strings don't change once they're visible to Python code, so it never needs to be reset
+    // (except by _PyString_Resize, whose callers own the only reference).
+    long hash;
+
     char interned_state;
 
     char* data() { return s_data; }
@@ -465,29 +473,85 @@ private:
     char s_data[0];
 };
 
+// Hashes strings a word at a time: every 8 characters get packed into a 64-bit word, which is mixed
+// into the hash with a 64x64->128-bit multiply.  The final partial word gets assembled from a couple
+// of overlapping loads instead of a loop.
+//
+// Wider character types (ie Py_UNICODE) get packed one byte per character, and the high bits only get
+// mixed in if they're nonzero, so a unicode object hashes the same as the str it compares equal to.
 template <typename T> struct StringHash {
-    size_t operator()(const T* str) {
-        size_t hash = 5381;
-        T c;
+    static constexpr uint64_t SEED = 0xa0761d6478bd642fULL, MUL = 0xe7037ed1a0b428dbULL,
+                              WIDE_MUL = 0x8ebc6af09c88c6e3ULL;
+
+    static uint64_t mix(uint64_t a, uint64_t b) {
+        __uint128_t r = (__uint128_t)a * b;
+        return (uint64_t)r ^ (uint64_t)(r >> 64);
+    }
 
-        while ((c = *str++))
-            hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    // Packs the n <= 8 characters at str into a little-endian word, and returns the bits that didn't
+    // fit in a byte in *high.
+    static uint64_t load(const T* str, int n, uint64_t* high) {
+        uint64_t w = 0;
+        *high = 0;
+        for (int i = 0; i < n; i++) {
+            w |= (uint64_t)(uint8_t)str[i] << (8 * i);
+            *high = *high * 31 + ((uint64_t)str[i] >> 8);
+        }
+        return w;
+    }
 
-        return hash;
+    size_t operator()(const T* str) {
+        size_t len = 0;
+        while (str[len])
+            len++;
+        return (*this)(str, len);
     }
-    size_t operator()(const T* str, int len) {
-        size_t hash = 5381;
-        T c;
 
-        while (--len >= 0) {
-            c = *str++;
-            hash = ((hash << 5) + hash) + c; /* hash * 33 + c */
+    size_t operator()(const T* str, size_t len) {
+        uint64_t h = SEED ^ (len * MUL);
+        uint64_t high;
+
+        size_t i = 0;
+        for (; i + 8 <= len; i += 8) {
+            uint64_t w = load(str + i, 8, &high);
+            if (unlikely(high))
+                h = mix(h ^ high, WIDE_MUL);
+            h = mix(h ^ w, MUL);
         }
 
-        return hash;
+        if (i < len) {
+            uint64_t w = load(str + i, len - i, &high);
+            if (unlikely(high))
+                h = mix(h ^ high, WIDE_MUL);
+            h = mix(h ^ w, MUL);
+        }
+
+        return h;
     }
 };
 
+template <> inline uint64_t StringHash<char>::load(const char* str, int n, uint64_t* high) {
+    *high = 0;
+
+    uint64_t w;
+    if (n == 8) {
+        memcpy(&w, str, 8);
+        return w;
+    }
+
+    // Overlapping loads: any bytes covered by both land in the same place, so or'ing is fine.
+    const uint8_t* p = reinterpret_cast<const uint8_t*>(str);
+    if (n >= 4) {
+        uint32_t lo, hi;
+        memcpy(&lo, p, 4);
+        memcpy(&hi, p + n - 4, 4);
+        return lo | ((uint64_t)hi << (8 * (n - 4)));
+    }
+    if (n == 0)
+        return 0;
+    return p[0] | ((uint64_t)p[n / 2] << (8 * (n / 2))) | ((uint64_t)p[n - 1] << (8 * (n - 1)));
+}
+
 template <> struct StringHash<std::string> {
     size_t operator()(const std::string& str) {
         StringHash<char> H;
@@ -495,6 +559,17 @@ template <> struct StringHash<std::string> {
     }
 };
 
+// Returns the cached hash of the string, computing it if necessary.  Never returns -1, since that
+// means "not computed" (and "error" to the C API).
+inline size_t strHashUnboxed(BoxedString* self) {
+    if (unlikely(self->hash == -1)) {
+        StringHash<char> H;
+        long h = H(self->data(), self->size());
+        self->hash = (h == -1) ? -2 : h;
+    }
+    return self->hash;
+}
+
 
 class BoxedInstanceMethod : public Box {
 public:
@@ -525,21 +600,93 @@ public:
     }
 };
 
+// How a BoxedList stores its elements; see BoxedList::strategy.
+enum class ListStrategy : int64_t {
+    OBJECTS,
+    INTS,   // exact ints, stored as raw int64_t's
+    FLOATS, // exact floats other than NaNs, stored as raw doubles
+};
+
 class BoxedList : public Box {
 public:
     int64_t size, capacity;
     GCdArray* elts;
+    // A list that starts out with an exact int (or float) keeps its elements unboxed in elts for as long as it only
+    // holds exact ints (floats), which saves an allocation per element and gives numeric code a dense array to work
+    // on.  Storing anything else generalizes the list to OBJECTS storage, and it stays that way until it's emptied.
+    // Every strategy uses 8-byte slots, so code that just moves elements around doesn't need to care which one is
+    // in use; code that reads or writes individual elements should go through getElt() and setElt(), and code that
+    // wants a Box** view of the contents has to get it from objectElts().
+    ListStrategy strategy;
 
     DS_DEFINE_MUTEX(lock);
 
-    BoxedList() __attribute__((visibility("default"))) : size(0), capacity(0) {}
+    BoxedList() __attribute__((visibility("default"))) : size(0), capacity(0), strategy(ListStrategy::OBJECTS) {}
 
     void ensure(int space);
     void shrink();
     static const int INITIAL_CAPACITY;
 
+    int64_t* intElts() {
+        assert(strategy == ListStrategy::INTS);
+        return reinterpret_cast<int64_t*>(&elts->elts[0]);
+    }
+    double* floatElts() {
+        assert(strategy == ListStrategy::FLOATS);
+        return reinterpret_cast<double*>(&elts->elts[0]);
+    }
+
+    // Whether a float can be stored unboxed.  A NaN isn't equal to itself, so `x in l` only finds it by identity,
+    // which reading it back out as a new box would lose.
+    static bool isUnboxableFloat(double d) { return !std::isnan(d); }
+
+    // Whether v can be stored without generalizing the list.
+    bool canStore(Box* v) {
+        if (likely(strategy == ListStrategy::OBJECTS))
+            return true;
+        if (strategy == ListStrategy::INTS)
+            return v->cls == int_cls;
+        return v->cls == float_cls && isUnboxableFloat(static_cast<BoxedFloat*>(v)->d);
+    }
+
+    // Returns element i, boxing it if the list is unboxed.
+    Box* getElt(int64_t i) {
+        assert(0 <= i && i < size);
+        if (likely(strategy == ListStrategy::OBJECTS))
+            return elts->elts[i];
+        if (strategy == ListStrategy::INTS)
+            return boxInt(intElts()[i]);
+        return boxFloat(floatElts()[i]);
+    }
+
+    // Stores v into slot i, which is allowed to be just past the end of the list.
+    void setElt(int64_t i, Box* v) {
+        assert(0 <= i && i < capacity);
+        if (unlikely(!canStore(v)))
+            generalize();
+
+        if (likely(strategy == ListStrategy::OBJECTS))
+            elts->elts[i] = v;
+        else if (strategy == ListStrategy::INTS)
+            intElts()[i] = static_cast<BoxedInt*>(v)->n;
+        else
+            floatElts()[i] = static_cast<BoxedFloat*>(v)->d;
+    }
+
+    Box** objectElts() {
+        if (unlikely(strategy != ListStrategy::OBJECTS))
+            generalize();
+        return &elts->elts[0];
+    }
+
+    // Switches the list over to OBJECTS storage, boxing any unboxed elements.
+    void generalize();
+    // Picks the storage for an empty list that's about to receive v.
+    void pickStrategyFor(Box* v);
+
     DEFAULT_CLASS_SIMPLE(list_cls);
 };
+static_assert(sizeof(int64_t) == sizeof(Box*) && sizeof(double) == sizeof(Box*), "list strategies share slots");
 
 class BoxedTuple : public BoxVar {
 public:
@@ -611,10 +758,20 @@ extern "C" BoxedString* EmptyString;
 
 struct PyHasher {
     size_t operator()(Box*) const;
+
+    // Exact strs are the common case for dict keys (attribute dicts, **kwargs, JSON-like data), and
+    // comparing them can't run arbitrary code; see CompactHashTable.
+    static bool isFastKey(Box* b) { return b->cls == str_cls; }
 };
 
 struct PyEq {
     bool operator()(Box*, Box*) const;
+
+    static bool fastEq(Box* lhs, Box* rhs) {
+        BoxedString* l = static_cast<BoxedString*>(lhs);
+        BoxedString* r = static_cast<BoxedString*>(rhs);
+        return l->size() == r->size() && memcmp(l->data(), r->data(), l->size()) == 0;
+    }
 };
 
 struct PyLt {
@@ -623,7 +780,7 @@ struct PyLt {
 
 class BoxedDict : public Box {
 public:
-    typedef std::unordered_map<Box*, Box*, PyHasher, PyEq, StlCompatAllocator<std::pair<Box*, Box*>>> DictMap;
+    typedef CompactMap<Box*, Box*, PyHasher, PyEq> DictMap;
 
     DictMap d;
 
@@ -832,8 +989,13 @@ public:
     bool iterated_from__hasnext__;
     ExcInfo exception;
 
+    // A generator either runs on a stack of its own (context and stack_begin are set once it has started), or, with
+    // ENABLE_STACKLESS_GENERATORS, it is "stackless": it runs on the stack of whoever resumes it, and returns back out
+    // at each yield, leaving its state in an interpreter frame on the heap (interpreter_frame); see
+    // astInterpretGeneratorResume().  Neither gets set up until the first time the generator gets resumed.
     struct Context* context, *returnContext;
     void* stack_begin;
+    void* interpreter_frame;
 
 #if STAT_TIMERS
     StatTimer* prev_stack;
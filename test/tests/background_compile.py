@@ -0,0 +1,53 @@
+# Compiles at the maximal effort level happen on a background thread, while the function keeps running
+# in its current tier; make sure things keep working while that happens and after the new versions get
+# installed.
+
+try:
+    import __pyston__
+    __pyston__.setOption("REOPT_THRESHOLD_BASELINE", 10)
+    __pyston__.setOption("REOPT_THRESHOLD_T2", 50)
+    __pyston__.setOption("OSR_THRESHOLD_BASELINE", 100)
+    __pyston__.setOption("OSR_THRESHOLD_T2", 100)
+except ImportError:
+    pass
+
+def f(x):
+    return x * 2 + 1
+
+t = 0
+for i in xrange(100000):
+    t += f(i)
+print t
+
+# Goes from the interpreter to the baseline jit, and then queues an OSR compile from there:
+def loop(n):
+    t = 0
+    for i in xrange(n):
+        t += i % 7
+    return t
+
+for i in xrange(3):
+    print loop(200000)
+print loop(10)
+
+# A function that gets hot on several threads at once:
+import threading
+
+def g(x):
+    if x % 3 == 0:
+        return x
+    return -x
+
+results = []
+def run(n):
+    t = 0
+    for i in xrange(n):
+        t += g(i)
+    results.append(t)
+
+threads = [threading.Thread(target=run, args=(30000 + i,)) for i in xrange(4)]
+for th in threads:
+    th.start()
+for th in threads:
+    th.join()
+print sorted(results)
@@ -0,0 +1,116 @@
+# Attribute and item lookups whose exceptions keep getting caught switch over to reporting errors by return code
+# instead of by throwing.  Make sure that the exceptions that come out of that path look the same as thrown ones.
+
+try:
+    import __pyston__
+    __pyston__.setOption("CAPI_EXCEPTION_THRESHOLD", 3)
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 5)
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 20)
+except ImportError:
+    pass
+
+import sys
+import traceback
+
+def lookup(d, k):
+    try:
+        return d[k]
+    except KeyError as e:
+        return "missing %r" % (e.args,)
+
+d = {1: "a", (2, 3): "b"}
+for i in xrange(100):
+    r = (lookup(d, 1), lookup(d, 2), lookup(d, (2, 3)), lookup(d, (4, 5)), lookup(d, "x"))
+print r
+
+def index(l, i):
+    try:
+        return l[i]
+    except IndexError as e:
+        return str(e)
+
+l = range(5)
+for i in xrange(100):
+    r = [index(l, j) for j in (0, 4, 5, -1, -5, -6, 1 << 40)]
+print r
+print index([1.5, 2.5], 3), index((1, 2), 3), index("ab", 3)
+
+class C(object):
+    x = 1
+
+def get_y(o):
+    try:
+        return o.y
+    except AttributeError as e:
+        return str(e)
+
+for i in xrange(100):
+    r = (get_y(C()), get_y(C), get_y(1))
+print r
+c = C()
+c.y = 5
+print get_y(c)
+
+class D(dict):
+    def __missing__(self, k):
+        return "default for %r" % (k,)
+
+class E(object):
+    def __getitem__(self, k):
+        if k > 2:
+            raise KeyError("too big")
+        return k
+
+class F(object):
+    def __getattr__(self, name):
+        if name == "z":
+            return 42
+        raise AttributeError("no " + name)
+
+for i in xrange(100):
+    r = (lookup(D(), 1), lookup(E(), 1), lookup(E(), 5), get_y(F()))
+print r
+
+# The exception's traceback should include the frame that caught it, and anything below it that it came from:
+def tb_lines(f, *args):
+    try:
+        f(*args)
+    except Exception:
+        return [(fn, line) for (fname, line, fn, text) in traceback.extract_tb(sys.exc_info()[2])]
+
+def direct(d):
+    return d["missing"]
+
+def from_getitem(e):
+    return e[10]
+
+for i in xrange(100):
+    r = (tb_lines(direct, {}), tb_lines(from_getitem, E()))
+print r
+
+# Exceptions that aren't caught where they happen still propagate normally:
+def outer(d):
+    try:
+        return direct(d)
+    except IndexError:
+        return "wrong handler"
+
+for i in xrange(20):
+    try:
+        outer({})
+    except KeyError as e:
+        r = e
+print repr(r)
+
+# Other exceptions from the same statement also have to go to the right place:
+def mixed(o):
+    try:
+        return o[0]
+    except KeyError:
+        return "KeyError"
+    except TypeError:
+        return "TypeError"
+
+for i in xrange(100):
+    r = (mixed({}), mixed(None), mixed([7]))
+print r
@@ -0,0 +1,95 @@
+# Superseded versions of functions (from reoptimization or failed speculations) and the code for exec/eval strings
+# get freed once a full collection shows that nothing is running them any more.  Make sure that frames that are still
+# in the middle of an old version, including suspended generators, keep working.
+
+try:
+    import __pyston__
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 3)
+    __pyston__.setOption("REOPT_THRESHOLD_BASELINE", 10)
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 20)
+    __pyston__.setOption("OSR_THRESHOLD_BASELINE", 50)
+    __pyston__.setOption("SPECULATION_THRESHOLD", 5)
+except ImportError:
+    pass
+
+import gc
+
+def add(a, b):
+    return a + b
+
+def recurse(n):
+    # The outer calls stay in the older versions while the inner ones cause reopts:
+    if n == 0:
+        gc.collect()
+        return 0
+    return add(n, recurse(n - 1))
+
+for i in xrange(5):
+    print recurse(40)
+    gc.collect()
+
+def gen(n):
+    for i in xrange(n):
+        yield add(i, i)
+
+gens = [gen(100) for i in xrange(20)]
+for g in gens:
+    g.next()
+for i in xrange(30):
+    add(i, i)
+    add(str(i), str(i))
+    gc.collect()
+print sum(sum(g) for g in gens)
+
+def loop(n):
+    t = 0
+    for i in xrange(n):
+        t = add(t, i)
+        if i % 100 == 0:
+            gc.collect()
+    return t
+
+for i in xrange(3):
+    print loop(500)
+
+def speculate(x):
+    return x.n + 1
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+class D(object):
+    def __init__(self, n):
+        self.n = float(n)
+
+for i in xrange(200):
+    r = speculate(C(i) if i < 100 or i % 3 else D(i))
+    if i % 50 == 0:
+        gc.collect()
+print r
+
+t = 0
+for i in xrange(300):
+    t += eval("%d * 2" % i)
+    exec "t += %d" % i
+    if i % 100 == 0:
+        gc.collect()
+print t
+
+# Things defined in an exec string outlive the code that defined them:
+fs = []
+for i in xrange(20):
+    d = {}
+    exec "def f(x):\n    return x + %d\nl = lambda: f(1)" % i in d
+    fs.append(d["l"])
+gc.collect()
+exec "pass"
+print [f() for f in fs]
+
+try:
+    eval("1 / 0")
+except ZeroDivisionError as e:
+    print "caught", e
+gc.collect()
+print eval("len(range(5))")
@@ -0,0 +1,98 @@
+# Exercises the deletion and resizing paths of the dict and set hash tables.
+
+d = {}
+for i in xrange(1000):
+    d[i] = i * 2
+for i in xrange(0, 1000, 3):
+    del d[i]
+print len(d), sum(d.keys()), sum(d.values())
+
+# Reinserting into a table full of deleted entries:
+for i in xrange(0, 1000, 3):
+    d[i] = -i
+print len(d), sum(d.values())
+
+# Popping everything (popitem takes from the end of the table):
+n = 0
+total = 0
+while d:
+    k, v = d.popitem()
+    n += 1
+    total += k
+print n, total, len(d)
+d[5] = 6
+print d
+
+# Keys that all collide:
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+    def __hash__(self):
+        return 7
+
+    def __eq__(self, rhs):
+        return self.n == rhs.n
+
+d = {}
+keys = [C(i) for i in xrange(50)]
+for k in keys:
+    d[k] = k.n
+for k in keys[::2]:
+    del d[k]
+print len(d), sorted(d.values()) == range(1, 50, 2)
+print C(3) in d, C(4) in d, d.get(C(5)), d.get(C(6), "missing")
+
+# Deleting while iterating over a copy:
+d = dict.fromkeys(range(100))
+for k in d.keys():
+    if k % 2:
+        del d[k]
+print len(d), sorted(d)[:5]
+
+# Sets share the implementation:
+s = set(range(500))
+for i in xrange(0, 500, 2):
+    s.remove(i)
+print len(s), sum(s)
+popped = 0
+while s:
+    s.pop()
+    popped += 1
+print popped, len(s)
+s2 = set(C(i) for i in xrange(20))
+print len(s2), C(19) in s2, C(20) in s2
+
+# Changing the size during iteration is an error, even if the entry we were about to return was deleted:
+d = {1: 1, 2: 2, 3: 3}
+try:
+    for k in d:
+        if k == 1:
+            del d[2]
+except RuntimeError as e:
+    print e
+it = iter(d)
+d[4] = 4
+for i in xrange(2):
+    try:
+        it.next()
+    except RuntimeError as e:
+        print e
+
+# Deleting and then re-adding keeps the size, and iteration skips the deleted entries:
+d = {1: 1, 2: 2, 3: 3}
+seen = []
+for k in d:
+    seen.append(k)
+    if k == 1:
+        del d[2]
+        d[2] = 2
+print len(seen) <= 4, len(d)
+
+s = set([1, 2, 3])
+try:
+    for x in s:
+        if x == 1:
+            s.remove(2)
+except RuntimeError as e:
+    print e
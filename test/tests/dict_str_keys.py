@@ -0,0 +1,43 @@
+# Lookups of str keys in dicts go through a specialized path; make sure it still behaves like the
+# generic one, including when the dict stops (or starts again) having only str keys.
+
+def f(d, k):
+    return d[k]
+
+d = {"a": 1, "b": 2, "hello world": 3}
+for i in xrange(1000):
+    f(d, "a")
+print f(d, "a"), f(d, "hello" + " world"), f(d, "".join(["b"]))
+
+try:
+    f(d, "c")
+except KeyError, e:
+    print "KeyError", e
+
+# Non-str keys in the dict:
+d[1] = "int"
+d[(1, 2)] = "tuple"
+print f(d, "b"), f(d, 1), f(d, (1, 2))
+del d[1]
+del d[(1, 2)]
+print f(d, "b"), len(d)
+
+# Keys that compare equal to strs without being strs:
+d[u"u"] = "unicode"
+print f(d, "u"), f(d, u"a")
+
+class S(str):
+    def __hash__(self):
+        return str.__hash__(self)
+    def __eq__(self, rhs):
+        print "S.__eq__"
+        return str.__eq__(self, rhs)
+d = {S("x"): 1}
+print f(d, "x")
+d = {"x": 2}
+print f(d, S("x"))
+
+class D(dict):
+    def __missing__(self, k):
+        return "missing " + k
+print f(D(a=1), "a"), f(D(a=1), "b")
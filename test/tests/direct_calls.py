@@ -0,0 +1,114 @@
+# Calls to module-level functions can get compiled to direct calls to the callee's optimized version, guarded on the
+# function object.  Make sure that rebinding the name, recursion, more than three arguments, and exceptions coming out
+# of the callee all still work.
+
+try:
+    import __pyston__
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 3)
+    __pyston__.setOption("REOPT_THRESHOLD_BASELINE", 10)
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 20)
+    __pyston__.setOption("OSR_THRESHOLD_BASELINE", 50)
+    __pyston__.setOption("REOPT_THRESHOLD_T2", 20)
+    __pyston__.setOption("OSR_THRESHOLD_T2", 100)
+except ImportError:
+    pass
+
+import sys
+import traceback
+
+def fib(n):
+    if n < 2:
+        return n
+    return fib(n - 1) + fib(n - 2)
+
+for i in xrange(5):
+    print fib(15 + i)
+
+def add(a, b):
+    return a + b
+
+def add4(a, b, c, d):
+    return a + b + c + d
+
+def caller(n):
+    t = 0
+    for i in xrange(n):
+        t = add(t, i)
+        t = add4(t, i, 1, -1)
+    return t
+
+for i in xrange(20):
+    r = caller(100)
+print r
+
+# Rebinding the global has to be noticed even though the caller is already compiled:
+def add(a, b):
+    return a - b
+print caller(100)
+
+old_add = add
+add = lambda a, b: a * 0 + b
+print caller(100)
+add = old_add
+
+def fails(x):
+    if x == 17:
+        raise ValueError("bad %d" % x)
+    return x
+
+def call_fails(n):
+    t = 0
+    for i in xrange(n):
+        t += fails(i)
+    return t
+
+for i in xrange(20):
+    call_fails(10)
+try:
+    call_fails(20)
+except ValueError:
+    # Both frames should show up:
+    names = [f[2] for f in traceback.extract_tb(sys.exc_info()[2])]
+    print names[-2:], sys.exc_info()[1]
+
+def countdown(n):
+    if n == 0:
+        raise KeyError("done")
+    return countdown(n - 1)
+
+for i in xrange(20):
+    try:
+        countdown(50)
+    except KeyError:
+        pass
+try:
+    countdown(10)
+except KeyError:
+    print len(traceback.extract_tb(sys.exc_info()[2]))
+
+# The caller doesn't keep the callee alive.  Once the callee is gone, another function can end up at the same address,
+# and that one must not get mistaken for it:
+import gc
+
+def mul(a, b):
+    return a * b
+
+def call_mul(n):
+    t = 0
+    for i in xrange(n):
+        t += mul(i, 2)
+    return t
+
+for i in xrange(20):
+    r = call_mul(10)
+print r
+
+old_id = id(mul)
+del mul
+gc.collect()
+fns = [lambda a, b: a + b for i in xrange(1000)]
+mul = fns[0]
+for f in fns:
+    if id(f) == old_id:
+        mul = f
+print call_mul(10)
@@ -0,0 +1,56 @@
+# Regression test for the generational collector:
+# - create some long-lived containers and get them promoted to the old generation
+# - store freshly-allocated (young) objects into them
+# - allocate enough to trigger several minor collections
+# -- the young objects are only reachable through the old containers, so they need to be
+#    found through the remembered set rather than by tracing the old generation.
+
+import gc
+
+class C(object):
+    pass
+
+l = [None] * 100
+d = {}
+o = C()
+gc.collect()
+
+for i in xrange(100):
+    l[i] = [i] * 10
+    d[i] = str(i) * 3
+    setattr(o, "attr%d" % (i % 10), (i, i))
+
+    # allocate some data to try to force a minor collection:
+    for j in xrange(100):
+        range(100)
+
+print sum(sum(x) for x in l)
+print sorted(d.items())[:5], len(d)
+print sorted(o.__dict__.items())
+
+gc.collect()
+print sum(sum(x) for x in l)
+
+# A full collection has to trace through young objects too: here the old object is only reachable
+# through a young one.
+class Old(object):
+    def __init__(self, n):
+        self.n = n
+        self.data = range(n)
+
+x = Old(20)
+gc.collect()
+y = [x]
+del x
+gc.collect()
+for i in xrange(1000):
+    range(100)
+print y[0].n, sum(y[0].data)
+
+# And it has to be able to free young objects that have become garbage:
+import weakref
+z = C()
+r = weakref.ref(z)
+del z
+gc.collect()
+print r() is None
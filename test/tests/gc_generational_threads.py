@@ -0,0 +1,36 @@
+# run_args: -I
+# Minor collections find young objects that are only referenced from malloc'd memory by scanning the dirty pages of
+# every writable mapping.  malloc gives each thread its own arena, and grows it with mprotect instead of mapping more
+# memory; make sure that we scan the memory that it adds between minor collections.
+#
+# Suspended interpreted generators keep their locals in malloc'd memory, so keep starting generators in a thread (which
+# grows that thread's arena) while allocating enough to trigger minor collections.
+
+import threading
+
+def gen(n):
+    l = [n] * 10
+    yield
+    yield sum(l)
+
+def alloc():
+    for j in xrange(100):
+        range(100)
+
+results = []
+def worker():
+    gens = []
+    for i in xrange(2000):
+        g = gen(i)
+        g.next()
+        gens.append(g)
+        if i % 20 == 0:
+            alloc()
+    alloc()
+    results.append(sum(g.next() for g in gens))
+
+for i in xrange(2):
+    t = threading.Thread(target=worker)
+    t.start()
+    t.join()
+print results
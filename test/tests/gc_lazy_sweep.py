@@ -0,0 +1,44 @@
+# Regression test for lazy sweeping:
+# - objects that die in a collection don't get freed until allocation gets to their block, so
+#   the weakrefs to them still need to get cleared (and their callbacks called) by the collection.
+# - classes can die in the same collection as their instances, and have to stay around until all
+#   of their instances have been swept.
+
+import gc
+import weakref
+
+ncleared = [0]
+def callback(wr):
+    ncleared[0] += 1
+
+def make_garbage():
+    refs = []
+    for i in xrange(200):
+        class C(object):
+            pass
+        c = C()
+        refs.append(weakref.ref(c, callback))
+        refs.append(weakref.ref(C))
+    return refs
+
+def clear_stack():
+    # Overwrite any stale pointers that might be left on the stack:
+    for i in xrange(10):
+        [None] * 100
+
+refs = make_garbage()
+clear_stack()
+gc.collect()
+
+ndead = sum(1 for r in refs if r() is None)
+print ndead > 300
+print ncleared[0] > 150
+
+# Allocate enough to reuse the memory of the dead objects:
+l = []
+for i in xrange(100000):
+    l.append((i, str(i)))
+print len(l)
+
+gc.collect()
+print sum(1 for r in refs if r() is None) >= ndead
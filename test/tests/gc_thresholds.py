@@ -0,0 +1,47 @@
+# Tests for the gc module's control over the automatic collection policy.
+
+import gc
+
+t = gc.get_threshold()
+print len(t)
+
+gc.set_threshold(1000000, 50, 4)
+print gc.get_threshold()
+
+gc.set_threshold(2000000)
+print gc.get_threshold()
+
+try:
+    gc.set_threshold(-1)
+except ValueError as e:
+    print e
+
+def stats():
+    return [s["collections"] for s in gc.get_stats()]
+
+before = stats()
+gc.collect()
+after = stats()
+print after[1] - before[1]
+print gc.get_stats()[1]["live_bytes"] > 0
+
+# With a low threshold, allocating a lot should cause automatic collections:
+l = []
+for i in xrange(200000):
+    l.append([i])
+    if len(l) > 1000:
+        l = []
+print sum(stats()) > sum(after)
+
+# Like in CPython, a threshold0 of 0 turns off automatic collection:
+gc.set_threshold(0)
+before = stats()
+l = []
+for i in xrange(200000):
+    l.append([i])
+    if len(l) > 1000:
+        l = []
+print stats() == before
+
+gc.set_threshold(*t)
+print gc.get_threshold() == t
@@ -0,0 +1,77 @@
+# run_args: -I
+# The interpreter keeps local variables in per-frame slots; make sure the various ways of reading
+# and writing locals still see the same values.
+
+def f(a, b=2, *args, **kw):
+    c = a + b
+    print sorted(locals().items())
+    del c
+    try:
+        print c
+    except UnboundLocalError as e:
+        print e
+    try:
+        del c
+    except NameError as e:
+        print e
+    c = len(args) + len(kw)
+    return c
+print f(1)
+print f(1, 2, 3, 4, x=5)
+
+def unused_params(x, y):
+    return 0
+print unused_params(1, 2)
+
+def closures(n):
+    total = 0
+    def inner(m):
+        return n + m
+    for i in xrange(5):
+        total += inner(i)
+    n = 100
+    return total, inner(1)
+print closures(10)
+
+g = 5
+def uses_global():
+    global g
+    g = g + 1
+    x = [g for g in xrange(3)]
+    return g, x
+print uses_global(), g
+
+def maybe_defined(n):
+    for i in xrange(n):
+        if i % 2:
+            y = i
+    return y
+print maybe_defined(10)
+try:
+    maybe_defined(1)
+except UnboundLocalError as e:
+    print e
+
+def loop(n):
+    # Run long enough to OSR out of the interpreter with some locals undefined:
+    t = 0
+    for i in xrange(n):
+        if i > n / 2:
+            late = i
+        t += i
+    return t, late
+print loop(100000)
+
+def gen(n):
+    for i in xrange(n):
+        x = i * 2
+        yield x, sorted(locals())
+print list(gen(2))
+
+class C(object):
+    a = 1
+    b = a + 1
+    def m(self, q=b):
+        return q
+print C.b, C().m()
+print (lambda x, y=3: x * y)(2)
@@ -0,0 +1,150 @@
+# Lists of only ints or only floats store their elements unboxed; make sure that they behave exactly like
+# normal lists, including when they have to switch over to boxed storage.
+
+def f(n):
+    l = [0.0] * n
+    for i in xrange(n):
+        l[i] = i * 0.5
+    for i in xrange(n):
+        l[i] += 1.0
+    t = 0.0
+    for x in l:
+        t += x
+    return t, l[-1], l[0]
+
+for i in xrange(1000):
+    r = f(10)
+print r
+
+def g(l):
+    s = 0
+    for i in xrange(len(l)):
+        l[i] = l[i] * 2
+        s += l[i]
+    return s
+
+for i in xrange(1000):
+    r = g(range(10))
+print r
+
+l = range(5)
+print l, repr(l), str(l)
+l.append(10)
+l.insert(0, -1)
+l.insert(100, 1 << 40)
+print l, len(l)
+print l.pop(), l.pop(0), l
+print 3 in l, 3.0 in l, "3" in l, 100 in l
+print l.index(3), l.count(2), l.index(2, 0, 100)
+l.remove(3)
+print l
+
+# Storing other kinds of objects generalizes the list:
+l.append("hello")
+print l
+l = [1, 2, 3]
+l[1] = 2.5
+print l, type(l[0]), type(l[1])
+l = [1, 2, 3]
+l.append(True)
+print l, [type(x) for x in l]
+l = [1.0, 2.0]
+l.append(3)
+print l, [type(x) for x in l]
+l = [1, 2]
+l.insert(1, None)
+print l
+
+class MyInt(int):
+    pass
+l = [1, 2]
+l.append(MyInt(3))
+print l, [type(x).__name__ for x in l]
+
+# Emptying a list lets it pick a new strategy:
+l = ["a"]
+l.pop()
+l.append(1.5)
+l.append(2.5)
+print l
+del l[:]
+l.append(1)
+print l
+
+l = [3, 1, 2] * 3
+print l
+print l + [1.5], l + l, [] + l
+l += l
+print l
+l.extend([4.5, 5.5])
+print l
+l.extend(xrange(2))
+print l
+
+l = [5, 3, 9, 1, -2]
+l.sort()
+print l
+l.sort(reverse=True)
+print l
+l.sort(key=lambda x: -x)
+print l
+l.sort(cmp=lambda a, b: cmp(b, a))
+print l
+l = [2.5, -1.0, 3.25, 0.0, -0.0]
+l.sort()
+print l
+
+l = range(10)
+print l[2:5], l[::2], l[::-1], l[-3:]
+l[2:5] = [1.5, 2.5]
+print l
+l = range(10)
+l[2:4] = [20, 30, 40]
+print l
+l[::3] = ["a", "b", "c", "d"]
+print l
+l = range(10)
+del l[::2]
+print l
+del l[1]
+print l
+l.reverse()
+print l
+
+a, b, c = [1.5, 2.5, 3.5]
+print a, b, c
+a, b = [10, 20]
+print a, b
+print tuple([1, 2, 3]), tuple([1.5])
+print list(reversed([1, 2, 3]))
+print [1, 2] == [1, 2], [1, 2] == [1.0, 2.0], [1, 2] < [1, 3], [1.5] > [1], [1, 2] != ["a"]
+print dict([[1, 2], [3, 4]])
+print max([1, 5, 3]), min([2.5, 1.5]), sum([1, 2, 3]), sum([0.5, 0.25])
+
+try:
+    [1, 2][5] = 3
+except IndexError as e:
+    print e
+try:
+    [1.0][-2]
+except IndexError as e:
+    print e
+
+big = [2 ** 62, -2 ** 62]
+print big, [x + 1 for x in big]
+big.append(2 ** 64)
+print big
+
+# A NaN is only found by identity, so it has to come back out as the same object:
+x = float('nan')
+for l in ([x], [1.5, x], [1.5]):
+    if x not in l:
+        l.append(x)
+    print x in l, l.count(x), l.index(x), l
+    l[0] = x
+    print l[0] is x, l.count(x)
+    l.remove(x)
+    print len(l)
+l = [0.5, 1.5]
+l[1] = x
+print x in l, l
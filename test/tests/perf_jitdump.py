@@ -0,0 +1,100 @@
+# With -p we write a jitdump file, /tmp/jit-PID.dump, for "perf inject --jit" to read.  Run a child with -p and -s,
+# and check that the file is well formed and has one JIT_CODE_LOAD record for every IC slot rewrite that the child's
+# stats report.
+
+import os
+import struct
+import subprocess
+import sys
+
+try:
+    import __pyston__
+except ImportError:
+    __pyston__ = None
+
+child = """
+class A(object):
+    x = 1
+class B(object):
+    x = 2
+class C(object):
+    def __init__(self):
+        self.x = 3
+def f(o):
+    return o.x
+t = 0
+for i in xrange(10000):
+    t += f(A()) + f(B()) + f(C())
+print t
+"""
+
+JITDUMP_MAGIC = 0x4A695444
+JITDUMP_VERSION = 1
+JIT_CODE_LOAD = 0
+JIT_CODE_DEBUG_INFO = 2
+JIT_CODE_CLOSE = 3
+
+def read_stat(stats, name):
+    for l in stats.splitlines():
+        if l.startswith(name + ": "):
+            return int(l.split(": ")[1])
+    raise Exception("no %s stat" % name)
+
+# Returns the number of JIT_CODE_LOAD records for IC slots.
+def check_jitdump(fn, pid):
+    with open(fn, "rb") as f:
+        data = f.read()
+
+    magic, version, total_size, elf_mach, pad1, header_pid, timestamp, flags = struct.unpack_from("<IIIIIIQQ", data)
+    assert magic == JITDUMP_MAGIC, hex(magic)
+    assert version == JITDUMP_VERSION, version
+    assert total_size == 40, total_size
+    assert header_pid == pid, (header_pid, pid)
+
+    pos = total_size
+    num_loads = 0
+    num_ic_loads = 0
+    closed = False
+    while pos < len(data):
+        assert not closed, "record after JIT_CODE_CLOSE"
+        id, size, timestamp = struct.unpack_from("<IIQ", data, pos)
+        assert size >= 16 and pos + size <= len(data), (pos, size)
+        if id == JIT_CODE_LOAD:
+            load_pid, tid, vma, code_addr, code_size, code_index = struct.unpack_from("<IIQQQQ", data, pos + 16)
+            assert load_pid == pid, (load_pid, pid)
+            assert code_index == num_loads, (code_index, num_loads)
+            name_end = data.index("\0", pos + 56)
+            assert name_end + 1 + code_size == pos + size, (pos, size, code_size)
+            if " IC slot " in data[pos + 56:name_end]:
+                num_ic_loads += 1
+            num_loads += 1
+        elif id == JIT_CODE_CLOSE:
+            closed = True
+        else:
+            assert id == JIT_CODE_DEBUG_INFO, id
+        pos += size
+
+    assert pos == len(data)
+    assert closed, "no JIT_CODE_CLOSE record"
+    return num_ic_loads
+
+if __pyston__:
+    p = subprocess.Popen([sys.executable, "-s", "-p", "-c", child], stdout=subprocess.PIPE, stderr=subprocess.PIPE)
+    out, err = p.communicate()
+    assert p.returncode == 0, err
+    print out.strip()
+
+    try:
+        num_ic_loads = check_jitdump("/tmp/jit-%d.dump" % p.pid, p.pid)
+    finally:
+        for fn in ("/tmp/jit-%d.dump" % p.pid, "/tmp/perf-%d.map" % p.pid):
+            if os.path.exists(fn):
+                os.remove(fn)
+
+    num_ic_slots_written = read_stat(err, "ic_slots_written")
+    assert num_ic_slots_written > 0
+    assert num_ic_loads == num_ic_slots_written, (num_ic_loads, num_ic_slots_written)
+    print "one record per IC rewrite:", True
+else:
+    exec child
+    print "one record per IC rewrite:", True
@@ -0,0 +1,84 @@
+# Sites that keep switching between a few classes (ex an attribute that's sometimes an int and sometimes a float) get
+# compiled to dispatch on those classes.  Make sure that every combination, and the classes that the profile didn't
+# cover, still give the right answers.
+
+try:
+    import __pyston__
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 3)
+    __pyston__.setOption("REOPT_THRESHOLD_BASELINE", 10)
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 20)
+    __pyston__.setOption("OSR_THRESHOLD_BASELINE", 50)
+    __pyston__.setOption("SPECULATION_THRESHOLD", 5)
+except ImportError:
+    pass
+
+class C(object):
+    def __init__(self, x, y):
+        self.x = x
+        self.y = y
+
+def arith(c):
+    return c.x + c.y, c.x * 2, 3 - c.y, c.x / c.y
+
+def aug(c):
+    t = 1
+    t += c.x
+    t *= c.y
+    return t
+
+objs = [C(i, i + 1) if i % 2 else C(i + 0.5, float(i + 1)) for i in xrange(200)]
+total = [0, 0, 0, 0, 0]
+for o in objs:
+    r = arith(o)
+    for i in xrange(4):
+        total[i] += r[i]
+    total[4] += aug(o)
+print total
+
+# Classes that the profile didn't see go down the generic path:
+print arith(C(10L, 3L))
+print arith(C(True, 2))
+print aug(C(2L, 3L))
+print arith(C(5, 2.0))
+try:
+    arith(C(1, 0))
+except ZeroDivisionError as e:
+    print "caught", e
+try:
+    arith(C(1.0, 0.0))
+except ZeroDivisionError as e:
+    print "caught", e
+try:
+    arith(C(None, 1))
+except TypeError as e:
+    print "caught", e
+
+class Holder(object):
+    def __init__(self, items):
+        self.items = items
+
+def first_two(h):
+    return h.items[0] + h.items[1]
+
+holders = [Holder([i, i * 2] if i % 2 else (i * 0.5, i)) for i in xrange(200)]
+print sum(first_two(h) for h in holders)
+print first_two(Holder("ab"))
+print first_two(Holder({0: 1, 1: 2}))
+try:
+    first_two(Holder([1]))
+except IndexError as e:
+    print "caught", e
+
+def compare(c):
+    return c.x < c.y, c.x == c.y, c.x >= 3, c.y != c.x, c.x > c.y, c.y <= 2.5
+
+counts = [0] * 6
+for o in objs + [C(i, i) for i in xrange(50)] + [C(i * 0.5, i) for i in xrange(50)]:
+    r = compare(o)
+    for i in xrange(6):
+        counts[i] += r[i]
+print counts
+print compare(C(10L, 3L))
+print compare(C(float('nan'), 1))
+print compare(C(3, 3.0))
+print compare(C("a", "b"))
@@ -0,0 +1,63 @@
+# The sampling profiler can be started and stopped from Python, and reports what it saw as folded stacks, which
+# aren't deterministic; just check that they look right.
+
+try:
+    import __pyston__
+except ImportError:
+    __pyston__ = None
+
+def spin(n):
+    t = 0
+    for i in xrange(n):
+        t += i % 7
+    return t
+
+def outer():
+    return spin(200000)
+
+def check_profile(profile):
+    found = False
+    for line in profile.splitlines():
+        stack, count = line.rsplit(" ", 1)
+        assert int(count) > 0, line
+        frames = stack.split(";")
+        for f in frames:
+            assert f.endswith("]") and " (" in f, f
+        if len(frames) >= 2 and frames[-2].startswith("outer (") and frames[-1].startswith("spin ("):
+            found = True
+    return found
+
+found = False
+for attempt in xrange(50):
+    if __pyston__:
+        __pyston__.startProfiler(100)
+    r = outer()
+    if __pyston__:
+        profile = __pyston__.stopProfiler()
+        if check_profile(profile):
+            found = True
+            break
+    else:
+        found = True
+        break
+print r, found
+
+if __pyston__:
+    try:
+        __pyston__.stopProfiler()
+    except RuntimeError as e:
+        print e
+    __pyston__.startProfiler()
+    try:
+        __pyston__.startProfiler(10)
+    except RuntimeError as e:
+        print e
+    __pyston__.stopProfiler()
+    try:
+        __pyston__.startProfiler(0)
+    except ValueError as e:
+        print e
+else:
+    print "the profiler isn't running"
+    print "the profiler is already running"
+    print "interval must be a positive number of microseconds"
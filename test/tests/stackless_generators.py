@@ -0,0 +1,190 @@
+# Generators don't get a stack of their own, and instead return out of the interpreter at each yield.  Make sure that
+# they behave the same as ones that do, including when they get hot enough to OSR in the middle of running (see also
+# stackless_generators_compiled.py).
+
+try:
+    import __pyston__
+    __pyston__.setOption("TEMPLATE_JIT_THRESHOLD_BACKEDGES", 10)
+    __pyston__.setOption("TEMPLATE_JIT_THRESHOLD_CALLS", 5)
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 50)
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 20)
+except ImportError:
+    pass
+
+import gc
+import sys
+import traceback
+
+def counter(n):
+    for i in xrange(n):
+        yield i
+
+print list(counter(5))
+print sum(counter(1000))
+print [sum(counter(i)) for i in xrange(30)]
+
+def echo():
+    r = []
+    x = yield "start"
+    while x is not None:
+        r.append(x)
+        x = yield x * 2
+    yield r
+
+g = echo()
+print g.next()
+print g.send(1), g.send(2), g.send("a")
+print g.send(None)
+try:
+    g.next()
+except StopIteration:
+    print "done"
+
+def catcher():
+    n = 0
+    while True:
+        try:
+            x = yield n
+        except ValueError as e:
+            print "caught", e
+            n += 100
+        except KeyError:
+            print "finishing"
+            return
+        else:
+            n += x
+
+g = catcher()
+print g.next()
+print g.send(1), g.send(2)
+print g.throw(ValueError, "bad")
+print g.send(3)
+try:
+    g.throw(KeyError)
+except StopIteration:
+    print "stopped"
+
+# Throwing into a generator that hasn't started doesn't run it:
+def not_started():
+    print "shouldn't get here"
+    yield 1
+g = not_started()
+try:
+    g.throw(ZeroDivisionError, "early")
+except ZeroDivisionError as e:
+    print "raised", e
+print list(g)
+
+def raiser(n):
+    for i in xrange(n):
+        yield i
+    raise ValueError("from generator")
+
+def consume():
+    for x in raiser(3):
+        pass
+
+try:
+    consume()
+except ValueError:
+    t, v, tb = sys.exc_info()
+    print [(f[2], f[3]) for f in traceback.extract_tb(tb)]
+
+def reraiser():
+    try:
+        yield 1
+    finally:
+        print "cleanup"
+
+g = reraiser()
+g.next()
+try:
+    g.throw(TypeError("thrown in"))
+except TypeError as e:
+    print "propagated", e
+
+# Lots of arguments, a closure, and yields in the middle of expressions:
+def many_args(a, b, c, d, e, *args, **kw):
+    def inner(x):
+        return x + a
+    yield inner(b) + (yield c) + d
+    yield (e, args, sorted(kw.items()))
+
+g = many_args(1, 2, 3, 4, 5, 6, 7, k=8)
+print g.next()
+print g.send(10)
+print g.next()
+
+print list(x * 2 for x in xrange(10) if x % 3)
+print dict((k, v) for k, v in zip("abc", counter(3)))
+
+def nested(n):
+    for i in xrange(n):
+        for j in counter(i):
+            yield (i, j)
+print list(nested(4))
+
+# Long enough to get into the template JIT, and then OSR part way through:
+def long_running(n):
+    t = 0
+    for i in xrange(n):
+        t += i
+        x = yield t
+        if x:
+            t = x
+g = long_running(1000)
+l = []
+for i in xrange(1000):
+    l.append(g.send(None) if i == 0 else g.send(i if i % 100 == 0 else None))
+print l[-5:], len(l)
+try:
+    g.next()
+except StopIteration:
+    print "long_running finished"
+
+def osr_then_throw():
+    i = 0
+    while True:
+        try:
+            yield i
+        except IndexError:
+            print "caught after", i
+        i += 1
+g = osr_then_throw()
+for i in xrange(200):
+    g.next()
+print g.throw(IndexError)
+print g.next()
+
+# Plenty of generators suspended at the same time, which shouldn't need a stack each:
+gens = [counter(10) for i in xrange(5000)]
+for g in gens:
+    g.next()
+gc.collect()
+print sum(g.next() for g in gens)
+print sum(sum(g) for g in gens)
+
+# The suspended frames keep their locals alive:
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+def holder(n):
+    objs = [C(i) for i in xrange(n)]
+    yield len(objs)
+    yield sum(o.n for o in objs)
+
+gens = [holder(i) for i in xrange(100)]
+for g in gens:
+    g.next()
+gc.collect()
+print sum(g.next() for g in gens)
+
+# Called enough times that the generator function gets compiled:
+def hot(n):
+    yield n
+    yield n + 1
+t = 0
+for i in xrange(100):
+    t += sum(hot(i))
+print t
@@ -0,0 +1,146 @@
+# statcheck: '-I' in EXTRA_JIT_ARGS or stats.get('num_stackless_compiled_yields', 0) > 0
+# statcheck: stats.get('generator_stack_created', 0) == 0
+# Generators whose code gets compiled by the LLVM tiers stay stackless too: compiled code hands its frame over to the
+# interpreter when it yields, and the interpreter gets back into compiled code at the next backedge.  The thresholds
+# are low so that all of that happens, including deopts and OSRs from compiled code.
+
+try:
+    import __pyston__
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 5)
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 2)
+    __pyston__.setOption("OSR_THRESHOLD_BASELINE", 10)
+    __pyston__.setOption("REOPT_THRESHOLD_BASELINE", 5)
+    __pyston__.setOption("SPECULATION_THRESHOLD", 5)
+except ImportError:
+    pass
+
+import sys
+
+def counter(n):
+    for i in xrange(n):
+        yield i
+
+print [sum(counter(i)) for i in xrange(40)]
+
+# One long-running generator, which OSRs and then goes back and forth:
+print sum(counter(5000))
+g = counter(1000)
+print [g.next() for i in xrange(10)], sum(g)
+
+# Unboxed ints and floats live across the yields:
+def numbers(n):
+    x = 0
+    f = 0.5
+    for i in xrange(n):
+        x += i
+        f *= 1.5
+        yield x, int(f)
+for i in xrange(20):
+    r = list(numbers(30))
+print r[-1], len(r)
+
+# Names that are only sometimes defined when we yield:
+def maybe(n):
+    for i in xrange(n):
+        if i % 3 == 1:
+            y = i
+        try:
+            yield y
+        except NameError:
+            yield "undefined"
+        else:
+            del y
+for i in xrange(10):
+    r = [v for v in maybe(30)]
+print r
+
+def maybe_unbound(n):
+    for i in xrange(n):
+        if i % 2:
+            z = i
+        yield i
+    yield z
+for i in xrange(10):
+    try:
+        print list(maybe_unbound(i))
+    except NameError as e:
+        print type(e).__name__
+
+# send() and throw() into compiled generators, with a try block around the yield:
+def accumulator():
+    total = 0
+    while True:
+        try:
+            x = yield total
+        except ValueError as e:
+            total = -total
+            continue
+        except KeyError:
+            return
+        total += x
+
+for i in xrange(10):
+    g = accumulator()
+    g.next()
+    l = [g.send(j) for j in xrange(20)]
+    l.append(g.throw(ValueError, "negate"))
+    l.append(g.send(1))
+    try:
+        g.throw(KeyError)
+    except StopIteration:
+        l.append("stopped")
+print l
+
+# Closures, both ones that the generator gets and ones that it creates:
+def make_gen(base):
+    def gen(n):
+        fs = []
+        for i in xrange(n):
+            fs.append(lambda: i + base)
+            yield fs[-1]() + len(fs)
+        yield [f() for f in fs]
+    return gen
+
+for i in xrange(10):
+    r = list(make_gen(100)(20))
+print r
+
+# Yielding from inside of an exception handler:
+def handler(n):
+    for i in xrange(n):
+        try:
+            raise IndexError(i)
+        except IndexError:
+            t, v = sys.exc_info()[:2]
+            yield t.__name__
+            yield v.args
+for i in xrange(10):
+    r = list(handler(10))
+print r[:4], r[-1]
+
+# Speculated on the types that it saw at first, and then deoptimized:
+def adder(a, b, n):
+    for i in xrange(n):
+        yield a + b
+        a = b
+for i in xrange(30):
+    r = list(adder(i, 2, 20))
+print r[-3:]
+print list(adder("a", "b", 20))[-3:]
+print list(adder(1.5, 2, 20))[-3:]
+g = adder([1], [2], 50)
+print g.next(), g.next(), len(list(g))
+
+# Generators that are started but never finished, or never yield at all:
+def never_yields(n):
+    if n >= 0:
+        return
+    yield n
+gens = []
+empty = 0
+for i in xrange(100):
+    gens.append(counter(50))
+    gens[-1].next()
+    gens[-1].next()
+    empty += list(never_yields(i)) == []
+print empty, sum(g.next() for g in gens)
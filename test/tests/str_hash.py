@@ -0,0 +1,25 @@
+# str hashes get cached on the string; make sure equal strings still hash the same no matter how they
+# were created, and that unicode objects keep hashing like the equal strs.
+
+words = ["", "a", "ab", "abc", "abcd", "abcdefg", "abcdefgh", "abcdefghi", "hello world, this is a longer string"]
+
+for w in words:
+    built = "".join(list(w))
+    sliced = ("x" + w + "y")[1:-1]
+    print repr(w), hash(w) == hash(built) == hash(sliced), hash(w) == hash(w), hash(w) == hash(unicode(w))
+
+print hash("abc") != hash("abd"), hash("abcdefgh1") != hash("abcdefgh2")
+
+# Strings that come back from C code that builds them in place:
+print hash("%s-%d" % ("x", 5)) == hash("x-5")
+print hash("a\tb".expandtabs()) == hash("a       b")
+
+d = {}
+for i in xrange(1000):
+    d["key_%d" % i] = i
+print sum(d["key_%d" % i] for i in xrange(1000))
+print d[u"key_17"], u"key_999" in d, "key_1000" in d
+
+class S(str):
+    pass
+print hash(S("abc")) == hash("abc"), d[S("key_5")]
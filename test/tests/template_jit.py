@@ -0,0 +1,92 @@
+# Hot interpreted functions get their blocks compiled by the template JIT; run a mix of code through it, including
+# the parts that it hands back to the interpreter, and make sure the results and tracebacks stay the same.
+# The LLVM tiers are pushed out of the way so that everything here stays in the interpreter and template JIT, except
+# for the last loop which is long enough to OSR out of the template JIT code.
+
+try:
+    import __pyston__
+    __pyston__.setOption("REOPT_THRESHOLD_INTERPRETER", 1000000)
+    __pyston__.setOption("OSR_THRESHOLD_INTERPRETER", 50000)
+    __pyston__.setOption("TEMPLATE_JIT_THRESHOLD_CALLS", 2)
+    __pyston__.setOption("TEMPLATE_JIT_THRESHOLD_BACKEDGES", 5)
+except ImportError:
+    pass
+
+import sys
+
+class C(object):
+    def __init__(self, n):
+        self.n = n
+
+    def m(self, a, b, c, d, e):
+        return self.n + a + b + c + d + e
+
+G = 7
+
+def f(n):
+    "docstring"
+    c = C(n)
+    l = [0] * 10
+    d = {}
+    t = 0
+    for i in xrange(n):
+        t += i * G
+        c.n = c.n + 1
+        l[i % 10] = l[i % 10] + i
+        d[i % 3] = i
+        if i % 2:
+            t -= 1
+        elif i > 5 and i < 10:
+            t += c.m(1, 2, 3, 4, 5)
+        else:
+            pass
+        a, b = i, -i
+        t += a + b
+    return t, c.n, l, sorted(d.items()), 7 / 2, abs(-t), "s", None
+
+for i in xrange(5):
+    print f(20 + i)
+
+def unbound(x):
+    if x:
+        y = 1
+    return y
+
+for i in xrange(5):
+    try:
+        print unbound(i % 2)
+    except UnboundLocalError as e:
+        print e
+
+def raises(n):
+    for i in xrange(n):
+        if i == 15:
+            raise ValueError(i)
+    return n
+
+def catches(n):
+    try:
+        return raises(n)
+    except ValueError as e:
+        tb = sys.exc_info()[2]
+        while tb.tb_next:
+            tb = tb.tb_next
+        return "caught", e, tb.tb_frame.f_code.co_name, tb.tb_lineno - tb.tb_frame.f_code.co_firstlineno
+
+for i in (10, 20, 10, 20):
+    print catches(i)
+
+def gen(n):
+    for i in xrange(n):
+        if i % 3 == 0:
+            yield i, G
+
+for i in xrange(4):
+    print list(gen(10 + i))
+
+def long_loop():
+    t = 0
+    for i in xrange(100000):
+        t = t + i % 7
+    return t
+print long_loop()
@@ -0,0 +1,41 @@
+# Threads that never block should still all get to run, and a thread that only wants the GIL
+# occasionally shouldn't get starved by them.
+
+from thread import start_new_thread
+import sys
+import time
+
+print sys.getcheckinterval()
+for n in (2 ** 40, -2 ** 40):
+    try:
+        sys.setcheckinterval(n)
+    except OverflowError as e:
+        print e
+print sys.getcheckinterval()
+sys.setcheckinterval(50)
+print sys.getcheckinterval()
+
+nthreads = 3
+counts = [0] * nthreads
+stop = []
+done = []
+
+def spin(idx):
+    while not stop:
+        counts[idx] += 1
+    done.append(idx)
+
+for i in xrange(nthreads):
+    start_new_thread(spin, (i,))
+
+# Each of these sleeps has to reacquire the GIL from the spinning threads; if the handoff starved
+# this thread, the test would hang here rather than fail:
+for i in xrange(20):
+    time.sleep(0.01)
+stop.append(True)
+
+while len(done) < nthreads:
+    time.sleep(0.01)
+
+print all(c > 0 for c in counts)
+sys.setcheckinterval(100)
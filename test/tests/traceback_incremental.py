@@ -0,0 +1,100 @@
+# Tracebacks only contain the frames that the exception propagated through, from the frame that caught it down to the
+# frame that raised it, no matter how deep the stack is or which tier the frames are running in.
+
+import sys
+import traceback
+
+def names(tb):
+    return [name for (fn, lineno, name, text) in traceback.extract_tb(tb)]
+
+def thrower(n):
+    if n:
+        return thrower(n - 1)
+    raise KeyError(n)
+
+def catcher(depth):
+    try:
+        thrower(depth)
+    except KeyError:
+        return names(sys.exc_info()[2])
+
+def recurse(n, f, *args):
+    if n:
+        return recurse(n - 1, f, *args)
+    return f(*args)
+
+# Run these enough times that they get compiled:
+for i in xrange(1000):
+    r1 = recurse(50, catcher, 0)
+    r2 = recurse(5, catcher, 3)
+print r1
+print r2
+
+def reraiser():
+    global inner
+    try:
+        thrower(1)
+    except KeyError:
+        # Looking at the traceback here shouldn't stop it from growing once we reraise:
+        inner = names(sys.exc_info()[2])
+        raise
+
+def outer():
+    reraiser()
+
+for i in xrange(500):
+    try:
+        recurse(20, outer)
+    except KeyError:
+        r = names(sys.exc_info()[2])
+print inner
+print r
+
+def gen():
+    yield 1
+    thrower(2)
+
+def consume():
+    return list(gen())
+
+try:
+    recurse(3, consume)
+except KeyError:
+    print names(sys.exc_info()[2])
+
+# Raising a saved traceback again continues it without changing it:
+def save():
+    try:
+        thrower(1)
+    except KeyError:
+        return sys.exc_info()
+
+def reraise_saved(t, v, tb):
+    raise t, v, tb
+
+for i in xrange(500):
+    saved = save()
+    before = names(saved[2])
+    try:
+        reraise_saved(*saved)
+    except KeyError:
+        r = names(sys.exc_info()[2])
+print before, names(saved[2])
+print r
+
+# A bare raise doesn't add the frame that it's in, even when that's not the frame that caught the exception:
+def bare_raise():
+    raise
+
+def handler():
+    try:
+        thrower(0)
+    except KeyError:
+        bare_raise()
+
+for i in xrange(500):
+    try:
+        handler()
+    except KeyError:
+        r = names(sys.exc_info()[2])
+print r
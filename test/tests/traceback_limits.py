@@ -1,6 +1,5 @@
-# expected: fail
-# - we don't stop tracebacks at the catching except handler.  this is hard do the way it gets added to
-# (ie a bare "raise" statement will add more traceback entries to the traceback it raises)
+# Tracebacks stop at the except handler that caught the exception, and a bare "raise" adds the frames that the
+# exception propagates through after that.
 
 import sys
 import traceback
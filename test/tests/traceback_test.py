@@ -2,12 +2,8 @@
 #
 # (We keep fixing tracebacks in one case to break them in another, so it's time for a test.)
 #
-# All of these tests involve except handlers at the top scope, since we currently generate extra-long
-# tracebacks when an exception gets caught inside a function.
-# - In CPython the traceback goes from the point of the exception to the point of the handler
-# - In Pyston the traceback always goes to the top-most frame
-#
-# See traceback_limits.py
+# Most of these tests involve except handlers at the top scope; see traceback_limits.py and
+# traceback_incremental.py for exceptions that get caught inside of functions.
 
 import sys
 import traceback
@@ -0,0 +1,79 @@
+# Lookups on types are cached globally; make sure the cache gets invalidated when
+# a class, or any of its bases, changes.
+
+class A(object):
+    x = 1
+    def f(self):
+        return "A.f"
+
+class B(A):
+    pass
+
+class C(B):
+    pass
+
+c = C()
+print c.x, c.f(), C.x
+
+A.x = 2
+print c.x, C.x
+B.x = 3
+print c.x, C.x, A.x
+del B.x
+print c.x, C.x
+
+A.f = lambda self: "new A.f"
+print c.f()
+C.f = lambda self: "C.f"
+print c.f()
+del C.f
+print c.f()
+
+# Negative results get cached too:
+print hasattr(c, "y"), hasattr(C, "y")
+A.y = 5
+print hasattr(c, "y"), c.y
+del A.y
+print hasattr(c, "y")
+
+# Changing the bases:
+class D(object):
+    x = "D"
+    def f(self):
+        return "D.f"
+B.__bases__ = (D,)
+print c.x, c.f(), C.__mro__[1:]
+B.__bases__ = (A,)
+print c.x, c.f()
+
+# Special methods go through the same lookups:
+class N(object):
+    def __len__(self):
+        return 1
+n = N()
+print len(n)
+N.__len__ = lambda self: 2
+print len(n)
+
+# A megamorphic site, followed by changes to the classes it saw:
+classes = []
+for i in xrange(200):
+    classes.append(type("K%d" % i, (A,), {"v": i}))
+
+def get(o):
+    return o.v + o.x
+
+def run():
+    t = 0
+    for k in classes:
+        t += get(k())
+    return t
+
+print run()
+A.x = 10
+print run()
+for k in classes[::2]:
+    k.v = 0
+print run()
+classes[1].x = 1000
+print run()
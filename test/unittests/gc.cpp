@@ -113,3 +113,33 @@ TEST(alloc, freeingLarge) {
     }
 }
 
+
+void testMarking(int B) {
+    void* p = gc_alloc(B, GCKind::UNTRACKED);
+    GCAllocation* al = GCAllocation::fromUserData(p);
+    memset(p, 0x5a, B);
+
+    uint64_t header;
+    memcpy(&header, al, sizeof(header));
+
+    ASSERT_FALSE(isMarked(al));
+    ASSERT_TRUE(trySetMarkAtomic(al));
+    ASSERT_TRUE(isMarked(al));
+    ASSERT_FALSE(trySetMarkAtomic(al));
+
+    // The mark bits live off to the side, so marking shouldn't have written to the object:
+    ASSERT_EQ(0, memcmp(&header, al, sizeof(header)));
+    for (int i = 0; i < B; i++) {
+        ASSERT_EQ(0x5a, ((unsigned char*)p)[i]);
+    }
+
+    clearMark(al);
+    ASSERT_FALSE(isMarked(al));
+    gc_free(p);
+}
+
+TEST(mark, sidebits16) { testMarking(16); }
+TEST(mark, sidebits48) { testMarking(48); }
+TEST(mark, sidebits1024) { testMarking(1024); }
+TEST(mark, sidebits8192) { testMarking(8192); }
+TEST(mark, sidebitshuge) { testMarking(4 << 20); }